@@ -79,6 +79,35 @@ class pre_build(build_ext):
 
         build_ext.run(self)
 
+#Optional libraries are used when their headers are found
+def has_header(header):
+    cc = os.environ.get("CC", "cc")
+    with open(os.devnull, "w") as null:
+        try:
+            return subprocess.call(
+                [cc, "-E", "-include", header, "-x", "c++", os.devnull],
+                stdout=null, stderr=null) == 0
+        except OSError:
+            return False
+
+LIBRARIES = ["bwa", "z", "dl", "m"]
+MACROS = [("PYBIND", None)]
+
+#Pore model k-mer length, see KLEN in the Makefile
+MACROS.append(("KMER_LEN", os.environ.get("KLEN", "5")))
+
+#(header, library, macro) for built-in VBZ decoding, BLOW5, and POD5 input
+OPTIONAL_LIBS = [
+    ("zstd.h",              "zstd",        "HAVE_ZSTD"),
+    ("slow5/slow5.h",       "slow5",       "HAVE_SLOW5LIB"),
+    ("pod5_format/c_api.h", "pod5_format", "HAVE_POD5")
+]
+
+for header, lib, macro in OPTIONAL_LIBS:
+    if has_header(header):
+        LIBRARIES.append(lib)
+        MACROS.append((macro, None))
+
 uncalled = Extension(
     "_uncalled",
 
@@ -90,8 +119,14 @@ uncalled = Extension(
        "src/mapper.cpp",
        "src/self_align_ref.cpp",
        "src/map_pool.cpp",
+       "src/map_pool_ord.cpp",
        "src/event_detector.cpp", 
        "src/read_buffer.cpp",
+       "src/paf_writer.cpp",
+       "src/read_checkpoint.cpp",
+       "src/read_tracer.cpp",
+       "src/read_file.cpp",
+       "src/vbz.cpp",
        "src/chunk.cpp",
        "src/realtime_pool.cpp",
        "src/seed_tracker.cpp", 
@@ -116,11 +151,11 @@ uncalled = Extension(
         "./submods/hdf5/lib/libhdf5.a"
     ],                                
 
-    libraries = ["bwa", "z", "dl", "m"],
+    libraries = LIBRARIES,
 
-    extra_compile_args = ["-std=c++11", "-O3"],
+    extra_compile_args = ["-std=c++11", "-O3", "-fno-math-errno"],
 
-    define_macros = [("PYBIND", None)]
+    define_macros = MACROS
 )
 
 setup(
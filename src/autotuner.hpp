@@ -0,0 +1,150 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_AUTOTUNER
+#define _INCL_AUTOTUNER
+
+#include <iostream>
+#include <algorithm>
+#include "util.hpp"
+#include "toplevel_prms.hpp"
+
+//Feedback controller for RealtimePool's throughput settings, see 
+//RealtimeParams::tune_latency. Each interval the pool reports how late 
+//reads were decided and how loaded its threads were. When threads are 
+//saturated and decisions are late, fewer reads are admitted, and each 
+//gets larger batches of events capped by a shorter per-event timeout, so 
+//reads need fewer turns. Reads whose chunks stall are also given up on 
+//sooner. When threads have time to spare, waiting reads are admitted, 
+//and once decisions are early the batches and timeouts relax back
+class Autotuner {
+    public:
+
+    typedef struct {
+        u32 max_active;
+        u16 evt_batch_size;
+        float evt_timeout;
+        float chunk_timeout;
+    } Settings;
+
+    typedef struct {
+        u32 decided;       //reads decided in the interval
+        float latency;     //90th percentile read start to decision, ms
+        float utilization; //fraction of thread time spent mapping
+        u32 active;        //reads being mapped
+        u32 waiting;       //reads waiting for max_active
+        u32 backlogged;    //active reads with chunks waiting to be mapped
+    } Sample;
+
+    //Moving toward the target by a tenth at a time avoids oscillating 
+    //between the under- and over-loaded cases within a few intervals
+    static constexpr float STEP = 0.1, 
+                           EARLY_FRAC = 0.7,
+                           SATURATED_UTIL = 0.9,
+                           BACKLOG_FRAC = 0.25;
+
+    Autotuner(const RealtimeParams &prms) : PRMS(prms) {}
+
+    bool is_enabled() const {
+        return PRMS.tune_latency > 0;
+    }
+
+    float interval() const {
+        return PRMS.tune_interval;
+    }
+
+    //Settings moved within bounds, changes are logged
+    Settings clamp(const Settings &s) const {
+        Settings ret = bound(s);
+        log(NULL, s, ret);
+        return ret;
+    }
+
+    //Returns the settings for the next interval
+    Settings step(const Sample &m, const Settings &s) const {
+        Settings ret = s;
+
+        bool saturated = m.utilization >= SATURATED_UTIL || 
+                         m.backlogged > BACKLOG_FRAC * m.active,
+             late = m.decided > 0 && m.latency > PRMS.tune_latency,
+             early = m.decided > 0 && m.latency < EARLY_FRAC * PRMS.tune_latency;
+
+        //Shed from the reads actually active, the limit may be far above
+        if (saturated && late) {
+            u32 active = std::min(s.max_active, m.active);
+            ret.max_active = active - (u32) (active * STEP);
+            ret.evt_batch_size = s.evt_batch_size + 1;
+            ret.evt_timeout = s.evt_timeout * (1 - STEP);
+            ret.chunk_timeout = s.chunk_timeout * (1 - STEP);
+
+        } else if (!saturated && m.waiting > 0) {
+            ret.max_active = s.max_active + std::max<u32>((u32) (s.max_active * STEP), 1);
+
+        } else if (early) {
+            if (s.evt_batch_size > PRMS.tune_batch_min) ret.evt_batch_size--;
+            ret.evt_timeout = s.evt_timeout * (1 + STEP);
+            ret.chunk_timeout = s.chunk_timeout * (1 + STEP);
+        }
+
+        ret = bound(ret);
+        log(&m, s, ret);
+        return ret;
+    }
+
+    private:
+    const RealtimeParams PRMS;
+
+    Settings bound(const Settings &s) const {
+        Settings ret = {
+            std::min(std::max(s.max_active, PRMS.tune_active_min), PRMS.tune_active_max),
+            std::min(std::max(s.evt_batch_size, PRMS.tune_batch_min), PRMS.tune_batch_max),
+            std::min(std::max(s.evt_timeout, PRMS.tune_timeout_min), PRMS.tune_timeout_max),
+            std::min(std::max(s.chunk_timeout, PRMS.tune_chunk_timeout_min), 
+                     PRMS.tune_chunk_timeout_max)
+        };
+        return ret;
+    }
+
+    static void log(const Sample *m, const Settings &prev, const Settings &next) {
+        if (prev.max_active == next.max_active && 
+            prev.evt_batch_size == next.evt_batch_size &&
+            prev.evt_timeout == next.evt_timeout &&
+            prev.chunk_timeout == next.chunk_timeout) return;
+
+        std::cerr << "Autotune:";
+        if (m != NULL) {
+            std::cerr << " p90 decision " << m->latency << " ms over " 
+                      << m->decided << " reads, " 
+                      << (u32) (m->utilization * 100) << "% busy, " 
+                      << m->backlogged << "/" << m->active << " backlogged, "
+                      << m->waiting << " waiting;";
+        }
+        std::cerr << " max_active_reads " << prev.max_active << "->" << next.max_active
+                  << ", evt_batch_size " << prev.evt_batch_size << "->" << next.evt_batch_size
+                  << ", evt_timeout " << prev.evt_timeout << "->" << next.evt_timeout 
+                  << ", chunk_timeout " << prev.chunk_timeout << "->" << next.chunk_timeout 
+                  << "\n";
+    }
+};
+
+#endif
@@ -28,6 +28,7 @@
 #include <vector>
 #include <cstdint>
 #include <cmath>
+#include <type_traits>
 
 #define BASE_COUNT 4
 
@@ -56,18 +57,22 @@ const char BASE_COMP_C[]
 const u8 BASE_COMP_B[] {3, 2, 1, 0};
 
 
-enum KmerLen {k2=2, k3=3, k4=4, k5=5};
+enum KmerLen {k2=2, k3=3, k4=4, k5=5, k6=6, k7=7, k8=8, k9=9};
+
+//K-mer IDs pack two bits per base, so k > 8 needs 32 bits
+template <KmerLen k>
+using KmerId = typename std::conditional<(k <= 8), u16, u32>::type;
 
 #define KMASK(k) ( (1 << (2*k)) - 1 )
 
 template <KmerLen k>
-inline u16 kmer_count() {
-    return (u16) pow((u16)BASE_COUNT, (u16)k);
+inline u32 kmer_count() {
+    return (u32) 1 << (2 * (u8) k);
 }
 
 template <KmerLen k>
-u16 str_to_kmer(std::string kmer, u64 offset=0) {
-    u16 index = BASE_BYTES[(u8) kmer[offset]];
+KmerId<k> str_to_kmer(std::string kmer, u64 offset=0) {
+    KmerId<k> index = BASE_BYTES[(u8) kmer[offset]];
     for (u8 i = 1; i < (u8) k; i++) {
         index = (index << 2) | BASE_BYTES[(u8) kmer[offset+i]];
     }
@@ -75,22 +80,26 @@ u16 str_to_kmer(std::string kmer, u64 offset=0) {
 }
 
 template <KmerLen k>
-u16 kmer_comp(u16 kmer) {
+KmerId<k> kmer_comp(KmerId<k> kmer) {
     return kmer ^ KMASK((u8) k);
 }
 
 template <KmerLen k>
-u16 kmer_revcomp(u16 kmer) {
-    u16 r = ~kmer;
-    r = ( (r >> 2 & 0x3333) | (r & 0x3333) << 2 );
-    r = ( (r >> 4 & 0x0F0F) | (r & 0x0F0F) << 4 );
-    r = ( (r >> 8 & 0x00FF) | (r & 0x00FF) << 8 );
-    return r >> (2 * (8 - k));
+KmerId<k> kmer_revcomp(KmerId<k> kmer) {
+    u32 r = ~kmer;
+    r = ( (r >> 2 & 0x33333333) | (r & 0x33333333) << 2 );
+    r = ( (r >> 4 & 0x0F0F0F0F) | (r & 0x0F0F0F0F) << 4 );
+    r = ( (r >> 8 & 0x00FF00FF) | (r & 0x00FF00FF) << 8 );
+    if (sizeof(KmerId<k>) == sizeof(u16)) {
+        return (r & 0xFFFF) >> (2 * (8 - k));
+    }
+    r = (r >> 16) | (r << 16);
+    return r >> (2 * (16 - k));
 }
 
 template <KmerLen KLEN>
-std::vector<u16> kmers_revcomp(const std::vector<u16> &kmers) {
-    std::vector<u16> rev;
+std::vector< KmerId<KLEN> > kmers_revcomp(const std::vector< KmerId<KLEN> > &kmers) {
+    std::vector< KmerId<KLEN> > rev;
     rev.reserve(kmers.size());
     for (auto k = kmers.rbegin(); k != kmers.rend(); k++) {
         rev.push_back(kmer_revcomp<KLEN>(*k));
@@ -99,22 +108,22 @@ std::vector<u16> kmers_revcomp(const std::vector<u16> &kmers) {
 }
 
 template <KmerLen k>
-u8 kmer_head(u16 kmer) {
+u8 kmer_head(KmerId<k> kmer) {
     return (u8) ((kmer >> (2*( (u8)k ) - 2)) & 0x3);
 }
 
 template <KmerLen k>
-u16 kmer_neighbor(u16 kmer, u8 i) {
+KmerId<k> kmer_neighbor(KmerId<k> kmer, u8 i) {
     return ((kmer << 2) & KMASK(k)) | i; 
 }
 
 template <KmerLen k>
-u8 kmer_base(u16 kmer, u8 i) {
+u8 kmer_base(KmerId<k> kmer, u8 i) {
     return (u8) ((kmer >> (2 * ((u16)k-i-1))) & 0x3);
 }
 
 template <KmerLen k>
-std::string kmer_to_str(u16 kmer) {
+std::string kmer_to_str(KmerId<k> kmer) {
     std::string s(k, 'N');
     for (u8 i = 0; i < k; i++) {
         s[i] = BASE_CHARS[kmer_base<k>(kmer, i)];
@@ -123,14 +132,14 @@ std::string kmer_to_str(u16 kmer) {
 }
 
 template <KmerLen KLEN>
-std::vector<u16> seq_to_kmers(u8 *seq, u64 st, u64 en) {
-    std::vector<u16> ret;
+std::vector< KmerId<KLEN> > seq_to_kmers(u8 *seq, u64 st, u64 en) {
+    std::vector< KmerId<KLEN> > ret;
 
     u64 pst = st >> 2,
         pen = ((en) >> 2)+1;
 
     u64 i = 0;
-    u16 kmer = 0;
+    KmerId<KLEN> kmer = 0;
     u8 bst = (st&3), ben;
 
     for (u64 j = pst; j < pen; j++) {
@@ -27,6 +27,8 @@
 #include <string>
 #include <climits>
 #include <utility>
+#include <unordered_map>
+#include <algorithm>
 #include <cstring>
 #include <bwa/bwa.h>
 #include <bwa/utils.h>
@@ -34,6 +36,12 @@
 #include "util.hpp"
 #include "bp.hpp"
 #include "range.hpp"
+#include "occ_table.hpp"
+#include "mapped_file.hpp"
+#include "sampled_sa.hpp"
+#include "kmer_ext_table.hpp"
+#include "repeat_mask.hpp"
+#include "sa_cache.hpp"
 
 #ifdef PYBIND
 #include <pybind11/pybind11.h>
@@ -48,12 +56,12 @@ class SubSeq {
         en_(en),
         size_(en_-st_-KLEN) {}
 
-    u16 operator[](u64 i) {
+    KmerId<KLEN> operator[](u64 i) {
         i += st_;
         u64 pst = i >> 2;
         u32 comb = *((u32 *) &pacseq_[pst]);
         u8 shift = i & 3;
-        return (u16) ( (comb >> ((16-KLEN)<<1)) & KMASK(KLEN) );
+        return (KmerId<KLEN>) ( (comb >> ((16-KLEN)<<1)) & KMASK(KLEN) );
     }
 
     u64 size() {
@@ -85,6 +93,9 @@ class SubSeq {
 //From submods/bwa/bwtindex.c
 #define BWA_BLOCK_SIZE 10000000
 
+//Target panel manifest written by uncalled/index.py build_panel
+#define PANEL_SUFF ".upnl"
+
 template <KmerLen KLEN>
 class BwaIndex {
     public:
@@ -98,6 +109,69 @@ class BwaIndex {
                       prefix.c_str(), 
                       BWTALGO_AUTO,
                       BWA_BLOCK_SIZE);
+
+        create_occ_table(prefix_auto);
+    }
+
+    //Builds the optional SampledSA with the specified interval
+    //Reuses the BWA suffix array if it has the same interval
+    static void create_sampled_sa(const std::string &prefix, u32 intv) {
+        if (!SampledSA::valid_intv(intv)) {
+            std::cerr << "Error: SA interval must be a power of two\n";
+            return;
+        }
+
+        std::string bwt_fname = prefix + ".bwt",
+                    sa_fname = prefix + ".sa";
+        bwt_t *bwt = bwt_restore_bwt(bwt_fname.c_str());
+
+        bwt_restore_sa(sa_fname.c_str(), bwt);
+        if (bwt->sa_intv != intv) {
+            bwt_cal_sa(bwt, intv);
+        }
+
+        SampledSA ssa;
+        if (ssa.build(bwt)) ssa.save(prefix + SAMPLED_SA_SUFF);
+
+        bwt_destroy(bwt);
+    }
+
+    //Builds the optional KmerExtTable for sequences up to max_len bases
+    static void create_kmer_ext_table(const std::string &prefix, u8 max_len) {
+        std::string bwt_fname = prefix + ".bwt";
+        bwt_t *bwt = bwt_restore_bwt(bwt_fname.c_str());
+
+        KmerExtTable ext;
+        if (ext.build(bwt, KLEN, max_len)) ext.save(prefix + KMER_EXT_SUFF);
+
+        bwt_destroy(bwt);
+    }
+
+    //Builds the optional RepeatMask of sequences mask_len bases long 
+    //found at least min_copies times, using threads threads
+    static void create_repeat_mask(const std::string &prefix, u32 mask_len, 
+                                   u32 min_copies, u32 threads) {
+        std::string bwt_fname = prefix + ".bwt";
+        bwt_t *bwt = bwt_restore_bwt(bwt_fname.c_str());
+
+        RepeatMask mask;
+        if (mask.build(bwt, mask_len, min_copies, threads)) {
+            mask.save(prefix + REPEAT_MASK_SUFF);
+        }
+
+        bwt_destroy(bwt);
+    }
+
+    //Builds the optional OccTable used for neighbor lookups
+    static void create_occ_table(const std::string &prefix) {
+        std::string bwt_fname = prefix + ".bwt";
+        bwt_t *bwt = bwt_restore_bwt(bwt_fname.c_str());
+
+        OccTable occ;
+        occ.build(bwt);
+        occ.save(prefix + OCC_TABLE_SUFF);
+
+        bwt_destroy(bwt);
     }
 
     BwaIndex() :
@@ -106,22 +180,73 @@ class BwaIndex {
         pacseq_(NULL),
         klen_(KLEN),
         kmer_ranges_(kmer_count<KLEN>()),
+        mmap_(false),
+        mmap_populate_(false),
+        mmap_hugepages_(false),
         loaded_(false) {}
 
-    BwaIndex(const std::string &prefix, bool pacseq=false) : BwaIndex() {
-        if (!prefix.empty()) load_index(prefix);
+    BwaIndex(const std::string &prefix, bool pacseq=false, bool use_mmap=false) : BwaIndex() {
+        if (!prefix.empty()) load_index(prefix, use_mmap);
         if (pacseq) load_pacseq();
     }
 
-    void load_index(const std::string &prefix) {
+    //If use_mmap is set the .bwt, .sa, .pac, and occurrence table files
+    //are mapped instead of copied, so processes share them in page cache
+    void load_index(const std::string &prefix, 
+                    bool use_mmap = false, 
+                    bool populate = false, 
+                    bool hugepages = false) {
+
         std::string bwt_fname = prefix + ".bwt",
                     sa_fname = prefix + ".sa";
 
-        index_ = bwt_restore_bwt(bwt_fname.c_str());
-        bwt_restore_sa(sa_fname.c_str(), index_);
+        prefix_ = prefix;
+        mmap_ = use_mmap;
+        mmap_populate_ = populate;
+        mmap_hugepages_ = hugepages;
+
+        //The BWA suffix array is only loaded if there's no sampled SA
+        std::string ssa_fname = prefix + SAMPLED_SA_SUFF;
+
+        if (mmap_) {
+            if (!map_bwt(bwt_fname)) {
+                destroy();
+                return;
+            }
+            if (!ssa_.map(ssa_fname, index_, populate, hugepages) && !map_sa(sa_fname)) {
+                destroy();
+                return;
+            }
+        } else {
+            index_ = bwt_restore_bwt(bwt_fname.c_str());
+            if (!ssa_.load(ssa_fname, index_)) {
+                bwt_restore_sa(sa_fname.c_str(), index_);
+            }
+        }
+
         bns_ = bns_restore(prefix.c_str());
 
-        for (u16 k = 0; k < kmer_ranges_.size(); k++) {
+        if (mmap_) {
+            occ_.map(prefix + OCC_TABLE_SUFF, index_, populate, hugepages);
+        } else {
+            occ_.load(prefix + OCC_TABLE_SUFF, index_);
+        }
+
+        if (mmap_) {
+            kmer_ext_.map(prefix + KMER_EXT_SUFF, index_, KLEN, populate, hugepages);
+        } else {
+            kmer_ext_.load(prefix + KMER_EXT_SUFF, index_, KLEN);
+        }
+
+        if (mmap_) {
+            rmask_.map(prefix + REPEAT_MASK_SUFF, index_, populate, hugepages);
+        } else {
+            rmask_.load(prefix + REPEAT_MASK_SUFF, index_);
+        }
+
+        load_panel(prefix + PANEL_SUFF);
+
+        for (u32 k = 0; k < kmer_ranges_.size(); k++) {
 
             Range r = get_base_range(kmer_head<KLEN>(k));
             for (u8 i = 1; i < KLEN; i++) {
@@ -139,33 +264,128 @@ class BwaIndex {
     }
 
     void load_pacseq() {
-        if (!pacseq_loaded()) {
-            //Copied from bwa/bwase.c
-            pacseq_ = (u8*) calloc(bns_->l_pac/4+1, 1);
-            err_fread_noeof(pacseq_, 1, bns_->l_pac/4+1, bns_->fp_pac);
-        }   
+        if (pacseq_loaded()) return;
+
+        if (mmap_) {
+            std::string pac_fname = prefix_ + ".pac";
+            if (pac_file_.open(pac_fname, false, mmap_populate_, mmap_hugepages_) &&
+                pac_file_.size() >= (u64) bns_->l_pac/4+1) {
+                pacseq_ = pac_file_.data();
+                return;
+            }
+            pac_file_.close();
+            std::cerr << "Warning: failed to map \"" << pac_fname << "\", reading instead\n";
+        }
+
+        //Copied from bwa/bwase.c
+        pacseq_ = (u8*) calloc(bns_->l_pac/4+1, 1);
+        err_fread_noeof(pacseq_, 1, bns_->l_pac/4+1, bns_->fp_pac);
     }
 
     void destroy() {
-        if (index_ != NULL) { 
+        if (bwt_file_.is_open()) {
+            //bwt and sa point into the mappings
+            free(index_);
+            bwt_file_.close();
+            sa_file_.close();
+        } else if (index_ != NULL) { 
             bwt_destroy(index_);
         }
+        index_ = NULL;
+
         if (bns_ != NULL) { 
             bns_destroy(bns_);
+            bns_ = NULL;
+        }
+
+        if (pac_file_.is_open()) {
+            pac_file_.close();
+        } else if (pacseq_ != NULL) {
+            free(pacseq_);
         }
+        pacseq_ = NULL;
+
+        occ_.destroy();
+        ssa_.destroy();
+        kmer_ext_.destroy();
+        rmask_.destroy();
+        panel_.clear();
+        loaded_ = false;
     }
 
     Range get_neighbor(Range r1, u8 base) const {
         u64 os, oe;
-        bwt_2occ(index_, r1.start_ - 1, r1.end_, base, &os, &oe);
+        if (occ_.is_loaded()) {
+            os = occ_.occ(r1.start_ - 1, base);
+            oe = occ_.occ(r1.end_, base);
+        } else {
+            bwt_2occ(index_, r1.start_ - 1, r1.end_, base, &os, &oe);
+        }
         return Range(index_->L2[base] + os + 1, index_->L2[base] + oe);
     }
 
-    Range get_kmer_range(u16 kmer) const {
+    //Computes get_neighbor(r1, b) for all four bases in one lookup
+    void get_neighbors(Range r1, Range out[BASE_COUNT]) const {
+        u64 os[4], oe[4];
+        if (occ_.is_loaded()) {
+            occ_.occ4(r1.start_ - 1, os);
+            occ_.occ4(r1.end_, oe);
+        } else {
+            bwt_2occ4(index_, r1.start_ - 1, r1.end_, os, oe);
+        }
+        for (u8 b = 0; b < BASE_COUNT; b++) {
+            out[b] = Range(index_->L2[b] + os[b] + 1, index_->L2[b] + oe[b]);
+        }
+    }
+
+    //Prefetches the occurrence rows read by get_neighbors(r1)
+    inline void prefetch_neighbors(Range r1) const {
+        if (occ_.is_loaded()) {
+            occ_.prefetch(r1.start_ - 1);
+            occ_.prefetch(r1.end_);
+        } else {
+            __builtin_prefetch(bwt_occ_intv(index_, r1.start_ - 1));
+            __builtin_prefetch(bwt_occ_intv(index_, r1.end_));
+        }
+    }
+
+    //Longest sequence get_extensions can be used for, KLEN if no table
+    u8 kmer_ext_len() const {
+        return kmer_ext_.is_loaded() ? kmer_ext_.max_len() : KLEN;
+    }
+
+    //Same as get_neighbors for the full range of seq, a len-base sequence
+    //packed like a k-mer, from the k-mer extension table
+    void get_extensions(u32 seq, u8 len, Range out[BASE_COUNT]) const {
+        kmer_ext_.get_extensions(seq, len, out);
+    }
+
+    bool occ_table_loaded() const {
+        return occ_.is_loaded();
+    }
+
+    bool sampled_sa_loaded() const {
+        return ssa_.is_loaded();
+    }
+
+    bool repeat_mask_loaded() const {
+        return rmask_.is_loaded();
+    }
+
+    //Sequence length and copies masked, 0 if there's no mask
+    u32 repeat_mask_len() const {
+        return rmask_.is_loaded() ? rmask_.mask_len() : 0;
+    }
+
+    u32 repeat_mask_copies() const {
+        return rmask_.is_loaded() ? rmask_.min_copies() : 0;
+    }
+
+    Range get_kmer_range(KmerId<KLEN> kmer) const {
         return kmer_ranges_[kmer];
     }
 
-    u64 get_kmer_count(u16 kmer) const {
+    u64 get_kmer_count(KmerId<KLEN> kmer) const {
         return kmer_ranges_[kmer].length();
     }
 
@@ -173,8 +393,84 @@ class BwaIndex {
         return Range(index_->L2[base], index_->L2[base+1]);
     }
 
+    //Same result as bwt_sa, using the sampled SA and occurrence table if loaded
     u64 sa(u64 i) const {
-        return bwt_sa(index_, i);
+        u64 steps = 0;
+        while (!sa_sampled(i)) {
+            i = lf(i);
+            steps++;
+        }
+        return steps + sa_value(i);
+    }
+
+    //Computes sa(i) for every row of r, stored in out[0..r.length()-1]
+    //Rows are walked in lockstep batches so their memory accesses overlap
+    void sa_range(Range r, u64 *out) const {
+        u64 rows[SA_BATCH];
+
+        for (u64 st = r.start_; st <= r.end_; st += SA_BATCH) {
+            u32 n = r.end_ - st + 1 < SA_BATCH ? r.end_ - st + 1 : SA_BATCH;
+            for (u32 i = 0; i < n; i++) rows[i] = st + i;
+            sa_batch(rows, n, out + (st - r.start_));
+        }
+    }
+
+    //Like sa_range, but skips rows in the repeat mask
+    //Returns the number of values stored in out
+    u64 sa_range_unmasked(Range r, u64 *out) const {
+        if (!rmask_.is_loaded()) {
+            sa_range(r, out);
+            return r.length();
+        }
+
+        u64 rows[SA_BATCH];
+        u32 n = 0;
+        u64 count = 0;
+
+        for (u64 i = r.start_; i <= r.end_; i++) {
+            if (rmask_.is_masked(i)) continue;
+            rows[n++] = i;
+            if (n == SA_BATCH) {
+                sa_batch(rows, n, out + count);
+                count += n;
+                n = 0;
+            }
+        }
+
+        if (n > 0) sa_batch(rows, n, out + count);
+        return count + n;
+    }
+
+    //Like sa_range, taking values from cache where it can and adding the
+    //rest to it. Skips rows in the repeat mask if unmasked is set
+    //Returns the number of values stored in out, hits counts cached ones
+    u64 sa_range_cached(Range r, u64 *out, SaCache &cache, 
+                        bool unmasked, u64 &hits) const {
+        u64 rows[SA_BATCH], orig[SA_BATCH], pos[SA_BATCH];
+        u32 n = 0;
+        u64 count = 0;
+        unmasked = unmasked && rmask_.is_loaded();
+
+        for (u64 i = r.start_; i <= r.end_; i++) {
+            if (unmasked && rmask_.is_masked(i)) continue;
+
+            if (cache.get(i, out[count])) {
+                hits++;
+                count++;
+                continue;
+            }
+
+            rows[n] = orig[n] = i;
+            pos[n++] = count++;
+
+            if (n == SA_BATCH) {
+                sa_batch_cached(rows, orig, pos, n, out, cache);
+                n = 0;
+            }
+        }
+
+        if (n > 0) sa_batch_cached(rows, orig, pos, n, out, cache);
+        return count;
     }
 
     u64 size() const {
@@ -210,15 +506,35 @@ class BwaIndex {
         return 0;
     }
 
+    //Panel indices report locations on the reference they were cut from
     u64 translate_loc(u64 sa_loc, std::string &ref_name, u64 &ref_loc) const {
         i32 rid = bns_pos2rid(bns_, sa_loc);
         if (rid < 0) return 0;
 
-        ref_name = std::string(bns_->anns[rid].name);
         ref_loc = sa_loc - bns_->anns[rid].offset;
+
+        if (!panel_.empty()) {
+            const PanelContig &c = panel_[rid];
+            ref_name = c.src_name;
+            ref_loc += c.src_start;
+            return c.src_len;
+        }
+
+        ref_name = std::string(bns_->anns[rid].name);
         return bns_->anns[rid].len;
     }
 
+    bool is_panel() const {
+        return !panel_.empty();
+    }
+
+    //True if sa_loc is in a panel decoy sequence
+    bool is_decoy(u64 sa_loc) const {
+        if (panel_.empty()) return false;
+        i32 rid = bns_pos2rid(bns_, sa_loc);
+        return rid >= 0 && panel_[rid].decoy;
+    }
+
     std::vector< std::pair<std::string, u64> > get_seqs() const {
         std::vector< std::pair<std::string, u64> > seqs;
 
@@ -231,6 +547,14 @@ class BwaIndex {
         return seqs;
     }
 
+    std::unordered_map<std::string, u64> get_ref_offsets() const {
+        std::unordered_map<std::string, u64> offsets;
+        for (i32 i = 0; i < bns_->n_seqs; i++) {
+            offsets[std::string(bns_->anns[i].name)] = bns_->anns[i].offset;
+        }
+        return offsets;
+    }
+
     u64 coord_to_pacseq(std::string name, u64 coord) {
         i32 i;
         for (i = 0; i < bns_->n_seqs; i++) {
@@ -244,13 +568,13 @@ class BwaIndex {
         return pacseq_ != NULL;
     }
 
-    std::vector<u16> get_kmers(std::string nm, u64 st, u64 en) {
+    std::vector< KmerId<KLEN> > get_kmers(std::string nm, u64 st, u64 en) {
         u64 sti = coord_to_pacseq(nm, st),
             eni = coord_to_pacseq(nm, en);
         return get_kmers(sti, eni);
     }
 
-    std::vector<u16> get_kmers(u64 st, u64 en) {
+    std::vector< KmerId<KLEN> > get_kmers(u64 st, u64 en) {
         return seq_to_kmers<KLEN>(pacseq_, st, en);
     }
 
@@ -338,9 +662,26 @@ class BwaIndex {
 
     static void pybind_defs(pybind11::class_<BwaIndex<KLEN>> &c) {
         c.def(pybind11::init<>());
-        c.def(pybind11::init<const std::string &, bool>());
+        c.def(pybind11::init<const std::string &, bool, bool>(),
+              pybind11::arg("prefix"),
+              pybind11::arg("pacseq") = false,
+              pybind11::arg("use_mmap") = false);
         PY_BWA_INDEX_METH(create);
-        PY_BWA_INDEX_METH(load_index);
+        PY_BWA_INDEX_METH(create_occ_table);
+        PY_BWA_INDEX_METH(create_sampled_sa);
+        PY_BWA_INDEX_METH(create_kmer_ext_table);
+        PY_BWA_INDEX_METH(create_repeat_mask);
+        PY_BWA_INDEX_METH(kmer_ext_len);
+        PY_BWA_INDEX_METH(occ_table_loaded);
+        PY_BWA_INDEX_METH(sampled_sa_loaded);
+        PY_BWA_INDEX_METH(repeat_mask_loaded);
+        PY_BWA_INDEX_METH(repeat_mask_len);
+        PY_BWA_INDEX_METH(repeat_mask_copies);
+        c.def("load_index", &BwaIndex<KLEN>::load_index,
+              pybind11::arg("prefix"),
+              pybind11::arg("use_mmap") = false,
+              pybind11::arg("populate") = false,
+              pybind11::arg("hugepages") = false);
         PY_BWA_INDEX_METH(is_loaded);
         PY_BWA_INDEX_METH(load_pacseq);
         PY_BWA_INDEX_METH(destroy);
@@ -351,6 +692,8 @@ class BwaIndex {
         PY_BWA_INDEX_METH(sa);
         PY_BWA_INDEX_METH(size);
         PY_BWA_INDEX_METH(translate_loc);
+        PY_BWA_INDEX_METH(is_panel);
+        PY_BWA_INDEX_METH(is_decoy);
         PY_BWA_INDEX_METH(get_seqs);
         PY_BWA_INDEX_METH(coord_to_pacseq);
         PY_BWA_INDEX_METH(pacseq_loaded);
@@ -361,18 +704,185 @@ class BwaIndex {
         PY_BWA_INDEX_METH(get_ref_name);
         PY_BWA_INDEX_METH(get_ref_len);
         PY_BWA_INDEX_METH(range_to_fms);
-        c.def("get_kmers", static_cast< std::vector<u16> (BwaIndex::*)(u64, u64)> (&BwaIndex::get_kmers) );
-        c.def("get_kmers", static_cast< std::vector<u16> (BwaIndex::*)(std::string, u64, u64)> (&BwaIndex::get_kmers) );
+        c.def("get_kmers", static_cast< std::vector< KmerId<KLEN> > (BwaIndex::*)(u64, u64)> (&BwaIndex::get_kmers) );
+        c.def("get_kmers", static_cast< std::vector< KmerId<KLEN> > (BwaIndex::*)(std::string, u64, u64)> (&BwaIndex::get_kmers) );
     }
 
     #endif
 
     private:
+
+    static const u32 SA_BATCH = 64;
+
+    //Computes sa() of n <= SA_BATCH rows in lockstep, overwriting rows
+    void sa_batch(u64 *rows, u32 n, u64 *out) const {
+        u32 active[SA_BATCH];
+        for (u32 i = 0; i < n; i++) active[i] = i;
+
+        for (u64 steps = 0; n > 0; steps++) {
+            u32 j = 0;
+            for (u32 a = 0; a < n; a++) {
+                u32 i = active[a];
+                if (sa_sampled(rows[i])) {
+                    out[i] = steps + sa_value(rows[i]);
+                } else {
+                    active[j++] = i;
+                }
+            }
+            n = j;
+
+            for (u32 a = 0; a < n; a++) {
+                rows[active[a]] = lf(rows[active[a]]);
+            }
+
+            for (u32 a = 0; a < n; a++) {
+                prefetch_row(rows[active[a]]);
+            }
+        }
+    }
+
+    //sa_batch, storing the i'th value in out[pos[i]] and in cache
+    void sa_batch_cached(u64 *rows, const u64 *orig, const u64 *pos, u32 n, 
+                         u64 *out, SaCache &cache) const {
+        u64 vals[SA_BATCH];
+        sa_batch(rows, n, vals);
+        for (u32 i = 0; i < n; i++) {
+            out[pos[i]] = vals[i];
+            cache.put(orig[i], vals[i]);
+        }
+    }
+
+    inline u64 lf(u64 k) const {
+        if (occ_.is_loaded()) return occ_.lf(k, index_->L2);
+        return bwt_invPsi(index_, k);
+    }
+
+    inline bool sa_sampled(u64 k) const {
+        if (ssa_.is_loaded()) return ssa_.is_sampled(k);
+        return (k & (index_->sa_intv - 1)) == 0;
+    }
+
+    inline u64 sa_value(u64 k) const {
+        if (ssa_.is_loaded()) return ssa_.get(k);
+        return index_->sa[k / index_->sa_intv];
+    }
+
+    //Prefetches whatever the next step of an SA lookup reads for row k
+    inline void prefetch_row(u64 k) const {
+        if (sa_sampled(k)) {
+            if (ssa_.is_loaded()) ssa_.prefetch(k);
+            else __builtin_prefetch(&index_->sa[k / index_->sa_intv]);
+        } else if (occ_.is_loaded()) {
+            occ_.prefetch(k);
+        } else {
+            __builtin_prefetch(bwt_occ_intv(index_, k));
+        }
+    }
+
+    //Equivalent to bwt_restore_bwt, but bwt->bwt points into the mapping
+    bool map_bwt(const std::string &fname) {
+        if (!bwt_file_.open(fname, false, mmap_populate_, mmap_hugepages_)) {
+            std::cerr << "Error: failed to map \"" << fname << "\"\n";
+            return false;
+        }
+
+        const u64 *header = reinterpret_cast<const u64 *>(bwt_file_.data());
+
+        index_ = (bwt_t *) calloc(1, sizeof(bwt_t));
+        index_->primary = header[0];
+        memcpy(index_->L2+1, header+1, 4 * sizeof(bwtint_t));
+        index_->seq_len = index_->L2[4];
+        index_->bwt_size = (bwt_file_.size() - 5 * sizeof(bwtint_t)) >> 2;
+        index_->bwt = (u32 *) (header + 5);
+        bwt_gen_cnt_table(index_);
+
+        return true;
+    }
+
+    //Equivalent to bwt_restore_sa. The mapping is copy-on-write so only 
+    //the page holding sa[0] is copied when it is set to -1
+    bool map_sa(const std::string &fname) {
+        if (!sa_file_.open(fname, true, mmap_populate_, mmap_hugepages_)) {
+            std::cerr << "Error: failed to map \"" << fname << "\"\n";
+            return false;
+        }
+
+        u64 *header = reinterpret_cast<u64 *>(sa_file_.data());
+        if (header[0] != index_->primary || header[6] != index_->seq_len) {
+            std::cerr << "Error: SA-BWT inconsistency in \"" << fname << "\"\n";
+            return false;
+        }
+
+        index_->sa_intv = header[5];
+        index_->n_sa = (index_->seq_len + index_->sa_intv) / index_->sa_intv;
+        if (sa_file_.size() < (index_->n_sa + 6) * sizeof(bwtint_t)) {
+            std::cerr << "Error: \"" << fname << "\" is truncated\n";
+            return false;
+        }
+
+        //sa[1] is the first value after the 7-word header
+        index_->sa = header + 6;
+        index_->sa[0] = -1;
+
+        return true;
+    }
+
+    //Loads the panel manifest if there is one. Each line has the contig 
+    //name, source reference name, source length, start, and decoy flag
+    bool load_panel(const std::string &fname) {
+        std::ifstream in(fname);
+        if (!in.is_open()) return false;
+
+        std::unordered_map<std::string, i32> rids;
+        for (i32 i = 0; i < bns_->n_seqs; i++) {
+            rids[std::string(bns_->anns[i].name)] = i;
+        }
+
+        panel_.assign(bns_->n_seqs, PanelContig());
+        std::vector<bool> found(bns_->n_seqs, false);
+
+        std::string name;
+        PanelContig c;
+        u32 decoy;
+        while (in >> name >> c.src_name >> c.src_len >> c.src_start >> decoy) {
+            c.decoy = decoy != 0;
+            auto r = rids.find(name);
+            if (r == rids.end()) continue;
+            panel_[r->second] = c;
+            found[r->second] = true;
+        }
+
+        if (std::find(found.begin(), found.end(), false) != found.end()) {
+            std::cerr << "Warning: ignoring panel manifest \"" << fname 
+                      << "\", it does not match the index\n";
+            panel_.clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    struct PanelContig {
+        std::string src_name;
+        u64 src_len, src_start;
+        bool decoy;
+    };
+
     bwt_t *index_;
     bntseq_t *bns_;
     u8 *pacseq_;
     KmerLen klen_;
     std::vector<Range> kmer_ranges_;
+    OccTable occ_;
+    SampledSA ssa_;
+    KmerExtTable kmer_ext_;
+    RepeatMask rmask_;
+    std::vector<PanelContig> panel_;
+
+    std::string prefix_;
+    bool mmap_, mmap_populate_, mmap_hugepages_;
+    MappedFile bwt_file_, sa_file_, pac_file_;
+
     bool loaded_;
 };
 
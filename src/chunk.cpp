@@ -10,7 +10,9 @@ Chunk::Chunk()
       channel_idx_(0),
       number_(0),
       start_time_(0),
-      raw_data_() {}
+      raw_data_(),
+      int_data_(NULL),
+      int_len_(0) {}
 
 
 Chunk::Chunk(const std::string &id, u16 channel, u32 number, u64 chunk_start, 
@@ -18,7 +20,9 @@ Chunk::Chunk(const std::string &id, u16 channel, u32 number, u64 chunk_start,
     : id_(id),
       channel_idx_(channel-1),
       number_(number),
-      start_time_(chunk_start) {
+      start_time_(chunk_start),
+      int_data_(NULL),
+      int_len_(0) {
 
     //TODO: could store chunk data as C arrays to prevent extra copy
     //probably not worth it
@@ -55,12 +59,25 @@ Chunk::Chunk(const std::string &id, u16 channel, u32 number, u64 start_time,
     : id_(id),
       channel_idx_(channel-1),
       number_(number),
-      start_time_(start_time) {
+      start_time_(start_time),
+      int_data_(NULL),
+      int_len_(0) {
     if (raw_st + raw_len > raw_data.size()) raw_len = raw_data.size() - raw_st;
     raw_data_.resize(raw_len);
     for (u32 i = 0; i < raw_len; i++) raw_data_[i] = raw_data[raw_st+i];
     
 }
+
+Chunk::Chunk(const std::string &id, u16 channel, u32 number, u64 start_time, 
+             const i16 *raw_data, u32 raw_len, std::shared_ptr<const void> owner)
+    : id_(id),
+      channel_idx_(channel-1),
+      number_(number),
+      start_time_(start_time),
+      int_data_(raw_data),
+      int_len_(raw_len),
+      int_owner_(owner) {}
+
 //Chunk::Chunk(const Chunk &c) 
 //    : id_(c.id_),
 //      channel_idx_(c.channel_idx_),
@@ -73,20 +90,39 @@ float &Chunk::operator[] (u32 i) {
 }
 
 u32 Chunk::size() const {
-    return raw_data_.size();
+    return int_data_ != NULL ? int_len_ : raw_data_.size();
 }
 
 bool Chunk::empty() const {
-    return raw_data_.empty();
+    return size() == 0;
 }
 
 void Chunk::print() const {
-    for (float s : raw_data_) std::cout << s << std::endl;
+    if (int_data_ != NULL) {
+        for (u32 i = 0; i < int_len_; i++) std::cout << int_data_[i] << std::endl;
+    } else {
+        for (float s : raw_data_) std::cout << s << std::endl;
+    }
 }
 
+//Moves samples into raw_data
+//External int16 samples are converted in one pass, which the compiler
+//vectorizes. Their owner is kept until clear() so it isn't released
+//on the consumer's thread
 bool Chunk::pop(std::vector<float> &raw_data) {
-    raw_data_.swap(raw_data);
-    clear();
+    if (int_data_ != NULL) {
+        raw_data.resize(int_len_);
+        float *out = raw_data.data();
+        const i16 *in = int_data_;
+        for (u32 i = 0; i < int_len_; i++) out[i] = in[i];
+
+        int_data_ = NULL;
+        int_len_ = 0;
+        raw_data_.clear();
+    } else {
+        raw_data_.swap(raw_data);
+        raw_data_.clear();
+    }
     return !raw_data.empty();
 }
 
@@ -95,7 +131,7 @@ u64 Chunk::get_start() const {
 }
 
 u64 Chunk::get_end() const {
-    return start_time_ + raw_data_.size();
+    return start_time_ + size();
 }
 
 std::string Chunk::get_id() const {
@@ -124,12 +160,22 @@ void Chunk::swap(Chunk &c) {
     std::swap(number_, c.number_);
     std::swap(start_time_, c.start_time_);
     raw_data_.swap(c.raw_data_);
+    std::swap(int_data_, c.int_data_);
+    std::swap(int_len_, c.int_len_);
+    int_owner_.swap(c.int_owner_);
 }
 
 void Chunk::clear() {
     raw_data_.clear();
+    int_data_ = NULL;
+    int_len_ = 0;
+    int_owner_.reset();
 }   
 
+void Chunk::reserve(u32 n) {
+    raw_data_.reserve(n);
+}
+
 bool operator< (const Chunk &r1, const Chunk &r2) {
     return r1.start_time_ < r2.start_time_;
 }
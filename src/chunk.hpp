@@ -2,10 +2,12 @@
 #define _INCL_CHUNK
 
 #include <vector>
+#include <memory>
 #include "util.hpp"
 
 #ifdef PYBIND
 #include "pybind11/pybind11.h"
+#include "pybind11/numpy.h"
 #endif
 
 class Chunk {
@@ -20,9 +22,15 @@ class Chunk {
     Chunk(const std::string &id, u16 channel, u32 number, u64 start_time, 
           const std::vector<float> &raw_data, u32 raw_st, u32 raw_len);
 
+    //Wraps int16 samples without copying. owner keeps them alive until
+    //clear(), samples are converted to float when the chunk is popped
+    Chunk(const std::string &id, u16 channel, u32 number, u64 start_time, 
+          const i16 *raw_data, u32 raw_len, std::shared_ptr<const void> owner);
+
     bool pop(std::vector<float> &raw_data);
     void swap(Chunk &c);
     void clear();
+    void reserve(u32 n);
 
     float &operator[] (u32);
 
@@ -40,6 +48,17 @@ class Chunk {
 
     #ifdef PYBIND
 
+    //Owner for samples wrapped from a python object. Chunks can be 
+    //cleared by pool calls that released the GIL, so it's taken back
+    //to release the reference
+    static std::shared_ptr<const void> py_owner(pybind11::object o) {
+        auto *ref = new pybind11::object(o);
+        return std::shared_ptr<const void>(ref, [](const void *p) {
+            pybind11::gil_scoped_acquire gil;
+            delete (pybind11::object *) p;
+        });
+    }
+
     #define PY_CHUNK_METH(P) c.def(#P, &Chunk::P);
     #define PY_CHUNK_PROP(P) c.def_property(#P, &Chunk::get_##P, &Chunk::set_##P);
     #define PY_CHUNK_RPROP(P) c.def_property_readonly(#P, &Chunk::get_##P);
@@ -57,6 +76,14 @@ class Chunk {
             const std::vector<float> &, //raw_data, 
             u32, u32 //raw_st, raw_len
         >());
+
+        //Holds a reference to the array instead of copying it
+        c.def(pybind11::init([](const std::string &id, 
+                                u16 channel, u32 number, u64 start,
+                                pybind11::array_t<i16, pybind11::array::c_style> raw) {
+            return new Chunk(id, channel, number, start, 
+                             raw.data(), raw.size(), py_owner(raw));
+        }));
         PY_CHUNK_METH(pop);
         PY_CHUNK_METH(swap);
         PY_CHUNK_METH(empty);
@@ -79,6 +106,11 @@ class Chunk {
     u32 number_;
     u64 start_time_;
     std::vector<float> raw_data_;
+
+    //External int16 samples, used instead of raw_data_ if not NULL
+    const i16 *int_data_;
+    u32 int_len_;
+    std::shared_ptr<const void> int_owner_;
     //std::vector<u32> chunk_classifications;
     //float median_before, median;
 
@@ -0,0 +1,107 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_CHUNK_QUEUE
+#define _INCL_CHUNK_QUEUE
+
+#include <vector>
+#include <atomic>
+#include "util.hpp"
+#include "chunk.hpp"
+
+//Lock-free single-producer/single-consumer ring of chunks
+//Chunks are swapped in and out of the slots, so sample buffers are
+//recycled between the producer, the queue, and the consumer's ReadBuffer
+class ChunkQueue {
+    public:
+
+    static const u32 DEF_CAPACITY = 4;
+
+    //capacity is rounded up to a power of two
+    ChunkQueue(u32 capacity = DEF_CAPACITY, u32 chunk_len = 0) 
+        : head_(0), tail_(0) {
+
+        u32 n = 1;
+        while (n < capacity) n <<= 1;
+        mask_ = n - 1;
+
+        slots_.resize(n);
+        for (Chunk &c : slots_) c.reserve(chunk_len);
+    }
+
+    //Producer: swaps c into the queue, c is left with a recycled buffer
+    //Returns false if the queue is full
+    bool push(Chunk &c) {
+        u32 tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) return false;
+
+        Chunk &slot = slots_[tail & mask_];
+        slot.clear();
+        slot.swap(c);
+
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Consumer: returns the oldest chunk, or NULL if empty
+    Chunk *front() {
+        u32 head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return NULL;
+        return &slots_[head & mask_];
+    }
+
+    //Consumer: releases the front slot back to the producer
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, 
+                    std::memory_order_release);
+    }
+
+    //Consumer
+    void clear() {
+        while (front() != NULL) pop();
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == 
+               tail_.load(std::memory_order_acquire);
+    }
+
+    u32 size() const {
+        return tail_.load(std::memory_order_acquire) - 
+               head_.load(std::memory_order_acquire);
+    }
+
+    u32 capacity() const {
+        return mask_ + 1;
+    }
+
+    private:
+    std::vector<Chunk> slots_;
+    u32 mask_;
+
+    //Free-running indices, written only by the consumer and producer
+    std::atomic<u32> head_, tail_;
+};
+
+#endif
@@ -28,7 +28,8 @@ ClientSim::ClientSim(Conf &conf) :
       fast5s_(conf.fast5_prms),
       scan_start_(0),
       is_running_(false),
-      in_scan_(false) {
+      in_scan_(false),
+      sim_time_(0) {
 
     float sample_rate = conf.get_sample_rate();
     time_coef_  = sample_rate / 1000;
@@ -37,7 +38,7 @@ ClientSim::ClientSim(Conf &conf) :
 
     channels_.reserve(conf.get_num_channels());
     for (u32 c = 1; c <= conf.get_num_channels(); c++) {
-        channels_.emplace_back(c);
+        channels_.emplace_back(this, c);
     }
 }
 
@@ -160,13 +161,20 @@ void ClientSim::add_read(u16 ch, const std::string &id, u32 offs) {
 
 void ClientSim::add_fast5(const std::string &fname) {
     fast5s_.add_fast5(fname);
+    fast5_names_.push_back(fname);
 }
 
 
 void ClientSim::load_fast5s() {
+    if (PRMS.stream_reads) {
+        index_fast5s();
+        return;
+    }
+
     u32 n = 0;
     while(!fast5s_.empty()) {
         ReadBuffer read = fast5s_.pop_read();
+        read.load_signal();
         ReadLoc r = read_locs[read.get_id()];
 
         read.set_channel(r.ch);
@@ -180,6 +188,59 @@ void ClientSim::load_fast5s() {
 }
 
 
+void ClientSim::index_fast5s() {
+    ReadFile::ReadFilter filter;
+    for (auto &l : read_locs) filter.include.insert(l.first);
+
+    //Only metadata is needed, the rest is loaded by load_read
+    u32 load_chunks = ReadBuffer::PRMS.load_chunks;
+    ReadBuffer::PRMS.load_chunks = 1;
+
+    u32 n = 0;
+    for (u32 f = 0; f < fast5_names_.size(); f++) {
+        std::unique_ptr<ReadFile> file(ReadFile::create(fast5_names_[f]));
+        if (!file || !file->open(fast5_names_[f], filter)) {
+            std::cerr << "Error: failed to open \"" << fast5_names_[f] << "\"\n";
+            continue;
+        }
+
+        for (ReadBuffer read; file->next_read(read); read = ReadBuffer()) {
+            auto l = read_locs.find(read.get_id());
+            if (l == read_locs.end()) continue;
+
+            ReadLoc &r = l->second;
+            channels_[r.ch-1].index_read(r.i, f, r.offs, read);
+
+            if (n % 1000 == 0) {
+                std::cerr << n << " indexed\n";
+            }
+            n++;
+        }
+    }
+
+    ReadBuffer::PRMS.load_chunks = load_chunks;
+}
+
+bool ClientSim::load_read(u16 channel, SimRead &r) {
+    const std::string &fname = fast5_names_[r.file_];
+    std::unique_ptr<ReadFile> file(ReadFile::create(fname));
+    ReadBuffer read;
+
+    ReadFile::ReadFilter filter;
+    filter.include.insert(r.id_);
+
+    if (!file || !file->open(fname, filter) || !file->next_read(read)) {
+        std::cerr << "Error: failed to load read " << r.id_ << "\n";
+        r.loaded_ = true; //Don't retry, the read will have no chunks
+        return false;
+    }
+
+    read.load_signal();
+    read.set_channel(channel);
+    r.load_read(read, r.offs_);
+    return true;
+}
+
 bool ClientSim::load_reads(const std::string &fname) {
     if (fname.empty()) {
         std::cerr << "No read file provided\n";
@@ -211,6 +272,7 @@ bool ClientSim::load_reads(const std::string &fname) {
 bool ClientSim::run() {
     is_running_ = true;
     in_scan_ = false;
+    sim_time_ = 0;
     timer_.reset();
     for (SimChannel &ch : channels_) {
         ch.start(0);
@@ -298,14 +360,20 @@ u32 ClientSim::unblock_read(u16 ch, u32 number) {
     return channels_[ch-1].unblock(get_time(), ej_time_);
 }
 
-float ClientSim::get_time() {
+double ClientSim::get_time() {
+    if (PRMS.fast_clock) return sim_time_;
     return (timer_.get() * time_coef_);
 }
 
 float ClientSim::get_runtime() {
+    if (PRMS.fast_clock) return sim_time_ / time_coef_ / 1000;
     return timer_.get() / 1000;
 }
 
+void ClientSim::advance() {
+    if (PRMS.fast_clock) sim_time_ += PRMS.clock_step * time_coef_ * 1000;
+}
+
 bool ClientSim::is_running() {
     return is_running_;
 }
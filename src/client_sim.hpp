@@ -26,9 +26,11 @@
 
 #include <unordered_map>
 #include <deque>
+#include <memory>
 #include "util.hpp"
 #include "chunk.hpp"
 #include "read_buffer.hpp" 
+#include "read_file.hpp" 
 #include "fast5_reader.hpp" 
 #include "conf.hpp" 
 
@@ -43,6 +45,10 @@ class ClientSim {
     bool is_running();
     float get_runtime();
 
+    //Moves the simulated clock forward clock_step seconds if fast_clock
+    //is set. Drivers should only call it once RealtimePool::is_idle
+    void advance();
+
     bool load_from_files(const std::string &prefix);
 
     void add_intv(u16 ch, u16 i, u32 st, u32 en);
@@ -71,6 +77,7 @@ class ClientSim {
         PY_SIM_METH(add_read);
         PY_SIM_METH(add_fast5);
         PY_SIM_METH(load_fast5s);
+        PY_SIM_METH(advance);
 
         PY_SIM_RPROP(is_running);
     }
@@ -86,7 +93,10 @@ class ClientSim {
 
 
     u32 get_number(u16 channel);
-    float get_time();
+    double get_time();
+
+    //stream_reads index of which file each read is in
+    void index_fast5s();
 
     typedef struct {
         u16 ch;
@@ -188,27 +198,62 @@ class ClientSim {
         u8 c_;
         u32 start_, end_, duration_, number_;
 
+        //Set by index_read, chunks are loaded from file on demand
+        std::string id_;
+        u32 file_, offs_;
+        bool indexed_, loaded_;
+
         SimRead() :
             c_(0),
             start_(0),
             end_(0),
             duration_(0),
-            number_(0) {}
+            number_(0),
+            file_(0),
+            offs_(0),
+            indexed_(false),
+            loaded_(false) {}
 
         void load_read(const ReadBuffer &read, u32 offs) {
             duration_ = read.get_duration();
+            chunks_.clear();
             read.get_chunks(chunks_, false, offs);
             number_ = read.get_number();
+            loaded_ = true;
+            set_chunk_starts();
         }
 
-        void start(u32 t) {
-            start_ = t;
-            end_ = start_ + duration_;
+        void index_read(const ReadBuffer &read, u32 file, u32 offs) {
+            duration_ = read.get_duration();
+            number_ = read.get_number();
+            id_ = read.get_id();
+            file_ = file;
+            offs_ = offs;
+            indexed_ = true;
+        }
+
+        bool is_loaded() const {
+            return !indexed_ || loaded_;
+        }
+
+        void release() {
+            if (!indexed_) return;
+            std::vector<Chunk>().swap(chunks_);
+            loaded_ = false;
+        }
+
+        void set_chunk_starts() {
             u64 i = start_;
             for (auto &ch : chunks_) {
                 ch.set_start(i);
                 i += ch.size();
             }
+        }
+
+        void start(u32 t) {
+            start_ = t;
+            end_ = start_ + duration_;
+            set_chunk_starts();
             c_ = 0;
         }
 
@@ -251,6 +296,7 @@ class ClientSim {
     class SimChannel {
         //private:
         public:
+        ClientSim *sim_;
         u16 channel_;
         std::deque<ScanIntv> intvs_; //intervals
         std::vector<SimRead> reads_;
@@ -259,7 +305,8 @@ class ClientSim {
         u32 read_count_;
         bool is_active_;
 
-        SimChannel(u16 channel) : 
+        SimChannel(ClientSim *sim, u16 channel) : 
+            sim_(sim),
             channel_(channel), 
             r_(0), 
             read_count_(0),
@@ -279,7 +326,7 @@ class ClientSim {
                 }
                 
             } else if (is_active_) {
-                r_ = (r_+1) % reads_.size();
+                next_read();
                 is_active_ = false;
             }
 
@@ -307,6 +354,20 @@ class ClientSim {
             reads_[i].load_read(read, offs);
         }
 
+        void index_read(u32 i, u32 file, u32 offs, const ReadBuffer &read) {
+            if (reads_.size() < read_count_) {
+                reads_.resize(read_count_);
+            }
+
+            reads_[i].index_read(read, file, offs);
+        }
+
+        //Streamed reads are released once the channel moves past them
+        void next_read() {
+            reads_[r_].release();
+            r_ = (r_+1) % reads_.size();
+        }
+
         void add_delay(u32 i, u32 delay) {
             while (i >= intvs_.size()) {
                 intvs_.emplace_back(channel_, intvs_.size());
@@ -334,14 +395,20 @@ class ClientSim {
 
             u32 end = reads_[r_].get_end();
             while (t >= end) {
-                r_ = (r_+1) % reads_.size();
+                next_read();
 
                 reads_[r_].start(end + intvs_[0].next_gap() + extra_gap_);
                 extra_gap_ = 0;
                 end = reads_[r_].get_end();
             }
 
-            return reads_[r_].chunk_ready(t);
+            //Reads skipped over above are never loaded
+            SimRead &r = reads_[r_];
+            if (r.started(t) && !r.is_loaded()) {
+                sim_->load_read(channel_, r);
+            }
+
+            return r.chunk_ready(t);
         }
 
         Chunk next_chunk(u32 t) {
@@ -376,6 +443,9 @@ class ClientSim {
 
     friend bool operator< (const SimRead &r1, const SimRead &r2);
 
+    //Loads an indexed read's chunks from its file
+    bool load_read(u16 channel, SimRead &r);
+
     SimParams PRMS;
     Fast5Reader fast5s_;
     float time_coef_; //TODO: make const?
@@ -385,6 +455,9 @@ class ClientSim {
     bool is_running_, in_scan_;
 
     Timer timer_;
+    double sim_time_;
+
+    std::vector<std::string> fast5_names_;
     
     std::vector<SimChannel> channels_;
 };
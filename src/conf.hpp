@@ -62,6 +62,7 @@ class Conf {
 
     Mode mode;
     u16 threads;
+    u16 batch_size; //Reads each map thread interleaves, 1 to disable
 
     Mapper::Params &mapper_prms = Mapper::PRMS;
     Normalizer::Params &norm_prms = mapper_prms.norm_prms;
@@ -70,6 +71,7 @@ class Conf {
     SeedTracker::Params &seed_prms = mapper_prms.seed_prms;
 
     ReadBuffer::Params &read_prms = ReadBuffer::PRMS;
+    ReadTracer::Params &trace_prms = ReadTracer::PRMS;
 
     Fast5Reader::Params fast5_prms = Fast5Reader::PRMS_DEF;
     static constexpr Fast5Reader::Docstrs fast5_docs = Fast5Reader::DOCSTRS;
@@ -77,8 +79,10 @@ class Conf {
     RealtimeParams realtime_prms = REALTIME_PRMS_DEF;
     SimParams sim_prms = SIM_PRMS_DEF;
     MapOrdParams map_ord_prms = MAP_ORD_PRMS_DEF;
+    OutputParams output_prms = OUTPUT_PRMS_DEF;
+    DistParams dist_prms = DIST_PRMS_DEF;
 
-    Conf() : mode(Mode::UNDEF), threads(1) {}
+    Conf() : mode(Mode::UNDEF), threads(1), batch_size(1) {}
 
     Conf(Mode m) : Conf() {
         mode = m;
@@ -101,6 +105,7 @@ class Conf {
         if (conf.contains("global")) {
             const auto subconf = toml::find(conf, "global");
             GET_TOML(u16, threads);
+            GET_TOML(u16, batch_size);
         }
 
         if (conf.contains("realtime")) {
@@ -109,6 +114,20 @@ class Conf {
             GET_TOML_EXTERN(u16, port, realtime_prms);
             GET_TOML_EXTERN(float, duration, realtime_prms);
             GET_TOML_EXTERN(u32, max_active_reads, realtime_prms);
+            GET_TOML_EXTERN(float, action_interval, realtime_prms);
+            GET_TOML_EXTERN(u32, action_batch, realtime_prms);
+            GET_TOML_EXTERN(bool, deadline_sched, realtime_prms);
+            GET_TOML_EXTERN(float, abandon_time, realtime_prms);
+            GET_TOML_EXTERN(float, tune_latency, realtime_prms);
+            GET_TOML_EXTERN(float, tune_interval, realtime_prms);
+            GET_TOML_EXTERN(u32, tune_active_min, realtime_prms);
+            GET_TOML_EXTERN(u32, tune_active_max, realtime_prms);
+            GET_TOML_EXTERN(u16, tune_batch_min, realtime_prms);
+            GET_TOML_EXTERN(u16, tune_batch_max, realtime_prms);
+            GET_TOML_EXTERN(float, tune_timeout_min, realtime_prms);
+            GET_TOML_EXTERN(float, tune_timeout_max, realtime_prms);
+            GET_TOML_EXTERN(float, tune_chunk_timeout_min, realtime_prms);
+            GET_TOML_EXTERN(float, tune_chunk_timeout_max, realtime_prms);
 
             if (subconf.contains("realtime_mode")) {
                 std::string mode_str = toml::find<std::string>(subconf, "realtime_mode");
@@ -142,6 +161,9 @@ class Conf {
             GET_TOML_EXTERN(float, scan_intv_time, sim_prms);
             GET_TOML_EXTERN(float, ej_time, sim_prms);
             GET_TOML_EXTERN(u32, min_ch_reads, sim_prms);
+            GET_TOML_EXTERN(bool, stream_reads, sim_prms);
+            GET_TOML_EXTERN(bool, fast_clock, sim_prms);
+            GET_TOML_EXTERN(float, clock_step, sim_prms);
         }
 
         if (conf.contains("map_ord")) {
@@ -149,6 +171,23 @@ class Conf {
             GET_TOML_EXTERN(u32, min_active_reads, map_ord_prms);
         }
 
+        if (conf.contains("output")) {
+            const auto subconf = toml::find(conf, "output");
+            GET_TOML_EXTERN(std::string, paf_out, output_prms);
+            GET_TOML_EXTERN(bool, paf_binary, output_prms);
+            GET_TOML_EXTERN(u32, paf_buffer, output_prms);
+            GET_TOML_EXTERN(std::string, checkpoint, output_prms);
+            GET_TOML_EXTERN(bool, resume, output_prms);
+        }
+
+        if (conf.contains("dist")) {
+            const auto subconf = toml::find(conf, "dist");
+            GET_TOML_EXTERN(std::string, dist_coord, dist_prms);
+            GET_TOML_EXTERN(u16, dist_port, dist_prms);
+            GET_TOML_EXTERN(bool, dist_backup, dist_prms);
+            GET_TOML_EXTERN(u32, dist_window, dist_prms);
+        }
+
         if (conf.contains("fast5_reader")) {
             const auto subconf = toml::find(conf, "fast5_reader");
 
@@ -156,12 +195,14 @@ class Conf {
             GET_TOML_EXTERN(u32, max_reads, fast5_prms);
             GET_TOML_EXTERN(std::string, fast5_list, fast5_prms);
             GET_TOML_EXTERN(std::string, read_list, fast5_prms);
+            GET_TOML_EXTERN(u16, io_threads, fast5_prms);
         }
 
         if (conf.contains("reads")) {
             const auto subconf = toml::find(conf, "reads");
 
             GET_TOML_EXTERN(u32, max_chunks,   read_prms);
+            GET_TOML_EXTERN(u32, load_chunks,  read_prms);
             GET_TOML_EXTERN(u16, bp_per_sec,   read_prms);
             GET_TOML_EXTERN(u16, sample_rate,  read_prms);
             GET_TOML_EXTERN(float, chunk_time, read_prms);
@@ -176,15 +217,27 @@ class Conf {
             GET_TOML_EXTERN(u32, max_rep_copy, mapper_prms);
             GET_TOML_EXTERN(u32, max_paths, mapper_prms);
             GET_TOML_EXTERN(u32, max_consec_stay, mapper_prms);
+            GET_TOML_EXTERN(u32, path_pool_size, mapper_prms);
+            GET_TOML_EXTERN(u32, min_path_budget, mapper_prms);
             GET_TOML_EXTERN(u32, max_events, mapper_prms);
             GET_TOML_EXTERN(float, max_stay_frac, mapper_prms);
             GET_TOML_EXTERN(float, min_seed_prob, mapper_prms);
             GET_TOML_EXTERN(std::string, bwa_prefix, mapper_prms);
             GET_TOML_EXTERN(std::string, idx_preset, mapper_prms);
             GET_TOML_EXTERN(std::string, model_path, mapper_prms);
+            GET_TOML_EXTERN(bool, idx_mmap, mapper_prms);
+            GET_TOML_EXTERN(bool, idx_populate, mapper_prms);
+            GET_TOML_EXTERN(bool, idx_hugepages, mapper_prms);
+            GET_TOML_EXTERN(bool, numa_pin, mapper_prms);
+            GET_TOML_EXTERN(std::string, numa_index, mapper_prms);
+            GET_TOML_EXTERN(bool, repeat_mask, mapper_prms);
+            GET_TOML_EXTERN(u32, sa_cache_mb, mapper_prms);
             GET_TOML_EXTERN(u16, evt_batch_size, mapper_prms);
             GET_TOML_EXTERN(float, evt_timeout, mapper_prms);
             GET_TOML_EXTERN(float, chunk_timeout, mapper_prms);
+            GET_TOML_EXTERN(std::string, target_bed, mapper_prms);
+            GET_TOML_EXTERN(float, early_conf, mapper_prms);
+            GET_TOML_EXTERN(bool, counter_tags, mapper_prms);
 
             #ifdef DEBUG_OUT
             GET_TOML_EXTERN(std::string, dbg_prefix, mapper_prms);
@@ -197,6 +250,7 @@ class Conf {
             GET_TOML_EXTERN(float, min_mean_conf,seed_prms);
             GET_TOML_EXTERN(float, min_top_conf, seed_prms);
             GET_TOML_EXTERN(u32, min_map_len, seed_prms);
+            GET_TOML_EXTERN(u32, max_evt_gap, seed_prms);
         }
 
         if (conf.contains("normalizer")) {
@@ -217,6 +271,14 @@ class Conf {
             GET_TOML_EXTERN(u32, window_length2, event_prms);
         }
 
+        if (conf.contains("tracer")) {
+            const auto subconf = toml::find(conf, "tracer");
+            GET_TOML_EXTERN(std::string, trace_out, trace_prms);
+            GET_TOML_EXTERN(float, trace_sample, trace_prms);
+            GET_TOML_EXTERN(std::string, trace_list, trace_prms);
+            GET_TOML_EXTERN(u32, trace_buffer, trace_prms);
+        }
+
         if (conf.contains("event_profiler")) {
             const auto subconf = toml::find(conf, "event_profiler");
             GET_TOML_EXTERN(u32, win_len, evt_prof_prms);
@@ -232,6 +294,7 @@ class Conf {
     }
 
     GET_SET(u16, threads)
+    GET_SET(u16, batch_size)
 
 
     //TODO define get<type, param>, set<type, param>, doc<type, param>
@@ -245,11 +308,26 @@ class Conf {
     GET_SET_DOC(fast5, std::string, read_list)
     GET_SET_DOC(fast5, u32, max_reads)
     GET_SET_DOC(fast5, u32, max_buffer)
+    GET_SET_DOC(fast5, u16, io_threads)
 
     GET_SET_EXTERN(std::string, realtime_prms, host)
     GET_SET_EXTERN(u16, realtime_prms, port)
     GET_SET_EXTERN(float, realtime_prms, duration)
     GET_SET_EXTERN(u32, realtime_prms, max_active_reads)
+    GET_SET_EXTERN(float, realtime_prms, action_interval)
+    GET_SET_EXTERN(u32, realtime_prms, action_batch)
+    GET_SET_EXTERN(bool, realtime_prms, deadline_sched)
+    GET_SET_EXTERN(float, realtime_prms, abandon_time)
+    GET_SET_EXTERN(float, realtime_prms, tune_latency)
+    GET_SET_EXTERN(float, realtime_prms, tune_interval)
+    GET_SET_EXTERN(u32, realtime_prms, tune_active_min)
+    GET_SET_EXTERN(u32, realtime_prms, tune_active_max)
+    GET_SET_EXTERN(u16, realtime_prms, tune_batch_min)
+    GET_SET_EXTERN(u16, realtime_prms, tune_batch_max)
+    GET_SET_EXTERN(float, realtime_prms, tune_timeout_min)
+    GET_SET_EXTERN(float, realtime_prms, tune_timeout_max)
+    GET_SET_EXTERN(float, realtime_prms, tune_chunk_timeout_min)
+    GET_SET_EXTERN(float, realtime_prms, tune_chunk_timeout_max)
     GET_SET_EXTERN(RealtimeParams::ActiveChs, realtime_prms, active_chs)
     GET_SET_EXTERN(RealtimeParams::Mode, realtime_prms, realtime_mode)
 
@@ -259,8 +337,21 @@ class Conf {
     GET_SET_EXTERN(std::string, mapper_prms, bwa_prefix)
     GET_SET_EXTERN(std::string, mapper_prms, idx_preset)
     GET_SET_EXTERN(std::string, mapper_prms, model_path)
+    GET_SET_EXTERN(bool, mapper_prms, idx_mmap)
+    GET_SET_EXTERN(bool, mapper_prms, idx_populate)
+    GET_SET_EXTERN(bool, mapper_prms, idx_hugepages)
+    GET_SET_EXTERN(bool, mapper_prms, numa_pin)
+    GET_SET_EXTERN(std::string, mapper_prms, numa_index)
+    GET_SET_EXTERN(bool, mapper_prms, repeat_mask)
+    GET_SET_EXTERN(u32, mapper_prms, sa_cache_mb)
     GET_SET_EXTERN(u32, mapper_prms, max_events)
     GET_SET_EXTERN(u32, mapper_prms, seed_len);
+    GET_SET_EXTERN(u32, mapper_prms, max_paths)
+    GET_SET_EXTERN(u32, mapper_prms, path_pool_size)
+    GET_SET_EXTERN(u32, mapper_prms, min_path_budget)
+    GET_SET_EXTERN(std::string, mapper_prms, target_bed)
+    GET_SET_EXTERN(float, mapper_prms, early_conf)
+    GET_SET_EXTERN(bool, mapper_prms, counter_tags)
 
     #ifdef DEBUG_OUT
     GET_SET_EXTERN(std::string, mapper_prms, dbg_prefix)
@@ -268,9 +359,15 @@ class Conf {
 
     GET_SET_EXTERN(u16,   read_prms, num_channels);
     GET_SET_EXTERN(u32,   read_prms, max_chunks)
+    GET_SET_EXTERN(u32,   read_prms, load_chunks)
     GET_SET_EXTERN(float, read_prms, chunk_time);
     GET_SET_EXTERN(float, read_prms, sample_rate);
 
+    GET_SET_EXTERN(std::string, trace_prms, trace_out);
+    GET_SET_EXTERN(float, trace_prms, trace_sample);
+    GET_SET_EXTERN(std::string, trace_prms, trace_list);
+    GET_SET_EXTERN(u32, trace_prms, trace_buffer);
+
 
     GET_SET_EXTERN(std::string, sim_prms, ctl_seqsum);
     GET_SET_EXTERN(std::string, sim_prms, unc_seqsum);
@@ -280,9 +377,23 @@ class Conf {
     GET_SET_EXTERN(float, sim_prms, scan_intv_time);
     GET_SET_EXTERN(float, sim_prms, ej_time);
     GET_SET_EXTERN(u32, sim_prms, min_ch_reads);
+    GET_SET_EXTERN(bool, sim_prms, stream_reads);
+    GET_SET_EXTERN(bool, sim_prms, fast_clock);
+    GET_SET_EXTERN(float, sim_prms, clock_step);
 
     GET_SET_EXTERN(u32, map_ord_prms, min_active_reads);
 
+    GET_SET_EXTERN(std::string, output_prms, paf_out);
+    GET_SET_EXTERN(bool, output_prms, paf_binary);
+    GET_SET_EXTERN(u32, output_prms, paf_buffer);
+    GET_SET_EXTERN(std::string, output_prms, checkpoint);
+    GET_SET_EXTERN(bool, output_prms, resume);
+
+    GET_SET_EXTERN(std::string, dist_prms, dist_coord);
+    GET_SET_EXTERN(u16, dist_prms, dist_port);
+    GET_SET_EXTERN(bool, dist_prms, dist_backup);
+    GET_SET_EXTERN(u32, dist_prms, dist_window);
+
     
 
     #ifdef PYBIND
@@ -299,12 +410,26 @@ class Conf {
          .def("load_toml", &Conf::load_toml);
 
         DEFPRP(threads)
+        DEFPRP(batch_size)
 
         DEFPRP(bwa_prefix)
         DEFPRP(idx_preset)
         DEFPRP(model_path);
+        DEFPRP(idx_mmap)
+        DEFPRP(idx_populate)
+        DEFPRP(idx_hugepages)
+        DEFPRP(numa_pin)
+        DEFPRP(numa_index)
+        DEFPRP(repeat_mask)
+        DEFPRP(sa_cache_mb)
         DEFPRP(max_events)
         DEFPRP(seed_len);
+        DEFPRP(max_paths)
+        DEFPRP(path_pool_size)
+        DEFPRP(min_path_budget)
+        DEFPRP(target_bed)
+        DEFPRP(early_conf)
+        DEFPRP(counter_tags)
         DEFPRP(chunk_time)
 
         #ifdef DEBUG_OUT
@@ -315,20 +440,52 @@ class Conf {
         DEFPRP_DOC(read_list)
         DEFPRP_DOC(max_reads)
         DEFPRP_DOC(max_buffer)
+        DEFPRP_DOC(io_threads)
 
         DEFPRP(host)
         DEFPRP(port)
         DEFPRP(duration)
         DEFPRP(max_active_reads)
+        DEFPRP(action_interval)
+        DEFPRP(action_batch)
+        DEFPRP(deadline_sched)
+        DEFPRP(abandon_time)
+        DEFPRP(tune_latency)
+        DEFPRP(tune_interval)
+        DEFPRP(tune_active_min)
+        DEFPRP(tune_active_max)
+        DEFPRP(tune_batch_min)
+        DEFPRP(tune_batch_max)
+        DEFPRP(tune_timeout_min)
+        DEFPRP(tune_timeout_max)
+        DEFPRP(tune_chunk_timeout_min)
+        DEFPRP(tune_chunk_timeout_max)
         DEFPRP(active_chs)
         DEFPRP(realtime_mode)
 
         DEFPRP(num_channels)
         DEFPRP(max_chunks)
+        DEFPRP(load_chunks)
         DEFPRP(sample_rate)
 
         DEFPRP(min_active_reads)
 
+        DEFPRP(paf_out)
+        DEFPRP(paf_binary)
+        DEFPRP(paf_buffer)
+        DEFPRP(checkpoint)
+        DEFPRP(resume)
+
+        DEFPRP(dist_coord)
+        DEFPRP(dist_port)
+        DEFPRP(dist_backup)
+        DEFPRP(dist_window)
+
+        DEFPRP(trace_out)
+        DEFPRP(trace_sample)
+        DEFPRP(trace_list)
+        DEFPRP(trace_buffer)
+
         DEFPRP(ctl_seqsum)
         DEFPRP(unc_seqsum)
         DEFPRP(unc_paf)
@@ -337,6 +494,9 @@ class Conf {
         DEFPRP(scan_intv_time)
         DEFPRP(ej_time)
         DEFPRP(min_ch_reads)
+        DEFPRP(stream_reads)
+        DEFPRP(fast_clock)
+        DEFPRP(clock_step)
     }
     #endif
 };
@@ -0,0 +1,361 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "dist_coordinator.hpp"
+
+DistCoordinator::DistCoordinator(const DistParams &prms, PafWriter &out,
+                                 ReadCheckpoint *checkpoint)
+    : prms_(prms),
+      out_(out),
+      checkpoint_(checkpoint),
+      listen_fd_(-1),
+      next_write_(0) {}
+
+DistCoordinator::~DistCoordinator() {
+    stop();
+}
+
+void DistCoordinator::add_fast5(const std::string &fname) {
+    if (checkpoint_ != NULL && checkpoint_->file_done(fname)) return;
+
+    //Workers track files by path
+    if (!file_names_.insert(fname).second) return;
+
+    queue_.push_back(files_.size());
+    files_.push_back({fname, 0, false, 0, {}});
+}
+
+bool DistCoordinator::load_fast5_list(const std::string &fname) {
+    std::ifstream list_file(fname);
+
+    if (!list_file.is_open()) {
+        std::cerr << "Error: failed to open fast5 list \""
+                  << fname << "\".\n";
+        return false;
+    }
+
+    std::string fast5_name;
+    while (getline(list_file, fast5_name)) {
+        if (!fast5_name.empty()) add_fast5(fast5_name);
+    }
+
+    return true;
+}
+
+bool DistCoordinator::start() {
+    listen_fd_ = DistSocket::listen_on(prms_.dist_port);
+    return listen_fd_ >= 0;
+}
+
+bool DistCoordinator::running() const {
+    return next_write_ < files_.size() || !workers_.empty();
+}
+
+void DistCoordinator::update(u32 timeout) {
+    std::vector<pollfd> fds;
+    fds.push_back({listen_fd_, POLLIN, 0});
+    for (auto &w : workers_) fds.push_back({w.fd, POLLIN, 0});
+
+    if (poll(fds.data(), fds.size(), timeout) <= 0) return;
+
+    auto w = workers_.begin();
+    for (u32 i = 1; i < fds.size(); i++) {
+        if (fds[i].revents != 0 && !read_msgs(*w)) {
+            disconnect(*w);
+            w = workers_.erase(w);
+        } else {
+            w++;
+        }
+    }
+
+    if (fds[0].revents & POLLIN) {
+        sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        int fd = accept(listen_fd_, reinterpret_cast<sockaddr *>(&addr), &len);
+        if (fd >= 0) {
+            char host[NI_MAXHOST], port[NI_MAXSERV];
+            getnameinfo(reinterpret_cast<sockaddr *>(&addr), len, 
+                        host, sizeof(host), port, sizeof(port), 
+                        NI_NUMERICHOST | NI_NUMERICSERV);
+
+            workers_.push_back({fd, std::string(host) + ":" + port, "", 0, {}});
+            std::cerr << "Worker " << workers_.back().addr << " connected\n";
+        }
+    }
+
+    //Files may have been freed up by a disconnect, or all finished
+    for (auto w = workers_.begin(); w != workers_.end();) {
+        if (serve(*w)) {
+            w++;
+        } else {
+            disconnect(*w);
+            w = workers_.erase(w);
+        }
+    }
+}
+
+bool DistCoordinator::read_msgs(Worker &w) {
+    char buf[1 << 16];
+    ssize_t n = recv(w.fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    w.in.append(buf, n);
+
+    size_t pos = 0;
+    DistSocket::MsgType type;
+    std::string payload;
+
+    while (DistSocket::next_msg(w.in, pos, type, payload)) {
+        if (!handle_msg(w, type, payload)) return false;
+    }
+    w.in.erase(0, pos);
+
+    return true;
+}
+
+bool DistCoordinator::handle_msg(Worker &w, DistSocket::MsgType type, 
+                                 const std::string &payload) {
+    size_t pos = 0;
+    u32 id = 0;
+
+    if (type == DistSocket::REQUEST) {
+        w.requests++;
+        return serve(w);
+    }
+
+    bool valid = DistSocket::read(payload, pos, id) && id < files_.size();
+    auto f = valid ? w.files.find(id) : w.files.end();
+
+    //Sent before the worker saw its copy was cancelled
+    if (f == w.files.end() && valid && files_[id].done) return true;
+
+    if (f == w.files.end()) {
+        std::cerr << "Error: invalid message from worker " << w.addr << "\n";
+        return false;
+    }
+
+    if (type == DistSocket::RESULT) {
+        //The other copy already finished
+        if (files_[id].done) return true;
+
+        u16 name_len = 0;
+        u64 rf_len = 0;
+        std::string rf_name;
+
+        valid = DistSocket::read(payload, pos, name_len) && 
+                pos + name_len <= payload.size();
+        if (valid) {
+            rf_name = payload.substr(pos, name_len);
+            pos += name_len;
+            valid = DistSocket::read(payload, pos, rf_len);
+        }
+
+        Paf p;
+        if (!valid || p.read_bin(&payload[pos], payload.size() - pos, 
+                                 rf_name, rf_len) == 0) {
+            std::cerr << "Error: invalid result from worker " << w.addr << "\n";
+            return false;
+        }
+
+        f->second.push_back(std::move(p));
+        return true;
+    }
+
+    if (type == DistSocket::DONE) {
+        files_[id].copies--;
+        if (!files_[id].done) file_done(id, f->second);
+        w.files.erase(f);
+        cancel_copies(id);
+        return true;
+    }
+
+    std::cerr << "Error: unknown message from worker " << w.addr << "\n";
+    return false;
+}
+
+bool DistCoordinator::serve(Worker &w) {
+    bool finished = next_write_ == files_.size();
+
+    while (w.requests > 0) {
+        std::string msg;
+        u32 id;
+
+        if (finished) {
+            size_t st = DistSocket::start_msg(msg, DistSocket::END);
+            DistSocket::end_msg(msg, st);
+        } else if (assign(w, id)) {
+            size_t st = DistSocket::start_msg(msg, DistSocket::FILE);
+            DistSocket::append(msg, id);
+            msg += files_[id].name;
+            DistSocket::end_msg(msg, st);
+        } else {
+            break;
+        }
+
+        if (!DistSocket::send_all(w.fd, msg.data(), msg.size())) return false;
+        w.requests--;
+    }
+
+    return true;
+}
+
+bool DistCoordinator::in_window(u32 id) const {
+    return prms_.dist_window == 0 || id < next_write_ + prms_.dist_window;
+}
+
+bool DistCoordinator::assign(Worker &w, u32 &id) {
+    while (!queue_.empty()) {
+        id = queue_.front();
+        if (!files_[id].done && !in_window(id)) break;
+
+        queue_.pop_front();
+        if (files_[id].done) continue;
+
+        files_[id].copies++;
+        files_[id].assigned = clock_.get();
+        w.files[id];
+        return true;
+    }
+
+    if (!prms_.dist_backup) return false;
+
+    //Backs up the longest running file that only one worker has
+    bool found = false;
+    for (u32 i = next_write_; i < files_.size() && in_window(i); i++) {
+        const WorkFile &f = files_[i];
+        if (f.done || f.copies != 1 || w.files.count(i) > 0) continue;
+        if (!found || f.assigned < files_[id].assigned) {
+            id = i;
+            found = true;
+        }
+    }
+
+    if (!found) return false;
+
+    std::cerr << "Backing up \"" << files_[id].name << "\" on worker " 
+              << w.addr << "\n";
+
+    files_[id].copies++;
+    files_[id].assigned = clock_.get();
+    w.files[id];
+    return true;
+}
+
+void DistCoordinator::file_done(u32 id, std::vector<Paf> &pafs) {
+    WorkFile &f = files_[id];
+    f.done = true;
+    f.pafs.swap(pafs);
+    write_ready();
+}
+
+void DistCoordinator::cancel_copies(u32 id) {
+    for (auto &w : workers_) {
+        if (files_[id].copies == 0) return;
+
+        auto f = w.files.find(id);
+        if (f == w.files.end()) continue;
+
+        w.files.erase(f);
+        files_[id].copies--;
+
+        std::string msg;
+        size_t st = DistSocket::start_msg(msg, DistSocket::CANCEL);
+        DistSocket::append(msg, id);
+        DistSocket::end_msg(msg, st);
+
+        //A lost worker is disconnected once its socket is polled
+        DistSocket::send_all(w.fd, msg.data(), msg.size());
+
+        std::cerr << "Cancelling \"" << files_[id].name << "\" on worker " 
+                  << w.addr << "\n";
+    }
+}
+
+//Writes finished files up to the first unfinished one
+void DistCoordinator::write_ready() {
+    while (next_write_ < files_.size() && files_[next_write_].done) {
+        WorkFile &f = files_[next_write_++];
+
+        std::sort(f.pafs.begin(), f.pafs.end(), 
+            [](const Paf &a, const Paf &b) {
+                return a.get_rd_name() < b.get_rd_name();
+            });
+
+        if (checkpoint_ != NULL) {
+            u32 ck = checkpoint_->file_opened(f.name);
+            for (auto &p : f.pafs) checkpoint_->read_loaded(ck, p.get_rd_name());
+            checkpoint_->file_loaded(ck);
+        }
+
+        for (auto &p : f.pafs) out_.submit(std::move(p));
+        std::vector<Paf>().swap(f.pafs);
+    }
+}
+
+void DistCoordinator::disconnect(Worker &w) {
+    u32 lost = 0;
+    for (auto &f : w.files) {
+        WorkFile &wf = files_[f.first];
+        wf.copies--;
+        if (!wf.done && wf.copies == 0) {
+            queue_.push_front(f.first);
+            lost++;
+        }
+    }
+
+    if (lost > 0) {
+        std::cerr << "Warning: worker " << w.addr << " disconnected, "
+                  << "handing out its " << lost << " unfinished files again\n";
+    } else {
+        std::cerr << "Worker " << w.addr << " disconnected\n";
+    }
+
+    close(w.fd);
+}
+
+void DistCoordinator::stop() {
+    for (auto &w : workers_) close(w.fd);
+    workers_.clear();
+
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+u32 DistCoordinator::file_count() const {
+    return files_.size();
+}
+
+u32 DistCoordinator::written_count() const {
+    return next_write_;
+}
+
+u32 DistCoordinator::worker_count() const {
+    return workers_.size();
+}
@@ -0,0 +1,128 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_DIST_COORDINATOR
+#define _INCL_DIST_COORDINATOR
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include "util.hpp"
+#include "toplevel_prms.hpp"
+#include "paf_writer.hpp"
+#include "read_checkpoint.hpp"
+#include "dist_socket.hpp"
+
+//Hands out read files to uncalled_map workers (see DistWorker) on other
+//nodes, and merges their results into one output
+//Each worker asks for a file whenever one of its I/O threads is free, so
+//faster nodes take more files without any up-front sharding. Files held 
+//by a worker that disconnects are handed out again. Once no files are 
+//left to hand out, idle workers are given a second copy of the file that 
+//has been out the longest if dist_backup is set. Whichever copy is done
+//first is kept, and the other workers are told to cancel theirs
+//
+//Results are held until their file is done, then written in fast5 list
+//order and sorted by read ID within each file, so the output doesn't 
+//depend on how files were split between workers. No file more than 
+//dist_window past the first unwritten one is handed out, which bounds
+//the results held. Idle workers back up files in the window instead
+class DistCoordinator {
+    public:
+
+    DistCoordinator(const DistParams &prms, PafWriter &out, 
+                    ReadCheckpoint *checkpoint=NULL);
+    ~DistCoordinator();
+
+    //Repeated files and those the checkpoint lists as done are skipped
+    void add_fast5(const std::string &fname);
+    bool load_fast5_list(const std::string &fname);
+
+    //Starts listening for workers, false on error
+    bool start();
+
+    //Handles worker messages for up to timeout ms
+    void update(u32 timeout);
+
+    //False once every file is written and all workers have disconnected
+    bool running() const;
+
+    //Disconnects all workers
+    void stop();
+
+    u32 file_count() const;
+    u32 written_count() const;
+    u32 worker_count() const;
+
+    private:
+    struct WorkFile {
+        std::string name;
+        u16 copies;       //workers mapping the file
+        bool done;
+        double assigned;  //when the last copy was handed out
+        std::vector<Paf> pafs;
+    };
+
+    struct Worker {
+        int fd;
+        std::string addr;
+        std::string in;
+        u32 requests;  //waiting for a file
+        std::unordered_map< u32, std::vector<Paf> > files;
+    };
+
+    bool read_msgs(Worker &w);
+    bool handle_msg(Worker &w, DistSocket::MsgType type, const std::string &payload);
+
+    //Answers w's waiting requests with files, or END once all are done
+    bool serve(Worker &w);
+    bool assign(Worker &w, u32 &id);
+    bool in_window(u32 id) const;
+
+    void file_done(u32 id, std::vector<Paf> &pafs);
+
+    //Tells workers still mapping a finished file to stop
+    void cancel_copies(u32 id);
+    void write_ready();
+    void disconnect(Worker &w);
+
+    DistParams prms_;
+    PafWriter &out_;
+    ReadCheckpoint *checkpoint_;
+
+    int listen_fd_;
+    Timer clock_;
+
+    std::vector<WorkFile> files_;
+    std::unordered_set<std::string> file_names_;
+    std::deque<u32> queue_;
+    u32 next_write_;
+
+    std::list<Worker> workers_;
+};
+
+#endif
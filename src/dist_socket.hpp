@@ -0,0 +1,213 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_DIST_SOCKET
+#define _INCL_DIST_SOCKET
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cerrno>
+#include <iostream>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "util.hpp"
+
+//Messages sent between a DistCoordinator and its DistWorkers over TCP
+//Each message is a MsgHeader followed by len bytes of payload, in host
+//byte order like the binary PAF format
+class DistSocket {
+    public:
+
+    enum MsgType : u8 {
+        REQUEST = 'G', //worker wants a file, no payload
+        FILE    = 'F', //file assigned: u32 file ID, path
+        RESULT  = 'R', //u32 file ID, u16 reference name length, name,
+                       //u64 reference length, Paf::BinRecord and body
+        DONE    = 'D', //all of a file's results were sent: u32 file ID
+        CANCEL  = 'C', //another copy of the file finished: u32 file ID
+        END     = 'E'  //no files are left, no payload
+    };
+
+    typedef struct {
+        u8 type;
+        u8 pad[3];
+        u32 len;
+    } MsgHeader;
+
+    //Appends a header for a message whose payload is appended after it,
+    //returns the offset to pass to end_msg once the payload is complete
+    static size_t start_msg(std::string &out, MsgType type) {
+        MsgHeader h = {type, {0, 0, 0}, 0};
+        size_t st = out.size();
+        out.append(reinterpret_cast<const char *>(&h), sizeof(h));
+        return st;
+    }
+
+    static void end_msg(std::string &out, size_t st) {
+        u32 len = out.size() - st - sizeof(MsgHeader);
+        memcpy(&out[st + offsetof(MsgHeader, len)], &len, sizeof(len));
+    }
+
+    template <typename T>
+    static void append(std::string &out, const T &v) {
+        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+
+    template <typename T>
+    static bool read(const std::string &in, size_t &pos, T &v) {
+        if (pos + sizeof(T) > in.size()) return false;
+        memcpy(&v, &in[pos], sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    //Moves the first complete message in buf starting at pos into payload
+    static bool next_msg(const std::string &buf, size_t &pos, 
+                         MsgType &type, std::string &payload) {
+        MsgHeader h;
+        if (pos + sizeof(h) > buf.size()) return false;
+        memcpy(&h, &buf[pos], sizeof(h));
+        if (pos + sizeof(h) + h.len > buf.size()) return false;
+
+        type = MsgType(h.type);
+        payload.assign(buf, pos + sizeof(h), h.len);
+        pos += sizeof(h) + h.len;
+        return true;
+    }
+
+    //Blocks until all of data is sent, false if the connection closed
+    static bool send_all(int fd, const char *data, size_t len) {
+        while (len > 0) {
+            ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    //Splits "host:port", the host defaulting to localhost
+    //False unless the port is a number from 1 to 65535
+    static bool parse_addr(const std::string &addr, std::string &host, u16 &port) {
+        size_t i = addr.rfind(':');
+        host = i == std::string::npos ? addr : addr.substr(0, i);
+        if (host.empty()) host = "localhost";
+        if (i == std::string::npos || i+1 == addr.size()) return false;
+
+        //strtoul would skip spaces and negate a leading '-'
+        const char *st = addr.c_str() + i + 1;
+        if (*st < '0' || *st > '9') return false;
+
+        char *en;
+        errno = 0;
+        unsigned long p = strtoul(st, &en, 10);
+        if (*en != '\0' || errno == ERANGE || p == 0 || p > 65535) return false;
+
+        port = (u16) p;
+        return true;
+    }
+
+    //Returns a connected socket, or -1 on error
+    static int connect_to(const std::string &host, u16 port) {
+        addrinfo hints, *res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        std::string port_str = std::to_string(port);
+        if (getaddrinfo(host.c_str(), port_str.c_str(), &hints, &res) != 0) {
+            std::cerr << "Error: failed to resolve \"" << host << "\"\n";
+            return -1;
+        }
+
+        int fd = -1;
+        for (addrinfo *a = res; a != NULL && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+
+        if (fd < 0) {
+            std::cerr << "Error: failed to connect to " 
+                      << host << ":" << port << "\n";
+            return -1;
+        }
+
+        //Requests are small and waited on
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+
+    //Returns a socket listening on port on all interfaces, or -1 on error
+    static int listen_on(u16 port) {
+        int fd = socket(AF_INET6, SOCK_STREAM, 0);
+        bool ipv6 = fd >= 0;
+        if (!ipv6) fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            std::cerr << "Error: failed to create socket\n";
+            return -1;
+        }
+
+        int one = 1, zero = 0;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        int ret;
+        if (ipv6) {
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+            sockaddr_in6 a;
+            memset(&a, 0, sizeof(a));
+            a.sin6_family = AF_INET6;
+            a.sin6_addr = in6addr_any;
+            a.sin6_port = htons(port);
+            ret = bind(fd, reinterpret_cast<sockaddr *>(&a), sizeof(a));
+        } else {
+            sockaddr_in a;
+            memset(&a, 0, sizeof(a));
+            a.sin_family = AF_INET;
+            a.sin_addr.s_addr = htonl(INADDR_ANY);
+            a.sin_port = htons(port);
+            ret = bind(fd, reinterpret_cast<sockaddr *>(&a), sizeof(a));
+        }
+
+        if (ret != 0 || listen(fd, 64) != 0) {
+            std::cerr << "Error: failed to listen on port " << port << "\n";
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+};
+
+#endif
@@ -0,0 +1,261 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <climits>
+#include <algorithm>
+#include "dist_worker.hpp"
+
+DistWorker::DistWorker(const std::string &addr)
+    : fd_(-1),
+      connected_(false),
+      finished_(false),
+      tracker_([this](const std::string &fname) {file_done(fname);}) {
+
+    std::string host;
+    u16 port = 0;
+    if (!DistSocket::parse_addr(addr, host, port)) {
+        std::cerr << "Error: invalid coordinator address \"" << addr 
+                  << "\", expected host:port\n";
+        return;
+    }
+
+    fd_ = DistSocket::connect_to(host, port);
+    connected_ = fd_ >= 0;
+}
+
+DistWorker::~DistWorker() {
+    close();
+}
+
+bool DistWorker::is_connected() const {
+    return connected_;
+}
+
+bool DistWorker::finished() const {
+    return finished_;
+}
+
+ReadCheckpoint *DistWorker::tracker() {
+    return &tracker_;
+}
+
+bool DistWorker::next_file(std::string &fname) {
+    std::lock_guard<std::mutex> lock(req_mtx_);
+    if (!connected_ || finished_) return false;
+
+    {
+        std::lock_guard<std::mutex> out_lock(out_mtx_);
+        size_t st = DistSocket::start_msg(out_, DistSocket::REQUEST);
+        DistSocket::end_msg(out_, st);
+        if (!send_buffered()) return false;
+    }
+
+    char buf[4096];
+    size_t pos = 0;
+    DistSocket::MsgType type;
+    std::string payload;
+
+    //Cancels may arrive before the reply
+    do {
+        while (!DistSocket::next_msg(in_, pos, type, payload)) {
+            ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                connected_ = false;
+                return false;
+            }
+            in_.append(buf, n);
+        }
+        if (type == DistSocket::CANCEL) cancel(payload);
+    } while (type == DistSocket::CANCEL);
+    in_.erase(0, pos);
+
+    u32 id;
+    pos = 0;
+    if (type == DistSocket::FILE && DistSocket::read(payload, pos, id)) {
+        fname = payload.substr(pos);
+        std::lock_guard<std::mutex> files_lock(files_mtx_);
+        file_ids_[fname] = id;
+        return true;
+    }
+
+    if (type != DistSocket::END) {
+        std::cerr << "Error: invalid message from coordinator\n";
+    }
+
+    finished_ = true;
+    return false;
+}
+
+void DistWorker::submit(const Paf &paf) {
+    const std::string &rd_name = paf.get_rd_name();
+    std::string fname = tracker_.read_file(rd_name);
+
+    u32 id;
+    {
+        std::lock_guard<std::mutex> lock(files_mtx_);
+        auto f = file_ids_.find(fname);
+        if (f != file_ids_.end()) {
+            id = f->second;
+
+        //Still counted, so the tracker finishes the cancelled file
+        } else if (cancelled_.count(fname) > 0) {
+            id = UINT_MAX;
+
+        } else {
+            std::cerr << "Warning: no file found for read " << rd_name << "\n";
+            return;
+        }
+    }
+
+    if (id == UINT_MAX) {
+        tracker_.read_written(rd_name);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(out_mtx_);
+        const std::string &rf_name = paf.get_rf_name();
+        u16 name_len = std::min(rf_name.size(), size_t(USHRT_MAX));
+
+        size_t st = DistSocket::start_msg(out_, DistSocket::RESULT);
+        DistSocket::append(out_, id);
+        DistSocket::append(out_, name_len);
+        out_.append(rf_name, 0, name_len);
+        DistSocket::append(out_, paf.get_rf_len());
+        paf.write_bin(out_, 0);
+        DistSocket::end_msg(out_, st);
+    }
+
+    //May finish the file, which queues its DONE after the result
+    tracker_.read_written(rd_name);
+}
+
+void DistWorker::file_done(const std::string &fname) {
+    u32 id;
+    {
+        std::lock_guard<std::mutex> lock(files_mtx_);
+        if (cancelled_.erase(fname) > 0) return;
+
+        auto f = file_ids_.find(fname);
+        if (f == file_ids_.end()) return;
+        id = f->second;
+        file_ids_.erase(f);
+    }
+
+    std::lock_guard<std::mutex> lock(out_mtx_);
+    size_t st = DistSocket::start_msg(out_, DistSocket::DONE);
+    DistSocket::append(out_, id);
+    DistSocket::end_msg(out_, st);
+}
+
+bool DistWorker::flush() {
+    {
+        //Skipped while next_file waits for a reply, which reads cancels
+        std::unique_lock<std::mutex> req_lock(req_mtx_, std::try_to_lock);
+        if (req_lock.owns_lock() && !read_cancels()) return false;
+    }
+
+    std::lock_guard<std::mutex> lock(out_mtx_);
+    return send_buffered();
+}
+
+bool DistWorker::read_cancels() {
+    if (!connected_) return false;
+
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd_, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        in_.append(buf, n);
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        connected_ = false;
+        return false;
+    }
+
+    size_t pos = 0;
+    DistSocket::MsgType type;
+    std::string payload;
+    while (DistSocket::next_msg(in_, pos, type, payload)) {
+        if (type != DistSocket::CANCEL) {
+            std::cerr << "Error: invalid message from coordinator\n";
+            connected_ = false;
+            return false;
+        }
+        cancel(payload);
+    }
+    in_.erase(0, pos);
+
+    return true;
+}
+
+void DistWorker::cancel(const std::string &payload) {
+    u32 id;
+    size_t pos = 0;
+    if (!DistSocket::read(payload, pos, id)) return;
+
+    std::string fname;
+    {
+        std::lock_guard<std::mutex> lock(files_mtx_);
+        for (auto f = file_ids_.begin(); f != file_ids_.end(); f++) {
+            if (f->second == id) {
+                fname = f->first;
+                file_ids_.erase(f);
+                cancelled_.insert(fname);
+                break;
+            }
+        }
+    }
+
+    //Already done if not found, its DONE is ignored
+    if (fname.empty()) return;
+
+    std::cerr << "Cancelled \"" << fname << "\", another worker finished it\n";
+
+    //Not under files_mtx_, since the tracker may call file_done
+    tracker_.cancel_file(fname);
+}
+
+bool DistWorker::send_buffered() {
+    if (!connected_) return false;
+    if (!DistSocket::send_all(fd_, out_.data(), out_.size())) {
+        connected_ = false;
+        return false;
+    }
+    out_.clear();
+    return true;
+}
+
+void DistWorker::close() {
+    if (fd_ < 0) return;
+
+    //Wakes up requests waiting for a reply
+    shutdown(fd_, SHUT_RDWR);
+    {
+        std::lock_guard<std::mutex> lock(req_mtx_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    connected_ = false;
+}
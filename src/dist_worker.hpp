@@ -0,0 +1,96 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_DIST_WORKER
+#define _INCL_DIST_WORKER
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+#include "util.hpp"
+#include "read_buffer.hpp"
+#include "read_checkpoint.hpp"
+#include "dist_socket.hpp"
+
+//Maps files handed out by a DistCoordinator, see uncalled_map -W
+//next_file is the MapPool's Fast5Reader::FileSource, so each I/O thread 
+//asks for another file once it's done loading one. Results are buffered
+//by submit and sent by flush, followed by a DONE message for each file 
+//once all of its reads are sent, which tracker() keeps count of
+//Files the coordinator cancels stop loading, and their results are 
+//dropped. Cancels are read by next_file and by flush
+class DistWorker {
+    public:
+
+    //Connects to the coordinator at "host:port"
+    DistWorker(const std::string &addr);
+    ~DistWorker();
+
+    bool is_connected() const;
+
+    //Blocks until the coordinator hands out a file
+    //Returns false once no files are left, or if the connection is lost
+    bool next_file(std::string &fname);
+
+    //Must be passed to MapPool::set_checkpoint
+    ReadCheckpoint *tracker();
+
+    void submit(const Paf &paf);
+
+    //Sends everything submitted so far, false if the connection is lost
+    bool flush();
+
+    //The coordinator said no files are left
+    bool finished() const;
+
+    void close();
+
+    private:
+    void file_done(const std::string &fname);
+    bool send_buffered();
+
+    //Reads any messages already received, which must be cancels
+    //Must hold req_mtx_
+    bool read_cancels();
+    void cancel(const std::string &payload);
+
+    int fd_;
+    std::atomic<bool> connected_, finished_;
+
+    ReadCheckpoint tracker_;
+
+    //Coordinator IDs of the files being mapped, and cancelled files 
+    //with reads still being mapped
+    std::mutex files_mtx_;
+    std::unordered_map<std::string, u32> file_ids_;
+    std::unordered_set<std::string> cancelled_;
+
+    //One request waits for a reply at a time
+    std::mutex out_mtx_, req_mtx_;
+    std::string out_, in_;
+};
+
+#endif
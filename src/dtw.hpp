@@ -4,8 +4,15 @@
 #include <vector>
 #include <iostream>
 #include <cfloat>
+#include <cmath>
+#include <algorithm>
 #include "util.hpp"
 
+#if defined(__x86_64__) || defined(__i386__)
+#define DTW_X86_SIMD
+#include <immintrin.h>
+#endif
+
 enum class DTWSubSeq {NONE, ROW, COL};
 typedef struct {
     DTWSubSeq subseq;
@@ -185,6 +192,447 @@ class DTW {
     #endif
 };
 
+//FULL keeps a move for every band cell, NONE only computes the score using
+//memory linear in the band, CHECKPOINT saves every sqrt(N)th anti-diagonal 
+//and recomputes one block at a time to trace back the same path as FULL
+enum class DTWTrace {FULL, NONE, CHECKPOINT};
+
+typedef struct {
+    u32 width;           //Cells on each side of the band center, 0 for no band
+    float slope, offset; //Center column = offset + slope*row, corner to corner if slope < 0
+    DTWTrace trace;
+} DTWBand;
+
+const DTWBand DTW_NO_BAND = {0, -1, 0, DTWTrace::FULL};
+
+//Same recurrence as DTW restricted to a band of columns in each row. Cells are
+//computed one anti-diagonal at a time, so each cell only depends on the two 
+//previous anti-diagonals and the interior of each one is vectorized
+template < class ColT, class RowT, typename Func >
+class BandedDTW {
+    public:
+
+    BandedDTW(const std::vector<ColT> &col_vals,   
+              const std::vector<RowT> &row_vals,
+              const DTWParams &p,
+              const DTWBand &band,
+              const Func &fn) : 
+        PRMS(p),
+        BAND(band),
+        fn_(fn),
+        rvals_(row_vals),
+        cvals_(col_vals),
+        nrows_(row_vals.size()),
+        ncols_(col_vals.size()),
+        ndiags_(nrows_ + ncols_ - 1) {
+
+        init_band();
+        compute();
+        if (BAND.trace != DTWTrace::NONE) traceback();
+    }
+
+    std::vector< std::pair<u64, u64> > get_path() {
+        return path_;
+    }
+
+    float score() {
+        return score_sum_;
+    }
+
+    float mean_score() {
+        return score_sum_ / path_len_;
+    }
+
+    u64 path_length() {
+        return path_len_;
+    }
+
+    u64 band_cells() {
+        return band_cells_;
+    }
+
+    void print_path(std::ostream &out) {
+        for (auto p = path_.rbegin(); p != path_.rend(); p++) {
+            out << p->first << "\t"
+                << p->second << "\t"
+                << rvals_[p->second] << "\t"
+                << cvals_[p->first] << "\t"
+                << fn_(rvals_[p->second], cvals_[p->first]) << "\t"
+                << "\n";
+        }
+    } 
+
+    private:
+    enum Move {D, H, V};
+    static constexpr float MAX_COST = FLT_MAX / 2.0;
+
+    const DTWParams PRMS;
+    const DTWBand BAND;
+    const Func &fn_;
+
+    const std::vector<RowT> &rvals_;
+    const std::vector<ColT> &cvals_;
+    const u64 nrows_, ncols_, ndiags_;
+
+    //Row range of each anti-diagonal within the band
+    std::vector<u32> diag_st_, diag_en_;
+    u64 band_cells_, block_diags_;
+
+    //Scores and path lengths of the last three anti-diagonals, indexed by row+1
+    AlignedVec<float> prev2_, prev1_, curr_, lprev2_, lprev1_, lcurr_, cost_;
+
+    //Cells in the last column and last row, for subsequence ends
+    std::vector<float> col_end_, col_end_len_, row_end_, row_end_len_;
+
+    std::vector<float> checkpoints_;
+    std::vector<u64> checkpoint_offs_, bcrumb_offs_;
+    std::vector<u8> bcrumbs_;
+    u64 bcrumb_block_;
+
+    std::vector< std::pair<u64, u64> > path_;
+    u64 end_row_, end_col_, path_len_;
+    float score_sum_;
+
+    static bool use_avx2() {
+        #ifdef DTW_X86_SIMD
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+        #else
+        return false;
+        #endif
+    }
+
+    void init_band() {
+        std::vector<i64> lo(nrows_, 0), hi(nrows_, ncols_-1);
+
+        if (BAND.width > 0) {
+            float slope = BAND.slope;
+            if (slope < 0) slope = nrows_ > 1 ? float(ncols_-1) / (nrows_-1) : 0;
+
+            i64 cmax = ncols_-1;
+            for (u64 i = 0; i < nrows_; i++) {
+                float c = BAND.offset + slope * i;
+                lo[i] = std::min(std::max(i64(floor(c)) - BAND.width, i64(0)), cmax);
+                hi[i] = std::min(std::max(i64(ceil(c)) + BAND.width, i64(0)), cmax);
+            }
+
+            //Band must contain both corners and overlap between adjacent rows
+            lo[0] = 0;
+            hi[nrows_-1] = cmax;
+            for (i64 i = nrows_-2; i >= 0; i--) {
+                hi[i] = std::max(hi[i], lo[i+1]);
+            }
+        }
+
+        diag_st_.resize(ndiags_);
+        diag_en_.resize(ndiags_);
+        band_cells_ = 0;
+
+        i64 st = 0, en = 0;
+        for (i64 d = 0; d < i64(ndiags_); d++) {
+            while (st < i64(nrows_) && d - st > hi[st]) st++;
+            while (en < i64(nrows_) && en <= d && d - en >= lo[en]) en++;
+            diag_st_[d] = st;
+            diag_en_[d] = std::max(st, en);
+            band_cells_ += diag_en_[d] - diag_st_[d];
+        }
+    }
+
+    void compute() {
+        prev2_.assign(nrows_+2, float(MAX_COST));
+        prev1_.assign(nrows_+2, float(MAX_COST));
+        curr_.assign(nrows_+2, float(MAX_COST));
+        lprev2_.assign(nrows_+2, 0);
+        lprev1_.assign(nrows_+2, 0);
+        lcurr_.assign(nrows_+2, 0);
+        cost_.resize(nrows_);
+
+        col_end_.assign(nrows_, float(MAX_COST));
+        col_end_len_.assign(nrows_, 0);
+        row_end_.assign(ncols_, float(MAX_COST));
+        row_end_len_.assign(ncols_, 0);
+
+        u8 *bc = NULL;
+        switch (BAND.trace) {
+            case DTWTrace::FULL:
+                block_diags_ = ndiags_;
+                bcrumb_block_ = 0;
+                init_bcrumbs(0);
+                bc = bcrumbs_.data();
+                break;
+            case DTWTrace::CHECKPOINT:
+                block_diags_ = std::max(u64(ceil(sqrt(ndiags_))), u64(1));
+                checkpoint_offs_.clear();
+                checkpoints_.clear();
+                break;
+            default:
+                block_diags_ = ndiags_;
+                break;
+        }
+
+        for (u64 d = 0; d < ndiags_; d++) {
+            if (BAND.trace == DTWTrace::CHECKPOINT && d % block_diags_ == 0) {
+                save_checkpoint(d);
+            }
+            compute_diag(d, bc == NULL ? NULL : bc + bcrumb_offs_[d]);
+            rotate();
+        }
+
+        end_row_ = nrows_-1;
+        end_col_ = ncols_-1;
+
+        switch (PRMS.subseq) {
+            case DTWSubSeq::ROW:
+                for (u64 k = 0; k < nrows_; k++) {
+                    if (col_end_[k] < col_end_[end_row_]) end_row_ = k;
+                }
+                score_sum_ = col_end_[end_row_];
+                path_len_ = col_end_len_[end_row_];
+                break;
+            case DTWSubSeq::COL:
+                for (u64 k = 0; k < ncols_; k++) {
+                    if (row_end_[k] < row_end_[end_col_]) end_col_ = k;
+                }
+                score_sum_ = row_end_[end_col_];
+                path_len_ = row_end_len_[end_col_];
+                break;
+            default:
+                score_sum_ = col_end_[end_row_];
+                path_len_ = col_end_len_[end_row_];
+                break;
+        }
+    }
+
+    void traceback() {
+        u64 i = end_row_, j = end_col_;
+        path_.clear();
+        path_.push_back(std::pair<u64, u64>(j, i));
+
+        while(!(i == 0 || PRMS.subseq == DTWSubSeq::ROW) ||
+              !(j == 0 || PRMS.subseq == DTWSubSeq::COL)) {
+
+            u8 move = (i > 0 && j > 0) ? get_bcrumb(i, j) : Move::D;
+
+            if (i == 0 || move == Move::H) {
+                j--;
+            } else if (j == 0 || move == Move::V) {
+                i--;
+            } else {
+                i--;
+                j--;
+            }
+
+            path_.push_back(std::pair<u64, u64>(j, i));
+        }
+    }
+
+    void init_bcrumbs(u64 block) {
+        u64 st = block * block_diags_, 
+            en = std::min(st + block_diags_, ndiags_);
+        bcrumb_offs_.resize(block_diags_ + 1);
+        bcrumb_offs_[0] = 0;
+        for (u64 d = st; d < en; d++) {
+            bcrumb_offs_[d-st+1] = bcrumb_offs_[d-st] + diag_en_[d] - diag_st_[d];
+        }
+        bcrumbs_.resize(bcrumb_offs_[en-st]);
+    }
+
+    //Recomputes the block of anti-diagonals containing the cell if needed
+    u8 get_bcrumb(u64 i, u64 j) {
+        u64 d = i + j, block = d / block_diags_;
+
+        if (BAND.trace == DTWTrace::CHECKPOINT && block != bcrumb_block_) {
+            bcrumb_block_ = block;
+            init_bcrumbs(block);
+            load_checkpoint(block);
+
+            u64 st = block * block_diags_,
+                en = std::min(st + block_diags_, ndiags_);
+            for (u64 e = st; e < en; e++) {
+                compute_diag(e, bcrumbs_.data() + bcrumb_offs_[e-st]);
+                rotate();
+            }
+        }
+
+        return bcrumbs_[bcrumb_offs_[d - bcrumb_block_*block_diags_] + i - diag_st_[d]];
+    }
+
+    //Saves the previous two anti-diagonals over the rows read by diagonal d
+    void save_checkpoint(u64 d) {
+        u64 st = diag_st_[d], en = diag_en_[d]+1;
+        checkpoint_offs_.push_back(checkpoints_.size());
+        checkpoints_.insert(checkpoints_.end(), &prev2_[st], &prev2_[en]);
+        checkpoints_.insert(checkpoints_.end(), &lprev2_[st], &lprev2_[en]);
+        checkpoints_.insert(checkpoints_.end(), &prev1_[st], &prev1_[en+1]);
+        checkpoints_.insert(checkpoints_.end(), &lprev1_[st], &lprev1_[en+1]);
+        bcrumb_block_ = ndiags_;
+    }
+
+    void load_checkpoint(u64 block) {
+        u64 d = block * block_diags_,
+            st = diag_st_[d], n = diag_en_[d]+1 - st;
+        const float *c = &checkpoints_[checkpoint_offs_[block]];
+        std::copy(c, c+n, &prev2_[st]);         c += n;
+        std::copy(c, c+n, &lprev2_[st]);        c += n;
+        std::copy(c, c+n+1, &prev1_[st]);       c += n+1;
+        std::copy(c, c+n+1, &lprev1_[st]);
+    }
+
+    void rotate() {
+        std::swap(prev2_, prev1_);
+        std::swap(prev1_, curr_);
+        std::swap(lprev2_, lprev1_);
+        std::swap(lprev1_, lcurr_);
+    }
+
+    void compute_diag(u64 d, u8 *bc) {
+        u64 st = diag_st_[d], en = diag_en_[d];
+        if (st >= en) return;
+
+        for (u64 i = st; i < en; i++) {
+            cost_[i] = fn_(rvals_[i], cvals_[d-i]);
+        }
+
+        //Cells in the first row or column depend on the subsequence mode
+        u64 ist = st, ien = en;
+        if (ist == 0) {
+            boundary_cell(d, 0, bc);
+            ist = 1;
+        }
+        if (ien-1 == d && ien > ist) {
+            boundary_cell(d, d, bc == NULL ? NULL : bc + d - st);
+            ien--;
+        }
+
+        if (ist < ien) {
+            u64 i = ist;
+            #ifdef DTW_X86_SIMD
+            if (use_avx2()) i = interior_avx2(ist, ien, st, bc);
+            #endif
+            interior_scalar(i, ien, st, bc);
+        }
+
+        //Rows adjacent to the band are read by the next two anti-diagonals
+        curr_[st] = MAX_COST;
+        curr_[en+1] = MAX_COST;
+
+        if (d >= ncols_-1 && d-(ncols_-1) >= st && d-(ncols_-1) < en) {
+            u64 i = d-(ncols_-1);
+            col_end_[i] = curr_[i+1];
+            col_end_len_[i] = lcurr_[i+1];
+        }
+
+        if (en == nrows_ && d >= nrows_-1) {
+            row_end_[d-(nrows_-1)] = curr_[nrows_];
+            row_end_len_[d-(nrows_-1)] = lcurr_[nrows_];
+        }
+    }
+
+    void boundary_cell(u64 d, u64 i, u8 *bc) {
+        u64 j = d - i;
+        bool row = PRMS.subseq == DTWSubSeq::ROW,
+             col = PRMS.subseq == DTWSubSeq::COL;
+
+        float dv = ((i == 0 && j == 0) || (i == 0 && col) || (j == 0 && row)) ? 0 : MAX_COST,
+              hv = j > 0 ? prev1_[i+1] : (row ? 0 : MAX_COST),
+              vv = i > 0 ? prev1_[i] : (col ? 0 : MAX_COST);
+
+        float cost = cost_[i],
+              ds = dv + (PRMS.dw * cost),
+              hs = hv + (PRMS.hw * cost),
+              vs = vv + (PRMS.vw * cost);
+
+        u8 move;
+        if (ds <= hs && ds <= vs) {
+            curr_[i+1] = ds;
+            move = Move::D;
+        } else if (hs <= vs) {
+            curr_[i+1] = hs;
+            move = Move::H;
+        } else {
+            curr_[i+1] = vs;
+            move = Move::V;
+        }
+        if (bc != NULL) *bc = move;
+
+        //Path lengths follow the traceback, which ends at the subsequence
+        //start and is forced along the first row or column
+        if ((row && j == 0) || (col && i == 0) || (i == 0 && j == 0)) {
+            lcurr_[i+1] = 1;
+        } else if (i == 0) {
+            lcurr_[i+1] = lprev1_[i+1] + 1;
+        } else {
+            lcurr_[i+1] = lprev1_[i] + 1;
+        }
+    }
+
+    void interior_scalar(u64 i, u64 en, u64 st, u8 *bc) {
+        for (; i < en; i++) {
+            float cost = cost_[i],
+                  ds = prev2_[i] + (PRMS.dw * cost),
+                  hs = prev1_[i+1] + (PRMS.hw * cost),
+                  vs = prev1_[i] + (PRMS.vw * cost);
+
+            u8 move;
+            if (ds <= hs && ds <= vs) {
+                curr_[i+1] = ds;
+                lcurr_[i+1] = lprev2_[i] + 1;
+                move = Move::D;
+            } else if (hs <= vs) {
+                curr_[i+1] = hs;
+                lcurr_[i+1] = lprev1_[i+1] + 1;
+                move = Move::H;
+            } else {
+                curr_[i+1] = vs;
+                lcurr_[i+1] = lprev1_[i] + 1;
+                move = Move::V;
+            }
+            if (bc != NULL) bc[i-st] = move;
+        }
+    }
+
+    #ifdef DTW_X86_SIMD
+    //No FMA, so scores match the scalar recurrence exactly
+    __attribute__((target("avx2")))
+    u64 interior_avx2(u64 i, u64 en, u64 st, u8 *bc) {
+        const __m256 dw = _mm256_set1_ps(PRMS.dw),
+                     hw = _mm256_set1_ps(PRMS.hw),
+                     vw = _mm256_set1_ps(PRMS.vw),
+                     one = _mm256_set1_ps(1);
+
+        for (; i + 8 <= en; i += 8) {
+            __m256 c = _mm256_loadu_ps(&cost_[i]),
+                   ds = _mm256_add_ps(_mm256_loadu_ps(&prev2_[i]), _mm256_mul_ps(dw, c)),
+                   hs = _mm256_add_ps(_mm256_loadu_ps(&prev1_[i+1]), _mm256_mul_ps(hw, c)),
+                   vs = _mm256_add_ps(_mm256_loadu_ps(&prev1_[i]), _mm256_mul_ps(vw, c));
+
+            __m256 dm = _mm256_and_ps(_mm256_cmp_ps(ds, hs, _CMP_LE_OQ), 
+                                      _mm256_cmp_ps(ds, vs, _CMP_LE_OQ)),
+                   hm = _mm256_cmp_ps(hs, vs, _CMP_LE_OQ);
+
+            _mm256_storeu_ps(&curr_[i+1], 
+                _mm256_blendv_ps(_mm256_blendv_ps(vs, hs, hm), ds, dm));
+
+            __m256 len = _mm256_blendv_ps(
+                _mm256_blendv_ps(_mm256_loadu_ps(&lprev1_[i]), 
+                                 _mm256_loadu_ps(&lprev1_[i+1]), hm),
+                _mm256_loadu_ps(&lprev2_[i]), dm);
+            _mm256_storeu_ps(&lcurr_[i+1], _mm256_add_ps(len, one));
+
+            if (bc != NULL) {
+                u32 dbits = _mm256_movemask_ps(dm), 
+                    hbits = _mm256_movemask_ps(hm);
+                for (u32 l = 0; l < 8; l++) {
+                    bc[i-st+l] = ((dbits >> l) & 1) ? Move::D : 
+                                 (((hbits >> l) & 1) ? Move::H : Move::V);
+                }
+            }
+        }
+        return i;
+    }
+    #endif
+};
+
 float dtwcost_r94p(u16 k, float e) {
     return -pmodel_r94_template.match_prob(e,k);
 }
@@ -209,6 +657,30 @@ class DTWr94p : public DTW<float, u16, decltype(dtwcost_r94p)> {
     
 };
 
+class BandedDTWr94p : public BandedDTW<float, u16, decltype(dtwcost_r94p)> {
+    public:
+    BandedDTWr94p(const std::vector<float> &means,
+              const std::vector<u16> &kmers,
+              const DTWParams &prms,
+              const DTWBand &band) 
+        : BandedDTW(means, kmers, prms, band, dtwcost_r94p) {}
+
+    #ifdef PYBIND
+    #define PY_BANDED_DTWR94P_METH(P) c.def(#P, &BandedDTWr94p::P);
+    static void pybind_defs(pybind11::class_<BandedDTWr94p> &c) {
+        c.def(pybind11::init<const std::vector<float>&, 
+                             const std::vector<u16>&,
+                             const DTWParams&,
+                             const DTWBand&>());
+        PY_BANDED_DTWR94P_METH(get_path)
+        PY_BANDED_DTWR94P_METH(score)
+        PY_BANDED_DTWR94P_METH(mean_score)
+        PY_BANDED_DTWR94P_METH(path_length)
+        PY_BANDED_DTWR94P_METH(band_cells)
+    }
+    #endif
+};
+
 float dtwcost_r94d(u16 k, float e) {
     return abs(e-pmodel_r94_template.get_mean(k));
 }
@@ -232,4 +704,28 @@ class DTWr94d : public DTW<float, u16, decltype(dtwcost_r94d)> {
     #endif
 };
 
+class BandedDTWr94d : public BandedDTW<float, u16, decltype(dtwcost_r94d)> {
+    public:
+    BandedDTWr94d(const std::vector<float> &means,
+              const std::vector<u16> &kmers,
+              const DTWParams &prms,
+              const DTWBand &band) 
+        : BandedDTW(means, kmers, prms, band, dtwcost_r94d) {}
+
+    #ifdef PYBIND
+    #define PY_BANDED_DTWR94D_METH(P) c.def(#P, &BandedDTWr94d::P);
+    static void pybind_defs(pybind11::class_<BandedDTWr94d> &c) {
+        c.def(pybind11::init<const std::vector<float>&, 
+                             const std::vector<u16>&,
+                             const DTWParams&,
+                             const DTWBand&>());
+        PY_BANDED_DTWR94D_METH(get_path)
+        PY_BANDED_DTWR94D_METH(score)
+        PY_BANDED_DTWR94D_METH(mean_score)
+        PY_BANDED_DTWR94D_METH(path_length)
+        PY_BANDED_DTWR94D_METH(band_cells)
+    }
+    #endif
+};
+
 #endif
@@ -59,6 +59,26 @@ std::unordered_map<std::string, Query>
 
 const KmerLen KLEN = KmerLen::k5;
 
+//Reads too long for the full matrix are aligned in a band around the diagonal
+const u32 MAX_FULL_DTW = 50000;
+const DTWBand LONG_READ_BAND = {500, -1, 0, DTWTrace::CHECKPOINT};
+
+template <class DTWType>
+void write_dtw(DTWType &dtw, const std::string &read_id, 
+               const std::string &out_prefix, Timer &t) {
+    if (!out_prefix.empty()) {
+        std::string path_fname = out_prefix+read_id+".txt";
+        std::ofstream out(path_fname);
+        dtw.print_path(out);
+        out.close();
+    }
+
+    std::cout << read_id << "\t"
+              << dtw.mean_score() << "\t"
+              << (t.lap()/1000) << "\n";
+    std::cout.flush();
+}
+
 int main(int argc, char** argv) {
     Timer t;
 
@@ -152,27 +172,13 @@ int main(int argc, char** argv) {
         signal.reserve(norm.unread_size());
         while (!norm.empty()) signal.push_back(norm.pop());
 
-        //Takes up too much space :(
-        if (signal.size() > 50000) {
-            std::cerr << "Skipping " << read.get_id() << "\n";
-            continue;
-        }
-
-
-        DTWr94d dtw(signal, kmers, dtwp);
-
-        if (!out_prefix.empty()) {
-            std::string path_fname = out_prefix+read.get_id()+".txt";
-            std::ofstream out(path_fname);
-            dtw.print_path(out);
-            out.close();
+        if (signal.size() > MAX_FULL_DTW) {
+            BandedDTWr94d dtw(signal, kmers, dtwp, LONG_READ_BAND);
+            write_dtw(dtw, read.get_id(), out_prefix, t);
+        } else {
+            DTWr94d dtw(signal, kmers, dtwp);
+            write_dtw(dtw, read.get_id(), out_prefix, t);
         }
-
-        std::cout << read.get_id() << "\t"
-                  << dtw.mean_score() << "\t"
-                  << (t.lap()/1000) << "\n";
-        std::cout.flush();
-
     }
 
     return 0;
@@ -12,6 +12,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
 #include "event_detector.hpp"
 
 const EventDetector::Params EventDetector::PRMS_DEF = {
@@ -111,16 +112,136 @@ bool EventDetector::add_sample(float s) {
     return false;
 }
 
+//T-statistic between the windows (st, i] and (i, en] given prefix sums
+//Branch-free so add_block can vectorize it
+static inline float tstat(double sum_st, double sum_i, double sum_en,
+                          double sumsq_st, double sumsq_i, double sumsq_en,
+                          float w_lengthf) {
+    const float eta = FLT_MIN;
+
+    double sum1 = sum_i - sum_st;
+    double sumsq1 = sumsq_i - sumsq_st;
+    float sum2 = (float)(sum_en - sum_i);
+    float sumsq2 = (float)(sumsq_en - sumsq_i);
+    float mean1 = sum1 / w_lengthf;
+    float mean2 = sum2 / w_lengthf;
+    float combined_var = sumsq1 / w_lengthf - mean1 * mean1
+        + sumsq2 / w_lengthf - mean2 * mean2;
+
+    // Prevent problem due to very small variances
+    // (same as fmaxf for eta > 0, including NaN)
+    combined_var = combined_var > eta ? combined_var : eta;
+
+    //t-stat
+    //  Formula is a simplified version of Student's t-statistic for the
+    //  special case where there are two samples of equal size with
+    //  differing variance
+    const float delta_mean = mean2 - mean1;
+    return fabs(delta_mean) / sqrt(combined_var / w_lengthf);
+}
+
+//Samples per add_samples block, keeps block buffers cache resident
+static const u32 BLOCK_LEN = 4096;
+
+//Same as calling add_sample on each sample, appending detected events
+//Returns the number of events added
+u32 EventDetector::add_samples(const float *raw, u32 n, 
+                               std::vector<Event> &events) {
+    u32 n0 = events.size(), i = 0;
+
+    //Use add_sample until the ring buffer holds a full window
+    for (; i < n && t <= BUF_LEN; i++) {
+        if (add_sample(raw[i])) events.push_back(event_);
+    }
+
+    for (; i < n; i += BLOCK_LEN) {
+        add_block(&raw[i], std::min(BLOCK_LEN, n - i), events);
+    }
+
+    return events.size() - n0;
+}
+
+//Computes prefix sums sequentially, then both t-stats over the whole block
+//in one branch-free loop the compiler can vectorize. Peak detection runs
+//over the t-stat arrays afterwards. Requires t > BUF_LEN
+void EventDetector::add_block(const float *raw, u32 n, 
+                              std::vector<Event> &events) {
+    const u32 HIST = BUF_LEN - 1,
+              w1 = PRMS.window_length1,
+              w2 = PRMS.window_length2;
+
+    //Block index k holds prefix at sample base+k
+    u32 last = t - 1, base = last - HIST;
+
+    blk_sum_.resize(HIST + n + 1);
+    blk_sumsq_.resize(HIST + n + 1);
+    blk_tstat1_.resize(n);
+    blk_tstat2_.resize(n);
+
+    double *bsum = blk_sum_.data(), *bsumsq = blk_sumsq_.data();
+
+    for (u32 k = 0; k <= HIST; k++) {
+        bsum[k] = sum[(base + k) % BUF_LEN];
+        bsumsq[k] = sumsq[(base + k) % BUF_LEN];
+    }
+
+    for (u32 j = 0; j < n; j++) {
+        float s = raw[j];
+        bsum[HIST+j+1] = bsum[HIST+j] + s;
+        bsumsq[HIST+j+1] = bsumsq[HIST+j] + s*s;
+    }
+
+    //Sample j has its window center at block index j+1+w2
+    float *ts1 = blk_tstat1_.data(), *ts2 = blk_tstat2_.data();
+    const float wf1 = (float) w1, wf2 = (float) w2;
+    const u32 mid = w2 + 1;
+    const double *s_mid = &bsum[mid], *q_mid = &bsumsq[mid],
+                 *s_st1 = &bsum[mid-w1], *q_st1 = &bsumsq[mid-w1],
+                 *s_en1 = &bsum[mid+w1], *q_en1 = &bsumsq[mid+w1],
+                 *s_st2 = &bsum[mid-w2], *q_st2 = &bsumsq[mid-w2],
+                 *s_en2 = &bsum[mid+w2], *q_en2 = &bsumsq[mid+w2];
+
+    for (u32 j = 0; j < n; j++) {
+        ts1[j] = tstat(s_st1[j], s_mid[j], s_en1[j], 
+                       q_st1[j], q_mid[j], q_en1[j], wf1);
+        ts2[j] = tstat(s_st2[j], s_mid[j], s_en2[j], 
+                       q_st2[j], q_mid[j], q_en2[j], wf2);
+    }
+
+    if (w1 < 2) std::fill(ts1, ts1 + n, 0);
+    if (w2 < 2) std::fill(ts2, ts2 + n, 0);
+
+    for (u32 j = 0; j < n; j++) {
+        t++;
+        buf_mid = get_buf_mid();
+
+        bool p1 = peak_detect(ts1[j], short_detector),
+             p2 = peak_detect(ts2[j], long_detector);
+
+        if (p1 || p2) {
+            u32 evt_en = buf_mid - w1 + 1;
+            create_event(evt_en, bsum[evt_en - base], bsumsq[evt_en - base]);
+
+            if (event_.mean >= PRMS.min_mean && event_.mean <= PRMS.max_mean) {
+                events.push_back(event_);
+            }
+        }
+    }
+
+    //Store the last BUF_LEN prefix sums back in the ring buffer
+    last = t - 1;
+    for (u32 k = last - HIST; k <= last; k++) {
+        sum[k % BUF_LEN] = bsum[k - base];
+        sumsq[k % BUF_LEN] = bsumsq[k - base];
+    }
+}
+
 std::vector<Event> EventDetector::get_events(const std::vector<float> &raw) {
     std::vector<Event> events;
     events.reserve(raw.size() / PRMS.window_length2);
     reset();
 
-    for (u32 i = 0; i < raw.size(); i++) {
-        if (add_sample(raw[i])) {
-            events.push_back(event_);
-        }
-    }
+    add_samples(raw.data(), raw.size(), events);
 
     return events;
 }
@@ -131,17 +252,14 @@ Event EventDetector::get_event() const {
 
 //TODO: template with float, double, Event?
 std::vector<float> EventDetector::get_means(const std::vector<float> &raw) {
-    std::vector<float> events;
-    events.reserve(raw.size() / PRMS.window_length2);
-    reset();
+    std::vector<Event> events = get_events(raw);
 
-    for (u32 i = 0; i < raw.size(); i++) {
-        if (add_sample(raw[i])) {
-            events.push_back(event_.mean);
-        }
+    std::vector<float> means(events.size());
+    for (u32 i = 0; i < events.size(); i++) {
+        means[i] = events[i].mean;
     }
 
-    return events;
+    return means;
 }
 
 float EventDetector::get_mean() const {
@@ -176,7 +294,6 @@ float EventDetector::compute_tstat(u32 w_length) {
 
     //float *tstat = (float *) calloc(d_length, sizeof(float));
 
-    const float eta = FLT_MIN;
     const float w_lengthf = (float) w_length;
 
     // Quick return:
@@ -198,24 +315,8 @@ float EventDetector::compute_tstat(u32 w_length) {
 
     //std::cout << i << " " << st << " " << en << "\n";
 
-    double sum1 = sum[i] - sum[st];
-    double sumsq1 = sumsq[i] - sumsq[st];
-    float sum2 = (float)(sum[en] - sum[i]);
-    float sumsq2 = (float)(sumsq[en] - sumsq[i]);
-    float mean1 = sum1 / w_lengthf;
-    float mean2 = sum2 / w_lengthf;
-    float combined_var = sumsq1 / w_lengthf - mean1 * mean1
-        + sumsq2 / w_lengthf - mean2 * mean2;
-
-    // Prevent problem due to very small variances
-    combined_var = fmaxf(combined_var, eta);
-
-    //t-stat
-    //  Formula is a simplified version of Student's t-statistic for the
-    //  special case where there are two samples of equal size with
-    //  differing variance
-    const float delta_mean = mean2 - mean1;
-    return fabs(delta_mean) / sqrt(combined_var / w_lengthf);
+    return tstat(sum[st], sum[i], sum[en], 
+                 sumsq[st], sumsq[i], sumsq[en], w_lengthf);
 }
 
 bool EventDetector::peak_detect(float current_value, Detector &detector) {
@@ -294,14 +395,17 @@ bool EventDetector::peak_detect(float current_value, Detector &detector) {
  *  @returns An initialised event.  A 'null' event is returned on error.
  **/
 Event EventDetector::create_event(u32 evt_en) {
-    //Event event = { 0 };
-
     u32 evt_en_buf = evt_en % BUF_LEN;
+    return create_event(evt_en, sum[evt_en_buf], sumsq[evt_en_buf]);
+}
+
+Event EventDetector::create_event(u32 evt_en, double sum_en, double sumsq_en) {
+    //Event event = { 0 };
 
     event_.start = evt_st;
     event_.length = (float)(evt_en - evt_st);
-    event_.mean = (sum[evt_en_buf] - evt_st_sum) / event_.length;
-    const float deltasqr = (sumsq[evt_en_buf] - evt_st_sumsq);
+    event_.mean = (sum_en - evt_st_sum) / event_.length;
+    const float deltasqr = (sumsq_en - evt_st_sumsq);
     const float var = deltasqr / event_.length - event_.mean * event_.mean;
     event_.stdv = sqrtf(fmaxf(var, 0.0f));
 
@@ -309,8 +413,8 @@ Event EventDetector::create_event(u32 evt_en) {
     event_.stdv = calibrate(event_.stdv);
 
     evt_st = evt_en;
-    evt_st_sum = sum[evt_en_buf];
-    evt_st_sumsq = sumsq[evt_en_buf];
+    evt_st_sum = sum_en;
+    evt_st_sumsq = sumsq_en;
 
     len_sum_ += event_.length;
     total_events_++;
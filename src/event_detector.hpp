@@ -46,6 +46,7 @@ class EventDetector {
     
     void reset();
     bool add_sample(float s);
+    u32 add_samples(const float *raw, u32 n, std::vector<Event> &events);
     Event get_event() const;
     std::vector<Event> get_events(const std::vector<float> &raw);
 
@@ -111,6 +112,8 @@ class EventDetector {
     float compute_tstat(u32 w_length); 
     bool peak_detect(float current_value, Detector &detector);
     Event create_event(u32 evt_en); 
+    Event create_event(u32 evt_en, double sum_en, double sumsq_en); 
+    void add_block(const float *raw, u32 n, std::vector<Event> &events);
     float calibrate(float v);
 
     const u32 BUF_LEN;
@@ -126,6 +129,10 @@ class EventDetector {
     u32 total_events_;
 
     Detector short_detector, long_detector;
+
+    //add_samples blocks: linear prefix sums and t-stats
+    std::vector<double> blk_sum_, blk_sumsq_;
+    std::vector<float> blk_tstat1_, blk_tstat2_;
 };
 
 
@@ -29,24 +29,23 @@ const Fast5Reader::Params Fast5Reader::PRMS_DEF = {
     fast5_list : "",
     read_list  : "",
     max_reads  : 0,
-    max_buffer : 100
-};
-
-const std::string Fast5Reader::FMT_RAW_PATHS[] = {
-    "/Raw",      //MULTI
-    "/Raw/Reads" //SINGLE
-};
-
-const std::string Fast5Reader::FMT_CH_PATHS[] = {
-    "/channel_id",                //MULTI
-    "/UniqueGlobalKey/channel_id" //SINGLE
+    max_buffer : 100,
+    io_threads : 2
 };
 
 Fast5Reader::Fast5Reader() : 
     Fast5Reader(PRMS_DEF) {}
 
-Fast5Reader::Fast5Reader(const Params &p) : PRMS(p) {
-    total_buffered_ = 0;
+Fast5Reader::Fast5Reader(const Params &p) 
+    : PRMS(p),
+      total_buffered_(0),
+      checkpoint_(NULL),
+      resumed_reads_(0),
+      resumed_included_(0),
+      open_file_id_(0),
+      read_queue_(p.max_buffer),
+      io_active_(0),
+      io_stop_(false) {
 
     if (!PRMS.read_list.empty()) load_read_list(PRMS.read_list);
     if (!PRMS.fast5_list.empty()) load_fast5_list(PRMS.fast5_list);
@@ -58,9 +57,17 @@ Fast5Reader::Fast5Reader(const std::string &fast5_list,
     : PRMS({fast5_list, 
             read_list, 
             max_reads, 
-            max_buffer}) {
+            max_buffer,
+            PRMS_DEF.io_threads}),
+      total_buffered_(0),
+      checkpoint_(NULL),
+      resumed_reads_(0),
+      resumed_included_(0),
+      open_file_id_(0),
+      read_queue_(max_buffer),
+      io_active_(0),
+      io_stop_(false) {
 
-    total_buffered_ = 0;
     if (!PRMS.fast5_list.empty()) load_fast5_list(PRMS.fast5_list);
     if (!PRMS.read_list.empty()) load_read_list(PRMS.read_list);
 }
@@ -68,7 +75,12 @@ Fast5Reader::Fast5Reader(const std::string &fast5_list,
 Fast5Reader::Fast5Reader(u32 max_reads, u32 max_buffer) 
     : Fast5Reader("","",max_reads,max_buffer) {}
 
+Fast5Reader::~Fast5Reader() {
+    stop_io();
+}
+
 void Fast5Reader::add_fast5(const std::string &fast5_path) {
+    std::lock_guard<std::mutex> lock(list_mtx_);
     fast5_list_.push_back(fast5_path);
 }
 
@@ -90,10 +102,10 @@ bool Fast5Reader::load_fast5_list(const std::string &fname) {
 }
 
 bool Fast5Reader::add_read(const std::string &read_id) {
-    if (PRMS.max_reads != 0 && read_filter_.size() >= PRMS.max_reads)
+    if (PRMS.max_reads != 0 && read_filter_.include.size() >= PRMS.max_reads)
         return false;
 
-    read_filter_.insert(read_id);
+    read_filter_.include.insert(read_id);
 
     return true;
 }
@@ -117,67 +129,59 @@ bool Fast5Reader::load_read_list(const std::string &fname) {
 }
 
 bool Fast5Reader::empty() {
-    return buffered_reads_.empty() && 
-           read_paths_.empty() && 
-           (fast5_list_.empty() || all_buffered());
+    if (buffered_reads_.empty()) fill_buffer();
+    return buffered_reads_.empty();
 }
 
-bool Fast5Reader::open_next() {
+bool Fast5Reader::next_fast5(std::string &fname) {
+    {
+        std::lock_guard<std::mutex> lock(list_mtx_);
+        if (!fast5_list_.empty()) {
+            fname = fast5_list_.front();
+            fast5_list_.pop_front();
+            return true;
+        }
+    }
 
-    read_paths_.clear();
-    if (open_fast5_.is_open()) open_fast5_.close();
-    if (fast5_list_.empty()) return false;
+    return file_source_ && file_source_(fname);
+}
 
-    open_fast5_.open(fast5_list_.front());
-    fast5_list_.pop_front();
+void Fast5Reader::set_file_source(FileSource source) {
+    file_source_ = source;
+}
 
-    open_fmt_ = Format::UNKNOWN;
-    for (const std::string &s : open_fast5_.list_group("/")) {
-        if (s == "Raw") {
-            open_fmt_ = Format::SINGLE;
-            break;
+bool Fast5Reader::open_next() {
+    open_file_.reset();
+
+    std::string fname;
+    while (next_fast5(fname)) {
+        if (checkpoint_ != NULL && checkpoint_->file_done(fname)) continue;
+
+        open_file_.reset(open_file(fname));
+        if (open_file_) {
+            if (checkpoint_ != NULL) 
+                open_file_id_ = checkpoint_->file_opened(fname);
+            return true;
         }
+
+        if (checkpoint_ != NULL) checkpoint_->file_failed(fname);
     }
-    if (open_fmt_ == Format::UNKNOWN) open_fmt_ = Format::MULTI; //TODO: add support for old multi format
-
-
-    std::string path;
-    switch (open_fmt_) {
-    case Format::SINGLE:
-        path = FMT_RAW_PATHS[Format::SINGLE];
-        for (const std::string &read : open_fast5_.list_group(path)) {
-            std::string read_id = "";
-            for (auto a : open_fast5_.get_attr_map(path+"/"+read)) {
-                if (a.first == "read_id") {
-                    read_id = a.second;
-                    break;
-                }
-            }
 
-            if (read_id.empty()) {
-                std::cerr << "Error: failed to find read_id\n";
-                return false;
-            }
-            
-            if (read_filter_.empty() || read_filter_.count(read_id) > 0) {
-                read_paths_.push_back("/"+read);
-            }
-        }
-        return true;
+    return false;
+}
 
-    case Format::MULTI:
-        for (const std::string &read : open_fast5_.list_group("/")) {
-            std::string id = read.substr(read.find('_')+1);
-            if (read_filter_.empty() || read_filter_.count(id) > 0) {
-                read_paths_.push_back("/"+read);
-            }
-        }
-        return true;
-    default:
-        return false;
+ReadFile *Fast5Reader::open_file(const std::string &fname) const {
+    ReadFile *file = ReadFile::create(fname);
+
+    if (file == NULL) {
+        std::cerr << "Error: unsupported read file \""
+                  << fname << "\"\n";
+    } else if (!file->open(fname, read_filter_)) {
+        delete file;
+        file = NULL;
     }
 
-    return false; 
+    return file;
 }
 
 u32 Fast5Reader::fill_buffer() {
@@ -187,38 +191,26 @@ u32 Fast5Reader::fill_buffer() {
     while (buffered_reads_.size() < PRMS.max_buffer) {
 
         if (all_buffered())  {
-            read_paths_.clear();
+            open_file_.reset();
             fast5_list_.clear();
             break;
         }
 
-        while (read_paths_.empty()) {
-            if(!open_next()) break;
-        }
-        if (read_paths_.empty()) break;
-
-        std::string raw_path, ch_path;
+        if (!open_file_ && !open_next()) break;
 
-        switch (open_fmt_) {
-            case Format::SINGLE:
-                raw_path = FMT_RAW_PATHS[open_fmt_] + read_paths_.front();
-                ch_path = FMT_CH_PATHS[open_fmt_];
-                break;
-            case Format::MULTI:
-                raw_path = read_paths_.front() + FMT_RAW_PATHS[open_fmt_],
-                ch_path =  read_paths_.front() + FMT_CH_PATHS[open_fmt_];
-                break;
-            default:
-                std::cerr << "Error: unrecognized fast5 format\n";
-                read_paths_.pop_front();
-                return count;
+        buffered_reads_.emplace_back();
+        if ((checkpoint_ != NULL && checkpoint_->file_cancelled(open_file_id_)) ||
+            !open_file_->next_read(buffered_reads_.back())) {
+            buffered_reads_.pop_back();
+            open_file_.reset();
+            if (checkpoint_ != NULL) checkpoint_->file_loaded(open_file_id_);
+            continue;
         }
 
-        //std::string raw_path = read_paths_.front() + FMT_RAW_PATHS[open_fmt_],
-        //            ch_path =  read_paths_.front() + FMT_CH_PATHS[open_fmt_];
-        read_paths_.pop_front();
-
-        buffered_reads_.emplace_back(open_fast5_, raw_path, ch_path);
+        if (checkpoint_ != NULL) {
+            checkpoint_->read_loaded(open_file_id_, 
+                                     buffered_reads_.back().get_id());
+        }
 
         count++;
         total_buffered_++;
@@ -227,17 +219,112 @@ u32 Fast5Reader::fill_buffer() {
     return count;
 }
 
+void Fast5Reader::start_io() {
+    if (!io_threads_.empty()) return;
+
+    u16 n = PRMS.io_threads > 0 ? PRMS.io_threads : 1;
+
+    read_queue_.reset();
+    read_queue_.set_capacity(PRMS.max_buffer);
+    io_stop_ = false;
+    io_active_ = n;
+
+    for (u16 i = 0; i < n; i++) {
+        io_threads_.emplace_back(&Fast5Reader::io_run, this);
+    }
+}
+
+void Fast5Reader::stop_io() {
+    if (io_threads_.empty()) return;
+
+    io_stop_ = true;
+    read_queue_.close();
+
+    for (auto &t : io_threads_) t.join();
+    io_threads_.clear();
+
+    read_queue_.clear();
+}
+
+bool Fast5Reader::pop_async(ReadBuffer &r, bool wait) {
+    if (io_stop_) return false;
+    return wait ? read_queue_.pop(r) : read_queue_.try_pop(r);
+}
+
+//Reserves one read towards max_reads/read_list
+bool Fast5Reader::claim_read() {
+    u32 n = total_buffered_.load();
+    do {
+        if (at_limit(n)) return false;
+    } while (!total_buffered_.compare_exchange_weak(n, n+1));
+    return true;
+}
+
+void Fast5Reader::io_run() {
+    std::string fname;
+
+    while (!io_stop_ && !all_buffered() && next_fast5(fname)) {
+        if (checkpoint_ != NULL && checkpoint_->file_done(fname)) continue;
+
+        std::unique_ptr<ReadFile> file(open_file(fname));
+        if (!file) {
+            if (checkpoint_ != NULL) checkpoint_->file_failed(fname);
+            continue;
+        }
+
+        u32 file_id = 0;
+        if (checkpoint_ != NULL) file_id = checkpoint_->file_opened(fname);
+
+        while (!io_stop_ && claim_read()) {
+            ReadBuffer r;
+            if ((checkpoint_ != NULL && checkpoint_->file_cancelled(file_id)) ||
+                !file->next_read(r)) {
+                total_buffered_--;
+                if (checkpoint_ != NULL) checkpoint_->file_loaded(file_id);
+                break;
+            }
+            if (checkpoint_ != NULL) {
+                checkpoint_->read_loaded(file_id, r.get_id());
+            }
+
+            //Only fails once stop_io closes the queue. The file is left 
+            //unfinished on purpose, so a resumed run reopens it and skips 
+            //the reads already written
+            if (!read_queue_.push(r)) break;
+        }
+    }
+
+    //Last thread out lets consumers drain and finish
+    if (--io_active_ == 0) read_queue_.close();
+}
+
+bool Fast5Reader::at_limit(u32 total) const {
+    return (PRMS.max_reads > 0 && total + resumed_reads_ >= PRMS.max_reads) ||
+           (!read_filter_.include.empty() && 
+            total + resumed_included_ >= read_filter_.include.size());
+}
+
+void Fast5Reader::set_checkpoint(ReadCheckpoint *checkpoint) {
+    checkpoint_ = checkpoint;
+    resumed_reads_ = resumed_included_ = 0;
+    if (checkpoint_ == NULL) return;
+
+    for (auto &id : checkpoint_->done_reads()) {
+        read_filter_.exclude.insert(id);
+        resumed_included_ += read_filter_.include.count(id);
+    }
+    resumed_reads_ = checkpoint_->done_reads().size();
+}
+
 bool Fast5Reader::all_buffered() {
-    return (PRMS.max_reads > 0 && total_buffered_ >= PRMS.max_reads) ||
-           (!read_filter_.empty() && total_buffered_ >= read_filter_.size());
+    return at_limit(total_buffered_);
 }
 
 ReadBuffer Fast5Reader::pop_read() {
-    if (buffer_size() == 0) { 
-        fill_buffer();
-    }
-    //TODO: swap to speed up?
-    ReadBuffer r = buffered_reads_.front();
+    ReadBuffer r;
+    if (empty()) return r;
+
+    r.swap(buffered_reads_.front());
     buffered_reads_.pop_front();
     return r;
 }
@@ -27,14 +27,23 @@
 #include <thread>
 #include <vector>
 #include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
 #include <unordered_set>
 #include "read_buffer.hpp"
+#include "read_file.hpp"
+#include "read_queue.hpp"
+#include "read_checkpoint.hpp"
 #include "util.hpp"
 
 #ifdef PYBIND
 #include <pybind11/pybind11.h>
 #endif
 
+//Loads reads from a list of fast5, slow5, blow5, or pod5 files
+//Each file is read through the ReadFile backend for its format
 class Fast5Reader {
     public:
 
@@ -42,21 +51,24 @@ class Fast5Reader {
         std::string fast5_list;
         std::string read_list;
         u32 max_reads, max_buffer;
+        u16 io_threads;
     } Params;
     static Params const PRMS_DEF;
 
     typedef struct {
-        const char *fast5_list, *read_list, *max_reads, *max_buffer;
+        const char *fast5_list, *read_list, *max_reads, *max_buffer, *io_threads;
     } Docstrs;
     static constexpr Docstrs DOCSTRS = {
         fast5_list : 
-            "File containing a list of paths to fast5 files, one per line.",
+            "File containing a list of paths to fast5, slow5, blow5, or pod5 files, one per line.",
         read_list : 
             "File containing a list of read IDs. Only these reads will be loaded if specified.",
         max_reads : 
             "Maximum number of reads to load.",
         max_buffer : 
-            "Maximum number of reads to store in memory."
+            "Maximum number of reads to store in memory.",
+        io_threads : 
+            "Number of threads used to load fast5 files in the background when mapping."
     };
 
 
@@ -70,6 +82,8 @@ class Fast5Reader {
                 const std::string &read_list="",
                 u32 max_reads=0, u32 max_buffer=100);
 
+    ~Fast5Reader();
+
     void add_fast5(const std::string &fast5_path);
 
     bool load_fast5_list(const std::string &fname);
@@ -88,6 +102,29 @@ class Fast5Reader {
  
     bool empty();
 
+    //Asynchronous mode: io_threads threads each open a different fast5
+    //and push decoded reads into a bounded queue, drained by pop_async
+    //Files must be added before start_io
+    void start_io();
+
+    void stop_io();
+
+    //Blocks until a read is available, unless wait is false
+    //Returns false once all reads have been loaded and popped, on stop_io,
+    //or if wait is false and no read is buffered
+    bool pop_async(ReadBuffer &r, bool wait=true);
+
+    //Skips files and reads finished in a previous run, and reports
+    //each file's reads as they load. Must be set before loading reads
+    void set_checkpoint(ReadCheckpoint *checkpoint);
+
+    //Fills fname with the next file to load, or returns false if none
+    //are left. May block, and is called from each I/O thread
+    typedef std::function<bool(std::string &)> FileSource;
+
+    //Pulls files from source once the added files are loaded
+    void set_file_source(FileSource source);
+
     #ifdef PYBIND
 
     #define PY_FAST5_METH(N) c.def(#N, &Fast5Reader::N);
@@ -112,12 +149,17 @@ class Fast5Reader {
         PY_FAST5_METH(fill_buffer);
         PY_FAST5_METH(all_buffered);
         PY_FAST5_METH(empty);
+        PY_FAST5_METH(start_io);
+        PY_FAST5_METH(stop_io);
+        c.def("set_checkpoint", &Fast5Reader::set_checkpoint, 
+              pybind11::keep_alive<1, 2>());
 
         pybind11::class_<Params> p(c, "Params");
         PY_FAST5_PRM(fast5_list);
         PY_FAST5_PRM(read_list);
         PY_FAST5_PRM(max_reads);
         PY_FAST5_PRM(max_buffer);
+        PY_FAST5_PRM(io_threads);
     }
 
     #endif
@@ -125,21 +167,41 @@ class Fast5Reader {
     private:
     Params PRMS;
 
-    enum Format {MULTI, SINGLE, UNKNOWN};
-    static const std::string FMT_RAW_PATHS[], FMT_CH_PATHS[];
-
     bool open_next();
 
-    u32 max_buffer_, total_buffered_, max_reads_;
+    //Pops the next added file, or pulls one from file_source_
+    bool next_fast5(std::string &fname);
+
+    //Returns an opened reader for fname, or NULL on error
+    ReadFile *open_file(const std::string &fname) const;
+
+    bool at_limit(u32 total) const;
+    bool claim_read();
+
+    void io_run();
 
+    u32 max_buffer_, max_reads_;
+    std::atomic<u32> total_buffered_;
+
+    //Guards fast5_list_ in asynchronous mode
+    std::mutex list_mtx_;
     std::deque<std::string> fast5_list_;
-    std::unordered_set<std::string> read_filter_;
+    FileSource file_source_;
+    ReadFile::ReadFilter read_filter_;
+
+    //Reads counted towards max_reads/read_list by a previous run
+    ReadCheckpoint *checkpoint_;
+    u32 resumed_reads_, resumed_included_;
 
-    hdf5_tools::File open_fast5_;
-    Format open_fmt_;
-    std::deque<std::string> read_paths_;
+    std::unique_ptr<ReadFile> open_file_;
+    u32 open_file_id_;
 
     std::deque<ReadBuffer> buffered_reads_;
+
+    ReadQueue read_queue_;
+    std::vector<std::thread> io_threads_;
+    std::atomic<u16> io_active_;
+    std::atomic<bool> io_stop_;
 };
 
 #endif
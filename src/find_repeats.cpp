@@ -26,15 +26,24 @@
 #include <list>
 #include <cstdlib>
 #include "range.hpp"
-#include "bwa_fmi.hpp"
-#include "self_align_ref.hpp"
+#include "bwa_index.hpp"
 
+const KmerLen KLEN = KmerLen::k5;
+
+//Prints each reference position where the shortest unique sequence is at
+//least min_k bases long. See BwaIndex::create_repeat_mask for the mask 
+//the mapper uses
 int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: find_repeats <bwa_prefix> <fasta> <min_k>\n";
+        return 1;
+    }
+
     std::string bwa_prefix(argv[1]),
                 fasta_fname(argv[2]);
     u32 min_k = atoi(argv[3]);
 
-    BwaIndex fmi(bwa_prefix);
+    BwaIndex<KLEN> fmi(bwa_prefix);
     
 
     //for (u64 i = 0; i < 50; i++) {
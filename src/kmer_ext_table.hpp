@@ -0,0 +1,278 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_KMER_EXT_TABLE
+#define _INCL_KMER_EXT_TABLE
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdio>
+#include <iostream>
+#include <bwa/bwt.h>
+#include "util.hpp"
+#include "range.hpp"
+#include "mapped_file.hpp"
+
+#define KMER_EXT_SUFF ".ukx"
+
+//FM ranges of every sequence between klen+1 and max_len bases, so the 
+//first BWT steps after a model k-mer are table lookups
+//Level l stores 4^l ranges as (start, end) pairs, indexed by the 2-bit
+//packed sequence with the first base highest, like k-mers in bp.hpp.
+//The four extensions of one sequence are adjacent, filling a cache line
+class KmerExtTable {
+    public:
+
+    static const u64 MAGIC = 0x31584d4b4c434e55ULL; //"UNCLKMX1"
+
+    //Level max_len takes 2^(2*max_len+4) bytes, 256 MB for 12
+    static const u8 MAX_LEN = 12;
+
+    KmerExtTable() :
+        seq_len_(0), primary_(0),
+        klen_(0), max_len_(0),
+        ranges_(NULL), nranges_(0),
+        loaded_(false) {}
+
+    //Move-only, since a copy would share the mapped file
+    KmerExtTable(const KmerExtTable &) = delete;
+    KmerExtTable &operator=(const KmerExtTable &) = delete;
+
+    KmerExtTable(KmerExtTable &&t) : KmerExtTable() {
+        *this = std::move(t);
+    }
+
+    //Leaves t empty, as after destroy()
+    KmerExtTable &operator=(KmerExtTable &&t) {
+        if (this == &t) return *this;
+        destroy();
+        seq_len_ = t.seq_len_;
+        primary_ = t.primary_;
+        klen_ = t.klen_;
+        max_len_ = t.max_len_;
+        ranges_ = t.ranges_;
+        nranges_ = t.nranges_;
+        level_offs_ = t.level_offs_;
+        range_buf_ = std::move(t.range_buf_);
+        file_ = std::move(t.file_);
+        loaded_ = t.loaded_;
+        if (loaded_ && !file_.is_open()) ranges_ = range_buf_.data();
+        t.destroy();
+        return *this;
+    }
+
+    bool is_loaded() const {
+        return loaded_;
+    }
+
+    //Longest sequence with a stored range
+    u8 max_len() const {
+        return max_len_;
+    }
+
+    u64 size_bytes() const {
+        return nranges_ * 2 * sizeof(u64);
+    }
+
+    static u64 size_bytes(u8 klen, u8 max_len) {
+        u64 n = 0;
+        for (u8 l = klen + 1; l <= max_len; l++) n += 1ULL << (2 * l);
+        return n * 2 * sizeof(u64);
+    }
+
+    //Ranges are computed exactly like BwaIndex::get_neighbor, so lookups 
+    //match searching the BWT step by step
+    bool build(const bwt_t *bwt, u8 klen, u8 max_len) {
+        if (max_len <= klen || max_len > MAX_LEN) {
+            std::cerr << "Error: k-mer extension length must be between "
+                      << (klen + 1) << " and " << (u32) MAX_LEN << "\n";
+            return false;
+        }
+
+        seq_len_ = bwt->seq_len;
+        primary_ = bwt->primary;
+        klen_ = klen;
+        max_len_ = max_len;
+        set_offsets();
+
+        range_buf_.resize(2 * nranges_);
+
+        std::vector<u64> prev, next(8);
+        for (u8 b = 0; b < 4; b++) {
+            next[2*b] = bwt->L2[b];
+            next[2*b+1] = bwt->L2[b+1];
+        }
+
+        for (u8 l = 2; l <= max_len_; l++) {
+            prev.swap(next);
+            next.resize(prev.size() * 4);
+
+            for (u64 s = 0; s < prev.size() / 2; s++) {
+                for (u8 b = 0; b < 4; b++) {
+                    u64 os, oe, j = 2 * ((s << 2) | b);
+                    bwt_2occ(bwt, prev[2*s] - 1, prev[2*s+1], b, &os, &oe);
+                    next[j] = bwt->L2[b] + os + 1;
+                    next[j+1] = bwt->L2[b] + oe;
+                }
+            }
+
+            if (l > klen_) {
+                std::copy(next.begin(), next.end(), 
+                          range_buf_.begin() + 2 * level_offs_[l - klen_ - 1]);
+            }
+        }
+
+        ranges_ = range_buf_.data();
+        loaded_ = true;
+        return true;
+    }
+
+    bool save(const std::string &fname) const {
+        FILE *out = fopen(fname.c_str(), "wb");
+        if (out == NULL) {
+            std::cerr << "Error: failed to open \"" << fname << "\"\n";
+            return false;
+        }
+
+        u64 header[HEADER_LEN] = {MAGIC, seq_len_, primary_, klen_, max_len_, nranges_, 0, 0};
+        bool ok = fwrite(header, sizeof(u64), HEADER_LEN, out) == HEADER_LEN &&
+                  fwrite(ranges_, sizeof(u64), 2 * nranges_, out) == 2 * nranges_;
+        fclose(out);
+
+        if (!ok) std::cerr << "Error: failed to write \"" << fname << "\"\n";
+        return ok;
+    }
+
+    //Returns false without printing if the file does not exist,
+    //since the table is optional
+    bool load(const std::string &fname, const bwt_t *bwt, u8 klen) {
+        FILE *in = fopen(fname.c_str(), "rb");
+        if (in == NULL) return false;
+
+        u64 header[HEADER_LEN];
+        bool ok = fread(header, sizeof(u64), HEADER_LEN, in) == HEADER_LEN &&
+                  check_header(header, bwt, klen);
+
+        if (ok) {
+            range_buf_.resize(2 * nranges_);
+            ok = fread(range_buf_.data(), sizeof(u64), range_buf_.size(), in) == range_buf_.size();
+        }
+        fclose(in);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid k-mer extension table \"" << fname << "\"\n";
+            destroy();
+            return false;
+        }
+
+        ranges_ = range_buf_.data();
+        loaded_ = true;
+        return true;
+    }
+
+    //Like load(), but maps the file instead of copying it
+    bool map(const std::string &fname, const bwt_t *bwt, u8 klen,
+             bool populate = false, bool hugepages = false) {
+        if (!file_.open(fname, false, populate, hugepages)) return false;
+
+        const u64 *header = reinterpret_cast<const u64 *>(file_.data());
+        bool ok = file_.size() >= HEADER_LEN * sizeof(u64) &&
+                  check_header(header, bwt, klen) &&
+                  file_.size() == (HEADER_LEN + 2 * nranges_) * sizeof(u64);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid k-mer extension table \"" << fname << "\"\n";
+            destroy();
+            return false;
+        }
+
+        ranges_ = header + HEADER_LEN;
+        loaded_ = true;
+        return true;
+    }
+
+    void destroy() {
+        file_.close();
+        range_buf_.clear();
+        level_offs_.clear();
+        ranges_ = NULL;
+        nranges_ = 0;
+        max_len_ = klen_;
+        loaded_ = false;
+    }
+
+    //Ranges of seq (len bases) extended by each base
+    //Requires klen <= len < max_len
+    inline void get_extensions(u32 seq, u8 len, Range out[4]) const {
+        const u64 *r = &ranges_[2 * (level_offs_[len - klen_] + (static_cast<u64>(seq) << 2))];
+        for (u8 b = 0; b < 4; b++) {
+            out[b] = Range(r[2*b], r[2*b+1]);
+        }
+    }
+
+    private:
+
+    static const u32 HEADER_LEN = 8;
+
+    bool check_header(const u64 *header, const bwt_t *bwt, u8 klen) {
+        if (header[0] != MAGIC || 
+            header[1] != bwt->seq_len || 
+            header[2] != bwt->primary ||
+            header[3] != klen ||
+            header[4] <= klen || header[4] > MAX_LEN) {
+            return false;
+        }
+        seq_len_ = header[1];
+        primary_ = header[2];
+        klen_ = header[3];
+        max_len_ = header[4];
+        set_offsets();
+        return header[5] == nranges_;
+    }
+
+    //level_offs_[i] is the first range of sequences with klen+1+i bases
+    void set_offsets() {
+        level_offs_.clear();
+        nranges_ = 0;
+        for (u8 l = klen_ + 1; l <= max_len_; l++) {
+            level_offs_.push_back(nranges_);
+            nranges_ += 1ULL << (2 * l);
+        }
+    }
+
+    u64 seq_len_, primary_;
+    u8 klen_, max_len_;
+
+    const u64 *ranges_;
+    u64 nranges_;
+    std::vector<u64> level_offs_;
+
+    //Storage when built or loaded rather than mapped
+    std::vector<u64> range_buf_;
+    MappedFile file_;
+
+    bool loaded_;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_LATENCY_HIST
+#define _INCL_LATENCY_HIST
+
+#include <vector>
+#include <algorithm>
+#include "util.hpp"
+
+//Log-linear histogram of latencies in the style of HdrHistogram
+//Values are binned in microseconds with SUB_BUCKETS linear bins per power 
+//of two, so any recorded value is reported within ~3% of its true value
+class LatencyHist {
+    public:
+
+    static const u32 SUB_BITS = 5, 
+                     SUB_BUCKETS = 1 << SUB_BITS,
+                     MAX_SHIFT = 40;
+
+    LatencyHist() 
+        : counts_((MAX_SHIFT + 2) * SUB_BUCKETS, 0) {
+        reset();
+    }
+
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    //Records a latency in milliseconds, negative values are ignored
+    void add(float ms) {
+        if (ms < 0) return;
+        u64 us = (u64) (ms * 1000);
+        counts_[std::min<u64>(bucket(us), counts_.size()-1)]++;
+        count_++;
+        sum_ += us;
+        max_ = std::max(max_, us);
+    }
+
+    void merge(const LatencyHist &h) {
+        for (u32 i = 0; i < counts_.size(); i++) counts_[i] += h.counts_[i];
+        count_ += h.count_;
+        sum_ += h.sum_;
+        max_ = std::max(max_, h.max_);
+    }
+
+    u64 count() const {
+        return count_;
+    }
+
+    float mean() const {
+        return count_ > 0 ? sum_ / 1000.0 / count_ : 0;
+    }
+
+    float max() const {
+        return max_ / 1000.0;
+    }
+
+    //Lower bound of the bin holding the p-th percentile, in milliseconds
+    float percentile(float p) const {
+        if (count_ == 0) return 0;
+        u64 target = std::max<u64>(1, (u64) (count_ * p / 100.0 + 0.5)), n = 0;
+        for (u32 i = 0; i < counts_.size(); i++) {
+            n += counts_[i];
+            if (n >= target) return std::min(bucket_min(i), max_) / 1000.0;
+        }
+        return max();
+    }
+
+    #ifdef PYBIND
+
+    #define PY_LATENCY_METH(P) c.def(#P, &LatencyHist::P);
+
+    static void pybind_defs(pybind11::class_<LatencyHist> &c) {
+        c.def(pybind11::init());
+        PY_LATENCY_METH(add);
+        PY_LATENCY_METH(reset);
+        PY_LATENCY_METH(merge);
+        PY_LATENCY_METH(count);
+        PY_LATENCY_METH(mean);
+        PY_LATENCY_METH(max);
+        PY_LATENCY_METH(percentile);
+    }
+
+    #endif
+
+    private:
+
+    //Values below 2*SUB_BUCKETS get their own bin, larger values share 
+    //bins 2^shift wide
+    static u32 bucket(u64 us) {
+        if (us < 2 * SUB_BUCKETS) return us;
+        u32 shift = 63 - __builtin_clzll(us) - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((us >> shift) - SUB_BUCKETS);
+    }
+
+    static u64 bucket_min(u32 i) {
+        if (i < 2 * SUB_BUCKETS) return i;
+        u32 shift = i / SUB_BUCKETS - 1;
+        return (u64) (i % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    }
+
+    std::vector<u64> counts_;
+    u64 count_, sum_, max_;
+};
+
+#endif
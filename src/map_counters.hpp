@@ -0,0 +1,105 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_MAP_COUNTERS
+#define _INCL_MAP_COUNTERS
+
+#include <atomic>
+#include <map>
+#include <string>
+#include "util.hpp"
+
+//Hot path work counts for one read. Each Mapper increments its own copy
+//without synchronization, and adds it to the process-wide totals when the
+//read ends, so totals can be read at any time without locking mappers
+class MapCounters {
+    public:
+
+    enum Counter {
+        EVENTS,      //events mapped
+        PATHS,       //paths extended or created
+        NEIGHBORS,   //FM index neighbor queries
+        SA_LOOKUPS,  //suffix array ranges located
+        SEEDS,       //seeds added to the seed tracker
+        SOURCES,     //source paths created
+        NORM_SKIPS,  //events skipped by a full normalizer
+        SA_HITS,     //SA values found in the SaCache
+        SA_MISSES,   //SA values walked to while the SaCache was active
+        READS,       //reads finished, only counted in totals
+        COUNT
+    };
+
+    MapCounters() {
+        reset();
+    }
+
+    void reset() {
+        for (u8 c = 0; c < COUNT; c++) counts_[c] = 0;
+    }
+
+    inline void add(Counter c, u64 n = 1) {
+        counts_[c] += n;
+    }
+
+    u64 get(Counter c) const {
+        return counts_[c];
+    }
+
+    //Adds this read's counts to the totals and resets them
+    void flush() {
+        counts_[READS] = 1;
+        for (u8 c = 0; c < COUNT; c++) {
+            totals()[c].fetch_add(counts_[c], std::memory_order_relaxed);
+        }
+        reset();
+    }
+
+    static const char *name(Counter c) {
+        static const char *NAMES[] = {
+            "events", "paths", "neighbors", "sa_lookups", 
+            "seeds", "sources", "norm_skips", "sa_hits", "sa_misses", 
+            "reads"
+        };
+        return NAMES[c];
+    }
+
+    //Totals over all finished reads, keyed by counter name
+    static std::map<std::string, u64> snapshot() {
+        std::map<std::string, u64> ret;
+        for (u8 c = 0; c < COUNT; c++) {
+            ret[name((Counter) c)] = totals()[c].load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+    private:
+    static std::atomic<u64> *totals() {
+        static std::atomic<u64> t[COUNT];
+        return t;
+    }
+
+    u64 counts_[COUNT];
+};
+
+#endif
@@ -26,132 +26,209 @@
 #include "map_pool.hpp"
 
 MapPool::MapPool(Conf &conf)
-    : fast5s_(conf.fast5_prms) {
+    : fast5s_(conf.fast5_prms),
+      io_started_(false),
+      batch_size_(conf.batch_size > 0 ? conf.batch_size : 1) {
 
     threads_ = std::vector<MapperThread>(conf.threads);
-
-    //fast5s_.fill_buffer();
-
-    for (u32 i = 0; i < threads_.size(); i++) {
-        //if (!fast5s_.empty()) {
-        //    ReadBuffer r = fast5s_.pop_read();
-        //    threads_[i].next_read_.swap(r);
-        //    threads_[i].in_buffered_ = true;
-        //}
-        threads_[i].start();
-    }
 }
 
 std::vector<Paf> MapPool::update() {
     std::vector<Paf> ret;
 
-    fast5s_.fill_buffer();
+    //Fast5s are added after construction, so start loading on first update
+    if (!io_started_) {
+        fast5s_.start_io();
+        for (u32 i = 0; i < threads_.size(); i++) {
+            threads_[i].start(fast5s_, batch_size_);
+        }
+        io_started_ = true;
+    }
 
     for (u32 i = 0; i < threads_.size(); i++) {
-        if (threads_[i].out_buffered_) {
-            ret.push_back(threads_[i].paf_out_);
-            threads_[i].out_buffered_ = false;
-        }
+        threads_[i].pop_pafs(ret);
+    }
 
+    return ret;
+}
 
-        if (!threads_[i].in_buffered_) {
-            if (fast5s_.empty()) { 
-                threads_[i].finished_ = true;
-            } else {
-                ReadBuffer r = fast5s_.pop_read();
-                threads_[i].next_read_.swap(r);
-                threads_[i].in_buffered_ = true;
-            }
-        }
+const PafSummary &MapPool::update_batch(PafWriter *out) {
+    summary_.clear();
+    for (Paf &p : update()) {
+        summary_.add(p);
+        if (out != NULL) out->submit(std::move(p));
     }
+    return summary_;
+}
 
-    return ret;
+const std::vector<std::string> &MapPool::batch_ref_names() const {
+    return summary_.ref_names();
 }
 
 void MapPool::add_fast5(const std::string &fast5_name) {
     fast5s_.add_fast5(fast5_name);
 }
 
+void MapPool::set_checkpoint(ReadCheckpoint *checkpoint) {
+    fast5s_.set_checkpoint(checkpoint);
+}
+
+void MapPool::set_file_source(Fast5Reader::FileSource source) {
+    fast5s_.set_file_source(source);
+}
+
 
 bool MapPool::running() {
+    if (!io_started_) return true;
+
     for (u16 i = 0; i < threads_.size(); i++) {
         if (threads_[i].running_) return true;
+
+        std::lock_guard<std::mutex> lock(threads_[i].out_mtx_);
+        if (!threads_[i].pafs_out_.empty()) return true;
     }
     return false;
 }
 
 void MapPool::stop() {
-    #ifdef FM_PROFILER
-    FMProfiler prof_combined;
-    #endif
+    //Wakes up any threads waiting on reads
+    fast5s_.stop_io();
 
-    //reads_.clear();
     for (auto &t : threads_) {
         t.stopped_ = true;
-        t.mapper_.request_reset();
-        t.thread_.join();
-
-        #ifdef FM_PROFILER
-        prof_combined.combine(t.mapper_.fm_profiler_);
-        #endif
+        for (auto &m : t.mappers_) m.request_reset();
+        if (t.thread_.joinable()) t.thread_.join();
     }
+}
 
-    #ifdef FM_PROFILER
-    prof_combined.write("query_counts.bed");
-    #endif
+std::map<std::string, u64> MapPool::counters() const {
+    return MapCounters::snapshot();
 }
 
 u16 MapPool::MapperThread::THREAD_COUNT = 0;
 
 MapPool::MapperThread::MapperThread()
     : tid_(THREAD_COUNT++),
-      running_(true),
+      running_(false),
       stopped_(false),
-      finished_(false),
-      in_buffered_(false),
-      out_buffered_(false) {
+      fast5s_(NULL) {
     
 }
 
 MapPool::MapperThread::MapperThread(MapperThread &&mt) 
     : tid_(mt.tid_),
-      running_(mt.running_),
-      stopped_(mt.stopped_),                                             
-      finished_(mt.finished_),                                             
-      in_buffered_(mt.in_buffered_), 
-      out_buffered_(mt.in_buffered_), 
-      mapper_(),
-      thread_(std::move(mt.thread_)) {}
-
-void MapPool::MapperThread::start() {
+      running_(mt.running_.load()),
+      stopped_(mt.stopped_.load()),
+      mappers_(),
+      thread_(std::move(mt.thread_)),
+      fast5s_(mt.fast5s_) {}
+
+void MapPool::MapperThread::start(Fast5Reader &fast5s, u16 batch_size) {
+    fast5s_ = &fast5s;
+    mappers_.resize(batch_size);
+    running_ = true;
     thread_ = std::thread(&MapPool::MapperThread::run, this);
 }
 
+bool MapPool::MapperThread::pop_pafs(std::vector<Paf> &out) {
+    std::lock_guard<std::mutex> lock(out_mtx_);
+    if (pafs_out_.empty()) return false;
+
+    out.insert(out.end(), pafs_out_.begin(), pafs_out_.end());
+    pafs_out_.clear();
+    return true;
+}
+
 void MapPool::MapperThread::run() {
-    running_ = true;
+    Mapper::bind_thread(tid_);
 
-    while (!(finished_ || stopped_)) {
-        while (!in_buffered_ && !(stopped_ || finished_)) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (mappers_.size() > 1) {
+        run_batch();
+        return;
+    }
+
+    Mapper &mapper = mappers_[0];
+
+    while (!stopped_ && fast5s_->pop_async(next_read_)) {
+        mapper.new_read(next_read_);
+
+        Paf p = mapper.map_read();
+
+        if (stopped_) break;
+
+        std::lock_guard<std::mutex> lock(out_mtx_);
+        pafs_out_.push_back(p);
+    }
+
+    running_ = false;
+}
+
+void MapPool::MapperThread::run_batch() {
+    std::vector<bool> active(mappers_.size(), false);
+    u16 active_count = 0;
+
+    while (!stopped_) {
+
+        //Fill empty slots, only blocking for reads if nothing is mapping
+        for (u16 i = 0; i < mappers_.size(); i++) {
+            if (active[i]) continue;
+            if (!fast5s_->pop_async(next_read_, active_count == 0)) break;
+
+            Mapper &m = mappers_[i];
+            m.new_read(next_read_);
+
+            if (m.map_start()) {
+                active[i] = true;
+                active_count++;
+            } else {
+                std::lock_guard<std::mutex> lock(out_mtx_);
+                pafs_out_.push_back(m.map_read());
+            }
         }
 
-        if (finished_ || stopped_) break;
+        //Blocking pop failed, all reads are done
+        if (active_count == 0) break;
 
-        mapper_.new_read(next_read_);
-        in_buffered_ = false;
+        for (u16 i = 0; i < mappers_.size(); i++) {
+            if (active[i]) mappers_[i].prefetch_paths();
+        }
 
-        Paf p = mapper_.map_read();
+        batch_evts_.resize(mappers_.size());
+        batch_probs_.resize(mappers_.size());
+        batch_idx_.resize(mappers_.size());
+
+        //Pop one event per read, ending reads with none left
+        u16 n = 0;
+        for (u16 i = 0; i < mappers_.size(); i++) {
+            if (!active[i]) continue;
+
+            if (mappers_[i].next_event(batch_evts_[n])) {
+                batch_probs_[n] = mappers_[i].kmer_probs();
+                batch_idx_[n++] = i;
+                continue;
+            }
 
-        while (out_buffered_ && !stopped_) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            active[i] = false;
+            active_count--;
+
+            std::lock_guard<std::mutex> lock(out_mtx_);
+            pafs_out_.push_back(mappers_[i].map_end());
         }
 
-        paf_out_ = p;
-        out_buffered_ = !stopped_;
-    }
+        for (u16 j = 0; j < n; j++) {
+            Mapper::model.match_probs(batch_evts_[j], batch_probs_[j]);
+        }
 
-    while (out_buffered_ && !stopped_) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        for (u16 j = 0; j < n && !stopped_; j++) {
+            u16 i = batch_idx_[j];
+            if (!mappers_[i].map_scored()) continue;
+
+            active[i] = false;
+            active_count--;
+
+            std::lock_guard<std::mutex> lock(out_mtx_);
+            pafs_out_.push_back(mappers_[i].map_end());
+        }
     }
 
     running_ = false;
@@ -28,8 +28,12 @@
 #include <vector>
 #include <deque>
 #include <unordered_set>
+#include <atomic>
 #include "conf.hpp"
+#include "paf_writer.hpp"
 
+//update releases the GIL, but the other methods must not be called while
+//it runs, except counters. Drive a pool from one thread at a time
 class MapPool {
     public:
 
@@ -37,51 +41,99 @@ class MapPool {
 
     std::vector<Paf> update();
 
+    //Same as update, returning a summary of each result instead
+    //Pafs are submitted to out if it's given. Touches no python objects
+    const PafSummary &update_batch(PafWriter *out = NULL);
+
+    //Names of the rf_ids in update_batch summaries
+    const std::vector<std::string> &batch_ref_names() const;
+
     bool running();
     void add_fast5(const std::string &fname);
     void stop();
 
+    //Skips reads and files finished in a previous run, see
+    //Fast5Reader::set_checkpoint. Must be set before the first update
+    void set_checkpoint(ReadCheckpoint *checkpoint);
+
+    //Pulls more files once the added ones are loaded, see DistWorker
+    void set_file_source(Fast5Reader::FileSource source);
+
+    //MapCounters totals over all reads finished so far
+    std::map<std::string, u64> counters() const;
+
     #ifdef PYBIND
     #define PY_MAP_POOL_METH(P) c.def(#P, &MapPool::P);
 
     static void pybind_defs(pybind11::class_<MapPool> &c) {
         c.def(pybind11::init<Conf &>());
-        PY_MAP_POOL_METH(update);
+        c.def("update", &MapPool::update, 
+              pybind11::call_guard<pybind11::gil_scoped_release>());
+
+        //Returns a structured array of PafSummary::Row
+        c.def("update_batch", [](MapPool &p, PafWriter *out) {
+            const PafSummary *s;
+            {
+                pybind11::gil_scoped_release nogil;
+                s = &p.update_batch(out);
+            }
+            return s->to_array();
+        }, pybind11::arg("out") = (PafWriter *) NULL);
+        PY_MAP_POOL_METH(batch_ref_names);
         PY_MAP_POOL_METH(running);
         PY_MAP_POOL_METH(add_fast5);
         PY_MAP_POOL_METH(stop);
+        c.def("set_checkpoint", &MapPool::set_checkpoint, 
+              pybind11::keep_alive<1, 2>());
+        PY_MAP_POOL_METH(counters);
     }
 
     #endif
 
     private:
     Fast5Reader fast5s_;
+    bool io_started_;
+    PafSummary summary_;
+    u16 batch_size_;
 
     class MapperThread {
         public:
         MapperThread();
         MapperThread(MapperThread &&mt);
 
-        void start();
+        void start(Fast5Reader &fast5s, u16 batch_size);
         void run();
 
+        //Maps up to mappers_.size() reads at once, one event per read per 
+        //round, so FM index lookups for one read overlap with the others
+        //Each round's events are scored together before paths are extended
+        void run_batch();
+
+        std::vector<float> batch_evts_;
+        std::vector<float *> batch_probs_;
+        std::vector<u16> batch_idx_;
+
+        //Moves finished alignments into out, returns false if none
+        bool pop_pafs(std::vector<Paf> &out);
+
         static u16 THREAD_COUNT;
 
         u16 tid_;
 
         //running: run method has not ended
         //stopped: force stopped, like by keyboard interrupt
-        //finished: no more reads left to process
-        bool running_, stopped_, finished_, 
-             in_buffered_, out_buffered_;
+        std::atomic<bool> running_, stopped_;
 
-        Mapper mapper_;
+        //One Mapper per read mapped in parallel, only one unless batching 
+        std::vector<Mapper> mappers_;
         std::thread thread_;
 
+        //Reads are pulled straight from the reader's I/O queue
+        Fast5Reader *fast5s_;
         ReadBuffer next_read_;
-        Paf paf_out_;
 
-        std::mutex in_mtx_, out_mtx_;
+        std::vector<Paf> pafs_out_;
+        std::mutex out_mtx_;
     };
 
     std::vector<MapperThread> threads_;
@@ -60,6 +60,28 @@ void MapPoolOrd::load_fast5s() {
 
 std::vector<Paf> MapPoolOrd::update() {
     std::vector<Paf> ret;
+    for (MapResult &m : update_results()) {
+        ret.push_back(std::move(std::get<2>(m)));
+    }
+    return ret;
+}
+
+const PafSummary &MapPoolOrd::update_batch(PafWriter *out) {
+    summary_.clear();
+    for (MapResult &m : update_results()) {
+        Paf &p = std::get<2>(m);
+        summary_.add(p, std::get<1>(m));
+        if (out != NULL) out->submit(std::move(p));
+    }
+    return summary_;
+}
+
+const std::vector<std::string> &MapPoolOrd::batch_ref_names() const {
+    return summary_.ref_names();
+}
+
+std::vector<MapResult> MapPoolOrd::update_results() {
+    std::vector<MapResult> ret;
 
     channels_empty_ = true;
 
@@ -76,6 +98,7 @@ std::vector<Paf> MapPoolOrd::update() {
 
         //Get next chunk
         ReadBuffer &r = channels_[i].front();
+        r.load_signal((chunk_idx_[i] + 1) * (u64) ReadBuffer::PRMS.chunk_len());
         Chunk chunk = r.get_chunk(chunk_idx_[i]);
 
         //Try adding to pool
@@ -86,7 +109,7 @@ std::vector<Paf> MapPoolOrd::update() {
     }
 
     //Get mapping results
-    for (const MapResult &m : pool_.update()) {
+    for (MapResult &m : pool_.update()) {
         u16 i = std::get<0>(m)-1;
         u32 nm = std::get<1>(m);
 
@@ -98,7 +121,7 @@ std::vector<Paf> MapPoolOrd::update() {
                 chunk_idx_[i] = 0;
         }
 
-        ret.push_back(std::get<2>(m));
+        ret.push_back(std::move(m));
     }
 
     //TODO: option to stop when lower than target
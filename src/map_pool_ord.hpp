@@ -32,6 +32,8 @@
 #include "realtime_pool.hpp"
 #include "fast5_reader.hpp"
 
+//update releases the GIL, but the other methods must not be called while
+//it runs. Drive a pool from one thread at a time
 class MapPoolOrd {
     public:
 
@@ -44,12 +46,52 @@ class MapPoolOrd {
     void load_fast5s();
 
     std::vector<Paf> update();
+
+    //Same as update, returning a summary of each result instead
+    //Pafs are submitted to out if it's given. Touches no python objects
+    const PafSummary &update_batch(PafWriter *out = NULL);
+
+    //Names of the rf_ids in update_batch summaries
+    const std::vector<std::string> &batch_ref_names() const;
+
     void stop();
     bool running();
 
+    #ifdef PYBIND
+    #define PY_MAP_POOL_ORD_METH(P) c.def(#P, &MapPoolOrd::P);
+
+    static void pybind_defs(pybind11::class_<MapPoolOrd> &c) {
+        c.def(pybind11::init<Conf &>());
+        PY_MAP_POOL_ORD_METH(add_fast5);
+        PY_MAP_POOL_ORD_METH(add_read);
+        c.def("load_fast5s", &MapPoolOrd::load_fast5s, 
+              pybind11::call_guard<pybind11::gil_scoped_release>());
+        c.def("update", &MapPoolOrd::update, 
+              pybind11::call_guard<pybind11::gil_scoped_release>());
+
+        //Returns a structured array of PafSummary::Row
+        c.def("update_batch", [](MapPoolOrd &p, PafWriter *out) {
+            const PafSummary *s;
+            {
+                pybind11::gil_scoped_release nogil;
+                s = &p.update_batch(out);
+            }
+            return s->to_array();
+        }, pybind11::arg("out") = (PafWriter *) NULL);
+        PY_MAP_POOL_ORD_METH(batch_ref_names);
+        PY_MAP_POOL_ORD_METH(stop);
+        PY_MAP_POOL_ORD_METH(running);
+    }
+
+    #endif
+
     private:
     Fast5Reader fast5s_;
     RealtimePool pool_;
+    PafSummary summary_;
+
+    //Adds the next chunk of each channel and returns finished reads
+    std::vector<MapResult> update_results();
 
     u32 active_tgt_;
 
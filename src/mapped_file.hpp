@@ -0,0 +1,136 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_MAPPED_FILE
+#define _INCL_MAPPED_FILE
+
+#include <string>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.hpp"
+
+//Memory-mapped file, used to share index files between processes
+//through the page cache. Like bwt_t and bntseq_t, it is released 
+//explicitly with close() rather than on destruction. It is move-only, 
+//since a copy closing the mapping would leave the other dangling.
+class MappedFile {
+    public:
+
+    MappedFile() : addr_(NULL), size_(0) {}
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&f) : addr_(f.addr_), size_(f.size_) {
+        f.addr_ = NULL;
+        f.size_ = 0;
+    }
+
+    MappedFile &operator=(MappedFile &&f) {
+        if (this != &f) {
+            close();
+            addr_ = f.addr_;
+            size_ = f.size_;
+            f.addr_ = NULL;
+            f.size_ = 0;
+        }
+        return *this;
+    }
+
+    //Maps the file read-only, or copy-on-write if private_writes is set
+    //populate pre-faults the mapping, hugepages requests transparent 
+    //hugepages where the kernel supports them for file mappings
+    //Any mapping already open is closed first
+    bool open(const std::string &fname, 
+              bool private_writes = false, 
+              bool populate = false, 
+              bool hugepages = false) {
+
+        close();
+
+        int fd = ::open(fname.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        int prot = PROT_READ, flags = MAP_SHARED;
+        if (private_writes) {
+            prot |= PROT_WRITE;
+            flags = MAP_PRIVATE;
+        }
+
+        #ifdef MAP_POPULATE
+        if (populate) flags |= MAP_POPULATE;
+        #endif
+
+        void *addr = mmap(NULL, st.st_size, prot, flags, fd, 0);
+        ::close(fd);
+
+        if (addr == MAP_FAILED) {
+            std::cerr << "Error: failed to mmap \"" << fname << "\"\n";
+            return false;
+        }
+
+        #ifdef MADV_HUGEPAGE
+        if (hugepages) madvise(addr, st.st_size, MADV_HUGEPAGE);
+        #endif
+
+        addr_ = static_cast<u8 *>(addr);
+        size_ = st.st_size;
+        return true;
+    }
+
+    void close() {
+        if (addr_ != NULL) {
+            munmap(addr_, size_);
+            addr_ = NULL;
+            size_ = 0;
+        }
+    }
+
+    bool is_open() const {
+        return addr_ != NULL;
+    }
+
+    u8 *data() const {
+        return addr_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    private:
+    u8 *addr_;
+    size_t size_;
+};
+
+#endif
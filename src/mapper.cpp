@@ -23,7 +23,10 @@
 
 #include <pdqsort.h>
 #include <exception>
+#include <algorithm>
+#include <thread>
 #include "mapper.hpp"
+#include "numa_topology.hpp"
 #include "model_r94.inl"
 
 Mapper::Params Mapper::PRMS {
@@ -32,15 +35,27 @@ Mapper::Params Mapper::PRMS {
     max_rep_copy    : 50,
     max_paths       : 10000,
     max_consec_stay : 8,
+    path_pool_size  : 0,
+    min_path_budget : 1000,
     max_events      : 30000,
     max_stay_frac   : 0.5,
     min_seed_prob   : -3.75,
     evt_batch_size  : 5,
     evt_timeout     : 10.0,
     chunk_timeout   : 4000.0,
+    target_bed      : "",
+    early_conf      : 0,
+    counter_tags    : false,
     bwa_prefix      : "",
     idx_preset      : "default",
     model_path      : "",
+    idx_mmap        : false,
+    idx_populate    : false,
+    idx_hugepages   : false,
+    numa_pin        : false,
+    numa_index      : "none",
+    repeat_mask     : true,
+    sa_cache_mb     : 0,
     seed_prms       : SeedTracker::PRMS_DEF,
     norm_prms       : Normalizer::PRMS_DEF,
     event_prms      : EventDetector::PRMS_DEF,
@@ -52,9 +67,26 @@ Mapper::Params Mapper::PRMS {
 };
 
 BwaIndex<KLEN> Mapper::fmi;
+std::vector<BwaIndex<KLEN> *> Mapper::numa_fmi_;
+SaCache Mapper::sa_cache_;
+thread_local const BwaIndex<KLEN> *Mapper::thread_fmi_ = &Mapper::fmi;
 std::vector<float> Mapper::prob_threshes_;
-
+float Mapper::min_prob_thresh_;
+bool Mapper::sparse_scoring_ = false;
+TargetRegions Mapper::targets;
+std::atomic<u64> Mapper::pool_paths_(0);
+std::atomic<u16> Mapper::evt_batch_size_(0);
+std::atomic<float> Mapper::evt_timeout_(0);
+std::atomic<float> Mapper::chunk_timeout_(0);
+const u32 Mapper::PathArena::NO_RING;
+const float Mapper::SPARSE_SCAN_FRAC = 0.05;
+
+#if KMER_LEN == 5
 PoreModel<KLEN> Mapper::model = pmodel_r94_complement;
+#else
+//No built-in model of other lengths, see load_static
+PoreModel<KLEN> Mapper::model;
+#endif
 
 const std::array<u8,Mapper::EVENT_TYPES.size()> Mapper::EVENT_TYPES = {
     Mapper::EVENT_STAY,
@@ -68,7 +100,13 @@ Mapper::Mapper() :
     evt_prof_(PRMS.evt_prof_prms),
     norm_(PRMS.norm_prms),
     seed_tracker_(PRMS.seed_prms),
-    state_(State::INACTIVE) {
+    reset_(false),
+    state_(State::INACTIVE),
+    trace_id_(0),
+    trace_evt_(0),
+    first_evt_time_(-1),
+    decision_time_(-1),
+    chunk_queue_(ChunkQueue::DEF_CAPACITY, ReadBuffer::PRMS.chunk_len()) {
 
     load_static();
 
@@ -77,18 +115,25 @@ Mapper::Mapper() :
     }
     PATH_TAIL_MOVE = 1 << (PRMS.seed_len-1);
 
-    kmer_probs_ = std::vector<float>(kmer_count<KLEN>());
+    kmer_probs_ = AlignedVec<float>(kmer_count<KLEN>());
+    cand_mask_ = std::vector<u64>((kmer_count<KLEN>() + 63) / 64, 0);
 
-    PathBuffer::reset_count();//TODO is there a better way?
-    prev_paths_ = std::vector<PathBuffer>(PRMS.max_paths);
-
-    PathBuffer::reset_count();
-    next_paths_ = std::vector<PathBuffer>(PRMS.max_paths);
+    //Paths are allocated as needed, since most reads need far fewer 
+    //than max_paths. Enough for sources from every k-mer to start
+    path_cap_ = 0;
+    pooled_paths_ = 0;
+    path_budget_ = PRMS.max_paths;
+    prev_size_ = 0;
+    reserve_paths();
 
     sources_added_ = std::vector<bool>(kmer_count<KLEN>(), false);
 
-    prev_size_ = 0;
+    clear_paths();
     event_i_ = 0;
+    chunk_evt_i_ = 0;
+    sig_i_ = 0;
+    stream_sig_ = false;
+    chunk_events_.clear();
     seed_tracker_.reset();
 
     norm_.set_target(model.get_means_mean(), model.get_means_stdv());
@@ -97,14 +142,74 @@ Mapper::Mapper() :
 Mapper::Mapper(const Mapper &m) : Mapper() {}
 
 Mapper::~Mapper() {
+    set_pool_paths(0);
     dbg_close_all();
+}
+
+
+//Pages are placed on the node of the thread that first touches them
+//unless a memory policy is set, so replicas are loaded by threads 
+//running on their nodes and the interleaved index under that policy
+void Mapper::load_index_numa() {
+    const NumaTopology &numa = NumaTopology::get();
+
+    bool replicate = PRMS.numa_index == "replicate" && numa.node_count() > 1,
+         interleave = PRMS.numa_index == "interleave" && numa.node_count() > 1;
+
+    //Mapped files share one copy in the page cache
+    if (replicate && PRMS.idx_mmap) {
+        std::cerr << "Warning: can't replicate a memory-mapped index, interleaving instead\n";
+        replicate = false;
+        interleave = true;
+    }
+
+    if (interleave) numa.interleave();
+    else if (replicate) numa.prefer_node(0);
+
+    fmi.load_index(PRMS.bwa_prefix, 
+                   PRMS.idx_mmap, 
+                   PRMS.idx_populate, 
+                   PRMS.idx_hugepages);
+
+    if (interleave || replicate) numa.reset_policy();
+
+    numa_fmi_.assign(1, &fmi);
+    if (!replicate || !fmi.is_loaded()) return;
 
-    for (u32 i = 0; i < next_paths_.size(); i++) {
-        next_paths_[i].free_buffers();
-        prev_paths_[i].free_buffers();
+    numa_fmi_.resize(numa.node_count(), NULL);
+
+    std::vector<std::thread> loaders;
+    for (u16 n = 1; n < numa.node_count(); n++) {
+        loaders.emplace_back([&numa, n]() {
+            numa.pin_node(n);
+            numa.prefer_node(n);
+            numa_fmi_[n] = new BwaIndex<KLEN>(PRMS.bwa_prefix);
+            numa.reset_policy();
+        });
+    }
+    for (auto &t : loaders) t.join();
+
+    for (u16 n = 1; n < numa.node_count(); n++) {
+        if (!numa_fmi_[n]->is_loaded()) {
+            std::cerr << "Error: failed to load index replica for NUMA node " 
+                      << numa.node_id(n) << "\n";
+            abort();
+        }
     }
+
+    std::cerr << "Replicated index on " << numa.node_count() << " NUMA nodes\n";
 }
 
+void Mapper::bind_thread(u32 thread) {
+    const NumaTopology &numa = NumaTopology::get();
+    u16 node = numa.thread_node(thread);
+
+    if (PRMS.numa_pin && !numa.pin_cpu(numa.thread_cpu(thread))) {
+        std::cerr << "Warning: failed to pin thread " << thread << "\n";
+    }
+
+    thread_fmi_ = node < numa_fmi_.size() ? numa_fmi_[node] : &fmi;
+}
 
 void Mapper::load_static() {
 
@@ -112,14 +217,41 @@ void Mapper::load_static() {
 
     if (!PRMS.model_path.empty()) {
         model = PoreModel<KLEN>(PRMS.model_path, true);
+        if (!model.is_loaded()) {
+            std::cerr << "Error: failed to load pore model \"" 
+                      << PRMS.model_path << "\"\n";
+            abort();
+        }
+    } else if (!model.is_loaded()) {
+        std::cerr << "Error: model_path must be set, there is no built-in "
+                  << (u32) KLEN << "-mer pore model\n";
+        abort();
     }
 
-    fmi.load_index(PRMS.bwa_prefix);
+    load_index_numa();
     if (!fmi.is_loaded()) {
         std::cerr << "Error: failed to load BWA index\n";
         abort();
     }
 
+    if (PRMS.repeat_mask && fmi.repeat_mask_loaded()) {
+        std::cerr << "Masking seeds in " << fmi.repeat_mask_len() 
+                  << "-mers with " << fmi.repeat_mask_copies() 
+                  << "+ copies\n";
+    }
+
+    if (!sa_cache_.init(PRMS.sa_cache_mb, fmi.size())) {
+        std::cerr << "Warning: index too large for the SA cache, disabling it\n";
+    } else if (sa_cache_.is_active()) {
+        std::cerr << "Caching SA values in " 
+                  << (sa_cache_.size_bytes() >> 20) << " MB\n";
+    }
+
+    if (!PRMS.target_bed.empty()) {
+        if (!targets.load_bed(PRMS.target_bed, fmi.get_ref_offsets())) abort();
+        std::cerr << "Loaded " << targets.size() << " target regions\n";
+    }
+
     std::ifstream param_file(PRMS.bwa_prefix + INDEX_SUFF);
     if (!param_file.is_open()) {
         std::cerr << "Error: failed to load uncalled index\n";
@@ -156,6 +288,13 @@ void Mapper::load_static() {
         }
     }
 
+    min_prob_thresh_ = *std::min_element(prob_threshes_.begin(), 
+                                         prob_threshes_.end());
+
+    //Sparse scoring is slower per k-mer, so only used if it scans few
+    sparse_scoring_ = model.scan_fraction(min_prob_thresh_) < SPARSE_SCAN_FRAC;
+
+    if (!ReadTracer::PRMS.trace_out.empty()) ReadTracer::get().open();
 }
 
 inline u64 Mapper::get_fm_bin(u64 fmlen) {
@@ -171,9 +310,19 @@ float Mapper::get_source_prob() const {
 }
 
 u16 Mapper::get_max_events() const {
-    if (event_i_ + PRMS.evt_batch_size > PRMS.max_events) 
+    u16 batch = evt_batch_size_.load(std::memory_order_relaxed);
+    if (batch == 0) batch = PRMS.evt_batch_size;
+
+    if (event_i_ + batch > PRMS.max_events) 
         return PRMS.max_events - event_i_;
-    return PRMS.evt_batch_size;
+    return batch;
+}
+
+void Mapper::set_tuned_prms(u16 evt_batch_size, float evt_timeout, 
+                            float chunk_timeout) {
+    evt_batch_size_.store(evt_batch_size, std::memory_order_relaxed);
+    evt_timeout_.store(evt_timeout, std::memory_order_relaxed);
+    chunk_timeout_.store(chunk_timeout, std::memory_order_relaxed);
 }
 
 ReadBuffer &Mapper::get_read() {
@@ -186,19 +335,69 @@ void Mapper::deactivate() {
 }
 
 Paf Mapper::map_read() {
-    if (read_.loc_.is_mapped()) return read_.loc_;
+    if (!map_start()) return read_.loc_;
+
+    while (!map_next()) {}
+
+    return map_end();
+}
+
+bool Mapper::map_start() {
+    if (read_.loc_.is_mapped()) return false;
 
     map_timer_.reset();
 
-    norm_.set_signal(evdt_.get_means(read_.full_signal_));
+    //Events are detected as mapping consumes them, see stream_events
+    norm_.reset();
+    stream_sig_ = true;
+    sig_i_ = 0;
+    stream_events();
 
-    while (!map_next()) {}
+    return true;
+}
+
+//Detects events one chunk of signal at a time until the normalizer is 
+//full, so reads no longer than the normalizer are normalized as a whole
+//and longer reads by a window sliding ahead of the mapped events
+void Mapper::stream_events() {
+    while (!norm_.full()) {
+        if (chunk_evt_i_ == chunk_events_.size()) {
+            u32 sig_len = read_.full_signal_.size();
+            if (sig_i_ >= sig_len) {
+                if (!read_.load_signal(sig_i_ + ReadBuffer::PRMS.chunk_len())) return;
+                sig_len = read_.full_signal_.size();
+            }
+
+            u32 n = std::min<u32>(ReadBuffer::PRMS.chunk_len(), sig_len - sig_i_);
+            chunk_events_.clear();
+            chunk_evt_i_ = 0;
+            evdt_.add_samples(&read_.full_signal_[sig_i_], n, chunk_events_);
+            sig_i_ += n;
+            continue;
+        }
 
+        const Event &e = chunk_events_[chunk_evt_i_++];
+        if (trace_id_ != 0) ReadTracer::get().event(trace_id_, e, 0, 0, 1);
+        norm_.push(e.mean);
+    }
+}
+
+Paf Mapper::map_end() {
     read_.loc_.set_float(Paf::Tag::MAP_TIME, map_timer_.get());
 
     return read_.loc_;
 }
 
+void Mapper::prefetch_paths() const {
+    const BwaIndex<KLEN> &idx = local_fmi();
+    for (u32 pj = 0; pj < prev_size_; pj++) {
+        u32 pi = prev_order_[pj];
+        if (prev_paths_.is_valid(pi)) {
+            idx.prefetch_neighbors(prev_paths_.fm_range_[pi]);
+        }
+    }
+}
+
 void Mapper::new_read(ReadBuffer &r) {
     read_.clear();//TODO: probably shouldn't auto erase previous read
     read_.swap(r);
@@ -212,13 +411,36 @@ void Mapper::new_read(Chunk &chunk) {
         std::cerr << "Error: possibly lost read '" << read_.id_ << "'\n";
     }
 
+    //Drop chunks left from the last read
+    chunk_queue_.clear();
+
     read_ = ReadBuffer(chunk);
     reset();
 }
 
+//Starts a read from the queued chunks, skipping any left from the last read
+//Only called while inactive, when the caller is the queue's only user
+bool Mapper::new_queued_read() {
+    Chunk *c;
+    while ((c = chunk_queue_.front()) != NULL && 
+           c->get_number() == read_.get_number()) {
+        chunk_queue_.pop();
+    }
+
+    if (c == NULL) return false;
+
+    read_ = ReadBuffer(*c);
+    chunk_queue_.pop();
+    reset();
+    return true;
+}
+
 void Mapper::reset() {
-    prev_size_ = 0;
+    clear_paths();
     event_i_ = 0;
+    chunk_evt_i_ = 0;
+    chunk_events_.clear();
+    stream_sig_ = false;
     reset_ = false;
     last_chunk_ = false;
     state_ = State::MAPPING;
@@ -233,6 +455,23 @@ void Mapper::reset() {
     map_timer_.reset();
     map_time_ = 0;
     wait_time_ = 0;
+    read_timer_.reset();
+    first_evt_time_ = -1;
+    decision_time_ = -1;
+
+    //The budget carries over from the last read on this channel
+    min_budget_ = path_budget_;
+    budget_evt_ = 0;
+    budget_shrinks_ = 0;
+    budget_grows_ = 0;
+    counters_.reset();
+
+    trace_id_ = 0;
+    if (ReadTracer::enabled()) {
+        trace_id_ = ReadTracer::get().start_read(read_.get_id(), 
+                                                 read_.get_number(), 
+                                                 read_.get_channel());
+    }
 
     dbg_close_all();
 
@@ -249,13 +488,29 @@ u32 Mapper::prev_unfinished(u32 next_number) const {
     return state_ == State::MAPPING && read_.number_ != next_number;
 }
 
+float Mapper::time_left() const {
+    u64 window = (u64) ReadBuffer::PRMS.max_chunks * ReadBuffer::PRMS.chunk_len(),
+        recvd = read_.raw_len_ + 
+                (u64) chunk_queue_.size() * ReadBuffer::PRMS.chunk_len();
+    if (recvd >= window) return 0;
+    return 1000.0 * (window - recvd) / ReadBuffer::PRMS.sample_rate;
+}
+
+//Events detected but not mapped, plus those expected from queued chunks
+u32 Mapper::event_backlog() const {
+    u32 chunks = std::max<u32>(read_.chunk_count(), 1),
+        per_chunk = (event_i_ + norm_.unread_size()) / chunks;
+    return norm_.unread_size() + (chunk_events_.size() - chunk_evt_i_) + 
+           chunk_queue_.size() * per_chunk;
+}
+
 bool Mapper::finished() const {
     return state_ == State::SUCCESS || state_ == State::FAILURE;
 }
 
 void Mapper::skip_events(u32 n) {
     event_i_ += n;
-    prev_size_ = 0;
+    clear_paths();
 }
 
 void Mapper::request_reset() {
@@ -278,36 +533,42 @@ Mapper::State Mapper::get_state() const {
     return state_;
 }
 
+//Queues a chunk of the current read for the mapper thread
+//Returns false if the read is done or the queue is full
 bool Mapper::add_chunk(Chunk &chunk) {
-    if (!chunk_mtx_.try_lock()) return false;
-
-    if (!is_chunk_processed() || finished() || reset_) { 
-        chunk_mtx_.unlock();
-        return false;
-    }
+    if (finished() || reset_) return false;
+    return chunk_queue_.push(chunk);
+}
 
-    if (read_.chunks_maxed()) {
+//Queues a chunk regardless of which read it belongs to
+bool Mapper::push_chunk(Chunk &chunk) {
+    return chunk_queue_.push(chunk);
+}
 
-        set_failed();
-        chunk.clear();
+bool Mapper::has_queued_chunks() const {
+    return !chunk_queue_.empty();
+}
 
-        chunk_mtx_.unlock();
-        return true;
-    }
+u16 Mapper::process_chunk() {
+    if (reset_) return 0;
+
+    //Take the next queued chunk of this read
+    //Chunks of a newer read wait until this one is deactivated
+    if (read_.chunk_processed_) {
+        Chunk *c = chunk_queue_.front();
+        if (c == NULL || c->get_number() != read_.get_number()) return 0;
+
+        //Drop chunks past max_chunks, map_chunk ends the read
+        if (read_.chunks_maxed()) {
+            chunk_queue_.pop();
+            return 0;
+        }
 
-    bool added = read_.add_chunk(chunk);
-    if (added) {
+        read_.add_chunk(*c);
+        chunk_queue_.pop();
         chunk_timer_.reset();
     }
 
-    chunk_mtx_.unlock();
-    return added;
-}
-
-u16 Mapper::process_chunk() {
-    if (read_.chunk_processed_ || reset_ || 
-        !chunk_mtx_.try_lock()) return 0; 
-
     if (read_.chunk_count() == 1) {
         dbg_open_all();
         read_.loc_.set_float(Paf::Tag::QUEUE_TIME, map_timer_.lap());
@@ -315,74 +576,88 @@ u16 Mapper::process_chunk() {
 
     wait_time_ += map_timer_.lap();
 
+    //Detect all events in the chunk at once
+    //If the normalizer fills up, remaining events are kept for the next call
+    if (!read_.chunk_.empty()) {
+        chunk_events_.clear();
+        chunk_evt_i_ = 0;
+        evdt_.add_samples(read_.chunk_.data(), read_.chunk_.size(), chunk_events_);
+        read_.chunk_.clear();
+    }
+
     u16 nevents = 0;
-    for (u32 i = 0; i < read_.chunk_.size(); i++) {
-        if (evdt_.add_sample(read_.chunk_[i])) {
+    while (chunk_evt_i_ < chunk_events_.size()) {
 
-            //Add event to profiler
-            //Returns true if next event is not masked
-            evt_prof_.add_event(evdt_.get_event());
-            
-            #ifdef DEBUG_EVENTS
-            if (evt_prof_.is_full()) {
-                dbg_events_.emplace_back(evt_prof_.anno_event());
-            }
-            #endif
+        //Add event to profiler
+        //Returns true if next event is not masked
+        evt_prof_.add_event(chunk_events_[chunk_evt_i_++]);
+        
+        #ifdef DEBUG_EVENTS
+        if (evt_prof_.is_full()) {
+            dbg_events_.emplace_back(evt_prof_.anno_event());
+        }
+        #endif
 
-            if (!evt_prof_.event_ready()) continue;
+        if (trace_id_ != 0 && evt_prof_.is_full()) {
+            AnnoEvent a = evt_prof_.anno_event();
+            ReadTracer::get().event(trace_id_, a.evt, a.win_mean, a.win_stdv, a.mask);
+        }
 
-            auto evt_mean = evt_prof_.next_mean();
+        if (!evt_prof_.event_ready()) continue;
 
-            if (!norm_.push(evt_mean)) {
+        auto evt_mean = evt_prof_.next_mean();
 
-                u32 nskip = norm_.skip_unread(nevents);
-                skip_events(nskip);
+        if (!norm_.push(evt_mean)) {
 
-                std::cerr << "#SKIP "
-                          << read_.get_id() << " "
-                          << nskip << "\n";
+            u32 nskip = norm_.skip_unread(nevents);
+            skip_events(nskip);
+            counters_.add(MapCounters::NORM_SKIPS, nskip);
 
-                if (!norm_.push(evt_mean)) {
-                    map_time_ += map_timer_.lap();
+            std::cerr << "#SKIP "
+                      << read_.get_id() << " "
+                      << nskip << "\n";
 
-                    chunk_mtx_.unlock();
-                    return nevents;
-                }
+            if (!norm_.push(evt_mean)) {
+                map_time_ += map_timer_.lap();
+                return nevents;
             }
-
-            nevents++;
         }
+
+        nevents++;
     }
 
     dbg_events_out();
 
-    read_.chunk_.clear();
-
     read_.chunk_processed_ = true;
 
     map_time_ += map_timer_.lap();
 
-    chunk_mtx_.unlock();
     return nevents;
 }
 
 void Mapper::set_failed() {
     state_ = State::FAILURE;
     reset_ = false;
+    decision_time_ = read_timer_.get();
+    end_path_budget();
+    end_counters();
 
     read_.loc_.set_float(Paf::Tag::MAP_TIME, map_time_);
     read_.loc_.set_float(Paf::Tag::WAIT_TIME, wait_time_);
 }
 
 bool Mapper::chunk_mapped() {
-    return read_.chunk_processed_ && norm_.empty();
+    return chunk_queue_.empty() && read_.chunk_processed_ && norm_.empty();
 }
 
 bool Mapper::map_chunk() {
     wait_time_ += map_timer_.lap();
 
+    float chunk_timeout = chunk_timeout_.load(std::memory_order_relaxed);
+    if (chunk_timeout == 0) chunk_timeout = PRMS.chunk_timeout;
+
     if (reset_ || 
-        chunk_timer_.get() > PRMS.chunk_timeout ||
+        chunk_timer_.get() > chunk_timeout ||
         event_i_ >= PRMS.max_events) {
 
         set_failed();
@@ -393,15 +668,8 @@ bool Mapper::map_chunk() {
                read_.chunk_processed_ && 
                read_.chunks_maxed()) {
 
-        chunk_mtx_.lock();
-
-        if (norm_.empty() && read_.chunk_processed_) {
-            set_failed();
-            chunk_mtx_.unlock();
-            return true;
-        }
-
-        chunk_mtx_.unlock();
+        set_failed();
+        return true;
     }
 
     if (norm_.empty()) {
@@ -410,7 +678,8 @@ bool Mapper::map_chunk() {
 
 
     u16 nevents = get_max_events();
-    float tlimit = PRMS.evt_timeout * nevents;
+    float timeout = evt_timeout_.load(std::memory_order_relaxed);
+    float tlimit = (timeout > 0 ? timeout : PRMS.evt_timeout) * nevents;
 
     for (u16 i = 0; i < nevents && !norm_.empty(); i++) {
         if (map_next()) {
@@ -425,209 +694,379 @@ bool Mapper::map_chunk() {
         }
     }
 
+    EarlyStop stop = early_decision();
+    if (stop != NO_STOP) {
+        map_time_ += map_timer_.lap();
+        set_failed();
+        read_.loc_.set_int(Paf::Tag::EARLY_STOP, stop);
+        norm_.skip_unread();
+        return true;
+    }
+
     map_time_ += map_timer_.lap();
 
     return false;
 }
 
+u32 Mapper::remaining_bp() const {
+    u32 evts = PRMS.max_events > event_i_ ? PRMS.max_events - event_i_ : 0;
+
+    //Chunks left before max_chunks, plus events waiting to be mapped
+    u32 max_chunks = ReadBuffer::PRMS.max_chunks,
+        chunks = max_chunks > read_.chunk_count() ? max_chunks - read_.chunk_count() : 0;
+    float chunk_evts = norm_.unread_size() + 
+                       (float) chunks * ReadBuffer::PRMS.chunk_len() / evdt_.mean_event_len();
+
+    return event_to_bp(std::min((float) evts, chunk_evts));
+}
+
+Mapper::EarlyStop Mapper::early_decision() const {
+    if (PRMS.early_conf <= 0) return NO_STOP;
+
+    //A cluster can grow by the read's remaining bases,
+    //plus one seed overlapping bases it has already covered
+    u32 min_len = seed_tracker_.PRMS.min_map_len;
+    if (seed_tracker_.get_top_len() + remaining_bp() + PRMS.seed_len < min_len) {
+        return UNREACHABLE;
+    }
+
+    const SeedCluster &top = seed_tracker_.max_map_;
+    if (!has_targets() || top.total_len_ < min_len) return NO_STOP;
+
+    u64 st, en;
+    cluster_loc(top, st, en);
+    if (on_target(st, en)) return NO_STOP;
+
+    u32 on_len = seed_tracker_.max_len_where([this](const SeedCluster &c) {
+        u64 cst, cen;
+        cluster_loc(c, cst, cen);
+        return on_target(cst, cen);
+    });
+
+    if (top.total_len_ >= PRMS.early_conf * std::max(on_len, 1u)) {
+        return OFF_TARGET;
+    }
+
+    return NO_STOP;
+}
+
 bool Mapper::map_next() {
+    float event;
+    if (!next_event(event)) return true;
+
+    score_candidates(event);
+
+    return map_candidates();
+}
+
+inline bool Mapper::is_candidate(u32 kmer) const {
+    return (cand_mask_[kmer >> 6] >> (kmer & 63)) & 1;
+}
+
+void Mapper::clear_candidates() {
+    if (cand_kmers_.empty()) {
+        std::fill(cand_mask_.begin(), cand_mask_.end(), 0);
+    } else {
+        for (auto k : cand_kmers_) cand_mask_[k >> 6] = 0;
+        cand_kmers_.clear();
+    }
+}
+
+void Mapper::score_candidates(float event) {
+    if (!sparse_scoring_) {
+        cand_kmers_.clear();
+        model.match_probs(event, kmer_probs_.data(), 
+                          min_prob_thresh_, cand_mask_.data());
+        return;
+    }
+
+    clear_candidates();
+    model.candidates(event, min_prob_thresh_, cand_kmers_, kmer_probs_.data());
+    for (auto k : cand_kmers_) cand_mask_[k >> 6] |= u64(1) << (k & 63);
+}
+
+void Mapper::collect_candidates() {
+    clear_candidates();
+    for (u32 k = 0; k < kmer_probs_.size(); k++) {
+        if (kmer_probs_[k] >= min_prob_thresh_) {
+            cand_mask_[k >> 6] |= u64(1) << (k & 63);
+        }
+    }
+}
+
+bool Mapper::next_event(float &event) {
+    if (stream_sig_) stream_events();
+
     if (norm_.empty() || reset_ || event_i_ >= PRMS.max_events) {
         state_ = State::FAILURE;
-        return true;
+        decision_time_ = read_timer_.get();
+        end_path_budget();
+        end_counters();
+        return false;
     }
 
+    update_path_budget();
+    reserve_paths();
 
-    float event = norm_.pop();
+    event = norm_.pop();
+    trace_evt_ = event;
+    counters_.add(MapCounters::EVENTS);
+    if (event_i_ == 0) first_evt_time_ = read_timer_.get();
 
-    //TODO: store kmer_probs_ in static array
-    for (u16 kmer = 0; kmer < kmer_probs_.size(); kmer++) {
-        kmer_probs_[kmer] = model.match_prob(event, kmer);
-    }
+    return true;
+}
+
+float *Mapper::kmer_probs() {
+    return kmer_probs_.data();
+}
 
-    Range prev_range;
-    u16 prev_kmer;
+bool Mapper::map_scored() {
+    collect_candidates();
+    return map_candidates();
+}
+
+bool Mapper::map_candidates() {
+    const BwaIndex<KLEN> &idx = local_fmi();
+    kmer_t prev_kmer;
     float evpr_thresh;
     bool child_found;
 
-    auto next_path = next_paths_.begin();
+    u32 max_paths = std::min(path_budget_, path_cap_),
+        next_i = 0;
 
     //Find neighbors of previous nodes
-    for (u32 pi = 0; pi < prev_size_; pi++) {
-        if (!prev_paths_[pi].is_valid()) {
+    for (u32 pj = 0; pj < prev_size_; pj++) {
+        u32 pi = prev_order_[pj];
+
+        if (!prev_paths_.is_valid(pi)) {
             continue;
         }
 
         child_found = false;
 
-        PathBuffer &prev_path = prev_paths_[pi];
-        Range &prev_range = prev_path.fm_range_;
-        prev_kmer = prev_path.kmer_;
+        Range &prev_range = prev_paths_.fm_range_[pi];
+        prev_kmer = prev_paths_.kmer_[pi];
 
         evpr_thresh = get_prob_thresh(prev_range.length());
 
-        //evpr_thresh = PRMS.get_path_thresh(prev_path.total_move_len_);
-
-        if (prev_path.consec_stays_ < PRMS.max_consec_stay && 
+        if (prev_paths_.consec_stays_[pi] < PRMS.max_consec_stay && 
+            is_candidate(prev_kmer) &&
             kmer_probs_[prev_kmer] >= evpr_thresh) {
 
-            next_path->make_child(prev_path, 
-                                  prev_range,
-                                  prev_kmer, 
-                                  kmer_probs_[prev_kmer], 
-                                  EVENT_STAY);
+            make_child(next_paths_, next_i,
+                       prev_paths_, pi,
+                       prev_range,
+                       prev_kmer, 
+                       kmer_probs_[prev_kmer], 
+                       EVENT_STAY,
+                       !child_found);
             child_found = true;
 
-            if (++next_path == next_paths_.end()) {
+            if (++next_i == max_paths) {
                 break;
             }
         }
 
         //Add all the neighbors
+        //FM ranges for all bases are found at once, only if one is needed
+        Range next_ranges[BASE_COUNT];
+        bool neighbors_found = false;
+
         for (u8 b = 0; b < BASE_COUNT; b++) {
-            u16 next_kmer = kmer_neighbor<KLEN>(prev_kmer, b);
+            kmer_t next_kmer = kmer_neighbor<KLEN>(prev_kmer, b);
 
-            if (kmer_probs_[next_kmer] < evpr_thresh) {
+            if (!is_candidate(next_kmer) || kmer_probs_[next_kmer] < evpr_thresh) {
                 continue;
             }
 
-            Range next_range = fmi.get_neighbor(prev_range, b);
+            if (!neighbors_found) {
+                u8 elen = prev_paths_.ext_len_[pi];
+                if (elen > 0 && elen < idx.kmer_ext_len()) {
+                    idx.get_extensions(prev_paths_.ext_seq_[pi], elen, next_ranges);
+                } else {
+                    idx.get_neighbors(prev_range, next_ranges);
+                }
+                counters_.add(MapCounters::NEIGHBORS);
+                neighbors_found = true;
+            }
+
+            Range &next_range = next_ranges[b];
 
             if (!next_range.is_valid()) {
                 continue;
             }
 
-            next_path->make_child(prev_path, 
-                                  next_range,
-                                  next_kmer, 
-                                  kmer_probs_[next_kmer], 
-                                  EVENT_MOVE);
+            make_child(next_paths_, next_i,
+                       prev_paths_, pi,
+                       next_range,
+                       next_kmer, 
+                       kmer_probs_[next_kmer], 
+                       EVENT_MOVE,
+                       !child_found);
 
             child_found = true;
 
-            if (++next_path == next_paths_.end()) {
+            if (++next_i == max_paths) {
                 break;
             }
         }
 
 
-        if (!child_found && !prev_path.sa_checked_) {
+        if (!child_found && !prev_paths_.sa_checked_[pi]) {
 
             //Add seeds for non-extended paths
             //Extended paths will be updated after sources filled in
-            update_seeds(prev_path, true);
+            update_seeds(prev_paths_, pi, true);
 
         }
 
-        if (next_path == next_paths_.end()) {
+        if (next_i == max_paths) {
             break;
         }
     }
 
+    //Rings not inherited by a child are no longer needed
+    for (u32 pj = 0; pj < prev_size_; pj++) {
+        u32 &r = prev_paths_.ring_[prev_order_[pj]];
+        if (r != PathArena::NO_RING) {
+            free_ring(r);
+            r = PathArena::NO_RING;
+        }
+    }
+
     //Create sources between gaps
-    if (next_path != next_paths_.begin()) {
+    if (next_i > 0) {
+
+        u32 next_size = next_i;
+
+        for (u32 i = 0; i < next_size; i++) {
+            path_keys_[i].fm_range_ = next_paths_.fm_range_[i];
+            path_keys_[i].seed_prob_ = next_paths_.seed_prob_[i];
+            path_keys_[i].idx_ = i;
+        }
 
-        u32 next_size = next_path - next_paths_.begin();
+        pdqsort(path_keys_.begin(), path_keys_.begin() + next_size);
 
-        pdqsort(next_paths_.begin(), next_path);
-        //std::sort(next_paths_.begin(), next_path);
+        for (u32 i = 0; i < next_size; i++) {
+            next_order_[i] = path_keys_[i].idx_;
+        }
 
-        u16 source_kmer;
+        kmer_t source_kmer;
         prev_kmer = kmer_probs_.size(); 
 
         Range unchecked_range, source_range;
 
         for (u32 i = 0; i < next_size; i++) {
-            source_kmer = next_paths_[i].kmer_;
+            u32 ni = next_order_[i];
+            const Range &ni_range = next_paths_.fm_range_[ni];
+            source_kmer = next_paths_.kmer_[ni];
 
             //Add source for beginning of kmer range
             if (source_kmer != prev_kmer &&
-                next_path != next_paths_.end() &&
+                next_i != max_paths &&
                 kmer_probs_[source_kmer] >= get_source_prob()) {
 
                 sources_added_[source_kmer] = true;
 
-                source_range = Range(fmi.get_kmer_range(source_kmer).start_,
-                                     next_paths_[i].fm_range_.start_ - 1);
+                source_range = Range(local_fmi().get_kmer_range(source_kmer).start_,
+                                     ni_range.start_ - 1);
 
                 if (source_range.is_valid()) {
-                    next_path->make_source(source_range,
-                                           source_kmer,
-                                           kmer_probs_[source_kmer]);
-                    next_path++;
+                    make_source(next_paths_, next_i,
+                                source_range,
+                                source_kmer,
+                                kmer_probs_[source_kmer]);
+                    next_order_[next_i] = next_i;
+                    next_i++;
                 }                                    
 
-                unchecked_range = Range(next_paths_[i].fm_range_.end_ + 1,
-                                        fmi.get_kmer_range(source_kmer).end_);
+                unchecked_range = Range(ni_range.end_ + 1,
+                                        local_fmi().get_kmer_range(source_kmer).end_);
             }
 
             prev_kmer = source_kmer;
 
-            //Range next_range = next_paths_[i].fm_range_;
+            u32 nn = i < next_size - 1 ? next_order_[i+1] : 0;
 
             //Remove paths with duplicate ranges
             //Best path will be listed last
-            if (i < next_size - 1 && next_paths_[i].fm_range_ == next_paths_[i+1].fm_range_) {
-                next_paths_[i].invalidate();
+            if (i < next_size - 1 && ni_range == next_paths_.fm_range_[nn]) {
+                next_paths_.invalidate(ni);
+                free_ring(next_paths_.ring_[ni]);
+                next_paths_.ring_[ni] = PathArena::NO_RING;
                 continue;
             }
 
             //Start source after current path
             //TODO: check if theres space for a source here, instead of after extra work?
-            if (next_path != next_paths_.end() &&
+            if (next_i != max_paths &&
                 kmer_probs_[source_kmer] >= get_source_prob()) {
                 
                 source_range = unchecked_range;
                 
                 //Between this and next path ranges
-                if (i < next_size - 1 && source_kmer == next_paths_[i+1].kmer_) {
+                if (i < next_size - 1 && source_kmer == next_paths_.kmer_[nn]) {
 
-                    source_range.end_ = next_paths_[i+1].fm_range_.start_ - 1;
+                    source_range.end_ = next_paths_.fm_range_[nn].start_ - 1;
 
-                    if (unchecked_range.start_ <= next_paths_[i+1].fm_range_.end_) {
-                        unchecked_range.start_ = next_paths_[i+1].fm_range_.end_ + 1;
+                    if (unchecked_range.start_ <= next_paths_.fm_range_[nn].end_) {
+                        unchecked_range.start_ = next_paths_.fm_range_[nn].end_ + 1;
                     }
                 }
 
                 //Add it if it's a real range
                 if (source_range.is_valid()) {
-
-                    next_path->make_source(source_range,
-                                           source_kmer,
-                                           kmer_probs_[source_kmer]);
-                    next_path++;
+                    make_source(next_paths_, next_i,
+                                source_range,
+                                source_kmer,
+                                kmer_probs_[source_kmer]);
+                    next_order_[next_i] = next_i;
+                    next_i++;
                 }
             }
 
-            update_seeds(next_paths_[i], false);
+            update_seeds(next_paths_, ni, false);
         }
     }
 
-    for (u16 kmer = 0; 
-         kmer < kmer_probs_.size() && 
-            next_path != next_paths_.end(); 
-         kmer++) {
-
-        Range next_range = fmi.get_kmer_range(kmer);
+    //Only candidates can be sources or have sources_added_ set
+    //Bits are visited in k-mer order, so sources are added in that order
+    for (u32 w = 0; w < cand_mask_.size(); w++) {
+        for (u64 bits = cand_mask_[w]; bits != 0; bits &= bits - 1) {
+            kmer_t kmer = (w << 6) | __builtin_ctzll(bits);
 
-        if (!sources_added_[kmer] && 
-            kmer_probs_[kmer] >= get_source_prob() &&
-            next_path != next_paths_.end() &&
-            next_range.is_valid()) {
+            if (sources_added_[kmer]) {
+                sources_added_[kmer] = false;
+                continue;
+            }
 
-            //TODO: don't write to prob buffer here to speed up source loop
-            next_path->make_source(next_range, kmer, kmer_probs_[kmer]);
-            next_path++;
+            if (next_i == max_paths || kmer_probs_[kmer] < get_source_prob()) {
+                continue;
+            }
 
-        } else {
-            sources_added_[kmer] = false;
+            Range next_range = local_fmi().get_kmer_range(kmer);
+            if (next_range.is_valid()) {
+                make_source(next_paths_, next_i, next_range, kmer, kmer_probs_[kmer]);
+                next_order_[next_i] = next_i;
+                next_i++;
+            }
         }
     }
 
-    prev_size_ = next_path - next_paths_.begin();
-    prev_paths_.swap(next_paths_);
+    set_pool_paths(next_i);
+    counters_.add(MapCounters::PATHS, next_i);
+    prev_size_ = next_i;
+    std::swap(prev_paths_, next_paths_);
+    prev_order_.swap(next_order_);
 
     dbg_paths_out();
 
+    if (trace_id_ != 0) {
+        ReadTracer::get().step(trace_id_, event_i_, next_i, trace_evt_, 
+                               norm_.get_scale(), norm_.get_shift(),
+                               seed_tracker_.get_top_len());
+    }
+
     SeedCluster sc = seed_tracker_.get_final();
 
     if (sc.is_valid()) {
@@ -650,6 +1089,9 @@ bool Mapper::map_next() {
 
         set_ref_loc(sc);
         state_ = State::SUCCESS;
+        decision_time_ = read_timer_.get();
+        end_path_budget();
+        end_counters();
         return true;
         #endif
     }
@@ -662,40 +1104,64 @@ bool Mapper::map_next() {
     return false;
 }
 
-void Mapper::update_seeds(PathBuffer &path, bool path_ended) {
+void Mapper::update_seeds(PathArena &paths, u32 i, bool path_ended) {
 
-    if (!path.is_seed_valid(path_ended)) return;
+    if (!paths.is_seed_valid(i, path_ended)) return;
 
     //TODO: store actual SA coords?
     //avoid checking multiple times!
-    path.sa_checked_ = true;
+    paths.sa_checked_[i] = true;
+
+    u64 nrows = paths.fm_range_[i].length();
+    if (sa_buf_.size() < nrows) sa_buf_.resize(nrows);
+
+    if (sa_cache_.is_active()) {
+        u64 hits = 0;
+        nrows = local_fmi().sa_range_cached(paths.fm_range_[i], sa_buf_.data(), 
+                                            sa_cache_, PRMS.repeat_mask, hits);
+        counters_.add(MapCounters::SA_HITS, hits);
+        counters_.add(MapCounters::SA_MISSES, nrows - hits);
+        if (nrows == 0) return;
+    } else if (PRMS.repeat_mask) {
+        nrows = local_fmi().sa_range_unmasked(paths.fm_range_[i], sa_buf_.data());
+        if (nrows == 0) return;
+    } else {
+        local_fmi().sa_range(paths.fm_range_[i], sa_buf_.data());
+    }
+
+    counters_.add(MapCounters::SA_LOOKUPS);
+    counters_.add(MapCounters::SEEDS, nrows);
 
-    for (u64 s = path.fm_range_.start_; s <= path.fm_range_.end_; s++) {
+    u8 moves = paths.move_count(i);
+
+    for (u64 s = 0; s < nrows; s++) {
 
-        //TODO: store in buffer, replace sa_checked
-        //
         //Reverse the reference coords so they both go L->R
-        u64 sa_end = fmi.size() - fmi.sa(s);
+        u64 sa_end = local_fmi().size() - sa_buf_[s];
 
-        u32 ref_len = path.move_count() + KLEN - 1;
+        u32 ref_len = moves + KLEN - 1;
         u64 sa_start = sa_end - ref_len + 1;
 
         //Add seed and store updated seed cluster
         auto clust = seed_tracker_.add_seed(
             sa_end, 
-            path.move_count(), 
+            moves, 
             event_i_ - path_ended
         );
 
         #ifdef DEBUG_SEEDS
         dbg_seeds_out(
-            path, 
+            i, 
             clust.id_, 
             event_i_ - path_ended, 
             sa_start, 
             ref_len
         );
         #endif
+
+        if (trace_id_ != 0) {
+            trace_seed(i, clust.id_, event_i_ - path_ended, sa_start, ref_len);
+        }
     }
 }
 
@@ -705,19 +1171,35 @@ u32 Mapper::event_to_bp(u32 evt_i, bool last) const {
     return (evt_i * evdt_.mean_event_len() * ReadBuffer::PRMS.bp_per_samp()) + last*(KLEN - 1);
 }                  
 
+bool Mapper::has_targets() const {
+    return !targets.empty() || local_fmi().is_panel();
+}
+
+bool Mapper::on_target(u64 st, u64 en) const {
+    if (local_fmi().is_decoy(st)) return false;
+    return targets.empty() || targets.overlaps(st, en);
+}
+
+bool Mapper::cluster_loc(const SeedCluster &seeds, u64 &st, u64 &en) const {
+    bool fwd = seeds.ref_st_ < local_fmi().size() / 2;
+
+    if (fwd) st = seeds.ref_st_;
+    else     st = local_fmi().size() - (seeds.ref_en_.end_ + KLEN - 1);
+    en = st + (seeds.ref_en_.end_ - seeds.ref_st_ + KLEN);
+
+    return fwd;
+}
+
 void Mapper::set_ref_loc(const SeedCluster &seeds) {
-    bool fwd = seeds.ref_st_ < fmi.size() / 2;
+    u64 sa_st, sa_en;
+    bool fwd = cluster_loc(seeds, sa_st, sa_en);
 
-    u64 sa_st;
-    if (fwd) sa_st = seeds.ref_st_;
-    else      sa_st = fmi.size() - (seeds.ref_en_.end_ + KLEN - 1);
-    
     std::string rf_name;
-    u64 rd_st = event_to_bp(seeds.evt_st_ - PRMS.seed_len),
+    u64 rd_st = seeds.evt_st_ > PRMS.seed_len ? event_to_bp(seeds.evt_st_ - PRMS.seed_len) : 0,
         rd_en = event_to_bp(seeds.evt_en_, true),
         rd_len = event_to_bp(event_i_, true),
         rf_st = 0,
-        rf_len = fmi.translate_loc(sa_st, rf_name, rf_st), //sets rf_st
+        rf_len = local_fmi().translate_loc(sa_st, rf_name, rf_st), //sets rf_st
         rf_en = rf_st + (seeds.ref_en_.end_ - seeds.ref_st_ + KLEN);
 
     u16 match_count = seeds.total_len_ + KLEN - 1;
@@ -725,146 +1207,300 @@ void Mapper::set_ref_loc(const SeedCluster &seeds) {
     read_.loc_.set_read_len(rd_len);
     read_.loc_.set_mapped(rd_st, rd_en, rf_name, rf_st, rf_en, rf_len, fwd, match_count);
 
-}
+    if (!on_target(sa_st, sa_en)) {
+        read_.loc_.set_off_target();
+    }
 
-#ifdef DEBUG_OUT
-u32 Mapper::PathBuffer::count_ = 0;
-#endif
+}
 
-Mapper::PathBuffer::PathBuffer()
-    : length_(0),
-      prob_sums_(new float[PRMS.seed_len+1]) {
+void Mapper::PathArena::resize(u32 n) {
+    fm_range_.resize(n);
+    length_.resize(n, 0);
+    consec_stays_.resize(n);
+    ring_head_.resize(n);
+    sa_checked_.resize(n);
+    event_moves_.resize(n);
+    ring_.resize(n, NO_RING);
+    total_move_len_.resize(n);
+    kmer_.resize(n);
+    ext_seq_.resize(n);
+    ext_len_.resize(n);
+    seed_prob_.resize(n);
 
     #ifdef DEBUG_OUT
-    id_ = count_++;
+    parent_.resize(n);
     #endif
 }
 
-Mapper::PathBuffer::PathBuffer(const PathBuffer &p) {
-    std::memcpy(this, &p, sizeof(PathBuffer));
+float *Mapper::ring_sums(u32 r) {
+    return &ring_sums_[r * (PRMS.seed_len + 1)];
+}
+
+u32 Mapper::alloc_ring() {
+    assert(!free_rings_.empty());
+    u32 r = free_rings_.back();
+    free_rings_.pop_back();
+    return r;
 }
 
-void Mapper::PathBuffer::free_buffers() {
-    delete[] prob_sums_;
+void Mapper::free_ring(u32 r) {
+    free_rings_.push_back(r);
 }
 
-void Mapper::PathBuffer::make_source(Range &range, u16 kmer, float prob) {
-    length_ = 1;
-    consec_stays_ = 0;
-    event_moves_ = EVENT_MOVE;
-    seed_prob_ = prob;
-    fm_range_ = range;
-    kmer_ = kmer;
-    sa_checked_ = false;
+void Mapper::clear_paths() {
+    set_pool_paths(0);
+    prev_size_ = 0;
 
+    u32 nrings = 2 * path_cap_;
+    free_rings_.resize(nrings);
+    for (u32 r = 0; r < nrings; r++) {
+        free_rings_[r] = nrings - r - 1;
+    }
 
-    //path_type_counts_[EVENT_MOVE] = 1;
-    //path_type_counts_[EVENT_STAY] = 0;
-    total_move_len_ = 1;
+    std::fill(prev_paths_.ring_.begin(), prev_paths_.ring_.end(), PathArena::NO_RING);
+    std::fill(next_paths_.ring_.begin(), next_paths_.ring_.end(), PathArena::NO_RING);
+}
 
-    //TODO: don't write this here to speed up source loop
-    prob_sums_[0] = 0;
-    prob_sums_[1] = prob;
+u64 Mapper::pool_paths() {
+    return pool_paths_.load(std::memory_order_relaxed);
+}
+
+//Sets this mapper's contribution to pool_paths_
+void Mapper::set_pool_paths(u32 n) {
+    if (PRMS.path_pool_size > 0 && n != pooled_paths_) {
+        pool_paths_.fetch_add(static_cast<u64>(n) - pooled_paths_, std::memory_order_relaxed);
+        pooled_paths_ = n;
+    }
+}
+
+void Mapper::reserve_paths() {
+    //Each path has at most one stay and four move children, and each 
+    //child can add two sources, plus one source per k-mer
+    u32 need = std::min(path_budget_, 
+                        15 * prev_size_ + (u32) kmer_count<KLEN>());
+    if (need <= path_cap_) return;
+
+    u32 cap = std::min(PRMS.max_paths, std::max(need, 2 * path_cap_));
+
+    prev_paths_.resize(cap);
+    next_paths_.resize(cap);
+    prev_order_.resize(cap);
+    next_order_.resize(cap);
+    path_keys_.resize(cap);
+
+    //Parents keep their rings until all children are made,
+    //so at most 2*cap can be in use
+    ring_sums_.resize(2 * cap * (PRMS.seed_len + 1));
+    for (u32 r = 2 * path_cap_; r < 2 * cap; r++) {
+        free_rings_.push_back(r);
+    }
+
+    path_cap_ = cap;
+}
+
+void Mapper::update_path_budget() {
+    if (PRMS.path_pool_size == 0 || event_i_ < budget_evt_) return;
+    budget_evt_ = event_i_ + BUDGET_INTERVAL;
+
+    u64 total = pool_paths();
+
+    if (total > PRMS.path_pool_size && path_budget_ > PRMS.min_path_budget) {
+        path_budget_ = std::max(PRMS.min_path_budget, path_budget_ / 2);
+        min_budget_ = std::min(min_budget_, path_budget_);
+        budget_shrinks_++;
+
+    } else if (total < PRMS.path_pool_size / 4 * 3 && path_budget_ < PRMS.max_paths) {
+        path_budget_ = std::min(PRMS.max_paths, path_budget_ * 2);
+        budget_grows_++;
+    }
+}
+
+//Finished reads stop counting toward the pool
+void Mapper::end_path_budget() {
+    if (PRMS.path_pool_size == 0) return;
+    set_pool_paths(0);
+    read_.loc_.set_int(Paf::Tag::PATH_BUDGET, min_budget_);
+    read_.loc_.set_int(Paf::Tag::BUDGET_SHRINKS, budget_shrinks_);
+    read_.loc_.set_int(Paf::Tag::BUDGET_GROWS, budget_grows_);
+}
+
+void Mapper::end_counters() {
+    if (PRMS.counter_tags) {
+        for (u8 c = 0; c < MapCounters::READS; c++) {
+            read_.loc_.set_int((Paf::Tag) (Paf::Tag::EVENT_COUNT + c), 
+                               counters_.get((MapCounters::Counter) c));
+        }
+    }
+    counters_.flush();
+
+    if (trace_id_ != 0) trace_end();
+}
+
+void Mapper::trace_seed(u32 path, u32 clust, u32 evt, u64 sa_start, u32 ref_len) {
+    const BwaIndex<KLEN> &idx = local_fmi();
+    bool fwd = sa_start < idx.size() / 2;
+    u64 sa_half = fwd ? sa_start : idx.size() - (sa_start + ref_len - 1);
+
+    std::string rf_name;
+    u64 rf_st = 0;
+    idx.translate_loc(sa_half, rf_name, rf_st);
+
+    ReadTracer::get().seed(trace_id_, evt, path, clust, rf_name, rf_st, ref_len, fwd);
+}
+
+void Mapper::trace_end() {
+    ReadTracer::get().end(trace_id_, event_i_, (u8) state_, 
+                          read_.loc_.is_mapped(), decision_time_);
+    trace_id_ = 0;
+}
+
+void Mapper::make_source(PathArena &paths, u32 i, 
+                         Range &range, kmer_t kmer, float prob) {
+    paths.length_[i] = 1;
+    paths.consec_stays_[i] = 0;
+    paths.event_moves_[i] = EVENT_MOVE;
+    paths.seed_prob_[i] = prob;
+    paths.fm_range_[i] = range;
+    paths.kmer_[i] = kmer;
+    paths.ext_seq_[i] = kmer;
+    paths.ext_len_[i] = range == local_fmi().get_kmer_range(kmer) ? KLEN : 0;
+    paths.sa_checked_[i] = false;
+    paths.total_move_len_[i] = 1;
+
+    counters_.add(MapCounters::SOURCES);
+
+    u32 r = alloc_ring();
+    float *sums = ring_sums(r);
+    sums[0] = 0;
+    sums[1] = prob;
+    paths.ring_[i] = r;
+    paths.ring_head_[i] = 1;
 
     #ifdef DEBUG_OUT
-    parent_ = PRMS.max_paths;
+    paths.parent_[i] = PRMS.max_paths;
     #endif
 }
 
-
-void Mapper::PathBuffer::make_child(PathBuffer &p, 
-                                    Range &range,
-                                    u16 kmer, 
-                                    float prob, 
-                                    u8 move) {
+void Mapper::make_child(PathArena &next, u32 i,
+                        PathArena &prev, u32 pi,
+                        Range &range,
+                        kmer_t kmer, 
+                        float prob, 
+                        u8 move,
+                        bool inherit) {
 
     u8 stay = 1-move;
+    u8 plen = prev.length_[pi];
+    u32 ring_len = PRMS.seed_len + 1;
+
+    next.length_[i] = plen + (plen < PRMS.seed_len);
+    next.fm_range_[i] = range;
+    next.kmer_[i] = kmer;
+    next.sa_checked_[i] = prev.sa_checked_[pi];
+
+    u8 elen = prev.ext_len_[pi];
+    if (move && elen > 0) {
+        next.ext_len_[i] = elen < local_fmi().kmer_ext_len() ? elen + 1 : 0;
+        next.ext_seq_[i] = (prev.ext_seq_[pi] << 2) | (kmer & 3);
+    } else {
+        next.ext_len_[i] = elen;
+        next.ext_seq_[i] = prev.ext_seq_[pi];
+    }
+    next.event_moves_[i] = ((prev.event_moves_[pi] << 1) | move) & PATH_MASK;
+    next.consec_stays_[i] = (prev.consec_stays_[pi] + stay) * stay;
+    next.total_move_len_[i] = prev.total_move_len_[pi] + move;
+
+    //The new sum overwrites the parent's oldest, which no child needs
+    //Siblings made after the first copy its ring, then set the new sum
+    u32 r;
+    if (inherit) {
+        r = prev.ring_[pi];
+        prev.ring_[pi] = PathArena::NO_RING;
+    } else {
+        r = alloc_ring();
+        std::memcpy(ring_sums(r), ring_sums(next.ring_[i-1]), ring_len * sizeof(float));
+    }
 
-    length_ = p.length_ + (p.length_ < PRMS.seed_len);
-    fm_range_ = range;
-    kmer_ = kmer;
-    sa_checked_ = p.sa_checked_;
-    event_moves_ = ((p.event_moves_ << 1) | move) & PATH_MASK;
-    consec_stays_ = (p.consec_stays_ + stay) * stay;
+    u8 phead = prev.ring_head_[pi],
+       head = u32(phead) + 1 == ring_len ? 0 : phead + 1;
 
-    total_move_len_ = p.total_move_len_ + move;
+    float *sums = ring_sums(r);
+    sums[head] = sums[phead] + prob;
 
-    if (p.length_ == PRMS.seed_len) {
-        std::memcpy(prob_sums_, &(p.prob_sums_[1]), PRMS.seed_len * sizeof(float));
-        prob_sums_[PRMS.seed_len] = prob_sums_[PRMS.seed_len-1] + prob;
-        seed_prob_ = (prob_sums_[PRMS.seed_len] - prob_sums_[0]) / PRMS.seed_len;
-        event_moves_ |= PATH_TAIL_MOVE;
+    next.ring_[i] = r;
+    next.ring_head_[i] = head;
+
+    if (plen == PRMS.seed_len) {
+        u8 tail = u32(head) + 1 == ring_len ? 0 : head + 1;
+        next.seed_prob_[i] = (sums[head] - sums[tail]) / PRMS.seed_len;
+        next.event_moves_[i] |= PATH_TAIL_MOVE;
 
     } else {
-        std::memcpy(prob_sums_, p.prob_sums_, length_ * sizeof(float));
-        prob_sums_[length_] = prob_sums_[length_-1] + prob;
-        seed_prob_ = prob_sums_[length_] / length_;
+        next.seed_prob_[i] = sums[head] / next.length_[i];
     }
 
     #ifdef DEBUG_OUT
-    parent_ = p.id_;
+    next.parent_[i] = pi;
     #endif
 }
 
-void Mapper::PathBuffer::invalidate() {
-    length_ = 0;
+float Mapper::prob_head(const PathArena &paths, u32 i) const {
+    const float *sums = &ring_sums_[paths.ring_[i] * (PRMS.seed_len + 1)];
+    u8 head = paths.ring_head_[i],
+       prev = head == 0 ? PRMS.seed_len : head - 1;
+    return sums[head] - sums[prev];
 }
 
-bool Mapper::PathBuffer::is_valid() const {
-    return length_ > 0;
+void Mapper::PathArena::invalidate(u32 i) {
+    length_[i] = 0;
 }
 
-u8 Mapper::PathBuffer::stay_count() const {
-    return length_ - move_count();
-    //return path_type_counts_[EVENT_MOVE];
+bool Mapper::PathArena::is_valid(u32 i) const {
+    return length_[i] > 0;
 }
 
-float Mapper::PathBuffer::prob_head() const {
-    return prob_sums_[length_] - prob_sums_[length_-1];
-
+u8 Mapper::PathArena::stay_count(u32 i) const {
+    return length_[i] - move_count(i);
 }
 
-u8 Mapper::PathBuffer::move_count() const {
-    return __builtin_popcount(event_moves_);
-    //return path_type_counts_[EVENT_MOVE];
+u8 Mapper::PathArena::move_count(u32 i) const {
+    return __builtin_popcount(event_moves_[i]);
 }
 
-u8 Mapper::PathBuffer::type_head() const {
-    //return (event_moves_ >> (PRMS.seed_len-2)) & 1;
-    return event_moves_ & 1;
+u8 Mapper::PathArena::type_head(u32 i) const {
+    return event_moves_[i] & 1;
 }
 
-u8 Mapper::PathBuffer::type_tail() const {
-    //return event_moves_ & 1;
-    return (event_moves_ >> (PRMS.seed_len-2)) & 1;
+u8 Mapper::PathArena::type_tail(u32 i) const {
+    return (event_moves_[i] >> (PRMS.seed_len-2)) & 1;
 }
 
-bool Mapper::PathBuffer::is_seed_valid(bool path_ended) const {
+bool Mapper::PathArena::is_seed_valid(u32 i, bool path_ended) const {
 
     //All seeds must be same length
     //and have high probability
-    return (length_ == PRMS.seed_len &&
-            seed_prob_ >= PRMS.min_seed_prob) && (
+    return (length_[i] == PRMS.seed_len &&
+            seed_prob_[i] >= PRMS.min_seed_prob) && (
 
                //Must be non repetitive,
                //end in a move
                //and not have too many stays
-               (fm_range_.length() == 1 &&
-                type_head() == EVENT_MOVE &&
-                stay_count() <= PRMS.max_stay_frac * PRMS.seed_len) ||
+               (fm_range_[i].length() == 1 &&
+                type_head(i) == EVENT_MOVE &&
+                stay_count(i) <= PRMS.max_stay_frac * PRMS.seed_len) ||
 
                //Unless path is terminal,
                //not too repetitive,
                //and not too short
                (path_ended &&
-                fm_range_.length() <= PRMS.max_rep_copy &&
-                move_count() >= PRMS.min_rep_len)
+                fm_range_[i].length() <= PRMS.max_rep_copy &&
+                move_count(i) >= PRMS.min_rep_len)
            );
 }
 
 
-bool operator< (const Mapper::PathBuffer &p1, 
-                const Mapper::PathBuffer &p2) {
+bool operator< (const Mapper::PathKey &p1, 
+                const Mapper::PathKey &p2) {
     return p1.fm_range_ < p2.fm_range_ ||
            (p1.fm_range_ == p2.fm_range_ && 
             p1.seed_prob_ < p2.seed_prob_);
@@ -989,7 +1625,7 @@ void Mapper::dbg_events_out() {
 }
 
 void Mapper::dbg_seeds_out(
-        const PathBuffer &path, 
+        u32 path_id, 
         u32 clust, 
         u32 evt_end,
         u64 sa_start, 
@@ -1001,19 +1637,19 @@ void Mapper::dbg_seeds_out(
     
     //TODO clearly deliniate fm_coord, sa_coord(fw/rv), pacseq_coord, ann_coord
 
-    bool fwd = sa_start < (fmi.size() / 2);
+    bool fwd = sa_start < (local_fmi().size() / 2);
 
     //TODO change sa_ to clarify unstranded
     u32 sa_half;
     if (fwd) {
         sa_half = sa_start;
     } else {
-        sa_half = fmi.size() - (sa_start + ref_len - 1);
+        sa_half = local_fmi().size() - (sa_start + ref_len - 1);
     }
 
     std::string rf_name;
     u64 ref_st = 0;
-    fmi.translate_loc(sa_half, rf_name, ref_st);
+    local_fmi().translate_loc(sa_half, rf_name, ref_st);
 
     seeds_out_ << rf_name << "\t"
                << ref_st << "\t"
@@ -1021,7 +1657,7 @@ void Mapper::dbg_seeds_out(
 
                //name field
                << evt_prof_.mask_idx_map_[evt_end] << ":"
-               << path.id_ << ":"
+               << path_id << ":"
                << clust << "\t"
 
                << (fwd ? "+" : "-") << "\n";
@@ -1033,40 +1669,42 @@ void Mapper::dbg_seeds_out(
 
 void Mapper::dbg_paths_out() {
     #ifdef DEBUG_PATHS
-    for (u32 i = 0; i < prev_size_; i++) {
-        auto &p = prev_paths_[i];
+    const PathArena &p = prev_paths_;
+
+    for (u32 j = 0; j < prev_size_; j++) {
+        u32 i = prev_order_[j];
 
         u32 evt = evt_prof_.mask_idx_map_[event_i_];
 
         paths_out_ << evt << ":" 
-                   << p.id_ << "\t";
+                   << i << "\t";
 
-        if (p.parent_ < PRMS.max_paths) {
+        if (p.parent_[i] < PRMS.max_paths) {
             paths_out_ << evt_prof_.mask_idx_map_[event_i_-1] << ":" 
-                       << p.parent_ << "\t";
+                       << p.parent_[i] << "\t";
         } else {
             paths_out_ << evt << ":" 
-                       << p.id_ << "\t";
+                       << i << "\t";
         }
 
         paths_out_
-            << p.fm_range_.start_ << "\t"
-            << p.fm_range_.length() << "\t";
+            << p.fm_range_[i].start_ << "\t"
+            << p.fm_range_[i].length() << "\t";
 
-        if (p.is_valid()) {
-            paths_out_ << kmer_to_str<KLEN>(p.kmer_) << "\t";
+        if (p.is_valid(i)) {
+            paths_out_ << kmer_to_str<KLEN>(p.kmer_[i]) << "\t";
         } else {
             paths_out_ << "NNNNN\t"; //TODO store constant 
         }
 
         paths_out_ 
-            << p.total_move_len_ << "\t"
-            << p.prob_head() << "\t";
+            << p.total_move_len_[i] << "\t"
+            << (p.is_valid(i) ? prob_head(p, i) : 0) << "\t";
 
 
-        if (p.is_valid()) {
-            for (u32 i = 0; i < p.length_; i++) {
-                paths_out_ << ((p.event_moves_ >> i) & 1);
+        if (p.is_valid(i)) {
+            for (u32 k = 0; k < p.length_[i]; k++) {
+                paths_out_ << ((p.event_moves_[i] >> k) & 1);
             }
         } else {
             paths_out_ << 0;
@@ -33,8 +33,18 @@
 #include "pore_model.hpp"
 #include "seed_tracker.hpp"
 #include "read_buffer.hpp"
+#include "chunk_queue.hpp"
+#include "target_regions.hpp"
+#include "map_counters.hpp"
+#include "read_tracer.hpp"
+
+//Pore model k-mer length, set by building with KLEN=N (default 5). The
+//model's k-mers must be this long, e.g. KLEN=9 for R10.4 9-mer models
+#ifndef KMER_LEN
+#define KMER_LEN 5
+#endif
 
-const KmerLen KLEN = KmerLen::k5;
+const KmerLen KLEN = (KmerLen) KMER_LEN;
 
 //#define DEBUG_TIME
 //#define DEBUG_SEEDS
@@ -46,6 +56,8 @@ const KmerLen KLEN = KmerLen::k5;
 class Mapper {
     public:
 
+    typedef PoreModel<KLEN>::kmer_t kmer_t;
+
     typedef struct {
         //standard mapping
         u32 seed_len;
@@ -53,6 +65,13 @@ class Mapper {
         u32 max_rep_copy;
         u32 max_paths;
         u32 max_consec_stay;
+
+        //Adaptive path budget, disabled if path_pool_size is 0
+        //Each mapper's budget halves while the paths active across all 
+        //mappers exceed path_pool_size, and grows back toward max_paths 
+        //once they are below 3/4 of it
+        u32 path_pool_size;
+        u32 min_path_budget;
         u32 max_events;
         float max_stay_frac;
         float min_seed_prob;
@@ -62,10 +81,41 @@ class Mapper {
         float evt_timeout;
         float chunk_timeout;
 
+        //BED file of target regions, mappings elsewhere are off-target
+        std::string target_bed;
+
+        //Ends reads early once they can't reach min_map_len, or once an
+        //off-target cluster is early_conf times longer than any on-target 
+        //cluster. 0 disables early decisions
+        float early_conf;
+
+        //Report per-read MapCounters as Paf tags
+        bool counter_tags;
+
         std::string bwa_prefix;
         std::string idx_preset;
         std::string model_path;
 
+        //mmap index files instead of reading them into memory
+        bool idx_mmap;
+        bool idx_populate;
+        bool idx_hugepages;
+
+        //Pin pool threads to cores, alternating between NUMA nodes
+        bool numa_pin;
+
+        //"interleave" spreads the index over all NUMA nodes, "replicate"
+        //loads a copy on each node for its threads. Anything else, or a 
+        //single node, leaves placement to the kernel
+        std::string numa_index;
+
+        //Drop seeds in the index's RepeatMask before their SA lookups,
+        //if the index has one
+        bool repeat_mask;
+
+        //Size of the SaCache shared by all mappers in MB, 0 to disable
+        u32 sa_cache_mb;
+
         SeedTracker::Params seed_prms;
         Normalizer::Params norm_prms;
         EventDetector::Params event_prms;
@@ -83,12 +133,35 @@ class Mapper {
     static BwaIndex<KLEN> fmi;
     static PoreModel<KLEN> model;
     static std::vector<float> prob_threshes_;
+    static float min_prob_thresh_;
+    static bool sparse_scoring_;
+    static TargetRegions targets;
 
     static void load_static();
+
+    //Called by the ith thread of a pool before mapping, pins the thread
+    //if numa_pin is set and routes it to its node's index replica
+    static void bind_thread(u32 thread);
+
+    //Overrides PRMS.evt_batch_size, evt_timeout and chunk_timeout for all
+    //mappers while they run, see Autotuner. Zeros go back to PRMS
+    static void set_tuned_prms(u16 evt_batch_size, float evt_timeout, 
+                               float chunk_timeout);
+
+    //Index replica for the calling thread's node, fmi if not replicated
+    static const BwaIndex<KLEN> &local_fmi() {
+        return *thread_fmi_;
+    }
+
+    //Paths active across all mappers, only counted if path_pool_size is set
+    static u64 pool_paths();
     static inline u64 get_fm_bin(u64 fmlen);
 
     enum class State { INACTIVE, MAPPING, SUCCESS, FAILURE };
 
+    //Reported in the EARLY_STOP tag
+    enum EarlyStop { NO_STOP, UNREACHABLE, OFF_TARGET };
+
     Mapper();
     Mapper(const Mapper &m);
 
@@ -100,18 +173,49 @@ class Mapper {
 
     void new_read(ReadBuffer &r);
     void new_read(Chunk &c);
+    bool new_queued_read();
     void reset();
     void set_failed();
 
     Paf map_read();
 
+    //map_read split into steps, so one thread can interleave several reads
+    //map_start returns false if the read is already mapped
+    bool map_start();
+    bool map_next();
+    Paf map_end();
+
+    //Prefetches the FM index rows the next map_next will read
+    void prefetch_paths() const;
+
+    //map_next split around k-mer scoring, so MapPool can score events 
+    //from several reads at once. next_event returns false if the
+    //read ended, otherwise kmer_probs must be filled before map_scored
+    bool next_event(float &event);
+    float *kmer_probs();
+    bool map_scored();
+
     void skip_events(u32 n);
     bool add_chunk(Chunk &chunk);
+    bool push_chunk(Chunk &chunk);
+    bool has_queued_chunks() const;
 
     u32 event_to_bp(u32 evt_i, bool last=false) const;
 
     u32 events_mapped() const {return event_i_;}
 
+    //Milliseconds from the start of the read to its first mapped event
+    //and to the map/unmap decision, negative if not reached yet
+    float first_event_time() const {return first_evt_time_;}
+    float decision_time() const {return decision_time_;}
+    float read_time() {return read_timer_.get();}
+
+    //Estimates for deadline scheduling, see RealtimePool::MapperThread
+    //time_left is milliseconds of pore time before max_chunks ends the read
+    float time_left() const;
+    u32 event_backlog() const;
+    u32 path_count() const {return prev_size_;}
+
     u16 process_chunk();
     bool chunk_mapped();
     bool map_chunk();
@@ -136,75 +240,124 @@ class Mapper {
     static u32 PATH_MASK, PATH_TAIL_MOVE;
     //static u32 PATH_MASK;TODO popcount instead of store?
 
-    class PathBuffer {
+    //All paths for one event, stored as structure-of-arrays
+    //Probability prefix sums are kept in ring buffers from the
+    //mapper's ring pool (see alloc_ring), so children don't copy them
+    class PathArena {
         public:
 
-        PathBuffer();
-        PathBuffer(const PathBuffer &p);
+        static const u32 NO_RING = UINT32_MAX;
 
-        void make_source(Range &range, 
-                         u16 kmer, 
-                         float prob);
+        void resize(u32 n);
 
-        void make_child(PathBuffer &p, 
-                        Range &range, 
-                        u16 kmer, 
-                        float prob, 
-                        u8 event_type);
+        void invalidate(u32 i);
+        bool is_valid(u32 i) const;
+        bool is_seed_valid(u32 i, bool path_ended) const;
 
-        void invalidate();
-        bool is_valid() const;
-        bool is_seed_valid(bool has_children) const;
+        u8 type_head(u32 i) const;
+        u8 type_tail(u32 i) const;
+        u8 move_count(u32 i) const;
+        u8 stay_count(u32 i) const;
 
-        u8 type_head() const;
-        u8 type_tail() const;
-        u8 move_count() const;
-        u8 stay_count() const;
+        std::vector<Range> fm_range_;
+        std::vector<u8> length_,
+                        consec_stays_,
+                        ring_head_,
+                        sa_checked_;
 
-        float prob_head() const;
+        std::vector<u32> event_moves_,
+                         ring_;
 
-        void free_buffers();
-        void print() const;
+        std::vector<u16> total_move_len_;
+        std::vector<kmer_t> kmer_;
 
-        Range fm_range_;
-        u8 length_,
-           consec_stays_;
+        //Bases the path spells, packed like a k-mer, while its range is 
+        //still the full range of that sequence and it fits the k-mer
+        //extension table. ext_len_ is 0 otherwise
+        std::vector<u32> ext_seq_;
+        std::vector<u8> ext_len_;
 
-        //u8 stay_count_, move_count_;
-        //u8 path_type_counts_[EVENT_TYPES.size()];
-        u32 event_moves_;
+        std::vector<float> seed_prob_;
 
-        u16 total_move_len_;
-
-        u16 kmer_;
+        #ifdef DEBUG_OUT
+        std::vector<u32> parent_;
+        #endif
+    };
 
+    //Compact sort key for paths, so pdqsort doesn't move whole paths
+    struct PathKey {
+        Range fm_range_;
         float seed_prob_;
-        float *prob_sums_;
+        u32 idx_;
+    };
 
-        bool sa_checked_;
+    friend bool operator< (const PathKey &p1, const PathKey &p2);
 
-        #ifdef DEBUG_OUT
-        static u32 count_;
-        u32 id_, parent_;
-        #endif
+    void make_source(PathArena &paths, u32 i,
+                     Range &range, 
+                     kmer_t kmer, 
+                     float prob);
 
-        static void reset_count() {
-        #ifdef DEBUG_OUT
-            count_ = 0;
-        #endif
-        }
-    };
+    //Extends path pi of prev into path i of next
+    //If inherit is set the child takes over the parent's ring buffer
+    void make_child(PathArena &next, u32 i, 
+                    PathArena &prev, u32 pi,
+                    Range &range, 
+                    kmer_t kmer, 
+                    float prob, 
+                    u8 event_type,
+                    bool inherit);
 
-    friend bool operator< (const PathBuffer &p1, const PathBuffer &p2);
+    float prob_head(const PathArena &paths, u32 i) const;
+
+    u32 alloc_ring();
+    void free_ring(u32 r);
+    void clear_paths();
+    float *ring_sums(u32 r);
 
     private:
 
-    bool map_next();
+    void update_seeds(PathArena &paths, u32 i, bool has_children);
+
+    //Sets cand_mask_ to the k-mers above min_prob_thresh_, scoring them
+    //or taking them from kmer_probs_ filled by the caller of map_scored
+    void score_candidates(float event);
+    void collect_candidates();
+    void clear_candidates();
+    inline bool is_candidate(u32 kmer) const;
+    bool map_candidates();
+
+    //Feeds the normalizer from read_.full_signal_ in offline mapping
+    void stream_events();
+
+    //Grows path storage to fit the next event, up to the path budget
+    void reserve_paths();
+    void set_pool_paths(u32 n);
+    void update_path_budget();
+    void end_path_budget();
+
+    //Sets counter tags if enabled, and adds the counts to the totals
+    void end_counters();
 
-    void update_seeds(PathBuffer &p, bool has_children);
+    //ReadTracer records, only called if the read is traced
+    void trace_seed(u32 path, u32 clust, u32 evt, u64 sa_start, u32 ref_len);
+    void trace_end();
 
     void set_ref_loc(const SeedCluster &seeds);
 
+    //Sets [st, en) to the cluster's forward strand pac coordinates
+    //Returns true if the cluster is on the forward strand
+    bool cluster_loc(const SeedCluster &seeds, u64 &st, u64 &en) const;
+
+    //Panel decoys are never on target, other panel contigs always are
+    //unless a target BED is also given
+    bool has_targets() const;
+    bool on_target(u64 st, u64 en) const;
+
+    //Upper bound on bases the read can still add to a cluster
+    u32 remaining_bp() const;
+    EarlyStop early_decision() const;
+
 
     EventDetector evdt_;
     EventProfiler evt_prof_;
@@ -214,18 +367,72 @@ class Mapper {
 
     //u16 channel_;
     //u32 read_num_;
-    bool last_chunk_, reset_;//, processing_, adding_;
+    bool last_chunk_;
+    std::atomic<bool> reset_;
     State state_;
-    std::vector<float> kmer_probs_;
-    std::vector<PathBuffer> prev_paths_, next_paths_;
+    AlignedVec<float> kmer_probs_;
+
+    //With sparse scoring, only candidate entries of kmer_probs_ are set
+    //and cand_kmers_ lists them, so cand_mask_ can be cleared sparsely
+    std::vector<kmer_t> cand_kmers_;
+    std::vector<u64> cand_mask_;
+    std::vector<u64> sa_buf_;
+    PathArena prev_paths_, next_paths_;
+    std::vector<u32> prev_order_, next_order_;
+    std::vector<PathKey> path_keys_;
+
+    //seed_len+1 prefix sums per ring, 2*max_paths rings
+    std::vector<float> ring_sums_;
+    std::vector<u32> free_rings_;
+
+    static std::atomic<u64> pool_paths_;
+
+    static std::atomic<u16> evt_batch_size_;
+    static std::atomic<float> evt_timeout_;
+    static std::atomic<float> chunk_timeout_;
+    static const u32 BUDGET_INTERVAL = 32;
+
+    //One index per NUMA node if replicated, the first being fmi
+    static std::vector<BwaIndex<KLEN> *> numa_fmi_;
+
+    static SaCache sa_cache_;
+    static thread_local const BwaIndex<KLEN> *thread_fmi_;
+
+    static void load_index_numa();
+
+    //Largest PoreModel::scan_fraction to score events sparsely at
+    static const float SPARSE_SCAN_FRAC;
+
+    //Allocated paths per arena, grown on demand up to path_budget_
+    //Budget and shrink/grow counts are reported as Paf tags
+    u32 path_cap_,
+        pooled_paths_,
+        path_budget_,
+        min_budget_,
+        budget_evt_,
+        budget_shrinks_,
+        budget_grows_;
+    MapCounters counters_;
     std::vector<bool> sources_added_;
+    std::vector<Event> chunk_events_;
     u32 prev_size_,
         event_i_,
-        chunk_i_;
-    Timer chunk_timer_, map_timer_;
-    float map_time_, wait_time_;
+        chunk_evt_i_,
+        sig_i_;
+
+    //ReadTracer ID of the read, 0 if not traced, and its last event
+    u32 trace_id_;
+    float trace_evt_;
+
+    //Set by map_start, full_signal_ is detected into chunk_events_ 
+    //starting from sig_i_ as events are needed
+    bool stream_sig_;
+    Timer chunk_timer_, map_timer_, read_timer_;
+    float map_time_, wait_time_, first_evt_time_, decision_time_;
 
-    std::mutex chunk_mtx_;
+    //Filled by the pool thread, drained by whichever mapper thread
+    //currently owns this channel
+    ChunkQueue chunk_queue_;
 
 
     //Debug output functions
@@ -234,7 +441,7 @@ class Mapper {
     void dbg_close_all();
 
     void dbg_seeds_out(
-        const PathBuffer &path, 
+        u32 path_id, 
         u32 clust, 
         u32 evt_end, 
         u64 sa_start, 
@@ -0,0 +1,182 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_NUMA_TOPOLOGY
+#define _INCL_NUMA_TOPOLOGY
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "util.hpp"
+
+//Memory policies from linux/mempolicy.h, set through the syscall 
+//so libnuma isn't required
+#define NUMA_MPOL_DEFAULT    0
+#define NUMA_MPOL_PREFERRED  1
+#define NUMA_MPOL_INTERLEAVE 3
+
+//NUMA nodes and the CPUs this process may run on, read from sysfs
+//Nodes without allowed CPUs are skipped. Without sysfs, all CPUs are 
+//treated as one node and pinning/memory policies still work or no-op
+class NumaTopology {
+    public:
+
+    static const u32 MAX_NODES = 1024;
+
+    static const NumaTopology &get() {
+        static NumaTopology topo;
+        return topo;
+    }
+
+    u16 node_count() const {
+        return cpus_.size();
+    }
+
+    //Kernel node ID of the ith node
+    u32 node_id(u16 node) const {
+        return ids_[node];
+    }
+
+    const std::vector<u32> &node_cpus(u16 node) const {
+        return cpus_[node];
+    }
+
+    //Consecutive worker threads alternate between nodes, then cores
+    u16 thread_node(u32 thread) const {
+        return thread % cpus_.size();
+    }
+
+    u32 thread_cpu(u32 thread) const {
+        const std::vector<u32> &c = cpus_[thread_node(thread)];
+        return c[(thread / cpus_.size()) % c.size()];
+    }
+
+    //Pins the calling thread
+    bool pin_cpu(u32 cpu) const {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    bool pin_node(u16 node) const {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (u32 c : cpus_[node]) CPU_SET(c, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+    //Memory policy of the calling thread for pages it touches first
+    bool prefer_node(u16 node) const {
+        std::vector<u64> mask(MAX_NODES / 64, 0);
+        set_bit(mask, ids_[node]);
+        return set_policy(NUMA_MPOL_PREFERRED, mask.data());
+    }
+
+    bool interleave() const {
+        std::vector<u64> mask(MAX_NODES / 64, 0);
+        for (u32 id : ids_) set_bit(mask, id);
+        return set_policy(NUMA_MPOL_INTERLEAVE, mask.data());
+    }
+
+    bool reset_policy() const {
+        return set_policy(NUMA_MPOL_DEFAULT, NULL);
+    }
+
+    private:
+
+    NumaTopology() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            for (u32 c = 0; c < CPU_SETSIZE; c++) CPU_SET(c, &allowed);
+        }
+
+        std::vector<u32> online;
+        std::ifstream in("/sys/devices/system/node/online");
+        std::string list;
+        if (in >> list) online = parse_list(list);
+
+        for (u32 id : online) {
+            std::ifstream cpu_in("/sys/devices/system/node/node" + 
+                                 std::to_string(id) + "/cpulist");
+            std::string cpu_list;
+            if (!(cpu_in >> cpu_list)) continue;
+
+            std::vector<u32> cpus;
+            for (u32 c : parse_list(cpu_list)) {
+                if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) cpus.push_back(c);
+            }
+
+            if (!cpus.empty()) {
+                ids_.push_back(id);
+                cpus_.push_back(cpus);
+            }
+        }
+
+        if (cpus_.empty()) {
+            ids_.assign(1, 0);
+            cpus_.resize(1);
+            for (u32 c = 0; c < CPU_SETSIZE; c++) {
+                if (CPU_ISSET(c, &allowed)) cpus_[0].push_back(c);
+            }
+            if (cpus_[0].empty()) cpus_[0].push_back(0);
+        }
+    }
+
+    //Parses sysfs lists like "0-3,8-11"
+    static std::vector<u32> parse_list(const std::string &list) {
+        std::vector<u32> ret;
+        std::stringstream ss(list);
+        std::string range;
+        while (getline(ss, range, ',')) {
+            size_t dash = range.find('-');
+            u32 st = atoi(range.c_str()),
+                en = dash == std::string::npos ? st : atoi(range.c_str()+dash+1);
+            for (u32 i = st; i <= en; i++) ret.push_back(i);
+        }
+        return ret;
+    }
+
+    static void set_bit(std::vector<u64> &mask, u32 id) {
+        if (id < MAX_NODES) mask[id / 64] |= 1ULL << (id % 64);
+    }
+
+    static bool set_policy(int mode, const u64 *mask) {
+        #ifdef SYS_set_mempolicy
+        return syscall(SYS_set_mempolicy, mode, mask, mask ? MAX_NODES : 0) == 0;
+        #else
+        return false;
+        #endif
+    }
+
+    std::vector<u32> ids_;
+    std::vector< std::vector<u32> > cpus_;
+};
+
+#endif
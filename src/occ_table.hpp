@@ -0,0 +1,328 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_OCC_TABLE
+#define _INCL_OCC_TABLE
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdio>
+#include <iostream>
+#include <bwa/bwt.h>
+#include "util.hpp"
+#include "mapped_file.hpp"
+
+#define OCC_TABLE_SUFF ".uocc"
+
+//Rank structure over the BWA BWT string, stored next to the ".bwt"
+//Each 64-byte block holds the occurrence counts of all four bases before it
+//(relative to its superblock) followed by 192 2-bit packed bases, so one 
+//cache line answers a rank query for every base using popcounts
+class OccTable {
+    public:
+
+    static const u64 MAGIC = 0x31434f434c434e55ULL; //"UNCLCOC1"
+    static const u32 BLOCK_BASES = 192;
+
+    //Blocks per superblock is 2^24, keeping relative counts below 2^32
+    static const u32 SUPER_SHIFT = 24;
+
+    struct alignas(64) Block {
+        u32 counts[4];
+        u64 bases[6];
+    };
+
+    OccTable() : 
+        len_(0), primary_(0), 
+        blocks_(NULL), supers_(NULL), 
+        nblocks_(0), nsupers_(0),
+        loaded_(false) {}
+
+    //Move-only, since a copy would share the mapped file
+    OccTable(const OccTable &) = delete;
+    OccTable &operator=(const OccTable &) = delete;
+
+    OccTable(OccTable &&o) : OccTable() {
+        *this = std::move(o);
+    }
+
+    //Leaves o empty, as after destroy()
+    OccTable &operator=(OccTable &&o) {
+        if (this == &o) return *this;
+        destroy();
+        len_ = o.len_;
+        primary_ = o.primary_;
+        blocks_ = o.blocks_;
+        supers_ = o.supers_;
+        nblocks_ = o.nblocks_;
+        nsupers_ = o.nsupers_;
+        block_buf_ = std::move(o.block_buf_);
+        super_buf_ = std::move(o.super_buf_);
+        file_ = std::move(o.file_);
+        loaded_ = o.loaded_;
+        if (loaded_ && !file_.is_open()) set_buffers();
+        o.destroy();
+        return *this;
+    }
+
+    bool is_loaded() const {
+        return loaded_;
+    }
+
+    u64 size_bytes() const {
+        return nblocks_ * sizeof(Block) + nsupers_ * sizeof(u64);
+    }
+
+    void build(const bwt_t *bwt) {
+        len_ = bwt->seq_len;
+        primary_ = bwt->primary;
+
+        u64 nblocks = len_ / BLOCK_BASES + 1;
+        block_buf_.assign(nblocks, Block());
+        super_buf_.clear();
+
+        u64 totals[4] = {0, 0, 0, 0};
+        u64 i = 0;
+        for (u64 b = 0; b < nblocks; b++) {
+            if ((b & ((1ULL << SUPER_SHIFT) - 1)) == 0) {
+                super_buf_.insert(super_buf_.end(), totals, totals+4);
+            }
+
+            Block &blk = block_buf_[b];
+            const u64 *sup = &super_buf_[super_buf_.size()-4];
+            for (u8 c = 0; c < 4; c++) {
+                blk.counts[c] = static_cast<u32>(totals[c] - sup[c]);
+            }
+
+            for (u8 w = 0; w < 6; w++) {
+                u64 word = 0;
+                for (u8 j = 0; j < 32 && i < len_; j++, i++) {
+                    u64 c = bwt_B0(bwt, i);
+                    word |= c << (j << 1);
+                    totals[c]++;
+                }
+                blk.bases[w] = word;
+            }
+        }
+
+        set_buffers();
+    }
+
+    bool save(const std::string &fname) const {
+        FILE *out = fopen(fname.c_str(), "wb");
+        if (out == NULL) {
+            std::cerr << "Error: failed to open \"" << fname << "\"\n";
+            return false;
+        }
+
+        u64 header[HEADER_LEN] = {MAGIC, len_, primary_, nblocks_, nsupers_, 0, 0, 0};
+        bool ok = fwrite(header, sizeof(u64), HEADER_LEN, out) == HEADER_LEN &&
+                  fwrite(blocks_, sizeof(Block), nblocks_, out) == nblocks_ &&
+                  fwrite(supers_, sizeof(u64), nsupers_, out) == nsupers_;
+        fclose(out);
+
+        if (!ok) std::cerr << "Error: failed to write \"" << fname << "\"\n";
+        return ok;
+    }
+
+    //Returns false without printing if the file does not exist,
+    //since the table is optional
+    bool load(const std::string &fname, const bwt_t *bwt) {
+        FILE *in = fopen(fname.c_str(), "rb");
+        if (in == NULL) return false;
+
+        u64 header[HEADER_LEN];
+        bool ok = fread(header, sizeof(u64), HEADER_LEN, in) == HEADER_LEN &&
+                  check_header(header, bwt);
+
+        if (ok) {
+            block_buf_.resize(header[3]);
+            super_buf_.resize(header[4]);
+            ok = fread(block_buf_.data(), sizeof(Block), block_buf_.size(), in) == block_buf_.size() &&
+                 fread(super_buf_.data(), sizeof(u64), super_buf_.size(), in) == super_buf_.size();
+        }
+        fclose(in);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid occurrence table \"" << fname << "\"\n";
+            block_buf_.clear();
+            super_buf_.clear();
+            return false;
+        }
+
+        set_buffers();
+        return true;
+    }
+
+    //Like load(), but maps the file instead of copying it
+    bool map(const std::string &fname, const bwt_t *bwt, 
+             bool populate = false, bool hugepages = false) {
+        if (!file_.open(fname, false, populate, hugepages)) return false;
+
+        const u64 *header = reinterpret_cast<const u64 *>(file_.data());
+        bool ok = file_.size() >= HEADER_LEN * sizeof(u64) &&
+                  check_header(header, bwt) &&
+                  file_.size() == HEADER_LEN * sizeof(u64) + 
+                                  header[3] * sizeof(Block) + 
+                                  header[4] * sizeof(u64);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid occurrence table \"" << fname << "\"\n";
+            file_.close();
+            return false;
+        }
+
+        nblocks_ = header[3];
+        nsupers_ = header[4];
+        blocks_ = reinterpret_cast<const Block *>(header + HEADER_LEN);
+        supers_ = reinterpret_cast<const u64 *>(blocks_ + nblocks_);
+        loaded_ = true;
+        return true;
+    }
+
+    void destroy() {
+        file_.close();
+        block_buf_.clear();
+        super_buf_.clear();
+        blocks_ = NULL;
+        supers_ = NULL;
+        nblocks_ = nsupers_ = 0;
+        loaded_ = false;
+    }
+
+    //Same semantics as bwt_occ4: counts of each base in BWT[0,k]
+    inline void occ4(u64 k, u64 cnt[4]) const {
+        if (k == (u64) -1) {
+            cnt[0] = cnt[1] = cnt[2] = cnt[3] = 0;
+            return;
+        }
+        rank4(k - (k >= primary_) + 1, cnt);
+    }
+
+    //Same semantics as bwt_occ
+    inline u64 occ(u64 k, u8 c) const {
+        if (k == (u64) -1) return 0;
+        return rank(k - (k >= primary_) + 1, c);
+    }
+
+    //Same semantics as bwt_invPsi, given the BWT's L2 array
+    //The base and its rank come from the same block
+    inline u64 lf(u64 k, const u64 *L2) const {
+        if (k == primary_) return 0;
+        u64 j = k - (k > primary_),
+            b = j / BLOCK_BASES;
+        u32 r = j - b * BLOCK_BASES;
+        u8 c = (blocks_[b].bases[r >> 5] >> ((r & 31) << 1)) & 3;
+        return L2[c] + rank(j + 1, c);
+    }
+
+    inline void prefetch(u64 k) const {
+        __builtin_prefetch(&blocks_[(k - (k > primary_)) / BLOCK_BASES]);
+    }
+
+    private:
+
+    static const u64 LO_BITS = 0x5555555555555555ULL;
+
+    //Header occupies one block so mapped blocks stay 64-byte aligned
+    static const u32 HEADER_LEN = 8;
+
+    bool check_header(const u64 *header, const bwt_t *bwt) {
+        if (header[0] != MAGIC || 
+            header[1] != bwt->seq_len || 
+            header[2] != bwt->primary) {
+            return false;
+        }
+        len_ = header[1];
+        primary_ = header[2];
+        return true;
+    }
+
+    void set_buffers() {
+        blocks_ = block_buf_.data();
+        supers_ = super_buf_.data();
+        nblocks_ = block_buf_.size();
+        nsupers_ = super_buf_.size();
+        loaded_ = true;
+    }
+
+    static inline u64 prefix_mask(u32 r) {
+        return r >= 32 ? ~0ULL : ((1ULL << (r << 1)) - 1);
+    }
+
+    //Counts of each base in the first n characters of the BWT string
+    inline void rank4(u64 n, u64 cnt[4]) const {
+        u64 b = n / BLOCK_BASES;
+        u32 r = n - b * BLOCK_BASES;
+        const Block &blk = blocks_[b];
+        const u64 *sup = &supers_[(b >> SUPER_SHIFT) << 2];
+
+        u32 n1 = 0, n2 = 0, n3 = 0;
+        for (u8 w = 0; r > (u32) w << 5; w++) {
+            u64 x = blk.bases[w],
+                m = prefix_mask(r - (w << 5)) & LO_BITS,
+                lo = x & m,
+                hi = (x >> 1) & m;
+            n1 += __builtin_popcountll(lo & ~hi);
+            n2 += __builtin_popcountll(hi & ~lo);
+            n3 += __builtin_popcountll(lo & hi);
+        }
+
+        cnt[0] = sup[0] + blk.counts[0] + (r - n1 - n2 - n3);
+        cnt[1] = sup[1] + blk.counts[1] + n1;
+        cnt[2] = sup[2] + blk.counts[2] + n2;
+        cnt[3] = sup[3] + blk.counts[3] + n3;
+    }
+
+    inline u64 rank(u64 n, u8 c) const {
+        u64 b = n / BLOCK_BASES;
+        u32 r = n - b * BLOCK_BASES;
+        const Block &blk = blocks_[b];
+
+        u64 pattern = LO_BITS * c;
+        u32 count = 0;
+        for (u8 w = 0; r > (u32) w << 5; w++) {
+            u64 x = blk.bases[w] ^ pattern;
+            count += __builtin_popcountll(~(x | (x >> 1)) & LO_BITS & prefix_mask(r - (w << 5)));
+        }
+
+        return supers_[((b >> SUPER_SHIFT) << 2) + c] + blk.counts[c] + count;
+    }
+
+    u64 len_, primary_;
+
+    const Block *blocks_;
+    const u64 *supers_;
+    u64 nblocks_, nsupers_;
+
+    //Storage when built or loaded rather than mapped
+    AlignedVec<Block> block_buf_;
+    std::vector<u64> super_buf_;
+    MappedFile file_;
+
+    bool loaded_;
+};
+
+#endif
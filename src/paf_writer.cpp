@@ -0,0 +1,496 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include "paf_writer.hpp"
+
+const char PafWriter::MAGIC[4] = {'U', 'N', 'C', 'P'};
+
+PafWriter::PafWriter(const std::string &fname, bool binary, u32 buffer_size, 
+                     bool append, ReadCheckpoint *checkpoint) 
+    : binary_(binary),
+      buffer_size_(std::max(buffer_size, u32(1))),
+      fd_(STDOUT_FILENO),
+      close_fd_(false),
+      stopped_(false),
+      written_(0),
+      checkpoint_(checkpoint) {
+
+    if (!fname.empty() && append) {
+        std::ifstream in(fname, std::ios::binary);
+        if (in.is_open()) {
+            std::string data((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+            u64 len = complete_length(data, binary_);
+            if (len < data.size() && truncate(fname.c_str(), len) != 0) {
+                std::cerr << "Warning: failed to truncate partial PAF record\n";
+            }
+        }
+    }
+
+    if (!fname.empty()) {
+        int mode = append ? O_APPEND : O_TRUNC;
+        fd_ = open(fname.c_str(), O_WRONLY | O_CREAT | mode, 0644);
+        if (fd_ < 0) {
+            std::cerr << "Error: failed to open PAF output \"" << fname << "\"\n";
+        } else {
+            close_fd_ = true;
+        }
+    }
+
+    Node *stub = new Node();
+    stub->next.store(NULL, std::memory_order_relaxed);
+    head_.store(stub, std::memory_order_relaxed);
+    tail_ = stub;
+
+    buffer_.reserve(buffer_size_);
+
+    //Appended runs start with their own header, see HEADER_ENTRY
+    if (binary_) {
+        PafBinHeader h;
+        memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version = VERSION;
+        h.record_size = sizeof(Paf::BinRecord);
+        h.tag_count = Paf::Tag::NORM_SKIP_COUNT + 1;
+        buffer_.append(reinterpret_cast<const char *>(&h), sizeof(h));
+    }
+
+    thread_ = std::thread(&PafWriter::run, this);
+}
+
+PafWriter::PafWriter(const OutputParams &prms, ReadCheckpoint *checkpoint) 
+    : PafWriter(prms.paf_out, prms.paf_binary, prms.paf_buffer, 
+                prms.resume, checkpoint) {}
+
+PafWriter::~PafWriter() {
+    close();
+    while (tail_ != NULL) {
+        Node *next = tail_->next.load(std::memory_order_acquire);
+        delete tail_;
+        tail_ = next;
+    }
+}
+
+void PafWriter::submit(const Paf &paf) {
+    submit(Paf(paf));
+}
+
+void PafWriter::submit(Paf &&paf) {
+    Node *n = new Node();
+    n->next.store(NULL, std::memory_order_relaxed);
+    n->paf = std::move(paf);
+
+    Node *prev = head_.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+}
+
+void PafWriter::close() {
+    if (thread_.joinable()) {
+        stopped_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+
+    if (close_fd_) {
+        ::close(fd_);
+        close_fd_ = false;
+        fd_ = -1;
+    }
+}
+
+u64 PafWriter::written() const {
+    return written_.load(std::memory_order_relaxed);
+}
+
+//The returned node becomes the new stub, and is freed by the next pop
+PafWriter::Node *PafWriter::pop() {
+    Node *next = tail_->next.load(std::memory_order_acquire);
+    if (next == NULL) return NULL;
+    delete tail_;
+    tail_ = next;
+    return next;
+}
+
+void PafWriter::run() {
+    Timer flush_timer;
+
+    while (true) {
+        //Anything submitted before close() is visible once stopped_ is
+        bool stopping = stopped_.load(std::memory_order_acquire);
+        bool idle = true;
+
+        Node *n;
+        while ((n = pop()) != NULL) {
+            encode(n->paf);
+            idle = false;
+
+            if (buffer_.size() >= buffer_size_) {
+                flush();
+                flush_timer.reset();
+            }
+        }
+
+        if (stopping) break;
+
+        if (idle) {
+            if (!buffer_.empty() && flush_timer.get() >= FLUSH_INTERVAL) {
+                flush();
+                flush_timer.reset();
+            }
+            usleep(SLEEP_US);
+        }
+    }
+
+    flush();
+}
+
+void PafWriter::encode(const Paf &paf) {
+    if (checkpoint_ != NULL) buffered_reads_.push_back(paf.get_rd_name());
+
+    if (!binary_) {
+        paf.write_paf(buffer_);
+        written_++;
+        return;
+    }
+
+    u32 id = Paf::NO_REF;
+    if (paf.is_mapped()) {
+        const std::string &name = paf.get_rf_name();
+        auto r = ref_ids_.find(name);
+
+        if (r != ref_ids_.end()) {
+            id = r->second;
+        } else {
+            id = ref_ids_.size();
+            ref_ids_[name] = id;
+
+            u64 len = paf.get_rf_len();
+            u16 name_len = std::min(name.size(), size_t(USHRT_MAX));
+            buffer_.push_back(REF_ENTRY);
+            buffer_.append(reinterpret_cast<const char *>(&id), sizeof(id));
+            buffer_.append(reinterpret_cast<const char *>(&len), sizeof(len));
+            buffer_.append(reinterpret_cast<const char *>(&name_len), sizeof(name_len));
+            buffer_.append(name, 0, name_len);
+        }
+    }
+
+    buffer_.push_back(PAF_ENTRY);
+    paf.write_bin(buffer_, id);
+    written_++;
+}
+
+void PafWriter::flush() {
+    const char *p = buffer_.data();
+    size_t n = buffer_.size();
+    while (n > 0 && fd_ >= 0) {
+        ssize_t w = write(fd_, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: failed to write PAF output\n";
+            break;
+        }
+        p += w;
+        n -= w;
+    }
+    buffer_.clear();
+
+    //Unwritten reads are left for the next run to map again
+    if (checkpoint_ != NULL && n == 0) {
+        for (auto &id : buffered_reads_) checkpoint_->read_written(id);
+        checkpoint_->flush();
+    }
+    buffered_reads_.clear();
+}
+
+u64 PafWriter::complete_length(const std::string &data, bool binary) {
+    if (!binary) {
+        size_t nl = data.rfind('\n');
+        return nl == std::string::npos ? 0 : nl + 1;
+    }
+
+    u64 i = 0, end = 0;
+    while (i < data.size()) {
+        u8 kind = data[i];
+        if (kind == HEADER_ENTRY) {
+            i += sizeof(PafBinHeader);
+        } else if (kind == REF_ENTRY) {
+            u16 name_len;
+            i += 1 + sizeof(u32) + sizeof(u64);
+            if (i + sizeof(name_len) > data.size()) break;
+            memcpy(&name_len, &data[i], sizeof(name_len));
+            i += sizeof(name_len) + name_len;
+        } else if (kind == PAF_ENTRY) {
+            Paf::BinRecord r;
+            if (i + 1 + sizeof(r) > data.size()) break;
+            memcpy(&r, &data[i+1], sizeof(r));
+            i += 1 + sizeof(r) + r.body_len;
+        } else {
+            break;
+        }
+        if (i <= data.size()) end = i;
+    }
+    return end;
+}
+
+template <typename T>
+static bool read_val(const std::string &data, u64 &i, T &v) {
+    if (i + sizeof(T) > data.size()) return false;
+    memcpy(&v, &data[i], sizeof(T));
+    i += sizeof(T);
+    return true;
+}
+
+PafBinReader::PafBinReader(const std::string &fname) : valid_(false) {
+    std::ifstream in(fname, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) {
+        std::cerr << "Error: failed to open binary PAF \"" << fname << "\"\n";
+        return;
+    }
+
+    std::string data(in.tellg(), '\0');
+    in.seekg(0);
+    in.read(&data[0], data.size());
+
+    if (data.size() < sizeof(PafBinHeader) || 
+        memcmp(data.data(), PafWriter::MAGIC, sizeof(PafWriter::MAGIC)) != 0) {
+        std::cerr << "Error: \"" << fname << "\" is not a binary PAF file\n";
+        return;
+    }
+
+    //Each run's reference IDs, mapped to indices into rf_names
+    std::unordered_map<std::string, u32> rf_index;
+    std::vector<u32> run_ids;
+
+    u64 i = 0;
+    while (i < data.size()) {
+        u8 kind = data[i++];
+
+        if (kind == PafWriter::HEADER_ENTRY) {
+            PafBinHeader h;
+            i--;
+            if (!read_val(data, i, h) || 
+                memcmp(h.magic, PafWriter::MAGIC, sizeof(h.magic)) != 0) break;
+
+            if (h.version != PafWriter::VERSION || h.record_size != sizeof(Paf::BinRecord)) {
+                std::cerr << "Error: unsupported binary PAF version " << h.version << "\n";
+                return;
+            }
+            run_ids.clear();
+
+        } else if (kind == PafWriter::REF_ENTRY) {
+            u32 id;
+            u64 len;
+            u16 name_len;
+            if (!read_val(data, i, id) || !read_val(data, i, len) || 
+                !read_val(data, i, name_len) || i + name_len > data.size()) break;
+
+            std::string name = data.substr(i, name_len);
+            i += name_len;
+
+            auto r = rf_index.find(name);
+            u32 idx;
+            if (r != rf_index.end()) {
+                idx = r->second;
+            } else {
+                idx = rf_names.size();
+                rf_index[name] = idx;
+                rf_names.push_back(name);
+                rf_lens.push_back(len);
+            }
+
+            if (id >= run_ids.size()) run_ids.resize(id+1, u32(Paf::NO_REF));
+            run_ids[id] = idx;
+
+        } else if (kind == PafWriter::PAF_ENTRY) {
+            Paf::BinRecord r;
+            if (!read_val(data, i, r) || i + r.body_len > data.size()) break;
+
+            u32 rec = rd_names.size();
+            rd_names.push_back(data.substr(i, r.name_len));
+            rd_len.push_back(r.rd_len);
+            rd_st.push_back(r.rd_st);
+            rd_en.push_back(r.rd_en);
+            rf_st.push_back(r.rf_st);
+            rf_en.push_back(r.rf_en);
+            rf_id.push_back(r.rf_id < run_ids.size() ? run_ids[r.rf_id] : u32(Paf::NO_REF));
+            matches.push_back(r.matches);
+            flags.push_back(r.flags);
+
+            u64 b = i + r.name_len;
+            for (u32 t = 0; t < r.int_count; t++) {
+                i32 v = 0;
+                int_rec.push_back(rec);
+                int_tag.push_back(data[b++]);
+                read_val(data, b, v);
+                int_val.push_back(v);
+            }
+            for (u32 t = 0; t < r.float_count; t++) {
+                float v = 0;
+                float_rec.push_back(rec);
+                float_tag.push_back(data[b++]);
+                read_val(data, b, v);
+                float_val.push_back(v);
+            }
+            for (u32 t = 0; t < r.str_count; t++) {
+                u16 len = 0;
+                str_rec.push_back(rec);
+                str_tag.push_back(data[b++]);
+                read_val(data, b, len);
+                str_val.push_back(data.substr(b, len));
+                b += len;
+            }
+
+            i += r.body_len;
+
+        } else {
+            std::cerr << "Error: corrupt binary PAF entry at byte " << (i-1) << "\n";
+            return;
+        }
+    }
+
+    //A writer that was killed mid-write leaves a truncated last entry
+    if (i < data.size()) {
+        std::cerr << "Warning: ignoring truncated binary PAF entry\n";
+    }
+
+    valid_ = true;
+}
+
+u64 PafBinReader::size() const {
+    return rd_names.size();
+}
+
+bool PafBinReader::is_valid() const {
+    return valid_;
+}
+
+Paf PafBinReader::get_paf(u64 i) const {
+    Paf p;
+    p.rd_name_ = rd_names[i];
+    p.rd_len_ = rd_len[i];
+    p.ended_ = (flags[i] & Paf::BIN_ENDED) != 0;
+    p.off_target_ = (flags[i] & Paf::BIN_OFF_TARGET) != 0;
+
+    if (flags[i] & Paf::BIN_MAPPED) {
+        p.is_mapped_ = true;
+        p.rd_st_ = rd_st[i];
+        p.rd_en_ = rd_en[i];
+        p.rf_st_ = rf_st[i];
+        p.rf_en_ = rf_en[i];
+        p.fwd_ = (flags[i] & Paf::BIN_FWD) != 0;
+        p.matches_ = matches[i];
+        if (rf_id[i] < rf_names.size()) {
+            p.rf_name_ = rf_names[rf_id[i]];
+            p.rf_len_ = rf_lens[rf_id[i]];
+        }
+    }
+
+    //Tags are stored in record order
+    u64 t = std::lower_bound(int_rec.begin(), int_rec.end(), i) - int_rec.begin();
+    for (; t < int_rec.size() && int_rec[t] == i; t++) {
+        p.int_tags_.emplace_back(Paf::Tag(int_tag[t]), int_val[t]);
+    }
+    t = std::lower_bound(float_rec.begin(), float_rec.end(), i) - float_rec.begin();
+    for (; t < float_rec.size() && float_rec[t] == i; t++) {
+        p.float_tags_.emplace_back(Paf::Tag(float_tag[t]), float_val[t]);
+    }
+    t = std::lower_bound(str_rec.begin(), str_rec.end(), i) - str_rec.begin();
+    for (; t < str_rec.size() && str_rec[t] == i; t++) {
+        p.str_tags_.emplace_back(Paf::Tag(str_tag[t]), str_val[t]);
+    }
+
+    return p;
+}
+
+void PafSummary::add(const Paf &paf, u32 number) {
+    Row r;
+    r.channel = 0;
+    r.number = number;
+    r.mapped = paf.is_mapped_;
+    r.fwd = paf.fwd_;
+    r.ended = paf.ended_;
+    r.off_target = paf.off_target_;
+    r.rd_len = paf.rd_len_;
+    r.rd_st = paf.rd_st_;
+    r.rd_en = paf.rd_en_;
+    r.rf_st = paf.rf_st_;
+    r.rf_en = paf.rf_en_;
+    r.matches = paf.matches_;
+    r.map_time = r.wait_time = r.queue_time = 0;
+
+    for (auto &t : paf.int_tags_) {
+        if (t.first == Paf::Tag::CHANNEL) r.channel = t.second;
+    }
+
+    //Later values replace earlier ones, as mappers update their times
+    for (auto &t : paf.float_tags_) {
+        switch (t.first) {
+            case Paf::Tag::MAP_TIME:
+            r.map_time = t.second;
+            break;
+            case Paf::Tag::WAIT_TIME:
+            r.wait_time = t.second;
+            break;
+            case Paf::Tag::QUEUE_TIME:
+            r.queue_time = t.second;
+            break;
+            default:
+            break;
+        }
+    }
+
+    r.rf_id = -1;
+    if (paf.is_mapped_) {
+        auto id = ref_ids_.find(paf.rf_name_);
+        if (id == ref_ids_.end()) {
+            id = ref_ids_.emplace(paf.rf_name_, ref_names_.size()).first;
+            ref_names_.push_back(paf.rf_name_);
+        }
+        r.rf_id = id->second;
+    }
+
+    rows_.push_back(r);
+}
+
+void PafSummary::clear() {
+    rows_.clear();
+}
+
+u64 PafSummary::size() const {
+    return rows_.size();
+}
+
+const std::vector<PafSummary::Row> &PafSummary::rows() const {
+    return rows_;
+}
+
+const std::vector<std::string> &PafSummary::ref_names() const {
+    return ref_names_;
+}
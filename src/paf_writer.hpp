@@ -0,0 +1,240 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_PAF_WRITER
+#define _INCL_PAF_WRITER
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "util.hpp"
+#include "read_buffer.hpp"
+#include "toplevel_prms.hpp"
+#include "read_checkpoint.hpp"
+
+#ifdef PYBIND
+#include "pybind11/numpy.h"
+#endif
+
+//Binary PAF files start with this header, followed by a stream of entries
+//each starting with PafWriter::REF_ENTRY or PafWriter::PAF_ENTRY
+//Each resumed run appends another header, which resets reference IDs
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 record_size; 
+    u32 tag_count;
+} PafBinHeader;
+
+//Formats and writes Pafs on its own thread
+//Pafs can be submitted from any thread without locking, and are written
+//once buffer_size bytes are buffered or the queue has been idle for
+//FLUSH_INTERVAL ms
+//With a ReadCheckpoint, reads are logged once their Pafs are written, so
+//a killed run repeats at most one buffer of Pafs when resumed
+class PafWriter {
+    public:
+
+    static const char MAGIC[4];
+    static const u32 VERSION = 1;
+    static const u8 REF_ENTRY = 'N', //u32 id, u64 length, u16 name length, name
+                    PAF_ENTRY = 'R', //Paf::BinRecord and its body
+                    HEADER_ENTRY = 'U'; //PafBinHeader of an appended run
+
+    //Appending drops a partial last record left by a killed run
+    PafWriter(const std::string &fname, bool binary, u32 buffer_size, 
+              bool append=false, ReadCheckpoint *checkpoint=NULL);
+    PafWriter(const OutputParams &prms, ReadCheckpoint *checkpoint=NULL);
+    ~PafWriter();
+
+    void submit(const Paf &paf);
+    void submit(Paf &&paf);
+
+    //Writes everything submitted so far and stops the thread
+    void close();
+
+    u64 written() const;
+
+    #ifdef PYBIND
+    #define PY_PAF_WRITER_METH(P) c.def(#P, &PafWriter::P);
+    static void pybind_defs(pybind11::class_<PafWriter> &c) {
+        c.def(pybind11::init<const std::string &, bool, u32, bool, ReadCheckpoint *>(),
+              pybind11::arg("fname"), pybind11::arg("binary"), 
+              pybind11::arg("buffer_size"), pybind11::arg("append")=false, 
+              pybind11::arg("checkpoint")=(ReadCheckpoint *)NULL,
+              pybind11::keep_alive<1, 6>());
+        c.def("submit", static_cast<void (PafWriter::*)(const Paf &)>(&PafWriter::submit));
+        PY_PAF_WRITER_METH(written);
+        c.def("close", &PafWriter::close, 
+              pybind11::call_guard<pybind11::gil_scoped_release>());
+    }
+    #endif
+
+    private:
+    static const u32 FLUSH_INTERVAL = 100, SLEEP_US = 1000;
+
+    //Intrusive multi-producer single-consumer queue (Vyukov)
+    struct Node {
+        std::atomic<Node *> next;
+        Paf paf;
+    };
+
+    bool binary_;
+    u32 buffer_size_;
+    int fd_;
+    bool close_fd_;
+
+    std::atomic<Node *> head_;
+    Node *tail_;
+
+    std::atomic<bool> stopped_;
+    std::atomic<u64> written_;
+    std::thread thread_;
+
+    std::string buffer_;
+    std::unordered_map<std::string, u32> ref_ids_;
+
+    ReadCheckpoint *checkpoint_;
+    std::vector<std::string> buffered_reads_;
+
+    Node *pop();
+    void run();
+    void encode(const Paf &paf);
+    void flush();
+
+    //Length of the complete records in an existing output
+    static u64 complete_length(const std::string &data, bool binary);
+};
+
+//Loads a binary PAF file into columns, which are exposed to python as
+//numpy arrays that share the reader's memory
+//Tags are stored as (record, tag, value) triples
+class PafBinReader {
+    public:
+
+    PafBinReader(const std::string &fname);
+
+    u64 size() const;
+    bool is_valid() const;
+
+    //Rebuilds the i'th record
+    Paf get_paf(u64 i) const;
+
+    std::vector<std::string> rd_names, rf_names;
+    std::vector<u64> rf_lens, rd_len, rd_st, rd_en, rf_st, rf_en;
+    std::vector<u32> rf_id;
+    std::vector<u16> matches;
+    std::vector<u8> flags;
+
+    std::vector<u32> int_rec, float_rec, str_rec;
+    std::vector<u8> int_tag, float_tag, str_tag;
+    std::vector<i32> int_val;
+    std::vector<float> float_val;
+    std::vector<std::string> str_val;
+
+    #ifdef PYBIND
+    #define PY_PAF_BIN_COL(N) c.def_property_readonly(#N, [](pybind11::object self) { \
+        auto &v = self.cast<PafBinReader &>().N; \
+        return pybind11::array(v.size(), v.data(), self); \
+    });
+    #define PY_PAF_BIN_LIST(N) c.def_readonly(#N, &PafBinReader::N);
+
+    static void pybind_defs(pybind11::class_<PafBinReader> &c) {
+        c.def(pybind11::init<const std::string &>());
+        c.def("__len__", &PafBinReader::size);
+        c.def("is_valid", &PafBinReader::is_valid);
+        c.def("get_paf", &PafBinReader::get_paf);
+        PY_PAF_BIN_LIST(rd_names)
+        PY_PAF_BIN_LIST(rf_names)
+        PY_PAF_BIN_LIST(str_val)
+        PY_PAF_BIN_COL(rf_lens)
+        PY_PAF_BIN_COL(rd_len)
+        PY_PAF_BIN_COL(rd_st)
+        PY_PAF_BIN_COL(rd_en)
+        PY_PAF_BIN_COL(rf_st)
+        PY_PAF_BIN_COL(rf_en)
+        PY_PAF_BIN_COL(rf_id)
+        PY_PAF_BIN_COL(matches)
+        PY_PAF_BIN_COL(flags)
+        PY_PAF_BIN_COL(int_rec)
+        PY_PAF_BIN_COL(int_tag)
+        PY_PAF_BIN_COL(int_val)
+        PY_PAF_BIN_COL(float_rec)
+        PY_PAF_BIN_COL(float_tag)
+        PY_PAF_BIN_COL(float_val)
+        PY_PAF_BIN_COL(str_rec)
+        PY_PAF_BIN_COL(str_tag)
+    }
+    #endif
+
+    private:
+    bool valid_;
+};
+
+//Fixed-size copies of Pafs, which the pools' update_batch returns to 
+//python as structured numpy arrays instead of a Paf object per result
+//Reference names are numbered in the order they're first seen
+class PafSummary {
+    public:
+
+    typedef struct {
+        u16 channel;
+        u32 number;
+        bool mapped, fwd, ended, off_target;
+        i32 rf_id; //-1 if unmapped, see ref_names
+        u64 rd_len, rd_st, rd_en, rf_st, rf_en;
+        u16 matches;
+        float map_time, wait_time, queue_time;
+    } Row;
+
+    //number is the read number, which offline Pafs don't record
+    void add(const Paf &paf, u32 number = 0);
+    void clear();
+    u64 size() const;
+
+    const std::vector<Row> &rows() const;
+    const std::vector<std::string> &ref_names() const;
+
+    #ifdef PYBIND
+    //Copies the rows into a new array, needs the GIL
+    pybind11::array_t<Row> to_array() const {
+        return pybind11::array_t<Row>(rows_.size(), rows_.data());
+    }
+
+    static void pybind_defs(pybind11::module &m) {
+        PYBIND11_NUMPY_DTYPE(Row, channel, number, mapped, fwd, ended, 
+                             off_target, rf_id, rd_len, rd_st, rd_en, 
+                             rf_st, rf_en, matches, 
+                             map_time, wait_time, queue_time);
+    }
+    #endif
+
+    private:
+    std::vector<Row> rows_;
+    std::vector<std::string> ref_names_;
+    std::unordered_map<std::string, i32> ref_ids_;
+};
+
+#endif
@@ -27,10 +27,16 @@
 #include <array>
 #include <utility>
 #include <cmath>
+#include <algorithm>
 #include "event_detector.hpp"
 #include "util.hpp"
 #include "bp.hpp"
 
+#if defined(__x86_64__) || defined(__i386__)
+#define PMODEL_X86_SIMD
+#include <immintrin.h>
+#endif
+
 typedef struct {
     KmerLen k;
     std::vector<float> means_stdvs;
@@ -39,28 +45,143 @@ typedef struct {
 template<KmerLen KLEN>
 class PoreModel {
 
+    public:
+    typedef KmerId<KLEN> kmer_t;
+
+    enum SimdLevel {SCALAR, AVX2, AVX512};
+
+    static bool simd_supported(SimdLevel level) {
+        #ifdef PMODEL_X86_SIMD
+        switch (level) {
+            case AVX512:
+            return __builtin_cpu_supports("avx512f");
+            case AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            default:
+            return true;
+        }
+        #else
+        return level == SCALAR;
+        #endif
+    }
+
+    //Fastest level the CPU supports, used by match_probs
+    static SimdLevel simd_level() {
+        static const SimdLevel level = 
+            simd_supported(AVX512) ? AVX512 :
+            simd_supported(AVX2) ? AVX2 : SCALAR;
+        return level;
+    }
+
     private:
-    std::vector<float> lv_means_, lv_vars_x2_, lognorm_denoms_;
+    //Stored as aligned structure-of-arrays for match_probs
+    //lv_vars_recp_ holds 1 / (2 * stdv^2)
+    AlignedVec<float> lv_means_, lv_vars_x2_, lv_vars_recp_, lognorm_denoms_;
     float model_mean_, model_stdv_;
-    u16 kmer_count_;
+    u32 kmer_count_;
     bool loaded_, complement_;
 
+    //K-mers sorted by level mean, so candidates can find every k-mer 
+    //near an event without scoring all of them
+    std::vector<float> sorted_means_;
+    std::vector<kmer_t> sorted_kmers_;
+    float max_var_x2_, min_lognorm_;
+
     void init_stdv() {
         model_stdv_ = 0;
 
-        for (u16 kmer = 0; kmer < kmer_count_; kmer++) {
+        for (u32 kmer = 0; kmer < kmer_count_; kmer++) {
             model_stdv_ += pow(lv_means_[kmer] - model_mean_, 2);
         }
 
         model_stdv_ = sqrt(model_stdv_ / kmer_count_);
     }
 
-    void init_kmer(u16 k, float mean, float stdv) {
+    void init_sorted() {
+        sorted_kmers_.resize(kmer_count_);
+        for (u32 k = 0; k < kmer_count_; k++) sorted_kmers_[k] = k;
+        std::sort(sorted_kmers_.begin(), sorted_kmers_.end(), 
+                  [this](kmer_t a, kmer_t b) {
+                      return lv_means_[a] < lv_means_[b];
+                  });
+
+        sorted_means_.resize(kmer_count_);
+        for (u32 i = 0; i < kmer_count_; i++) {
+            sorted_means_[i] = lv_means_[sorted_kmers_[i]];
+        }
+
+        max_var_x2_ = *std::max_element(lv_vars_x2_.begin(), lv_vars_x2_.end());
+        min_lognorm_ = *std::min_element(lognorm_denoms_.begin(), lognorm_denoms_.end());
+    }
+
+    //Largest distance from a level mean any k-mer can pass thresh within
+    float window(float thresh) const {
+        float w = max_var_x2_ * (-thresh - min_lognorm_);
+        return w > 0 ? sqrt(w) : 0;
+    }
+
+    void init_kmer(kmer_t k, float mean, float stdv) {
         lv_means_[k] = mean;
         lv_vars_x2_[k] = 2 * stdv * stdv;
+        lv_vars_recp_[k] = 1.0 / lv_vars_x2_[k];
         lognorm_denoms_[k] = log(sqrt(M_PI * lv_vars_x2_[k]));
     }
 
+    inline float kmer_prob(float samp, u32 k) const {
+        float d = samp - lv_means_[k];
+        return -(d * d) * lv_vars_recp_[k] - lognorm_denoms_[k];
+    }
+
+    //If mask is set, bits of k-mers with probabilities >= thresh are set
+    //mask must be zeroed, and hold a bit for every k-mer
+    void match_probs_scalar(float samp, float *out, u32 start,
+                            float thresh, u64 *mask) const {
+        for (u32 k = start; k < kmer_count_; k++) {
+            out[k] = kmer_prob(samp, k);
+            if (mask != NULL && out[k] >= thresh) {
+                mask[k >> 6] |= u64(1) << (k & 63);
+            }
+        }
+    }
+
+    #ifdef PMODEL_X86_SIMD
+    __attribute__((target("avx2,fma")))
+    void match_probs_avx2(float samp, float *out, float thresh, u64 *mask) const {
+        const __m256 s = _mm256_set1_ps(samp), t = _mm256_set1_ps(thresh);
+        u32 k = 0;
+        for (; k + 8 <= kmer_count_; k += 8) {
+            __m256 d = _mm256_sub_ps(s, _mm256_load_ps(&lv_means_[k]));
+            __m256 p = _mm256_mul_ps(_mm256_mul_ps(d, d), _mm256_load_ps(&lv_vars_recp_[k]));
+            p = _mm256_sub_ps(_mm256_setzero_ps(), 
+                              _mm256_add_ps(p, _mm256_load_ps(&lognorm_denoms_[k])));
+            _mm256_storeu_ps(&out[k], p);
+            if (mask != NULL) {
+                u64 bits = _mm256_movemask_ps(_mm256_cmp_ps(p, t, _CMP_GE_OQ));
+                mask[k >> 6] |= bits << (k & 63);
+            }
+        }
+        match_probs_scalar(samp, out, k, thresh, mask);
+    }
+
+    __attribute__((target("avx512f")))
+    void match_probs_avx512(float samp, float *out, float thresh, u64 *mask) const {
+        const __m512 s = _mm512_set1_ps(samp), t = _mm512_set1_ps(thresh);
+        u32 k = 0;
+        for (; k + 16 <= kmer_count_; k += 16) {
+            __m512 d = _mm512_sub_ps(s, _mm512_load_ps(&lv_means_[k]));
+            __m512 p = _mm512_mul_ps(_mm512_mul_ps(d, d), _mm512_load_ps(&lv_vars_recp_[k]));
+            p = _mm512_sub_ps(_mm512_setzero_ps(), 
+                              _mm512_add_ps(p, _mm512_load_ps(&lognorm_denoms_[k])));
+            _mm512_storeu_ps(&out[k], p);
+            if (mask != NULL) {
+                u64 bits = _mm512_cmp_ps_mask(p, t, _CMP_GE_OQ);
+                mask[k >> 6] |= bits << (k & 63);
+            }
+        }
+        match_probs_scalar(samp, out, k, thresh, mask);
+    }
+    #endif
+
     public:
 
     PoreModel() 
@@ -70,6 +191,7 @@ class PoreModel {
 
         lv_means_.resize(kmer_count_);
         lv_vars_x2_.resize(kmer_count_);
+        lv_vars_recp_.resize(kmer_count_);
         lognorm_denoms_.resize(kmer_count_);
     }
     
@@ -81,7 +203,7 @@ class PoreModel {
 
         model_mean_ = 0;
 
-        u16 kmer = 0;
+        kmer_t kmer = 0;
         for (u32 i = 0; i < means_stdvs.size(); i += 2) {
             float mean = means_stdvs[i],
                   stdv = means_stdvs[i+1];
@@ -98,6 +220,7 @@ class PoreModel {
 
         model_mean_ /= kmer_count_;
         init_stdv();
+        init_sorted();
 
         loaded_ = true;
     }
@@ -105,6 +228,8 @@ class PoreModel {
     //TODO: clean up IO
     //maybe load from toml and/or header file
     //make scripts for model to toml and header?
+    //The model must have exactly kmer_count k-mers of length KLEN, 
+    //otherwise an error is printed and it is left unloaded
     PoreModel(const std::string &model_fname, bool cmpl) : PoreModel () {
 
         std::ifstream model_in(model_fname);
@@ -114,7 +239,7 @@ class PoreModel {
 
         //Variables for reading model
         std::string kmer_str, neighbor_kmer;
-        u16 kmer;
+        kmer_t kmer;
         float lv_mean, lv_stdv;
 
         model_mean_ = 0;
@@ -123,17 +248,16 @@ class PoreModel {
         for (u32 i = 0; i < kmer_count_; i++) {
         //while (!model_in.eof()) {
         //
-            if (model_in.eof()) {
+            if (!(model_in >> kmer_str >> lv_mean >> lv_stdv)) {
                 std::cerr << "Error: ran out of k-mers\n";
                 return;
             }
 
-            model_in >> kmer_str >> lv_mean >> lv_stdv; 
-
-            std::cerr << "setting "
-                      << kmer_str << " "
-                      << lv_mean << " "
-                      << lv_stdv << "\n";
+            if (kmer_str.size() != (u32) KLEN) {
+                std::cerr << "Error: model k-mer '" << kmer_str << "' is not " 
+                          << (u32) KLEN << " bases long\n";
+                return;
+            }
 
             //Get unique ID for the kmer
             kmer = str_to_kmer<KLEN>(kmer_str);
@@ -153,19 +277,109 @@ class PoreModel {
             model_mean_ += lv_mean;
         }
 
+        if (model_in >> kmer_str) {
+            std::cerr << "Error: model has more than " << kmer_count_ << " k-mers\n";
+            return;
+        }
+
         //Compute model level mean and stdv
         model_mean_ /= kmer_count_;
         init_stdv();
+        init_sorted();
 
         loaded_ = true;
     }
 
-    float match_prob(float samp, u16 kmer) const {
+    float match_prob(float samp, kmer_t kmer) const {
         return (-pow(samp - lv_means_[kmer], 2) / lv_vars_x2_[kmer]) - lognorm_denoms_[kmer];
     }
 
+    //Computes match_prob(samp, k) for every k-mer, out must hold kmer_count
+    //Uses AVX-512 or AVX2 when the CPU supports it
+    void match_probs(float samp, float *out) const {
+        match_probs(samp, out, 0, NULL);
+    }
+
+    //Also sets bits in mask for k-mers with probabilities >= thresh
+    //mask must hold (kmer_count + 63) / 64 words, and is overwritten
+    void match_probs(float samp, float *out, float thresh, u64 *mask) const {
+        match_probs_at(simd_level(), samp, out, thresh, mask);
+    }
+
+    //match_probs using the given level, which must be simd_supported
+    void match_probs_at(SimdLevel level, float samp, float *out, 
+                        float thresh, u64 *mask) const {
+        if (mask != NULL) std::fill(mask, mask + (kmer_count_ + 63) / 64, 0);
+
+        switch (level) {
+            #ifdef PMODEL_X86_SIMD
+            case AVX512:
+            match_probs_avx512(samp, out, thresh, mask);
+            break;
+            case AVX2:
+            match_probs_avx2(samp, out, thresh, mask);
+            break;
+            #endif
+            default:
+            match_probs_scalar(samp, out, 0, thresh, mask);
+        }
+    }
+
+    //Average fraction of k-mers candidates scans per event, for events
+    //distributed like the model levels. Dense SIMD scoring is faster 
+    //unless this is small
+    float scan_fraction(float thresh) const {
+        float w = window(thresh);
+        if (w <= 0) return 0;
+
+        u32 step = std::max(kmer_count_ / 1024, 1u);
+        u64 scanned = 0, samples = 0;
+        for (u32 i = 0; i < kmer_count_; i += step) {
+            float m = sorted_means_[i];
+            scanned += std::upper_bound(sorted_means_.begin(), sorted_means_.end(), m + w) 
+                     - std::lower_bound(sorted_means_.begin(), sorted_means_.end(), m - w);
+            samples++;
+        }
+        return double(scanned) / samples / kmer_count_;
+    }
+
+    //Appends every k-mer with match_prob(samp, k) >= thresh to out, found 
+    //by binary search on level means within the widest window any k-mer
+    //could pass in. If probs is set, candidate k-mer probabilities are 
+    //written to it as match_probs would. Returns the number added
+    u32 candidates(float samp, float thresh, std::vector<kmer_t> &out, 
+                   float *probs = NULL) const {
+        float w = window(thresh);
+        if (w <= 0) return 0;
+
+        u32 n = out.size();
+        auto it = std::lower_bound(sorted_means_.begin(), sorted_means_.end(), samp - w);
+        for (u32 i = it - sorted_means_.begin(); 
+             i < kmer_count_ && sorted_means_[i] <= samp + w; i++) {
+            kmer_t k = sorted_kmers_[i];
+            float p = kmer_prob(samp, k);
+            if (p >= thresh) {
+                out.push_back(k);
+                if (probs != NULL) probs[k] = p;
+            }
+        }
+        return out.size() - n;
+    }
+
+    std::vector<kmer_t> candidates_vec(float samp, float thresh) const {
+        std::vector<kmer_t> ret;
+        candidates(samp, thresh, ret);
+        return ret;
+    }
+
+    std::vector<float> match_probs_vec(float samp) const {
+        std::vector<float> ret(kmer_count_);
+        match_probs(samp, ret.data());
+        return ret;
+    }
+
     //TODO should be able to overload
-    float match_prob_evt(const Event &evt, u16 kmer) const {
+    float match_prob_evt(const Event &evt, kmer_t kmer) const {
         return match_prob(evt.mean, kmer);
     }
 
@@ -177,7 +391,7 @@ class PoreModel {
         return model_stdv_;
     }
 
-    float get_mean(u16 kmer) const {
+    float get_mean(kmer_t kmer) const {
         return lv_means_[kmer];
     }
 
@@ -192,6 +406,8 @@ class PoreModel {
     static void pybind_defs(pybind11::class_<PoreModel<KLEN>> &c) {
         c.def(pybind11::init<const std::string &, bool>());
         PY_PORE_MODEL_METH(match_prob);
+        c.def("match_probs", &PoreModel<KLEN>::match_probs_vec);
+        c.def("candidates", &PoreModel<KLEN>::candidates_vec);
         PY_PORE_MODEL_METH(get_means_mean);
         PY_PORE_MODEL_METH(get_means_stdv);
         PY_PORE_MODEL_METH(get_mean);
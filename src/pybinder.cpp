@@ -2,7 +2,9 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include "map_pool.hpp"
+#include "map_pool_ord.hpp"
 #include "self_align_ref.hpp"
+#include "paf_writer.hpp"
 #include "realtime_pool.hpp"
 #include "client_sim.hpp"
 #include "model_r94.inl"
@@ -20,9 +22,15 @@ PYBIND11_MODULE(_uncalled, m) {
     py::class_<MapPool> map_pool(m, "MapPool");
     MapPool::pybind_defs(map_pool);
 
+    py::class_<MapPoolOrd> map_pool_ord(m, "MapPoolOrd");
+    MapPoolOrd::pybind_defs(map_pool_ord);
+
     py::class_<RealtimePool> realtime_pool(m, "RealtimePool");
     RealtimePool::pybind_defs(realtime_pool);
 
+    py::class_<LatencyHist> latency_hist(m, "LatencyHist");
+    LatencyHist::pybind_defs(latency_hist);
+
     py::class_<ClientSim> client_sim(m, "ClientSim");
     ClientSim::pybind_defs(client_sim);
 
@@ -58,6 +66,24 @@ PYBIND11_MODULE(_uncalled, m) {
 
     m.def("self_align", &self_align);
 
+    py::class_<ReadCheckpoint> read_checkpoint(m, "ReadCheckpoint");
+    ReadCheckpoint::pybind_defs(read_checkpoint);
+
+    py::class_<PafWriter> paf_writer(m, "PafWriter");
+    PafWriter::pybind_defs(paf_writer);
+
+    py::class_<PafBinReader> paf_bin_reader(m, "PafBinReader");
+    PafBinReader::pybind_defs(paf_bin_reader);
+
+    PafSummary::pybind_defs(m);
+
+    py::class_<SelfAlignStats> self_align_stats_cls(m, "SelfAlignStats");
+    SelfAlignStats::pybind_defs(self_align_stats_cls);
+    m.def("self_align_stats", &self_align_stats, 
+          "bwa_prefix"_a, "sample_dist"_a, "kmer_len"_a, "max_len"_a, 
+          "threads"_a=1, "seed"_a=0, 
+          py::call_guard<py::gil_scoped_release>());
+
     //BP operation functions
     m.def("kmer_count",    &kmer_count<KLEN>);
     m.def("str_to_kmer",   &str_to_kmer<KLEN>);
@@ -78,6 +104,25 @@ PYBIND11_MODULE(_uncalled, m) {
     py::class_<DTWr94d> dtw_r94d(m, "DTWr94d");
     DTWr94d::pybind_defs(dtw_r94d);
 
+    py::class_<BandedDTWr94p> bdtw_r94p(m, "BandedDTWr94p");
+    BandedDTWr94p::pybind_defs(bdtw_r94p);
+
+    py::class_<BandedDTWr94d> bdtw_r94d(m, "BandedDTWr94d");
+    BandedDTWr94d::pybind_defs(bdtw_r94d);
+
+    py::enum_<DTWTrace> dtwt(m, "DTWTrace");
+    dtwt.value("FULL", DTWTrace::FULL);
+    dtwt.value("NONE", DTWTrace::NONE);
+    dtwt.value("CHECKPOINT", DTWTrace::CHECKPOINT);
+
+    py::class_<DTWBand> dtwb(m, "DTWBand");
+    dtwb.def(py::init<>());
+    dtwb.def_readwrite("width", &DTWBand::width);
+    dtwb.def_readwrite("slope", &DTWBand::slope);
+    dtwb.def_readwrite("offset", &DTWBand::offset);
+    dtwb.def_readwrite("trace", &DTWBand::trace);
+    m.attr("DTW_NO_BAND") = py::cast(DTW_NO_BAND);
+
     py::class_<DTWParams>dtwp(m, "DTWParams");
     dtwp.def_readwrite("dw", &DTWParams::dw);
     dtwp.def_readwrite("hw", &DTWParams::hw);
@@ -21,7 +21,12 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstring>
 #include "read_buffer.hpp"
+#include "vbz.hpp"
+
+static_assert(sizeof(Paf::BinRecord) == 56, "BinRecord must not be padded");
 
 ReadBuffer::Params ReadBuffer::PRMS = {
     num_channels : 512,
@@ -29,6 +34,7 @@ ReadBuffer::Params ReadBuffer::PRMS = {
     sample_rate  : 4000,
     chunk_time   : 1.0,
     max_chunks   : 1000000,
+    load_chunks  : 0
 };
 
 const std::string Paf::PAF_TAGS[] = {
@@ -46,12 +52,27 @@ const std::string Paf::PAF_TAGS[] = {
     "kp", //KEEP
     "dl", //DELAY
     "sc", //SEED_CLUSTER
-    "ce"  //CONFIDENT_EVENT
+    "ce", //CONFIDENT_EVENT
+    "pb", //PATH_BUDGET
+    "ps", //BUDGET_SHRINKS
+    "pg", //BUDGET_GROWS
+    "ot", //OFF_TARGET
+    "es", //EARLY_STOP
+    "ne", //EVENT_COUNT
+    "np", //PATH_COUNT
+    "nn", //NEIGHBOR_COUNT
+    "na", //SA_LOOKUP_COUNT
+    "nd", //SEED_COUNT
+    "ns", //SOURCE_COUNT
+    "nk", //NORM_SKIP_COUNT
+    "nc", //SA_HIT_COUNT
+    "nw"  //SA_MISS_COUNT
 };
 
 Paf::Paf() 
     : is_mapped_(false),
       ended_(false),
+      off_target_(false),
       rd_name_(""),
       rf_name_(""),
       rd_st_(0),
@@ -66,6 +87,7 @@ Paf::Paf()
 Paf::Paf(const std::string &rd_name, u16 channel, u64 start_sample)
     : is_mapped_(false),
       ended_(false),
+      off_target_(false),
       rd_name_(rd_name),
       rf_name_(""),
       rd_st_(0),
@@ -89,45 +111,174 @@ bool Paf::is_ended() const {
     return ended_;
 }
 
+bool Paf::is_on_target() const {
+    return is_mapped_ && !off_target_;
+}
+
 void Paf::print_paf() const {
-    std::cout << rd_name_ << "\t"
-       << rd_len_ << "\t";
+    std::string line;
+    write_paf(line);
+    std::cout << line;
+}
+
+void Paf::write_paf(std::string &out) const {
+    out += rd_name_;
+    out += "\t";
+    out += std::to_string(rd_len_);
+
     if (is_mapped_) {
-       std::cout 
-           << rd_st_ << "\t"
-           << rd_en_ << "\t"
-           << (fwd_ ? '+' : '-') << "\t"
-           << rf_name_ << "\t"
-           << rf_len_ << "\t"
-           << rf_st_ << "\t"
-           << rf_en_ << "\t"
-           << matches_ << "\t"
-           << (rf_en_ - rf_st_ + 1) << "\t"
-           << 255;
+        out += "\t";
+        out += std::to_string(rd_st_);
+        out += "\t";
+        out += std::to_string(rd_en_);
+        out += fwd_ ? "\t+\t" : "\t-\t";
+        out += rf_name_;
+        out += "\t";
+        out += std::to_string(rf_len_);
+        out += "\t";
+        out += std::to_string(rf_st_);
+        out += "\t";
+        out += std::to_string(rf_en_);
+        out += "\t";
+        out += std::to_string(matches_);
+        out += "\t";
+        out += std::to_string(rf_en_ - rf_st_ + 1);
+        out += "\t255";
     } else {
-        std::cout << "*" << "\t"
-           << "*" << "\t"
-           << "*" << "\t"
-           << "*" << "\t"
-           << "*" << "\t"
-           << "*" << "\t"
-           << "*" << "\t"
-           << "*" << "\t"
-           << "*" << "\t"
-           << "255";
+        out += "\t*\t*\t*\t*\t*\t*\t*\t*\t*\t255";
     }
 
-    for (auto t : int_tags_) { 
-        std::cout << std::fixed << "\t" << PAF_TAGS[t.first] << ":i:" << t.second;
+    //std::to_string formats floats like std::fixed
+    for (auto &t : int_tags_) { 
+        out += "\t";
+        out += PAF_TAGS[t.first];
+        out += ":i:";
+        out += std::to_string(t.second);
     }
-    for (auto t : float_tags_) { 
-        std::cout << std::fixed << "\t" << PAF_TAGS[t.first] << ":f:" << t.second;
+    for (auto &t : float_tags_) { 
+        out += "\t";
+        out += PAF_TAGS[t.first];
+        out += ":f:";
+        out += std::to_string(t.second);
     }
-    for (auto t : str_tags_) { 
-        std::cout << "\t" << PAF_TAGS[t.first] << ":Z:" << t.second;
+    for (auto &t : str_tags_) { 
+        out += "\t";
+        out += PAF_TAGS[t.first];
+        out += ":Z:";
+        out += t.second;
     }
 
-    std::cout << "\n";
+    out += "\n";
+}
+
+void Paf::write_bin(std::string &out, u32 rf_id) const {
+    BinRecord r;
+    r.rd_len = rd_len_;
+    r.rd_st = rd_st_;
+    r.rd_en = rd_en_;
+    r.rf_st = rf_st_;
+    r.rf_en = rf_en_;
+    r.rf_id = is_mapped_ ? rf_id : NO_REF;
+    r.matches = matches_;
+    r.name_len = std::min(rd_name_.size(), size_t(USHRT_MAX));
+    r.flags = (is_mapped_   ? BIN_MAPPED : 0) |
+              (fwd_         ? BIN_FWD : 0) |
+              (ended_       ? BIN_ENDED : 0) |
+              (off_target_  ? BIN_OFF_TARGET : 0);
+    r.int_count = std::min(int_tags_.size(), size_t(UCHAR_MAX));
+    r.float_count = std::min(float_tags_.size(), size_t(UCHAR_MAX));
+    r.str_count = std::min(str_tags_.size(), size_t(UCHAR_MAX));
+
+    r.body_len = r.name_len + 5 * (r.int_count + r.float_count);
+    for (u32 i = 0; i < r.str_count; i++) {
+        r.body_len += 3 + std::min(str_tags_[i].second.size(), size_t(USHRT_MAX));
+    }
+
+    out.append(reinterpret_cast<const char *>(&r), sizeof(r));
+    out.append(rd_name_, 0, r.name_len);
+
+    for (u32 i = 0; i < r.int_count; i++) {
+        i32 v = int_tags_[i].second;
+        out.push_back(u8(int_tags_[i].first));
+        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    for (u32 i = 0; i < r.float_count; i++) {
+        float v = float_tags_[i].second;
+        out.push_back(u8(float_tags_[i].first));
+        out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+    for (u32 i = 0; i < r.str_count; i++) {
+        const std::string &v = str_tags_[i].second;
+        u16 len = std::min(v.size(), size_t(USHRT_MAX));
+        out.push_back(u8(str_tags_[i].first));
+        out.append(reinterpret_cast<const char *>(&len), sizeof(len));
+        out.append(v, 0, len);
+    }
+}
+
+u64 Paf::read_bin(const char *data, u64 len, 
+                  const std::string &rf_name, u64 rf_len) {
+    BinRecord r;
+    if (len < sizeof(r)) return 0;
+    memcpy(&r, data, sizeof(r));
+
+    u64 total = sizeof(r) + r.body_len;
+    if (total > len) return 0;
+
+    const char *p = data + sizeof(r), *end = data + total;
+    if (p + r.name_len > end) return 0;
+
+    *this = Paf();
+    rd_name_.assign(p, r.name_len);
+    p += r.name_len;
+
+    rd_len_ = r.rd_len;
+    rd_st_ = r.rd_st;
+    rd_en_ = r.rd_en;
+    rf_st_ = r.rf_st;
+    rf_en_ = r.rf_en;
+    matches_ = r.matches;
+    is_mapped_ = (r.flags & BIN_MAPPED) != 0;
+    fwd_ = (r.flags & BIN_FWD) != 0;
+    ended_ = (r.flags & BIN_ENDED) != 0;
+    off_target_ = (r.flags & BIN_OFF_TARGET) != 0;
+
+    if (is_mapped_) {
+        rf_name_ = rf_name;
+        rf_len_ = rf_len;
+    }
+
+    u32 n = r.int_count + r.float_count;
+    if (p + 5 * n > end) return 0;
+
+    for (u32 i = 0; i < n; i++) {
+        u8 tag = u8(*p);
+        if (tag > Tag::NORM_SKIP_COUNT) return 0;
+
+        if (i < r.int_count) {
+            i32 v;
+            memcpy(&v, p+1, sizeof(v));
+            int_tags_.emplace_back(Tag(tag), v);
+        } else {
+            float v;
+            memcpy(&v, p+1, sizeof(v));
+            float_tags_.emplace_back(Tag(tag), v);
+        }
+        p += 5;
+    }
+
+    for (u32 i = 0; i < r.str_count; i++) {
+        u16 slen;
+        if (p + 3 > end) return 0;
+        u8 tag = u8(*p);
+        memcpy(&slen, p+1, sizeof(slen));
+        p += 3;
+        if (tag > Tag::NORM_SKIP_COUNT || p + slen > end) return 0;
+        str_tags_.emplace_back(Tag(tag), std::string(p, slen));
+        p += slen;
+    }
+
+    return total;
 }
 
 void Paf::set_read_len(u64 rd_len) {
@@ -154,6 +305,11 @@ void Paf::set_mapped(u64 rd_st, u64 rd_en,
     matches_ = matches;
 }
 
+void Paf::set_off_target() {
+    off_target_ = true;
+    set_int(Tag::OFF_TARGET, 1);
+}
+
 void Paf::set_int(Tag t, int v) {
     int_tags_.emplace_back(t, v);
 }
@@ -181,6 +337,7 @@ void ReadBuffer::swap(ReadBuffer &r) {
     std::swap(start_sample_, r.start_sample_);
     std::swap(raw_len_, r.raw_len_);
     std::swap(full_signal_, r.full_signal_);
+    std::swap(lazy_, r.lazy_);
     std::swap(chunk_, r.chunk_);
     std::swap(chunk_count_, r.chunk_count_);
     std::swap(chunk_processed_, r.chunk_processed_);
@@ -190,6 +347,7 @@ void ReadBuffer::swap(ReadBuffer &r) {
 void ReadBuffer::clear() {
     raw_len_ = 0;
     full_signal_.clear();
+    lazy_.reset();
     chunk_.clear();
     chunk_count_ = 0;
     loc_ = Paf();
@@ -223,28 +381,63 @@ ReadBuffer::ReadBuffer(const hdf5_tools::File &file,
     }
 
     std::string sig_path = raw_path + "/Signal";
-    std::vector<i16> int_data; 
-    file.read(sig_path, int_data);
+    u64 max_len = (u64) PRMS.max_chunks * PRMS.chunk_len();
 
-    chunk_count_ = (int_data.size() / PRMS.chunk_len()) + (int_data.size() % PRMS.chunk_len() != 0);
+    //Decode VBZ signal in-tree if possible, otherwise read through HDF5 filters
+    static thread_local VbzDecoder vbz;
+    VbzDecoder::Calibration cal = {cal_range, cal_digit, cal_offset};
 
-    if (chunk_count_ > PRMS.max_chunks) {
-        chunk_count_ = PRMS.max_chunks;
-        int_data.resize(chunk_count_ * PRMS.chunk_len());
+    u64 sig_len = 0, load_len = (u64) PRMS.load_chunks * PRMS.chunk_len();
+    if (load_len > 0) {
+        sig_len = std::min(LazySignal::dataset_len(file.id(), sig_path), max_len);
     }
 
-    //full_signal_.reserve(int_data.size());
+    //Only the first load_chunks are read now, see load_signal
+    if (load_len > 0 && load_len < sig_len) {
+        lazy_ = std::make_shared<LazySignal>(file.id(), sig_path, cal, sig_len);
+        LazySignal::read(file.id(), sig_path, cal, 0, load_len, full_signal_);
+
+    } else if (!vbz.read_signal(file.id(), sig_path, cal, max_len, full_signal_)) {
+        std::vector<i16> int_data; 
+        file.read(sig_path, int_data);
 
-    //full_signal_.assign(int_data.begin(), int_data.end());
-    for (u16 raw : int_data) {
-		float calibrated = (cal_range * raw / cal_digit) + cal_offset;
-        full_signal_.push_back(calibrated);
+        if (int_data.size() > max_len) {
+            int_data.resize(max_len);
+        }
+
+        full_signal_.reserve(int_data.size());
+        for (u16 raw : int_data) {
+            float calibrated = (cal_range * raw / cal_digit) + cal_offset;
+            full_signal_.push_back(calibrated);
+        }
     }
 
+    u64 len = lazy_ ? lazy_->size() : full_signal_.size();
+    chunk_count_ = (len / PRMS.chunk_len()) + (len % PRMS.chunk_len() != 0);
+
     loc_ = Paf(id_, get_channel(), start_sample_);
-    set_raw_len(full_signal_.size());
+    set_raw_len(len);
 }
 
+ReadBuffer::ReadBuffer(const std::string &id, u16 channel, u32 number, 
+                       u64 start_sample, std::vector<float> &signal)
+    : channel_idx_(channel-1),
+      id_(id),
+      number_(number),
+      start_sample_(start_sample),
+      chunk_processed_(false) {
+
+    u64 max_len = (u64) PRMS.max_chunks * PRMS.chunk_len();
+    if (signal.size() > max_len) {
+        signal.resize(max_len);
+    }
+    full_signal_.swap(signal);
+
+    chunk_count_ = (full_signal_.size() / PRMS.chunk_len()) + (full_signal_.size() % PRMS.chunk_len() != 0);
+
+    loc_ = Paf(id_, get_channel(), start_sample_);
+    set_raw_len(full_signal_.size());
+}
 
 ReadBuffer::ReadBuffer(Chunk &first_chunk) 
     : //source_(Source::LIVE),
@@ -330,6 +523,103 @@ u32 ReadBuffer::get_chunks(std::vector<Chunk> &chunk_queue, bool real_start, u32
     return count;
 }
 
+bool ReadBuffer::load_signal(u64 end) {
+    u64 loaded = full_signal_.size();
+    if (end <= loaded) return true;
+    if (!lazy_) return false;
+
+    //Grow geometrically, VBZ chunks can be decoded more than once
+    end = std::min(std::max(end, 2 * loaded), lazy_->size());
+
+    bool ok = lazy_->read(loaded, end - loaded, full_signal_);
+
+    //Done with the file once all signal is loaded
+    if (!ok || full_signal_.size() >= lazy_->size()) lazy_.reset();
+
+    return ok && full_signal_.size() > loaded;
+}
+
+LazySignal::LazySignal(hid_t file, const std::string &path, 
+                       const VbzDecoder::Calibration &cal, u64 len)
+    : path_(path), cal_(cal), len_(len), file_(-1) {
+
+    ssize_t n = H5Fget_name(file, NULL, 0);
+    if (n > 0) {
+        fname_.resize(n + 1);
+        H5Fget_name(file, &fname_[0], n + 1);
+        fname_.resize(n);
+    }
+}
+
+LazySignal::~LazySignal() {
+    if (file_ >= 0) H5Fclose(file_);
+}
+
+bool LazySignal::read(u64 st, u64 len, std::vector<float> &out) {
+    if (file_ < 0) {
+        file_ = H5Fopen(fname_.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_ < 0) {
+            std::cerr << "Error: failed to reopen \"" << fname_ << "\"\n";
+            return false;
+        }
+    }
+    return read(file_, path_, cal_, st, std::min(len, len_ - st), out);
+}
+
+bool LazySignal::read(hid_t file, const std::string &path, 
+                      const VbzDecoder::Calibration &cal,
+                      u64 st, u64 len, std::vector<float> &out) {
+    static thread_local VbzDecoder vbz;
+    if (vbz.read_signal(file, path, cal, len, out, st)) return true;
+
+    //Hyperslab read through the HDF5 filters
+    hid_t dset = H5Dopen2(file, path.c_str(), H5P_DEFAULT);
+    if (dset < 0) return false;
+
+    hid_t space = H5Dget_space(dset);
+    hsize_t offs = st, n = len;
+    std::vector<i16> raw(n);
+
+    hid_t mem = H5Screate_simple(1, &n, NULL);
+    bool ok = space >= 0 && mem >= 0 &&
+              H5Sselect_hyperslab(space, H5S_SELECT_SET, &offs, NULL, &n, NULL) >= 0 &&
+              H5Dread(dset, H5T_NATIVE_INT16, mem, space, H5P_DEFAULT, raw.data()) >= 0;
+
+    if (mem >= 0) H5Sclose(mem);
+    if (space >= 0) H5Sclose(space);
+    H5Dclose(dset);
+
+    if (!ok) {
+        std::cerr << "Error: failed to read signal from \"" << path << "\"\n";
+        return false;
+    }
+
+    out.reserve(out.size() + n);
+    for (u16 r : raw) {
+        out.push_back((cal.range * r / cal.digit) + cal.offset);
+    }
+
+    return true;
+}
+
+u64 LazySignal::dataset_len(hid_t file, const std::string &path) {
+    hid_t dset = H5Dopen2(file, path.c_str(), H5P_DEFAULT);
+    if (dset < 0) return 0;
+
+    hid_t space = H5Dget_space(dset);
+    hsize_t dim = 0;
+    if (space >= 0) {
+        if (H5Sget_simple_extent_ndims(space) != 1 ||
+            H5Sget_simple_extent_dims(space, &dim, NULL) != 1) {
+            dim = 0;
+        }
+        H5Sclose(space);
+    }
+    H5Dclose(dset);
+
+    return dim;
+}
+
 bool operator< (const ReadBuffer &r1, const ReadBuffer &r2) {
     return r1.start_sample_ < r2.start_sample_;
 }
@@ -27,9 +27,12 @@
 #include <string>
 #include <vector>
 #include <unordered_set>
+#include <memory>
+#include <climits>
 #include <fast5/hdf5_tools.hpp>
 #include "util.hpp"
 #include "chunk.hpp"
+#include "vbz.hpp"
 
 #ifdef PYBIND
 #include <pybind11/pybind11.h>
@@ -53,7 +56,23 @@ class Paf {
         KEEP,
         DELAY,
         SEED_CLUSTER,
-        CONFIDENT_EVENT
+        CONFIDENT_EVENT,
+        PATH_BUDGET,
+        BUDGET_SHRINKS,
+        BUDGET_GROWS,
+        OFF_TARGET,
+        EARLY_STOP,
+
+        //MapCounters, in the same order
+        EVENT_COUNT,
+        PATH_COUNT,
+        NEIGHBOR_COUNT,
+        SA_LOOKUP_COUNT,
+        SEED_COUNT,
+        SOURCE_COUNT,
+        NORM_SKIP_COUNT,
+        SA_HIT_COUNT,
+        SA_MISS_COUNT
     };
 
     Paf();
@@ -61,7 +80,22 @@ class Paf {
 
     bool is_mapped() const;
     bool is_ended() const;
+
+    //Mapped, and inside a target region if any were given
+    bool is_on_target() const;
     void print_paf() const;
+
+    //Appends the line printed by print_paf
+    void write_paf(std::string &out) const;
+
+    //Appends a binary record (see BinRecord), naming the reference by rf_id
+    void write_bin(std::string &out, u32 rf_id) const;
+
+    //Loads a record written by write_bin, whose reference is given by name
+    //Returns the bytes read, or 0 if the record is truncated or invalid
+    u64 read_bin(const char *data, u64 len, 
+                 const std::string &rf_name, u64 rf_len);
+
     void set_read_len(u64 rd_len);
     void set_mapped(u64 rd_st, u64 rd_en, 
                     std::string rf_name,
@@ -69,15 +103,50 @@ class Paf {
                     bool fwd, u16 matches);
     void set_ended();
     void set_unmapped();
+    void set_off_target();
 
     void set_int(Tag t, int v);
     void set_float(Tag t, float v);
     void set_str(Tag t, std::string v);
 
-    std::string get_rd_name() {
+    const std::string &get_rd_name() const {
         return rd_name_;
     }
 
+    const std::string &get_rf_name() const {
+        return rf_name_;
+    }
+
+    u64 get_rf_len() const {
+        return rf_len_;
+    }
+
+    static const std::string &tag_str(Tag t) {
+        return PAF_TAGS[t];
+    }
+
+    //Fixed-size header of each binary record. It's followed by the read 
+    //name, a (u8 tag, i32) pair per int tag, a (u8 tag, f32) pair per 
+    //float tag, and (u8 tag, u16 length, chars) per string tag
+    typedef struct {
+        u64 rd_len, rd_st, rd_en, rf_st, rf_en;
+        u32 rf_id;
+        u32 body_len;
+        u16 matches;
+        u16 name_len;
+        u8 flags;
+        u8 int_count, float_count, str_count;
+    } BinRecord;
+
+    enum BinFlag {
+        BIN_MAPPED     = 1, 
+        BIN_FWD        = 2, 
+        BIN_ENDED      = 4, 
+        BIN_OFF_TARGET = 8
+    };
+
+    static const u32 NO_REF = UINT_MAX;
+
     #ifdef PYBIND
     #define PY_PAF_METH(P) c.def(#P, &Paf::P);
     #define PY_PAF_TAG(P) t.value(#P, Paf::Tag::P);
@@ -87,9 +156,11 @@ class Paf {
         PY_PAF_METH(print_paf);
         PY_PAF_METH(is_mapped);
         PY_PAF_METH(is_ended);
+        PY_PAF_METH(is_on_target);
         PY_PAF_METH(set_int);
         PY_PAF_METH(set_float);
         PY_PAF_METH(set_str);
+        c.def_static("tag_str", &Paf::tag_str);
 
         pybind11::enum_<Paf::Tag> t(c, "Tag");
         PY_PAF_TAG(MAP_TIME);
@@ -98,15 +169,32 @@ class Paf {
         PY_PAF_TAG(ENDED);
         PY_PAF_TAG(KEEP);
         PY_PAF_TAG(DELAY);
+        PY_PAF_TAG(PATH_BUDGET);
+        PY_PAF_TAG(BUDGET_SHRINKS);
+        PY_PAF_TAG(BUDGET_GROWS);
+        PY_PAF_TAG(OFF_TARGET);
+        PY_PAF_TAG(EARLY_STOP);
+        PY_PAF_TAG(EVENT_COUNT);
+        PY_PAF_TAG(PATH_COUNT);
+        PY_PAF_TAG(NEIGHBOR_COUNT);
+        PY_PAF_TAG(SA_LOOKUP_COUNT);
+        PY_PAF_TAG(SEED_COUNT);
+        PY_PAF_TAG(SOURCE_COUNT);
+        PY_PAF_TAG(NORM_SKIP_COUNT);
+        PY_PAF_TAG(SA_HIT_COUNT);
+        PY_PAF_TAG(SA_MISS_COUNT);
         t.export_values();
     }
 
     #endif
 
     private:
+    friend class PafBinReader;
+    friend class PafSummary;
+
     static const std::string PAF_TAGS[];
 
-    bool is_mapped_, ended_;
+    bool is_mapped_, ended_, off_target_;
     std::string rd_name_, rf_name_;
     u64 rd_st_, rd_en_, rd_len_,
         rf_st_, rf_en_, rf_len_;
@@ -118,6 +206,34 @@ class Paf {
     std::vector< std::pair<Tag, std::string> > str_tags_;
 };
 
+//Reads slices of one fast5 read's signal after the file it was loaded
+//from has moved on, using its own read-only handle to the file
+class LazySignal {
+    public:
+    LazySignal(hid_t file, const std::string &path, 
+               const VbzDecoder::Calibration &cal, u64 len);
+    ~LazySignal();
+
+    //Appends calibrated samples [st, st+len), the file is opened on first use
+    bool read(u64 st, u64 len, std::vector<float> &out);
+
+    //Same as read, through an already open file
+    static bool read(hid_t file, const std::string &path, 
+                     const VbzDecoder::Calibration &cal,
+                     u64 st, u64 len, std::vector<float> &out);
+
+    u64 size() const {return len_;}
+
+    //Length of a 1D dataset, 0 if it can't be opened
+    static u64 dataset_len(hid_t file, const std::string &path);
+
+    private:
+    std::string fname_, path_;
+    VbzDecoder::Calibration cal_;
+    u64 len_;
+    hid_t file_;
+};
+
 class ReadBuffer {
     public:
 
@@ -128,6 +244,10 @@ class ReadBuffer {
         float chunk_time;
         u32 max_chunks;
 
+        //Chunks of fast5 signal loaded with each read, the rest is read
+        //with load_signal as it's needed. 0 loads whole reads
+        u32 load_chunks;
+
         float bp_per_samp() {
             return bp_per_sec / sample_rate;
         }
@@ -143,6 +263,10 @@ class ReadBuffer {
     ReadBuffer();
     ReadBuffer(const std::string &filename);
     ReadBuffer(const hdf5_tools::File &file, const std::string &raw_path, const std::string &ch_path);
+
+    //Takes calibrated samples from signal, leaving it with unused storage
+    ReadBuffer(const std::string &id, u16 channel, u32 number, 
+               u64 start_sample, std::vector<float> &signal);
     
     ReadBuffer(Chunk &first_chunk);
 
@@ -155,6 +279,11 @@ class ReadBuffer {
     u16 get_channel() const;
     const std::vector<float> &get_raw() const {return full_signal_;}
 
+    //Loads signal up to sample end if it was left out by load_chunks
+    //Chunks and get_raw only include loaded signal
+    //Returns false if no more signal past what's loaded can be read
+    bool load_signal(u64 end = ULLONG_MAX);
+
     bool add_chunk(Chunk &c);
     Chunk &&pop_chunk();
     void swap(ReadBuffer &r);
@@ -195,6 +324,7 @@ class ReadBuffer {
         PY_READ_PRM(sample_rate);
         PY_READ_PRM(chunk_time);
         PY_READ_PRM(max_chunks);
+        PY_READ_PRM(load_chunks);
     }
 
     #endif
@@ -205,6 +335,7 @@ class ReadBuffer {
     u32 number_;
     u64 start_sample_, raw_len_;
     std::vector<float> full_signal_, chunk_;
+    std::shared_ptr<LazySignal> lazy_;
     u16 chunk_count_;
     bool chunk_processed_;
 
@@ -0,0 +1,154 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include "read_checkpoint.hpp"
+
+ReadCheckpoint::ReadCheckpoint(const std::string &fname, bool resume) {
+    if (resume) load(fname);
+
+    out_.open(fname, resume ? std::ios::app : std::ios::trunc);
+    if (!out_.is_open()) {
+        std::cerr << "Error: failed to open checkpoint \"" << fname << "\"\n";
+    }
+}
+
+ReadCheckpoint::ReadCheckpoint(FileCallback on_file_done) 
+    : on_file_done_(on_file_done) {}
+
+ReadCheckpoint::~ReadCheckpoint() {
+    flush();
+}
+
+void ReadCheckpoint::load(const std::string &fname) {
+    std::ifstream in(fname);
+    if (!in.is_open()) return;
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string data = ss.str();
+
+    //Only complete lines, the run may have been killed mid-write
+    size_t st = 0, en;
+    while ((en = data.find('\n', st)) != std::string::npos) {
+        if (en - st > 2 && data[st+1] == '\t') {
+            std::string val = data.substr(st+2, en-st-2);
+            if (data[st] == 'r') done_reads_.insert(val);
+            else if (data[st] == 'f') done_files_.insert(val);
+        }
+        st = en + 1;
+    }
+
+    //Drops the partial line so new entries start on their own line
+    if (st < data.size() && truncate(fname.c_str(), st) != 0) {
+        std::cerr << "Warning: failed to truncate checkpoint \"" 
+                  << fname << "\"\n";
+    }
+
+    std::cerr << "Resuming after " << done_reads_.size() << " reads from "
+              << done_files_.size() << " finished files\n";
+}
+
+bool ReadCheckpoint::is_open() const {
+    return out_.is_open();
+}
+
+bool ReadCheckpoint::file_done(const std::string &fname) const {
+    return done_files_.count(fname) > 0;
+}
+
+const std::unordered_set<std::string> &ReadCheckpoint::done_reads() const {
+    return done_reads_;
+}
+
+u32 ReadCheckpoint::done_file_count() const {
+    return done_files_.size();
+}
+
+u32 ReadCheckpoint::file_opened(const std::string &fname) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    files_.push_back({fname, 0, false, false});
+    return files_.size() - 1;
+}
+
+void ReadCheckpoint::read_loaded(u32 file, const std::string &read_id) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    files_[file].pending++;
+    pending_reads_[read_id] = file;
+}
+
+void ReadCheckpoint::file_loaded(u32 file) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    LoadedFile &f = files_[file];
+    f.loaded = true;
+    if (f.pending == 0) file_done(f);
+}
+
+void ReadCheckpoint::cancel_file(const std::string &fname) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (LoadedFile &f : files_) {
+        if (!f.loaded && f.name == fname) f.cancelled = true;
+    }
+}
+
+bool ReadCheckpoint::file_cancelled(u32 file) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return files_[file].cancelled;
+}
+
+void ReadCheckpoint::file_failed(const std::string &fname) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (on_file_done_) on_file_done_(fname);
+}
+
+void ReadCheckpoint::read_written(const std::string &read_id) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (out_.is_open()) out_ << "r\t" << read_id << "\n";
+
+    auto r = pending_reads_.find(read_id);
+    if (r == pending_reads_.end()) return;
+
+    LoadedFile &f = files_[r->second];
+    pending_reads_.erase(r);
+    if (--f.pending == 0 && f.loaded) file_done(f);
+}
+
+std::string ReadCheckpoint::read_file(const std::string &read_id) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto r = pending_reads_.find(read_id);
+    if (r == pending_reads_.end()) return "";
+    return files_[r->second].name;
+}
+
+void ReadCheckpoint::file_done(LoadedFile &f) {
+    if (out_.is_open()) out_ << "f\t" << f.name << "\n";
+    if (on_file_done_) on_file_done_(f.name);
+    std::string().swap(f.name);
+}
+
+void ReadCheckpoint::flush() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    out_.flush();
+}
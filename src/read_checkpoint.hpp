@@ -0,0 +1,126 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_READ_CHECKPOINT
+#define _INCL_READ_CHECKPOINT
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <functional>
+#include <unordered_set>
+#include <unordered_map>
+#include "util.hpp"
+
+#ifdef PYBIND
+#include <pybind11/pybind11.h>
+#endif
+
+//Log of reads whose results have been written, and of files whose reads
+//all have, so an interrupted offline mapping run can be resumed
+//Fast5Reader reports which file each read is loaded from, and PafWriter 
+//reports reads once their results are written. Each line of the log is 
+//"r\t<read id>" or "f\t<file path>"; a partial last line is ignored
+class ReadCheckpoint {
+    public:
+
+    //Called with each file's path once all of its reads are written
+    typedef std::function<void(const std::string &)> FileCallback;
+
+    //Only tracks which reads are pending, without a log
+    ReadCheckpoint(FileCallback on_file_done);
+
+    //Loads reads and files finished by a previous run if resume is set,
+    //otherwise the log is truncated
+    ReadCheckpoint(const std::string &fname, bool resume);
+
+    ~ReadCheckpoint();
+
+    bool is_open() const;
+
+    //Finished in the previous run
+    bool file_done(const std::string &fname) const;
+    const std::unordered_set<std::string> &done_reads() const;
+    u32 done_file_count() const;
+
+    //Returns an ID for a file being loaded
+    u32 file_opened(const std::string &fname);
+    void read_loaded(u32 file, const std::string &read_id);
+
+    //Every read in the file has been loaded
+    void file_loaded(u32 file);
+
+    //Tells the reader to stop loading the file, which is then treated 
+    //as loaded. Reads already loaded are still pending until written
+    void cancel_file(const std::string &fname);
+    bool file_cancelled(u32 file);
+
+    //The file couldn't be opened. It's never logged as done, but its
+    //path is passed to the callback so tracking can move past it
+    void file_failed(const std::string &fname);
+
+    void read_written(const std::string &read_id);
+
+    //Path of the file a pending read was loaded from, empty if unknown
+    std::string read_file(const std::string &read_id);
+
+    //Writes everything logged so far
+    void flush();
+
+    #ifdef PYBIND
+    #define PY_READ_CHECKPOINT_METH(P) c.def(#P, &ReadCheckpoint::P);
+    static void pybind_defs(pybind11::class_<ReadCheckpoint> &c) {
+        c.def(pybind11::init<const std::string &, bool>());
+        PY_READ_CHECKPOINT_METH(is_open);
+        PY_READ_CHECKPOINT_METH(file_done);
+        PY_READ_CHECKPOINT_METH(done_file_count);
+        PY_READ_CHECKPOINT_METH(flush);
+        c.def("done_read_count", [](ReadCheckpoint &c) {
+            return c.done_reads().size();
+        });
+    }
+    #endif
+
+    private:
+    struct LoadedFile {
+        std::string name;
+        u32 pending;
+        bool loaded, cancelled;
+    };
+
+    void load(const std::string &fname);
+    void file_done(LoadedFile &f);
+
+    std::mutex mtx_;
+    std::ofstream out_;
+    FileCallback on_file_done_;
+
+    std::unordered_set<std::string> done_files_, done_reads_;
+
+    //Loaded reads waiting for their results, by the file they came from
+    std::vector<LoadedFile> files_;
+    std::unordered_map<std::string, u32> pending_reads_;
+};
+
+#endif
@@ -0,0 +1,459 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include "read_file.hpp"
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && 
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+ReadFile *ReadFile::create(const std::string &path) {
+    if (ends_with(path, ".fast5")) return new Fast5File();
+    if (ends_with(path, ".slow5")) return new Slow5File();
+
+    #ifdef HAVE_SLOW5LIB
+    if (ends_with(path, ".blow5")) return new Blow5File();
+    #endif
+
+    #ifdef HAVE_POD5
+    if (ends_with(path, ".pod5")) return new Pod5File();
+    #endif
+
+    return NULL;
+}
+
+bool ReadFile::is_supported(const std::string &path) {
+    ReadFile *f = create(path);
+    delete f;
+    return f != NULL;
+}
+
+//-------------------------------- FAST5 --------------------------------
+
+const std::string Fast5File::FMT_RAW_PATHS[] = {
+    "/Raw",      //MULTI
+    "/Raw/Reads" //SINGLE
+};
+
+const std::string Fast5File::FMT_CH_PATHS[] = {
+    "/channel_id",                //MULTI
+    "/UniqueGlobalKey/channel_id" //SINGLE
+};
+
+bool Fast5File::open(const std::string &path, const ReadFilter &filter) {
+    close();
+    file_.open(path);
+
+    fmt_ = Format::UNKNOWN;
+    for (const std::string &s : file_.list_group("/")) {
+        if (s == "Raw") {
+            fmt_ = Format::SINGLE;
+            break;
+        }
+    }
+    if (fmt_ == Format::UNKNOWN) fmt_ = Format::MULTI; //TODO: add support for old multi format
+
+    std::string raw_path;
+    switch (fmt_) {
+    case Format::SINGLE:
+        raw_path = FMT_RAW_PATHS[Format::SINGLE];
+        for (const std::string &read : file_.list_group(raw_path)) {
+            std::string read_id = "";
+            for (auto a : file_.get_attr_map(raw_path+"/"+read)) {
+                if (a.first == "read_id") {
+                    read_id = a.second;
+                    break;
+                }
+            }
+
+            if (read_id.empty()) {
+                std::cerr << "Error: failed to find read_id\n";
+                return false;
+            }
+            
+            if (filter.pass(read_id)) {
+                read_paths_.push_back("/"+read);
+            }
+        }
+        return true;
+
+    case Format::MULTI:
+        for (const std::string &read : file_.list_group("/")) {
+            std::string id = read.substr(read.find('_')+1);
+            if (filter.pass(id)) {
+                read_paths_.push_back("/"+read);
+            }
+        }
+        return true;
+    default:
+        return false;
+    }
+
+    return false; 
+}
+
+bool Fast5File::next_read(ReadBuffer &r) {
+    if (next_ >= read_paths_.size()) return false;
+
+    const std::string &read_path = read_paths_[next_++];
+    std::string raw_path, ch_path;
+
+    switch (fmt_) {
+        case Format::SINGLE:
+            raw_path = FMT_RAW_PATHS[fmt_] + read_path;
+            ch_path = FMT_CH_PATHS[fmt_];
+            break;
+        case Format::MULTI:
+            raw_path = read_path + FMT_RAW_PATHS[fmt_],
+            ch_path =  read_path + FMT_CH_PATHS[fmt_];
+            break;
+        default:
+            std::cerr << "Error: unrecognized fast5 format\n";
+            return false;
+    }
+
+    ReadBuffer read(file_, raw_path, ch_path);
+    r.swap(read);
+    return true;
+}
+
+void Fast5File::close() {
+    if (file_.is_open()) file_.close();
+    read_paths_.clear();
+    next_ = 0;
+}
+
+//-------------------------------- SLOW5 --------------------------------
+
+const std::string Slow5File::COLUMN_NAMES[] = {
+    "read_id", "digitisation", "offset", "range", 
+    "raw_signal", "channel_number", "read_number", "start_time"
+};
+
+bool Slow5File::open(const std::string &path, const ReadFilter &filter) {
+    close();
+
+    in_.open(path);
+    if (!in_.is_open()) {
+        std::cerr << "Error: failed to open \"" << path << "\"\n";
+        return false;
+    }
+
+    //Header lines start with '#' or '@', ending with the column names
+    cols_.assign(NUM_COLUMNS, -1);
+    bool found_cols = false;
+    while (!found_cols && std::getline(in_, line_)) {
+        if (line_.compare(0, 9, "#read_id\t") != 0) continue;
+
+        const char *s = line_.c_str() + 1;
+        for (i32 i = 0; *s != '\0'; i++) {
+            const char *e = strchr(s, '\t');
+            size_t len = e == NULL ? strlen(s) : e - s;
+
+            for (u8 c = 0; c < NUM_COLUMNS; c++) {
+                if (COLUMN_NAMES[c].compare(0, std::string::npos, s, len) == 0) {
+                    cols_[c] = i;
+                }
+            }
+
+            s += len + (e != NULL);
+        }
+        found_cols = true;
+    }
+
+    for (u8 c = 0; c <= RAW_SIGNAL; c++) {
+        if (cols_[c] < 0) {
+            std::cerr << "Error: \"" << path << "\" is missing SLOW5 column \"" 
+                      << COLUMN_NAMES[c] << "\"\n";
+            return false;
+        }
+    }
+
+    //Index the selected reads by file offset, skipping over their signal
+    filtered_ = !filter.empty();
+    if (filtered_) {
+        std::string id;
+        while (true) {
+            std::streamoff offs = in_.tellg();
+            if (!std::getline(in_, id, '\t')) break;
+            in_.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+
+            if (filter.pass(id)) offsets_.push_back(offs);
+        }
+        in_.clear();
+    }
+
+    return true;
+}
+
+bool Slow5File::next_read(ReadBuffer &r) {
+    if (filtered_) {
+        if (next_ >= offsets_.size()) return false;
+        in_.seekg(offsets_[next_++]);
+    }
+
+    do {
+        if (!std::getline(in_, line_)) return false;
+    } while (line_.empty() || line_[0] == '#' || line_[0] == '@');
+
+    //Split on tabs in place
+    field_st_.clear();
+    field_st_.push_back(0);
+    for (u32 i = 0; i < line_.size(); i++) {
+        if (line_[i] == '\t') {
+            line_[i] = '\0';
+            field_st_.push_back(i+1);
+        }
+    }
+
+    auto field = [this](Column c) -> const char * {
+        i32 i = cols_[c];
+        return (i >= 0 && i < (i32) field_st_.size()) ? &line_[field_st_[i]] : NULL;
+    };
+
+    const char *raw = field(RAW_SIGNAL);
+    if (raw == NULL) {
+        std::cerr << "Error: truncated SLOW5 record\n";
+        return false;
+    }
+
+    float digit = atof(field(DIGITISATION)),
+          offset = atof(field(OFFSET)),
+          range = atof(field(RANGE));
+
+    //Calibrated the same way as fast5 reads
+    signal_.clear();
+    while (*raw != '\0') {
+        char *end;
+        u16 v = strtol(raw, &end, 10);
+        if (end == raw) break;
+        signal_.push_back((range * v / digit) + offset);
+        raw = *end == ',' ? end + 1 : end;
+    }
+
+    const char *ch = field(CHANNEL_NUMBER),
+               *num = field(READ_NUMBER),
+               *st = field(START_TIME);
+
+    ReadBuffer read(field(READ_ID), 
+                    ch != NULL ? atoi(ch) : 1, 
+                    num != NULL ? atoi(num) : 0, 
+                    st != NULL ? strtoull(st, NULL, 10) : 0, 
+                    signal_);
+    r.swap(read);
+    return true;
+}
+
+void Slow5File::close() {
+    if (in_.is_open()) in_.close();
+    in_.clear();
+    offsets_.clear();
+    next_ = 0;
+}
+
+//-------------------------------- BLOW5 --------------------------------
+
+#ifdef HAVE_SLOW5LIB
+
+Blow5File::Blow5File() : file_(NULL), rec_(NULL), next_(0) {}
+
+Blow5File::~Blow5File() {
+    close();
+}
+
+bool Blow5File::open(const std::string &path, const ReadFilter &filter) {
+    close();
+
+    file_ = slow5_open(path.c_str(), "r");
+    if (file_ == NULL) {
+        std::cerr << "Error: failed to open \"" << path << "\"\n";
+        return false;
+    }
+
+    filtered_ = !filter.empty();
+    if (filtered_) {
+        if (slow5_idx_load(file_) < 0) {
+            std::cerr << "Error: failed to load index for \"" << path << "\"\n";
+            return false;
+        }
+
+        uint64_t n = 0;
+        char **ids = slow5_get_rids(file_, &n);
+        for (uint64_t i = 0; ids != NULL && i < n; i++) {
+            if (filter.pass(ids[i])) read_ids_.push_back(ids[i]);
+        }
+    }
+
+    return true;
+}
+
+bool Blow5File::next_read(ReadBuffer &r) {
+    if (file_ == NULL) return false;
+
+    if (filtered_) {
+        if (next_ >= read_ids_.size()) return false;
+        if (slow5_get(read_ids_[next_++].c_str(), &rec_, file_) < 0) return false;
+    } else if (slow5_get_next(&rec_, file_) < 0) {
+        return false;
+    }
+
+    float digit = rec_->digitisation,
+          offset = rec_->offset,
+          range = rec_->range;
+
+    //Calibrated the same way as fast5 reads
+    signal_.resize(rec_->len_raw_signal);
+    for (u64 i = 0; i < rec_->len_raw_signal; i++) {
+        signal_[i] = (range * (u16) rec_->raw_signal[i] / digit) + offset;
+    }
+
+    int err;
+    u64 len;
+    char *ch = slow5_aux_get_string(rec_, "channel_number", &len, &err);
+    i32 number = slow5_aux_get_int32(rec_, "read_number", &err);
+    if (err < 0) number = 0;
+    u64 start = slow5_aux_get_uint64(rec_, "start_time", &err);
+    if (err < 0) start = 0;
+
+    ReadBuffer read(rec_->read_id, 
+                    ch != NULL ? atoi(std::string(ch, len).c_str()) : 1,
+                    number, start, signal_);
+    r.swap(read);
+    return true;
+}
+
+void Blow5File::close() {
+    if (rec_ != NULL) slow5_rec_free(rec_);
+    if (file_ != NULL) slow5_close(file_);
+    rec_ = NULL;
+    file_ = NULL;
+    read_ids_.clear();
+    next_ = 0;
+}
+
+#endif
+
+//-------------------------------- POD5 ---------------------------------
+
+#ifdef HAVE_POD5
+
+static std::once_flag pod5_init_flag;
+
+Pod5File::Pod5File() 
+    : file_(NULL), batch_(NULL), filter_(NULL),
+      batch_count_(0), batch_i_(0), row_count_(0), row_(0) {}
+
+Pod5File::~Pod5File() {
+    close();
+}
+
+bool Pod5File::open(const std::string &path, const ReadFilter &filter) {
+    close();
+    std::call_once(pod5_init_flag, pod5_init);
+
+    file_ = pod5_open_file(path.c_str());
+    if (file_ == NULL) {
+        std::cerr << "Error: failed to open \"" << path << "\": "
+                  << pod5_get_error_string() << "\n";
+        return false;
+    }
+
+    if (pod5_get_read_batch_count(&batch_count_, file_) != POD5_OK) {
+        std::cerr << "Error: " << pod5_get_error_string() << "\n";
+        return false;
+    }
+
+    filter_ = &filter;
+    return true;
+}
+
+bool Pod5File::next_read(ReadBuffer &r) {
+    if (file_ == NULL) return false;
+
+    while (true) {
+        if (batch_ == NULL) {
+            if (batch_i_ >= batch_count_ || 
+                pod5_get_read_batch(&batch_, file_, batch_i_++) != POD5_OK ||
+                pod5_get_read_batch_row_count(&row_count_, batch_) != POD5_OK) {
+                return false;
+            }
+            row_ = 0;
+        }
+
+        if (row_ >= row_count_) {
+            pod5_free_read_batch(batch_);
+            batch_ = NULL;
+            continue;
+        }
+
+        size_t row = row_++;
+
+        ReadBatchRowInfo_t info;
+        uint16_t version;
+        if (pod5_get_read_batch_row_info_data(batch_, row, READ_BATCH_ROW_INFO_VERSION, 
+                                              &info, &version) != POD5_OK) {
+            return false;
+        }
+
+        char read_id[37];
+        pod5_format_read_id(info.read_id, read_id);
+        if (!filter_->pass(read_id)) continue;
+
+        size_t n = 0;
+        if (pod5_get_read_complete_sample_count(file_, batch_, row, &n) != POD5_OK) {
+            return false;
+        }
+
+        raw_.resize(n);
+        if (pod5_get_read_complete_signal(file_, batch_, row, n, raw_.data()) != POD5_OK) {
+            return false;
+        }
+
+        signal_.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            signal_[i] = (raw_[i] + info.calibration_offset) * info.calibration_scale;
+        }
+
+        ReadBuffer read(read_id, info.channel, info.read_number, 
+                        info.start_sample, signal_);
+        r.swap(read);
+        return true;
+    }
+}
+
+void Pod5File::close() {
+    if (batch_ != NULL) pod5_free_read_batch(batch_);
+    if (file_ != NULL) pod5_close_and_free_reader(file_);
+    batch_ = NULL;
+    file_ = NULL;
+    batch_count_ = batch_i_ = row_count_ = row_ = 0;
+}
+
+#endif
@@ -0,0 +1,173 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_READ_FILE
+#define _INCL_READ_FILE
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_set>
+#include "read_buffer.hpp"
+#include "util.hpp"
+
+#ifdef HAVE_SLOW5LIB
+#include <slow5/slow5.h>
+#endif
+
+#ifdef HAVE_POD5
+#include <pod5_format/c_api.h>
+#endif
+
+//Cursor over the reads stored in one input file
+//Each instance has its own file handle, so instances can be used from
+//different threads at the same time (HDF5 calls are still serialized)
+class ReadFile {
+    public:
+
+    //Reads in include are loaded if it isn't empty, reads in exclude never are
+    struct ReadFilter {
+        std::unordered_set<std::string> include, exclude;
+
+        bool empty() const {
+            return include.empty() && exclude.empty();
+        }
+
+        bool pass(const std::string &id) const {
+            return (include.empty() || include.count(id) > 0) && 
+                   exclude.count(id) == 0;
+        }
+    };
+
+    virtual ~ReadFile() {}
+
+    //Opens the file, only reads in filter will be loaded if it isn't empty
+    virtual bool open(const std::string &path, const ReadFilter &filter) = 0;
+
+    //Loads the next read, returns false once all reads have been loaded
+    virtual bool next_read(ReadBuffer &r) = 0;
+
+    virtual void close() = 0;
+
+    //Returns a reader for the file's format, based on its extension
+    //(.fast5, .slow5, .blow5, .pod5), or NULL if it isn't supported
+    static ReadFile *create(const std::string &path);
+
+    static bool is_supported(const std::string &path);
+};
+
+class Fast5File : public ReadFile {
+    public:
+
+    Fast5File() : next_(0) {}
+
+    bool open(const std::string &path, const ReadFilter &filter);
+    bool next_read(ReadBuffer &r);
+    void close();
+
+    private:
+    enum Format {MULTI, SINGLE, UNKNOWN};
+    static const std::string FMT_RAW_PATHS[], FMT_CH_PATHS[];
+
+    hdf5_tools::File file_;
+    Format fmt_;
+    std::vector<std::string> read_paths_;
+    u32 next_;
+};
+
+//Built-in reader for ASCII SLOW5
+//Reads are scanned sequentially, or seeked to by offset when filtered
+class Slow5File : public ReadFile {
+    public:
+
+    Slow5File() : filtered_(false), next_(0) {}
+
+    bool open(const std::string &path, const ReadFilter &filter);
+    bool next_read(ReadBuffer &r);
+    void close();
+
+    private:
+    enum Column {READ_ID, DIGITISATION, OFFSET, RANGE, 
+                 RAW_SIGNAL, CHANNEL_NUMBER, READ_NUMBER, START_TIME, 
+                 NUM_COLUMNS};
+    static const std::string COLUMN_NAMES[];
+
+    std::ifstream in_;
+    std::vector<i32> cols_;
+    std::vector<std::streamoff> offsets_;
+    bool filtered_;
+    u32 next_;
+
+    std::string line_;
+    std::vector<u32> field_st_;
+    std::vector<float> signal_;
+};
+
+#ifdef HAVE_SLOW5LIB
+//BLOW5 reader using slow5lib
+//Filtered reads are fetched by ID through the BLOW5 index
+class Blow5File : public ReadFile {
+    public:
+
+    Blow5File();
+    ~Blow5File();
+
+    bool open(const std::string &path, const ReadFilter &filter);
+    bool next_read(ReadBuffer &r);
+    void close();
+
+    private:
+    slow5_file_t *file_;
+    slow5_rec_t *rec_;
+    std::vector<std::string> read_ids_;
+    bool filtered_;
+    u32 next_;
+    std::vector<float> signal_;
+};
+#endif
+
+#ifdef HAVE_POD5
+//POD5 reader using the pod5 C API
+//Read metadata is checked against the filter before decoding any signal
+class Pod5File : public ReadFile {
+    public:
+
+    Pod5File();
+    ~Pod5File();
+
+    bool open(const std::string &path, const ReadFilter &filter);
+    bool next_read(ReadBuffer &r);
+    void close();
+
+    private:
+    Pod5FileReader_t *file_;
+    Pod5ReadRecordBatch_t *batch_;
+    const ReadFilter *filter_;
+    size_t batch_count_, batch_i_, row_count_, row_;
+    std::vector<i16> raw_;
+    std::vector<float> signal_;
+};
+#endif
+
+#endif
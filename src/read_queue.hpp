@@ -0,0 +1,139 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_READ_QUEUE
+#define _INCL_READ_QUEUE
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "util.hpp"
+#include "read_buffer.hpp"
+
+//Bounded multi-producer/multi-consumer queue of reads
+//Producers block while full, consumers block while empty until close()
+class ReadQueue {
+    public:
+
+    ReadQueue(u32 capacity = 100) 
+        : capacity_(capacity > 0 ? capacity : 1), 
+          closed_(false) {}
+
+    //Swaps r into the queue, blocking while full
+    //Returns false if the queue was closed
+    bool push(ReadBuffer &r) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        not_full_.wait(lock, [this] {
+            return closed_ || reads_.size() < capacity_;
+        });
+        if (closed_) return false;
+
+        reads_.emplace_back();
+        reads_.back().swap(r);
+
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    //Swaps the oldest read into r, blocking while empty
+    //Returns false once the queue is closed and drained
+    bool pop(ReadBuffer &r) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        not_empty_.wait(lock, [this] {
+            return closed_ || !reads_.empty();
+        });
+        if (reads_.empty()) return false;
+
+        r.swap(reads_.front());
+        reads_.pop_front();
+
+        lock.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+
+    //Like pop, but returns false instead of waiting if the queue is empty
+    bool try_pop(ReadBuffer &r) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (reads_.empty()) return false;
+
+        r.swap(reads_.front());
+        reads_.pop_front();
+
+        lock.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+
+    //No more reads will be pushed, wakes up all waiting threads
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    //Reopens the queue and drops any buffered reads
+    void reset() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        reads_.clear();
+        closed_ = false;
+    }
+
+    void clear() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            reads_.clear();
+        }
+        not_full_.notify_all();
+    }
+
+    u32 size() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return reads_.size();
+    }
+
+    bool closed() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return closed_;
+    }
+
+    void set_capacity(u32 capacity) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        capacity_ = capacity > 0 ? capacity : 1;
+    }
+
+    private:
+    std::deque<ReadBuffer> reads_;
+    u32 capacity_;
+    bool closed_;
+
+    std::mutex mtx_;
+    std::condition_variable not_empty_, not_full_;
+};
+
+#endif
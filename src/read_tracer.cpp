@@ -0,0 +1,277 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <unistd.h>
+#include "read_tracer.hpp"
+
+ReadTracer::Params ReadTracer::PRMS = {
+    trace_out    : "",
+    trace_sample : 0,
+    trace_list   : "",
+    trace_buffer : 1 << 20
+};
+
+const char ReadTracer::MAGIC[4] = {'U', 'N', 'C', 'T'};
+
+std::atomic<bool> ReadTracer::enabled_(false);
+thread_local ReadTracer::Ring *ReadTracer::thread_ring_ = NULL;
+
+static_assert(sizeof(ReadTracer::RecHeader) == 8, "RecHeader is part of the trace format");
+static_assert(sizeof(ReadTracer::ReadRec) == 16, "ReadRec is part of the trace format");
+static_assert(sizeof(ReadTracer::EventRec) == 36, "EventRec is part of the trace format");
+static_assert(sizeof(ReadTracer::StepRec) == 32, "StepRec is part of the trace format");
+static_assert(sizeof(ReadTracer::SeedRec) == 40, "SeedRec is part of the trace format");
+static_assert(sizeof(ReadTracer::EndRec) == 24, "EndRec is part of the trace format");
+
+ReadTracer &ReadTracer::get() {
+    static ReadTracer tracer;
+    return tracer;
+}
+
+ReadTracer::ReadTracer() 
+    : sample_thresh_(0),
+      out_(NULL),
+      stopped_(false),
+      read_count_(0),
+      dropped_(0) {}
+
+ReadTracer::~ReadTracer() {
+    close();
+}
+
+bool ReadTracer::open() {
+    if (out_ != NULL || PRMS.trace_out.empty()) return false;
+
+    float frac = std::min(std::max(PRMS.trace_sample, 0.0f), 1.0f);
+    sample_thresh_ = frac >= 1 ? UINT32_MAX : u32(frac * UINT32_MAX);
+
+    if (!PRMS.trace_list.empty()) {
+        std::ifstream in(PRMS.trace_list);
+        if (!in.is_open()) {
+            std::cerr << "Error: failed to open trace list \"" 
+                      << PRMS.trace_list << "\"\n";
+            return false;
+        }
+        std::string id;
+        while (getline(in, id)) read_list_.insert(id);
+    }
+
+    out_ = fopen(PRMS.trace_out.c_str(), "wb");
+    if (out_ == NULL) {
+        std::cerr << "Error: failed to open trace file \"" 
+                  << PRMS.trace_out << "\"\n";
+        return false;
+    }
+
+    TraceHeader h;
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    fwrite(&h, sizeof(h), 1, out_);
+
+    stopped_ = false;
+    thread_ = std::thread(&ReadTracer::run, this);
+    enabled_ = true;
+    return true;
+}
+
+void ReadTracer::close() {
+    if (out_ == NULL) return;
+
+    enabled_ = false;
+    stopped_ = true;
+    thread_.join();
+    fclose(out_);
+    out_ = NULL;
+
+    if (dropped_ > 0) {
+        std::cerr << "Warning: " << dropped_ << " trace records dropped, "
+                  << "trace_buffer may be too small\n";
+    }
+}
+
+//FNV-1a, stable across runs and platforms
+bool ReadTracer::sampled(const std::string &read_id) const {
+    if (read_list_.count(read_id) > 0) return true;
+    if (sample_thresh_ == 0) return false;
+
+    u32 h = 2166136261u;
+    for (char c : read_id) {
+        h = (h ^ u8(c)) * 16777619u;
+    }
+    return h <= sample_thresh_;
+}
+
+u32 ReadTracer::start_read(const std::string &read_id, u32 number, u16 channel) {
+    if (!enabled() || !sampled(read_id)) return 0;
+
+    ReadRec r;
+    r.h.read = ++read_count_;
+    r.number = number;
+    r.channel = channel;
+    r.name_len = std::min<size_t>(read_id.size(), MAX_NAME);
+    push(r.h, READ, sizeof(r), &read_id);
+    return r.h.read;
+}
+
+void ReadTracer::event(u32 read, const Event &e, 
+                       float win_mean, float win_stdv, u32 mask) {
+    EventRec r;
+    r.h.read = read;
+    r.start = e.start;
+    r.length = e.length;
+    r.mean = e.mean;
+    r.stdv = e.stdv;
+    r.win_mean = win_mean;
+    r.win_stdv = win_stdv;
+    r.mask = mask;
+    push(r.h, EVENT, sizeof(r));
+}
+
+void ReadTracer::step(u32 read, u32 event, u32 paths, float value, 
+                      float norm_scale, float norm_shift, u32 top_len) {
+    StepRec r;
+    r.h.read = read;
+    r.event = event;
+    r.paths = paths;
+    r.value = value;
+    r.norm_scale = norm_scale;
+    r.norm_shift = norm_shift;
+    r.top_len = top_len;
+    push(r.h, STEP, sizeof(r));
+}
+
+void ReadTracer::seed(u32 read, u32 event, u32 path, u32 cluster, 
+                      const std::string &ref_name, u64 ref_st, u32 ref_len, bool fwd) {
+    SeedRec r;
+    memset(&r, 0, sizeof(r));
+    r.h.read = read;
+    r.event = event;
+    r.path = path;
+    r.cluster = cluster;
+    r.ref_len = ref_len;
+    r.ref_st = ref_st;
+    r.fwd = fwd;
+    r.name_len = std::min<size_t>(ref_name.size(), MAX_NAME);
+    push(r.h, SEED, sizeof(r), &ref_name);
+}
+
+void ReadTracer::end(u32 read, u32 events, u8 state, bool mapped, float decision_time) {
+    EndRec r;
+    memset(&r, 0, sizeof(r));
+    r.h.read = read;
+    r.events = events;
+    r.state = state;
+    r.mapped = mapped;
+    r.decision_time = decision_time;
+    push(r.h, END, sizeof(r));
+}
+
+u64 ReadTracer::dropped() const {
+    return dropped_.load();
+}
+
+//h is the start of a record len bytes long, which may be followed by name
+void ReadTracer::push(RecHeader &h, RecType type, u32 len, const std::string *name) {
+    if (!enabled()) return;
+
+    if (thread_ring_ == NULL) {
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        rings_.emplace_back(new Ring(PRMS.trace_buffer));
+        thread_ring_ = rings_.back().get();
+    }
+
+    u32 name_len = name == NULL ? 0 : std::min<size_t>(name->size(), MAX_NAME);
+
+    h.type = type;
+    h.pad = 0;
+    h.size = len + name_len;
+
+    //Names are copied after the record so it's pushed in one piece
+    u8 buf[sizeof(SeedRec) + MAX_NAME];
+    memcpy(buf, &h, len);
+    if (name_len > 0) memcpy(buf + len, name->data(), name_len);
+
+    if (!thread_ring_->push(buf, h.size)) dropped_++;
+}
+
+void ReadTracer::run() {
+    std::string buf;
+
+    while (true) {
+        bool stopping = stopped_.load(std::memory_order_acquire);
+
+        {
+            std::lock_guard<std::mutex> lock(rings_mtx_);
+            for (auto &r : rings_) r->drain(buf);
+        }
+
+        if (!buf.empty()) {
+            fwrite(buf.data(), 1, buf.size(), out_);
+            buf.clear();
+        }
+
+        if (stopping) break;
+        usleep(FLUSH_INTERVAL * 1000);
+    }
+
+    fflush(out_);
+}
+
+ReadTracer::Ring::Ring(u32 size) : head_(0), tail_(0) {
+    u64 cap = 1;
+    while (cap < size) cap <<= 1;
+    buf_.resize(cap);
+    mask_ = cap - 1;
+}
+
+bool ReadTracer::Ring::push(const void *rec, u32 len) {
+    u64 head = head_.load(std::memory_order_relaxed),
+        tail = tail_.load(std::memory_order_acquire);
+    if (head + len - tail > buf_.size()) return false;
+
+    const u8 *src = static_cast<const u8 *>(rec);
+    u64 st = head & mask_,
+        n = std::min<u64>(len, buf_.size() - st);
+    memcpy(&buf_[st], src, n);
+    memcpy(&buf_[0], src + n, len - n);
+
+    head_.store(head + len, std::memory_order_release);
+    return true;
+}
+
+void ReadTracer::Ring::drain(std::string &out) {
+    u64 tail = tail_.load(std::memory_order_relaxed),
+        head = head_.load(std::memory_order_acquire);
+    if (head == tail) return;
+
+    u64 st = tail & mask_,
+        len = head - tail,
+        n = std::min<u64>(len, buf_.size() - st);
+    out.append(reinterpret_cast<const char *>(&buf_[st]), n);
+    out.append(reinterpret_cast<const char *>(&buf_[0]), len - n);
+
+    tail_.store(head, std::memory_order_release);
+}
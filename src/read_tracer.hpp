@@ -0,0 +1,200 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_READ_TRACER
+#define _INCL_READ_TRACER
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <cstdio>
+#include "util.hpp"
+#include "event_detector.hpp"
+
+//Records how a sample of reads are mapped, for uncalled/debug.py
+//Each thread appends binary records to its own ring buffer, which a
+//writer thread drains to the trace file. Records are dropped rather than
+//blocking mapping if a ring fills up. Mapper only checks enabled() when a
+//read starts, so there is no per-event cost while tracing is off
+//
+//The file starts with a TraceHeader, followed by records that each start
+//with a RecHeader. Records of one read share its RecHeader::read ID, and 
+//may be interleaved with other reads since threads are drained in turn
+class ReadTracer {
+    public:
+
+    typedef struct {
+        //Trace file, tracing is disabled if empty
+        std::string trace_out;
+
+        //Fraction of reads to trace, chosen by a hash of the read ID so
+        //the same reads are traced on every run
+        float trace_sample;
+
+        //File listing read IDs to trace in addition to the sample
+        std::string trace_list;
+
+        //Bytes buffered per thread
+        u32 trace_buffer;
+    } Params;
+
+    static Params PRMS;
+
+    static const char MAGIC[4];
+    static const u32 VERSION = 1;
+
+    typedef struct {
+        char magic[4];
+        u32 version;
+    } TraceHeader;
+
+    enum RecType : u8 {
+        READ  = 'R', //read started, followed by its ID
+        EVENT = 'E', //event detected
+        STEP  = 'P', //event mapped
+        SEED  = 'S', //seed added to a cluster, followed by the reference name
+        END   = 'D'  //mapping ended
+    };
+
+    typedef struct {
+        u8 type;
+        u8 pad;
+        u16 size; //including this header
+        u32 read;
+    } RecHeader;
+
+    typedef struct {
+        RecHeader h;
+        u32 number;
+        u16 channel;
+        u16 name_len;
+    } ReadRec;
+
+    //Events skipped by the EventProfiler have mask 0
+    typedef struct {
+        RecHeader h;
+        u32 start, length;
+        float mean, stdv, win_mean, win_stdv;
+        u32 mask;
+    } EventRec;
+
+    typedef struct {
+        RecHeader h;
+        u32 event;
+        u32 paths;
+        float value, norm_scale, norm_shift;
+        u32 top_len;
+    } StepRec;
+
+    typedef struct {
+        RecHeader h;
+        u32 event, path, cluster, ref_len;
+        u64 ref_st;
+        u8 fwd;
+        u8 pad;
+        u16 name_len;
+        u32 pad2;
+    } SeedRec;
+
+    typedef struct {
+        RecHeader h;
+        u32 events;
+        u8 state;
+        u8 mapped;
+        u16 pad;
+        float decision_time;
+        u32 pad2;
+    } EndRec;
+
+    static ReadTracer &get();
+
+    ~ReadTracer();
+
+    //Opens PRMS.trace_out and starts the writer thread
+    bool open();
+
+    //Writes everything recorded so far and closes the file
+    void close();
+
+    static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    //Returns an ID for the read's records, or 0 if it isn't traced
+    u32 start_read(const std::string &read_id, u32 number, u16 channel);
+
+    void event(u32 read, const Event &e, float win_mean, float win_stdv, u32 mask);
+    void step(u32 read, u32 event, u32 paths, float value, 
+              float norm_scale, float norm_shift, u32 top_len);
+    void seed(u32 read, u32 event, u32 path, u32 cluster, 
+              const std::string &ref_name, u64 ref_st, u32 ref_len, bool fwd);
+    void end(u32 read, u32 events, u8 state, bool mapped, float decision_time);
+
+    //Records lost to full buffers
+    u64 dropped() const;
+
+    private:
+    ReadTracer();
+
+    //Single producer single consumer byte ring
+    class Ring {
+        public:
+        Ring(u32 size);
+        bool push(const void *rec, u32 len);
+        void drain(std::string &out);
+
+        private:
+        std::vector<u8> buf_;
+        u64 mask_;
+        std::atomic<u64> head_, tail_;
+    };
+
+    static const u32 FLUSH_INTERVAL = 20, //ms
+                     MAX_NAME = 1024;
+
+    static std::atomic<bool> enabled_;
+    static thread_local Ring *thread_ring_;
+
+    bool sampled(const std::string &read_id) const;
+    void push(RecHeader &h, RecType type, u32 len, const std::string *name = NULL);
+    void run();
+
+    u32 sample_thresh_;
+    std::unordered_set<std::string> read_list_;
+
+    FILE *out_;
+    std::thread thread_;
+    std::atomic<bool> stopped_;
+    std::atomic<u32> read_count_;
+    std::atomic<u64> dropped_;
+
+    //Guards rings_, which are never freed so threads can keep theirs
+    std::mutex rings_mtx_;
+    std::vector< std::unique_ptr<Ring> > rings_;
+};
+
+#endif
@@ -23,8 +23,7 @@
 
 #include <thread>
 #include <chrono>
-#include <stdlib.h>
-#include <time.h>
+#include <algorithm>
 #include "realtime_pool.hpp"
 #include "mapper.hpp"
 
@@ -38,79 +37,244 @@
 //};
 
 RealtimePool::RealtimePool(Conf &conf) :
-    PRMS(conf.realtime_prms),
-    stopped_(false) {
-
+    max_active_(conf.realtime_prms.max_active_reads),
+    stopped_(false),
+    tuner_(conf.realtime_prms),
+    tune_started_(false),
+    tune_busy_(0),
+    work_gen_(0),
+    idle_count_(0) {
+
+    threads_.reserve(conf.threads);
     for (u16 t = 0; t < conf.threads; t++) {
-        threads_.emplace_back(mappers_);
+        threads_.emplace_back(*this, t);
     }
 
-    mappers_.resize(conf.get_num_channels());
-    chunk_buffer_.resize(conf.get_num_channels());
-    buffer_queue_.reserve(conf.get_num_channels());
-    active_queue_.reserve(conf.get_num_channels());
+    u16 num_chs = conf.get_num_channels();
+    devices_.push_back({"", conf.realtime_prms, 0, num_chs, {}, {}, {}});
 
+    mappers_.resize(num_chs);
+    buffered_.resize(num_chs, false);
+    ended_.resize(num_chs, UINT32_MAX);
+    chunk_timers_.resize(num_chs);
+    decided_.resize(num_chs, 0);
+    recv_read_.resize(num_chs, UINT32_MAX);
+    received_.resize(num_chs, 0);
+    start_delay_.resize(num_chs, 0);
+    buffer_queue_.reserve(num_chs);
+    active_queue_.reserve(num_chs);
 
     for (u16 t = 0; t < conf.threads; t++) {
         threads_[t].start();
     }
+}
+
+i32 RealtimePool::add_device(const std::string &name, 
+                             const RealtimeParams &prms, u16 num_channels) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+
+    if (device_id(name) >= 0) {
+        std::cerr << "Error: device '" << name << "' already added\n";
+        return -1;
+    }
+
+    //Threads hold references into mappers_, so it can only grow while idle
+    bool idle = active_queue_.empty() && buffer_queue_.empty();
+    for (u32 i = 0; idle && i < mappers_.size(); i++) {
+        idle = mappers_[i].get_state() == Mapper::State::INACTIVE;
+    }
+    if (!idle) {
+        std::cerr << "Error: devices must be added before mapping starts\n";
+        return -1;
+    }
+
+    u32 offs = mappers_.size();
+    if (offs + num_channels > UINT16_MAX) {
+        std::cerr << "Error: too many channels for device '" << name << "'\n";
+        return -1;
+    }
+
+    devices_.push_back({name, prms, (u16) offs, num_channels, {}, {}, {}});
+
+    //Devices share threads, so the active read limit is their sum
+    max_active_ += prms.max_active_reads;
+
+    mappers_.resize(offs + num_channels);
+    buffered_.resize(mappers_.size(), false);
+    ended_.resize(mappers_.size(), UINT32_MAX);
+    chunk_timers_.resize(mappers_.size());
+    decided_.resize(mappers_.size(), 0);
+    recv_read_.resize(mappers_.size(), UINT32_MAX);
+    received_.resize(mappers_.size(), 0);
+    start_delay_.resize(mappers_.size(), 0);
+    buffer_queue_.reserve(mappers_.size());
+    active_queue_.reserve(mappers_.size());
+
+    return devices_.size() - 1;
+}
+
+u16 RealtimePool::device_count() const {
+    return devices_.size();
+}
+
+i32 RealtimePool::device_id(const std::string &name) const {
+    for (u16 d = 0; d < devices_.size(); d++) {
+        if (devices_[d].name == name) return d;
+    }
+    return -1;
+}
 
-    srand(time(NULL));
+RealtimeParams &RealtimePool::device_params(u16 device) {
+    return devices_[device].prms;
 }
 
-void RealtimePool::buffer_chunk(Chunk &c) {
-    u16 ch = c.get_channel_idx();
-    if (chunk_buffer_[ch].empty()) {
-        buffer_queue_.push_back(ch);
+u16 RealtimePool::device_of(u16 ch) const {
+    u16 d = devices_.size() - 1;
+    while (d > 0 && ch < devices_[d].ch_offs) d--;
+    return d;
+}
+
+void RealtimePool::end_read(u16 channel, u32 number, u16 device) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    ended_[devices_[device].ch_offs + channel - 1] = number;
+}
+
+bool RealtimePool::is_read_ended(u16 channel, u32 number, u16 device) const {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    return ended_[devices_[device].ch_offs + channel - 1] == number;
+}
+
+bool RealtimePool::is_channel_active(u16 channel, u16 device) const {
+    switch (devices_[device].prms.active_chs) {
+        case RealtimeParams::ActiveChs::EVEN:
+        return channel % 2 == 0;
+        case RealtimeParams::ActiveChs::ODD:
+        return channel % 2 == 1;
+        default:
+        return true;
+    }
+}
+
+float RealtimePool::chunk_age(u16 channel, u16 device) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    return chunk_timers_[devices_[device].ch_offs + channel - 1].get();
+}
+
+void RealtimePool::queue_action(u16 channel, u32 number, bool unblock, 
+                                u16 device) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    Device &d = devices_[device];
+    d.actions.emplace_back(channel, number, unblock);
+    d.decided.push_back(decided_[d.ch_offs + channel - 1]);
+}
+
+std::vector<MapAction> RealtimePool::pop_actions(u16 device, bool force) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    std::vector<MapAction> ret;
+    Device &d = devices_[device];
+    if (d.actions.empty()) return ret;
+
+    float now = clock_.get();
+    if (!force && 
+        (d.prms.action_batch == 0 || d.actions.size() < d.prms.action_batch) &&
+        now - d.decided.front() < d.prms.action_interval) {
+        return ret;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(lat_mtx_);
+        for (float t : d.decided) dec_disp_lat_.add(now - t);
+    }
+    d.decided.clear();
+    ret.swap(d.actions);
+    return ret;
+}
+
+std::map<std::string, LatencyHist> RealtimePool::latencies() const {
+    std::lock_guard<std::mutex> lock(lat_mtx_);
+    return {{"receive_event", recv_evt_lat_},
+            {"event_decision", evt_dec_lat_},
+            {"decision_dispatch", dec_disp_lat_}};
+}
+
+void RealtimePool::chunk_received(const Chunk &c, u16 ch) {
+    if (recv_read_[ch] != c.get_number()) {
+        recv_read_[ch] = c.get_number();
+        received_[ch] = clock_.get();
+    }
+}
+
+//Reads can wait in buffer_queue_ for the channel's previous read to finish
+void RealtimePool::read_started(u16 ch) {
+    if (recv_read_[ch] == mappers_[ch].get_read().get_number()) {
+        start_delay_[ch] = clock_.get() - received_[ch];
     } else {
-        //TODO: handle backlog (probably reset paths?)
-        chunk_buffer_[ch].clear();
+        start_delay_[ch] = 0;
+    }
+}
+
+//Queue a chunk for a read that can't start until the mapper is deactivated
+bool RealtimePool::buffer_chunk(Chunk &c, u16 ch) {
+    if (!mappers_[ch].push_chunk(c)) return false;
+
+    if (!buffered_[ch]) {
+        buffered_[ch] = true;
+        buffer_queue_.push_back(ch);
     }
-    chunk_buffer_[ch].swap(c);
+    return true;
 }
 
 
-//Add chunk to master buffer
-bool RealtimePool::add_chunk(Chunk &c) {
-    u16 ch = c.get_channel_idx();
+//Add chunk to channel queue
+bool RealtimePool::add_chunk(Chunk &c, u16 device) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    if (device >= devices_.size() || 
+        c.get_channel_idx() >= devices_[device].num_chs) return false;
+    u16 ch = devices_[device].ch_offs + c.get_channel_idx();
+
+    if (ended_[ch] == c.get_number()) return false;
+    chunk_timers_[ch].reset();
+    chunk_received(c, ch);
 
     //Check if previous read is still aligning
-    //If so, tell thread to reset, store chunk in pool buffer
+    //If so, tell thread to reset, queue chunk for the next read
     if (mappers_[ch].prev_unfinished(c.get_number())) {
         mappers_[ch].request_reset();
-        buffer_chunk(c);
-        return true;
+        return buffer_chunk(c, ch);
 
     //Previous alignment finished but mapper hasn't reset
     //Happens if update hasn't been called yet
     } else if (mappers_[ch].finished()) {
         if (mappers_[ch].get_read().number_ != c.get_number()){ 
-            buffer_chunk(c);
+            return buffer_chunk(c, ch);
         }
         return true;
 
     //Mapper inactive - need to reset graph and assign to thread
     } else if (mappers_[ch].get_state() == Mapper::State::INACTIVE) {
+        if (buffered_[ch]) return buffer_chunk(c, ch);
+
         mappers_[ch].new_read(c);
+        read_started(ch);
         active_queue_.push_back(ch);
         return true;
-
     }
     
     return mappers_[ch].add_chunk(c);
-    
-
-    return false;
 }
 
-bool RealtimePool::is_read_finished(const ReadBuffer &r) {
-    u16 ch = r.get_channel_idx();
+bool RealtimePool::is_read_finished(const ReadBuffer &r, u16 device) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    u16 ch = devices_[device].ch_offs + r.get_channel_idx();
     return (mappers_[ch].finished() && 
             mappers_[ch].get_read().get_number() == r.get_number());
 }
 
-bool RealtimePool::try_add_chunk(Chunk &c) {
-    u16 ch = c.get_channel_idx();
+bool RealtimePool::try_add_chunk(Chunk &c, u16 device) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    if (device >= devices_.size() || 
+        c.get_channel_idx() >= devices_[device].num_chs) return false;
+    u16 ch = devices_[device].ch_offs + c.get_channel_idx();
 
     //Chunk is empty if all read chunks were output
     if (c.empty()) {
@@ -124,7 +288,9 @@ bool RealtimePool::try_add_chunk(Chunk &c) {
 
     //Start new read if mapper inactive
     if (mappers_[ch].get_state() == Mapper::State::INACTIVE) {
+        chunk_received(c, ch);
         mappers_[ch].new_read(c);
+        read_started(ch);
         active_queue_.push_back(ch);
         return true;
 
@@ -135,6 +301,7 @@ bool RealtimePool::try_add_chunk(Chunk &c) {
             return false;
         }
 
+        chunk_received(c, ch);
         return mappers_[ch].add_chunk(c);
     }
 
@@ -142,11 +309,17 @@ bool RealtimePool::try_add_chunk(Chunk &c) {
 }
 
 //TODO: make sure update is the same
-std::vector<MapResult> RealtimePool::update() {
+std::vector<MapResult> RealtimePool::update(u16 device) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    return update_unlocked(device);
+}
+
+std::vector<MapResult> RealtimePool::update_unlocked(u16 device) {
 
     std::vector< u16 > read_counts(threads_.size(), 0);
     active_count_ = 0;
     std::vector<MapResult> ret;
+    if (device >= devices_.size()) return ret;
 
     //Get alignment outputs
     for (u16 t = 0; t < threads_.size(); t++) {
@@ -159,8 +332,21 @@ std::vector<MapResult> RealtimePool::update() {
 
             //Loop over alignments
             for (auto ch : out_chs_) {
-                ReadBuffer &r = mappers_[ch].get_read();
-                ret.emplace_back(r.get_channel(), r.number_, r.loc_);
+                Mapper &m = mappers_[ch];
+                ReadBuffer &r = m.get_read();
+
+                float decided = m.decision_time() >= 0 ? 
+                                m.decision_time() : m.read_time();
+                decided_[ch] = clock_.get() - (m.read_time() - decided);
+                if (m.first_event_time() >= 0) {
+                    std::lock_guard<std::mutex> lock(lat_mtx_);
+                    recv_evt_lat_.add(start_delay_[ch] + m.first_event_time());
+                    evt_dec_lat_.add(decided - m.first_event_time());
+                }
+                if (tuner_.is_enabled()) tune_lat_.add(decided);
+
+                devices_[device_of(ch)].out.emplace_back(
+                    r.get_channel(), r.number_, r.loc_);
 
                 //TODO rename set_inactive?
                 mappers_[ch].deactivate();
@@ -173,27 +359,23 @@ std::vector<MapResult> RealtimePool::update() {
         active_count_ += read_counts[t];
     }
 
+    //Start reads queued while their mapper was busy
     //Buffer queue should be ordered in "ord" mode
     for (u16 i = buffer_queue_.size()-1; i < buffer_queue_.size(); i--) {
-        u16 ch = buffer_queue_[i];//TODO: store chunks in queue
-        Chunk &c = chunk_buffer_[ch];
+        u16 ch = buffer_queue_[i];
 
-        bool added = false;
+        if (mappers_[ch].get_state() != Mapper::State::INACTIVE) continue;
 
-        if (mappers_[ch].get_state() == Mapper::State::INACTIVE) {
-            mappers_[ch].new_read(c);
+        if (mappers_[ch].new_queued_read()) {
+            read_started(ch);
             active_queue_.push_back(ch);
-            added = true;
-        } else if (!mappers_[ch].finished()) {
-            added = mappers_[ch].add_chunk(c);
         }
 
-        if (added) {
-            if (i != buffer_queue_.size()-1) {
-                buffer_queue_[i] = buffer_queue_.back();
-            }
-            buffer_queue_.pop_back();
+        buffered_[ch] = false;
+        if (i != buffer_queue_.size()-1) {
+            buffer_queue_[i] = buffer_queue_.back();
         }
+        buffer_queue_.pop_back();
     }
 
     #ifdef DEBUG_THREADS
@@ -207,45 +389,28 @@ std::vector<MapResult> RealtimePool::update() {
     }
     #endif
 
-    //Estimate how much to fill each thread
-    u16 target = min(active_queue_.size() + active_count_, PRMS.max_active_reads);
-
-    u16 min_per_thread = target / threads_.size(), // + (target % threads_.size() > 0);
-        remain = target % threads_.size();
-
-    for (u32 c : read_counts) remain -= (c > min_per_thread);
+    //Estimate how many new reads can be activated
+    u16 target = min(active_queue_.size() + active_count_, max_active_);
 
-    u16 st = (u16) rand();
-
-    for (u16 i = 0; i < threads_.size(); i++) {
-        if (active_queue_.empty()) break;
-
-        u16 t = (st+i) % threads_.size();
-
-        u32 n = min_per_thread + (remain > 0) - read_counts[t];
-
-        //If thread not full
-        if (n > 0 && n <= active_queue_.size()) {
-            u32 r0 = active_queue_.size() - n,
-                rn = active_queue_.size();
-
-            threads_[t].in_mtx_.lock();
-
-            std::vector<u16> &in_chs = threads_[t].in_chs_;
-            in_chs.insert(in_chs.end(),
-                          &(active_queue_[r0]),
-                          &(active_queue_[rn]));
-
-            threads_[t].in_mtx_.unlock();
+    //Give each new read to the least loaded thread
+    //Imbalance after that is corrected by work stealing
+    bool queued = false;
+    while (active_count_ < target && !active_queue_.empty()) {
+        u16 t = 0;
+        for (u16 i = 1; i < threads_.size(); i++) {
+            if (read_counts[i] < read_counts[t]) t = i;
+        }
 
-            active_queue_.resize(r0);
-            remain -= (remain > 0);
+        threads_[t].push_ch(active_queue_.back());
+        active_queue_.pop_back();
 
-            read_counts[t] += n;
-            active_count_ += n;
-        }
+        read_counts[t]++;
+        active_count_++;
+        queued = true;
     }
 
+    if (queued) notify_work();
+
     #ifdef DEBUG_THREADS
     if (time_.get() >= 500 && active_count_ > 0) {
         time_.reset();
@@ -257,19 +422,116 @@ std::vector<MapResult> RealtimePool::update() {
     }
     #endif
 
+    if (tuner_.is_enabled()) autotune();
+
+    ret.swap(devices_[device].out);
     return ret;
 }
 
+void RealtimePool::autotune() {
+    if (!tune_started_) {
+        tuned_ = tuner_.clamp({max_active_, Mapper::PRMS.evt_batch_size, 
+                               Mapper::PRMS.evt_timeout, 
+                               Mapper::PRMS.chunk_timeout});
+        tune_started_ = true;
+
+    } else {
+        float elapsed = tune_timer_.get();
+        if (elapsed < tuner_.interval()) return;
+
+        double busy = 0;
+        for (MapperThread &t : threads_) busy += t.get_stats().busy_time;
+
+        //Reads waiting for max_active have queued chunks too
+        std::vector<bool> waiting(mappers_.size(), false);
+        for (u16 ch : active_queue_) waiting[ch] = true;
+
+        u32 backlogged = 0;
+        for (u32 ch = 0; ch < mappers_.size(); ch++) {
+            if (!waiting[ch] && mappers_[ch].has_queued_chunks()) backlogged++;
+        }
+
+        Autotuner::Sample sample = {
+            (u32) tune_lat_.count(),
+            tune_lat_.percentile(90),
+            (float) ((busy - tune_busy_) / (elapsed * threads_.size())),
+            active_count_,
+            (u32) active_queue_.size(),
+            backlogged
+        };
+
+        tuned_.max_active = max_active_;
+        tuned_ = tuner_.step(sample, tuned_);
+        tune_busy_ = busy;
+    }
+
+    max_active_ = tuned_.max_active;
+    Mapper::set_tuned_prms(tuned_.evt_batch_size, tuned_.evt_timeout, 
+                           tuned_.chunk_timeout);
+    tune_lat_.reset();
+    tune_timer_.reset();
+}
+
 u32 RealtimePool::active_count() const {
+    std::lock_guard<std::mutex> lock(api_mtx_);
     return active_count_;
 }
 
+std::vector<RealtimePool::ThreadStats> RealtimePool::thread_stats() {
+    std::vector<ThreadStats> ret;
+    for (MapperThread &t : threads_) {
+        ret.push_back(t.get_stats());
+    }
+    return ret;
+}
+
+std::map<std::string, u64> RealtimePool::counters() const {
+    return MapCounters::snapshot();
+}
+
+u64 RealtimePool::work_gen() {
+    std::lock_guard<std::mutex> lock(idle_mtx_);
+    return work_gen_;
+}
+
+//Sleeps until work is queued after gen was read, or the pool stops
+void RealtimePool::wait_for_work(u64 gen) {
+    std::unique_lock<std::mutex> lock(idle_mtx_);
+    idle_count_++;
+    idle_cv_.wait(lock, [&] { return work_gen_ != gen || stopped_; });
+    idle_count_--;
+}
+
+void RealtimePool::notify_work() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mtx_);
+        work_gen_++;
+    }
+    idle_cv_.notify_all();
+}
+
 //void u32 ReadBuffer::end_read(u16 ch, u32 number) {
 //    ch--;
 //    if (!mappers_[ch].finished() && mappers_[ch].get_read()
 //}
 
+const PafSummary &RealtimePool::update_batch(u16 device, PafWriter *out) {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    summary_.clear();
+    for (MapResult &r : update_unlocked(device)) {
+        Paf &p = std::get<2>(r);
+        summary_.add(p, std::get<1>(r));
+        if (out != NULL) out->submit(std::move(p));
+    }
+    return summary_;
+}
+
+const std::vector<std::string> &RealtimePool::batch_ref_names() const {
+    return summary_.ref_names();
+}
+
 bool RealtimePool::all_finished() {
+    std::lock_guard<std::mutex> lock(api_mtx_);
     if (!buffer_queue_.empty()) return false;
 
     for (MapperThread &t : threads_) {
@@ -279,112 +541,402 @@ bool RealtimePool::all_finished() {
     return true;
 }
 
+bool RealtimePool::is_idle() {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    if (!buffer_queue_.empty()) return false;
+    if (!active_queue_.empty() && active_count_ < max_active_) return false;
+
+    for (MapperThread &t : threads_) {
+        std::lock_guard<std::mutex> lock(t.out_mtx_);
+        if (!t.out_chs_.empty()) return false;
+    }
+
+    for (Mapper &m : mappers_) {
+        switch (m.get_state()) {
+            case Mapper::State::INACTIVE:
+            break;
+            case Mapper::State::MAPPING:
+            if (m.is_resetting() || !m.chunk_mapped()) return false;
+            break;
+            default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void RealtimePool::stop_all() {
+    std::lock_guard<std::mutex> lock(api_mtx_);
+    if (tune_started_) Mapper::set_tuned_prms(0, 0, 0);
+
     if (!stopped_) {
-        stopped_ = true;
+        {
+            std::lock_guard<std::mutex> lock(idle_mtx_);
+            stopped_ = true;
+            for (MapperThread &t : threads_) {
+                t.running_ = false;
+            }
+        }
+        idle_cv_.notify_all();
+
         for (MapperThread &t : threads_) {
-            t.running_ = false;
             t.thread_.join();
         }
 
         active_queue_.clear();
         buffer_queue_.clear();
+        for (Device &d : devices_) {
+            d.out.clear();
+            d.actions.clear();
+            d.decided.clear();
+        }
+        buffered_.assign(buffered_.size(), false);
+        ended_.assign(ended_.size(), UINT32_MAX);
+        recv_read_.assign(recv_read_.size(), UINT32_MAX);
     }
 }
 
-u16 RealtimePool::MapperThread::num_threads = 0;
-
-RealtimePool::MapperThread::MapperThread(std::vector<Mapper> &mappers)
-    : tid_(num_threads++),
-      mappers_(mappers),
-      running_(true) {}
+RealtimePool::MapperThread::MapperThread(RealtimePool &pool, u16 tid)
+    : pool_(pool),
+      tid_(tid),
+      mappers_(pool.mappers_),
+      running_(true),
+      load_(0),
+      path_ms_(0),
+      stats_({0, 0, 0, 0, 0, 0, 0, 0}) {}
 
 RealtimePool::MapperThread::MapperThread(MapperThread &&mt) 
-    : tid_(mt.tid_),
+    : pool_(mt.pool_),
+      tid_(mt.tid_),
       mappers_(mt.mappers_),
       running_(mt.running_), 
-      thread_(std::move(mt.thread_)) {}
+      load_(mt.load_.load()),
+      path_ms_(mt.path_ms_),
+      queue_(std::move(mt.queue_)),
+      thread_(std::move(mt.thread_)),
+      stats_(mt.stats_) {}
 
 void RealtimePool::MapperThread::start() {
     thread_ = std::thread(&RealtimePool::MapperThread::run, this);
 }
 
-
 u16 RealtimePool::MapperThread::read_count() const {
-    return in_chs_.size() + active_chs_.size();
+    return load_;
 }
 
-void RealtimePool::MapperThread::run() {
-    std::string fast5_id;
-    std::vector<float> fast5_signal;
+void RealtimePool::MapperThread::push_ch(u16 ch) {
+    std::lock_guard<std::mutex> lock(queue_mtx_);
+    queue_.push_back(ch);
+    load_++;
+    stats_.max_load = std::max(stats_.max_load, (u32) load_);
+}
 
-    std::vector<u16> finished;
+bool RealtimePool::MapperThread::pop_ch(u16 &ch) {
+    std::lock_guard<std::mutex> lock(queue_mtx_);
+    return take_next(ch);
+}
 
-    Timer t;
+//Pore time left once the read's backlog is mapped at the current rate
+float RealtimePool::MapperThread::slack(u16 ch) const {
+    const Mapper &m = mappers_[ch];
+    float cost = path_ms_ * std::max<u32>(m.path_count(), 1) * m.event_backlog();
+    return m.time_left() - cost;
+}
 
-    while (running_) {
-        if (read_count() == 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
+//Takes the next channel to map, queue_mtx_ must be held
+bool RealtimePool::MapperThread::take_next(u16 &ch) {
+    if (queue_.empty()) return false;
+
+    u16 d = pool_.device_of(queue_.front());
+    if (!pool_.devices_[d].prms.deadline_sched) {
+        ch = queue_.front();
+        queue_.pop_front();
+        return true;
+    }
+
+    //Earliest deadline first among reads that can still be decided in 
+    //time, then the least late. Reads over abandon_time late are taken 
+    //right away, since they end as soon as they're mapped
+    float abandon = pool_.devices_[d].prms.abandon_time;
+    u32 early = queue_.size(), late = queue_.size();
+    float early_slack = 0, late_slack = 0;
+    bool lost = false;
+    for (u32 i = 0; i < queue_.size(); i++) {
+        float s = slack(queue_[i]);
+        if (s > 0) {
+            if (early == queue_.size() || s < early_slack) {
+                early = i;
+                early_slack = s;
+            }
+        } else if (abandon > 0 && s < -abandon) {
+            early = i;
+            lost = true;
+            break;
+        } else if (late == queue_.size() || s > late_slack) {
+            late = i;
+            late_slack = s;
         }
+    }
 
-        //Read inputs (pop, lock, and swap it)
-        if (!in_chs_.empty()) {
+    u32 i = early < queue_.size() ? early : late;
+    ch = queue_[i];
+    queue_.erase(queue_.begin() + i);
 
+    if (lost && !mappers_[ch].is_resetting()) {
+        mappers_[ch].request_reset();
+        stats_.abandoned++;
+    }
 
-            in_mtx_.lock();
-            in_tmp_.swap(in_chs_);
-            in_mtx_.unlock();
+    return true;
+}
 
+//Moves half of victim's queued channels (rounded up) from the back into out
+u32 RealtimePool::MapperThread::steal_from(MapperThread &victim, 
+                                           std::vector<u16> &out) {
+    std::lock_guard<std::mutex> lock(victim.queue_mtx_);
 
-            for (auto ch : in_tmp_) {
-                active_chs_.push_back(ch);
-            }
+    u32 n = (victim.queue_.size() + 1) / 2;
+    for (u32 i = 0; i < n; i++) {
+        out.push_back(victim.queue_.back());
+        victim.queue_.pop_back();
+    }
 
-            in_tmp_.clear(); //(pop)
-        }
+    victim.load_ -= n;
+    victim.stats_.stolen += n;
+    return n;
+}
+
+bool RealtimePool::MapperThread::steal_ch(u16 &ch) {
+    std::vector<MapperThread> &threads = pool_.threads_;
+
+    //Try victims from most to least loaded
+    //Loads may be stale, steal_from re-checks under the victim's lock
+    std::vector<MapperThread *> victims;
+    for (MapperThread &t : threads) {
+        if (&t != this && t.load_ > 0) victims.push_back(&t);
+    }
+    std::sort(victims.begin(), victims.end(), 
+              [](MapperThread *a, MapperThread *b) { 
+                  return a->load_ > b->load_; 
+              });
+
+    steal_tmp_.clear();
+    for (MapperThread *v : victims) {
+        if (steal_from(*v, steal_tmp_) > 0) break;
+    }
+
+    if (steal_tmp_.empty()) return false;
+
+    ch = steal_tmp_.back();
+    steal_tmp_.pop_back();
+
+    std::lock_guard<std::mutex> lock(queue_mtx_);
+    for (u16 c : steal_tmp_) queue_.push_back(c);
+    load_ += steal_tmp_.size() + 1;
+    stats_.steals++;
+    stats_.max_load = std::max(stats_.max_load, (u32) load_);
+
+    return true;
+}
 
-        //TODO: reads are in here
-        //Map chunks
-        for (u16 i = 0; i < active_chs_.size() && running_; i++) {
-            u16 ch = active_chs_[i];
+RealtimePool::ThreadStats RealtimePool::MapperThread::get_stats() {
+    std::lock_guard<std::mutex> lock(queue_mtx_);
+    ThreadStats ret = stats_;
+    ret.load = load_;
+    return ret;
+}
 
+void RealtimePool::MapperThread::run() {
+    Mapper::bind_thread(tid_);
+
+    Timer t;
 
-            mappers_[ch].process_chunk();
+    u16 ch = 0;
+    bool has_ch = false;
 
-            if (mappers_[ch].map_chunk()) {
-                out_tmp_.push_back(i);
+    while (running_) {
+        if (!has_ch) {
+            //Read generation first so work queued after a failed pop/steal
+            //won't be missed by wait_for_work
+            u64 gen = pool_.work_gen();
+            has_ch = pop_ch(ch) || steal_ch(ch);
+
+            if (!has_ch) {
+                t.reset();
+                pool_.wait_for_work(gen);
+                double idle = t.get();
+
+                std::lock_guard<std::mutex> lock(queue_mtx_);
+                stats_.idle_time += idle;
+                continue;
             }
         }
 
-        //Add finished to output
-        if (!out_tmp_.empty()) {
+        t.reset();
+
+        u32 paths = std::max<u32>(mappers_[ch].path_count(), 1),
+            evts = mappers_[ch].events_mapped();
+
+        mappers_[ch].process_chunk();
+        bool finished = mappers_[ch].map_chunk();
 
-            t.reset();
+        double busy = t.get();
 
+        evts = mappers_[ch].events_mapped() - evts;
+        if (evts > 0) {
+            float ms = busy / (paths * evts);
+            path_ms_ = path_ms_ > 0 ? 0.9 * path_ms_ + 0.1 * ms : ms;
+        }
+
+        if (finished) {
             out_mtx_.lock();
-            for (auto i : out_tmp_) {
-                out_chs_.push_back(active_chs_[i]);
-            }
+            out_chs_.push_back(ch);
             out_mtx_.unlock();
+        }
 
-            std::sort(out_tmp_.begin(), out_tmp_.end(),
-                      [](u32 a, u32 b) { return a > b; });
-            for (auto i : out_tmp_) {
-                active_chs_[i] = active_chs_.back();
-                active_chs_.pop_back();
+        //Requeue unfinished channel and take the next one
+        bool excess;
+        {
+            std::lock_guard<std::mutex> lock(queue_mtx_);
+
+            stats_.busy_time += busy;
+            if (finished) {
+                stats_.reads_mapped++;
+                load_--;
+            } else {
+                queue_.push_back(ch);
             }
-            out_tmp_.clear();
+
+            has_ch = take_next(ch);
+
+            excess = !queue_.empty();
         }
-    }
 
-    active_chs_.clear();
+        //Let idle threads steal what we can't get to right away
+        if (excess && pool_.idle_count_ > 0) {
+            pool_.notify_work();
+        }
+    }
 
-    in_mtx_.lock();
-    in_chs_.clear();
-    in_mtx_.unlock();
+    queue_mtx_.lock();
+    queue_.clear();
+    load_ = 0;
+    queue_mtx_.unlock();
 
     out_mtx_.lock();
     out_chs_.clear();
     out_mtx_.unlock();
 }
+
+#ifdef PYBIND
+
+void RealtimePool::add_py_chunks(std::vector<Chunk> &chunks, u16 device) {
+    pybind11::gil_scoped_release nogil;
+    for (Chunk &chunk : chunks) add_chunk(chunk, device);
+}
+
+std::vector< std::pair<u16, u32> > RealtimePool::add_read_chunks(
+        pybind11::iterable batch, const std::string &dtype, u16 device) {
+
+    std::vector< std::pair<u16, u32> > inactive;
+    std::vector<Chunk> chunks;
+
+    for (pybind11::handle item : batch) {
+        pybind11::tuple t = item.cast<pybind11::tuple>();
+        u16 ch = t[0].cast<u16>();
+        pybind11::object read = t[1];
+        u32 number = read.attr("number").cast<u32>();
+
+        if (!is_channel_active(ch, device)) {
+            inactive.emplace_back(ch, number);
+            continue;
+        }
+
+        std::string id = read.attr("id").cast<std::string>();
+        u64 start = read.attr("chunk_start_sample").cast<u64>();
+        pybind11::object raw = read.attr("raw_data");
+
+        if (!PyBytes_Check(raw.ptr())) {
+            throw pybind11::type_error("Read raw_data must be bytes");
+        }
+
+        //int16 signal is wrapped without copying, see Chunk
+        if (dtype == "int16") {
+            chunks.emplace_back(id, ch, number, start, 
+                                (const i16 *) PyBytes_AS_STRING(raw.ptr()), 
+                                PyBytes_GET_SIZE(raw.ptr()) / sizeof(i16), 
+                                Chunk::py_owner(raw));
+        } else {
+            chunks.emplace_back(id, ch, number, start, dtype, 
+                                raw.cast<std::string>());
+        }
+    }
+
+    add_py_chunks(chunks, device);
+    return inactive;
+}
+
+pybind11::array_t<bool> RealtimePool::add_chunk_batch(
+        const std::vector<std::string> &ids,
+        pybind11::array_t<u16, PY_BATCH_ARR> channels,
+        pybind11::array_t<u32, PY_BATCH_ARR> numbers,
+        pybind11::array_t<u64, PY_BATCH_ARR> starts,
+        pybind11::array_t<u64, PY_BATCH_ARR> offsets,
+        pybind11::array signal, u16 device) {
+
+    u64 n = ids.size();
+    if ((u64) channels.size() != n || (u64) numbers.size() != n || 
+        (u64) starts.size() != n || (u64) offsets.size() != n + 1) {
+        throw pybind11::value_error("Chunk batch arrays differ in length");
+    }
+
+    bool int_sig = pybind11::isinstance< pybind11::array_t<i16> >(signal);
+    const u64 *offs = offsets.data();
+    for (u64 i = 0; i < n; i++) {
+        if (offs[i] > offs[i+1] || offs[i+1] - offs[i] > UINT_MAX) {
+            throw pybind11::value_error("Invalid chunk batch offsets");
+        }
+    }
+    if (offs[n] > (u64) signal.size() || (!int_sig && offs[n] > UINT_MAX)) {
+        throw pybind11::value_error("Chunk batch offsets exceed signal");
+    }
+
+    pybind11::array_t<i16, pybind11::array::c_style> int_arr;
+    std::shared_ptr<const void> owner;
+    std::vector<float> float_sig;
+    if (int_sig) {
+        int_arr = pybind11::array_t<i16, pybind11::array::c_style>::ensure(signal);
+        owner = Chunk::py_owner(int_arr);
+    } else {
+        auto arr = pybind11::array_t<float, PY_BATCH_ARR>::ensure(signal);
+        if (!arr) throw pybind11::value_error("Chunk signal must be int16 or float32");
+        float_sig.assign(arr.data(), arr.data() + arr.size());
+    }
+
+    pybind11::array_t<bool> inactive(n);
+    bool *inact = inactive.mutable_data();
+    const u16 *chs = channels.data();
+    const u32 *nums = numbers.data();
+    const u64 *sts = starts.data();
+
+    std::vector<Chunk> chunks;
+    for (u64 i = 0; i < n; i++) {
+        inact[i] = !is_channel_active(chs[i], device);
+        if (inact[i]) continue;
+
+        u32 len = offs[i+1] - offs[i];
+        if (int_sig) {
+            chunks.emplace_back(ids[i], chs[i], nums[i], sts[i], 
+                                int_arr.data() + offs[i], len, owner);
+        } else {
+            chunks.emplace_back(ids[i], chs[i], nums[i], sts[i], 
+                                float_sig, offs[i], len);
+        }
+    }
+
+    add_py_chunks(chunks, device);
+    return inactive;
+}
+
+#endif
@@ -27,52 +27,216 @@
 #include <thread>
 #include <vector>
 #include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include "mapper.hpp"
 #include "conf.hpp"
+#include "latency_hist.hpp"
+#include "paf_writer.hpp"
+#include "autotuner.hpp"
 
 using MapResult = std::tuple<u16, u32, Paf>;
 
+//Channel, read number, and true to unblock or false to stop receiving
+using MapAction = std::tuple<u16, u32, bool>;
+
+//Public methods other than the device accessors lock api_mtx_, so they
+//can be called from several threads, e.g. by python without the GIL
+//Their bindings release the GIL before locking: a chunk's python owner
+//can be dropped with api_mtx_ held, which takes the GIL back
 class RealtimePool {
     public:
 
-    //static Params const PRMS_DEF;
-    RealtimeParams PRMS;
-
+    //Creates device 0 from conf.realtime_prms and conf.num_channels
     RealtimePool(Conf &conf);
+
+    //Adds another flowcell served by the same index and threads
+    //Must be called before any chunks are added, returns the device ID
+    //Devices are fixed after that, so their accessors don't lock
+    i32 add_device(const std::string &name, const RealtimeParams &prms, 
+                   u16 num_channels);
+
+    u16 device_count() const;
+    i32 device_id(const std::string &name) const;
+    RealtimeParams &device_params(u16 device);
     
-    bool add_chunk(Chunk &chunk);
-    bool try_add_chunk(Chunk &chunk);
-    void end_read(u16 ch, u32 number);
-    bool is_read_finished(const ReadBuffer &r);
+    bool add_chunk(Chunk &chunk, u16 device = 0);
+    bool try_add_chunk(Chunk &chunk, u16 device = 0);
+    bool is_read_finished(const ReadBuffer &r, u16 device = 0);
+
+    //Drops any later chunks of a read that was unblocked or stopped
+    void end_read(u16 channel, u32 number, u16 device = 0);
+    bool is_read_ended(u16 channel, u32 number, u16 device = 0) const;
+
+    //False for channels excluded by the device's active_chs
+    //A device accessor, so it doesn't lock
+    bool is_channel_active(u16 channel, u16 device = 0) const;
+
+    //Milliseconds since add_chunk last received a chunk on the channel
+    float chunk_age(u16 channel, u16 device = 0);
+
+    //Holds a decision on a read returned by update until pop_actions
+    void queue_action(u16 channel, u32 number, bool unblock, u16 device = 0);
+
+    //Returns the device's queued actions once action_batch are queued or 
+    //action_interval has passed since the oldest, or immediately if forced
+    std::vector<MapAction> pop_actions(u16 device = 0, bool force = false);
+
+    //Histograms of a read's first chunk being received to its first event,
+    //first event to decision, and decision to its action being dispatched
+    //by pop_actions. When the client applies the action isn't observed
+    //Like thread_stats and counters, safe to call from any thread
+    std::map<std::string, LatencyHist> latencies() const;
 
     bool is_stopped() {return stopped_;}
 
-    std::vector<MapResult> update();
+    //Schedules all devices, returns reads finished on the given device
+    std::vector<MapResult> update(u16 device = 0);
+
+    //Same as update, returning a summary of each result instead
+    //Pafs are submitted to out if it's given. Touches no python objects
+    const PafSummary &update_batch(u16 device = 0, PafWriter *out = NULL);
+
+    //Names of the rf_ids in update_batch summaries
+    //Only valid until the next update_batch call
+    const std::vector<std::string> &batch_ref_names() const;
+
     bool all_finished();
+
+    //True if every chunk added has been mapped and every result returned
+    //by update, except reads waiting for max_active_reads. Simulations
+    //can advance time once this is set
+    bool is_idle();
     void stop_all(); //TODO: just name stop
 
     u32 active_count() const; 
 
+    //Per-thread scheduler load, times in milliseconds
+    struct ThreadStats {
+        u32 load, max_load, reads_mapped, steals, stolen, abandoned;
+        double busy_time, idle_time;
+    };
+
+    std::vector<ThreadStats> thread_stats();
+
+    //MapCounters totals over all reads finished so far
+    std::map<std::string, u64> counters() const;
+
     #ifdef PYBIND
 
     #define PY_REALTIME_METH(P) c.def(#P, &RealtimePool::P);
+    #define PY_REALTIME_NOGIL pybind11::call_guard<pybind11::gil_scoped_release>()
+    #define PY_REALTIME_LOCKED(P) c.def(#P, &RealtimePool::P, PY_REALTIME_NOGIL);
     #define PY_REALTIME_PRM(P) p.def_readwrite(#P, &RealtimeParams::P);
     #define PY_REALTIME_MODE(P) m.value(#P, RealtimeParams::Mode::P);
     #define PY_REALTIME_ACTIVE(P) a.value(#P, RealtimeParams::ActiveChs::P);
+    #define PY_BATCH_ARR pybind11::array::c_style | pybind11::array::forcecast
+
+    //Adds a read_until batch of (channel, read) pairs in one call
+    //Returns (channel, number) of reads on inactive channels, which the 
+    //caller should stop receiving
+    std::vector< std::pair<u16, u32> > add_read_chunks(pybind11::iterable batch, 
+                                                      const std::string &dtype, 
+                                                      u16 device);
+
+    //Adds chunks whose samples are concatenated in signal, the i'th being
+    //signal[offsets[i]:offsets[i+1]]. int16 signal is wrapped without 
+    //copying, float32 is copied. Returns a mask of chunks on inactive 
+    //channels, which the caller should stop receiving
+    pybind11::array_t<bool> add_chunk_batch(const std::vector<std::string> &ids,
+                                            pybind11::array_t<u16, PY_BATCH_ARR> channels,
+                                            pybind11::array_t<u32, PY_BATCH_ARR> numbers,
+                                            pybind11::array_t<u64, PY_BATCH_ARR> starts,
+                                            pybind11::array_t<u64, PY_BATCH_ARR> offsets,
+                                            pybind11::array signal, u16 device);
 
     static void pybind_defs(pybind11::class_<RealtimePool> &c) {
         c.def(pybind11::init<Conf &>());
-        PY_REALTIME_METH(add_chunk);
-        PY_REALTIME_METH(try_add_chunk);
-        PY_REALTIME_METH(update);
-        PY_REALTIME_METH(all_finished);
-        PY_REALTIME_METH(stop_all);
+        PY_REALTIME_LOCKED(add_device);
+        PY_REALTIME_METH(device_count);
+        PY_REALTIME_METH(device_id);
+        c.def("device_params", &RealtimePool::device_params, 
+              pybind11::return_value_policy::reference_internal);
+        c.def("add_chunk", &RealtimePool::add_chunk, 
+              pybind11::arg("chunk"), pybind11::arg("device") = 0,
+              PY_REALTIME_NOGIL);
+        c.def("try_add_chunk", &RealtimePool::try_add_chunk, 
+              pybind11::arg("chunk"), pybind11::arg("device") = 0,
+              PY_REALTIME_NOGIL);
+        c.def("update", &RealtimePool::update, pybind11::arg("device") = 0,
+              PY_REALTIME_NOGIL);
+
+        //Returns a structured array of PafSummary::Row
+        c.def("update_batch", [](RealtimePool &p, u16 device, PafWriter *out) {
+            const PafSummary *s;
+            {
+                pybind11::gil_scoped_release nogil;
+                s = &p.update_batch(device, out);
+            }
+            return s->to_array();
+        }, pybind11::arg("device") = 0, pybind11::arg("out") = (PafWriter *) NULL);
+        PY_REALTIME_METH(batch_ref_names);
+        c.def("end_read", &RealtimePool::end_read, pybind11::arg("channel"), 
+              pybind11::arg("number"), pybind11::arg("device") = 0,
+              PY_REALTIME_NOGIL);
+        c.def("is_channel_active", &RealtimePool::is_channel_active, 
+              pybind11::arg("channel"), pybind11::arg("device") = 0);
+        c.def("chunk_age", &RealtimePool::chunk_age, 
+              pybind11::arg("channel"), pybind11::arg("device") = 0,
+              PY_REALTIME_NOGIL);
+        c.def("queue_action", &RealtimePool::queue_action, 
+              pybind11::arg("channel"), pybind11::arg("number"), 
+              pybind11::arg("unblock"), pybind11::arg("device") = 0,
+              PY_REALTIME_NOGIL);
+        c.def("pop_actions", &RealtimePool::pop_actions, 
+              pybind11::arg("device") = 0, pybind11::arg("force") = false,
+              PY_REALTIME_NOGIL);
+        PY_REALTIME_METH(latencies);
+
+        c.def("add_read_chunks", &RealtimePool::add_read_chunks, 
+              pybind11::arg("batch"), pybind11::arg("dtype"), 
+              pybind11::arg("device") = 0);
+        c.def("add_chunk_batch", &RealtimePool::add_chunk_batch, 
+              pybind11::arg("ids"), pybind11::arg("channels"), 
+              pybind11::arg("numbers"), pybind11::arg("starts"), 
+              pybind11::arg("offsets"), pybind11::arg("signal"), 
+              pybind11::arg("device") = 0);
+        PY_REALTIME_LOCKED(all_finished);
+        PY_REALTIME_LOCKED(is_idle);
+        PY_REALTIME_LOCKED(stop_all);
+        PY_REALTIME_METH(thread_stats);
+        PY_REALTIME_METH(counters);
+
+        pybind11::class_<ThreadStats> s(c, "ThreadStats");
+        s.def_readonly("load", &ThreadStats::load);
+        s.def_readonly("max_load", &ThreadStats::max_load);
+        s.def_readonly("reads_mapped", &ThreadStats::reads_mapped);
+        s.def_readonly("steals", &ThreadStats::steals);
+        s.def_readonly("stolen", &ThreadStats::stolen);
+        s.def_readonly("abandoned", &ThreadStats::abandoned);
+        s.def_readonly("busy_time", &ThreadStats::busy_time);
+        s.def_readonly("idle_time", &ThreadStats::idle_time);
 
         pybind11::class_<RealtimeParams> p(c, "RealtimeParams");
         PY_REALTIME_PRM(host);
         PY_REALTIME_PRM(port);
         PY_REALTIME_PRM(duration);
         PY_REALTIME_PRM(max_active_reads);
+        PY_REALTIME_PRM(action_interval);
+        PY_REALTIME_PRM(action_batch);
+        PY_REALTIME_PRM(deadline_sched);
+        PY_REALTIME_PRM(abandon_time);
+        PY_REALTIME_PRM(tune_latency);
+        PY_REALTIME_PRM(tune_interval);
+        PY_REALTIME_PRM(tune_active_min);
+        PY_REALTIME_PRM(tune_active_max);
+        PY_REALTIME_PRM(tune_batch_min);
+        PY_REALTIME_PRM(tune_batch_max);
+        PY_REALTIME_PRM(tune_timeout_min);
+        PY_REALTIME_PRM(tune_timeout_max);
+        PY_REALTIME_PRM(tune_chunk_timeout_min);
+        PY_REALTIME_PRM(tune_chunk_timeout_max);
         PY_REALTIME_PRM(active_chs);
         PY_REALTIME_PRM(realtime_mode);
 
@@ -92,9 +256,15 @@ class RealtimePool {
 
     private:
 
+    //Each thread owns a deque of channels, mapping one batch from the front
+    //and requeuing it at the back. Idle threads steal from the back of the
+    //most loaded thread's deque, and sleep on idle_cv_ until work arrives
+    //With deadline_sched, the next channel is instead the one with the 
+    //least pore time left after its estimated mapping cost. Reads that
+    //can't be decided in time go last, or are abandoned once abandon_time late
     class MapperThread {
         public:
-        MapperThread(std::vector<Mapper> &mappers);
+        MapperThread(RealtimePool &pool, u16 tid);
         MapperThread(MapperThread &&mt);
 
         void start();
@@ -104,36 +274,125 @@ class RealtimePool {
 
         u16 read_count() const;
 
-        static u16 num_threads;
+        void push_ch(u16 ch);
+        bool pop_ch(u16 &ch);
+        bool take_next(u16 &ch);
+        float slack(u16 ch) const;
+        bool steal_ch(u16 &ch);
+        u32 steal_from(MapperThread &victim, std::vector<u16> &out);
+
+        ThreadStats get_stats();
+
+        RealtimePool &pool_;
         u16 tid_;
 
         std::vector<Mapper> &mappers_;
 
         bool running_;
 
-        //Corrasponding inputs/output
-        std::vector< u16 > in_chs_, in_tmp_, 
-                           out_chs_, out_tmp_,
-                           active_chs_;
-        std::mutex in_mtx_, out_mtx_;
+        //Channels assigned to this thread (queued + mapping)
+        std::atomic<u32> load_;
+
+        //Moving average of milliseconds per path per event mapped
+        float path_ms_;
+
+        std::deque<u16> queue_;
+        std::mutex queue_mtx_;
+
+        std::vector<u16> out_chs_, steal_tmp_;
+        std::mutex out_mtx_;
 
         std::thread thread_;
 
-        float mtx_time_;
+        //Protected by queue_mtx_
+        ThreadStats stats_;
+    };
+
+    u64 work_gen();
+    void wait_for_work(u64 gen);
+    void notify_work();
+
+    #ifdef PYBIND
+    //Adds chunks converted by the python bindings, which must hold the GIL
+    //It's released while they're added, since api_mtx_ can't be waited on
+    //with it held. Chunks of ended reads are dropped by add_chunk
+    void add_py_chunks(std::vector<Chunk> &chunks, u16 device);
+    #endif
+
+    //update without locking api_mtx_, for callers holding it
+    std::vector<MapResult> update_unlocked(u16 device);
+
+    bool buffer_chunk(Chunk &c, u16 ch);
+    u16 device_of(u16 ch) const;
+
+    //Record when a read's first chunk arrives and when it starts mapping
+    void chunk_received(const Chunk &c, u16 ch);
+    void read_started(u16 ch);
+
+    //Each device owns a contiguous range of mappers_
+    //Finished reads wait in out_ until that device's update
+    struct Device {
+        std::string name;
+        RealtimeParams prms;
+        u16 ch_offs, num_chs;
+        std::vector<MapResult> out;
+
+        //Queued actions and when each read was decided, on clock_
+        std::vector<MapAction> actions;
+        std::vector<float> decided;
     };
 
-    void buffer_chunk(Chunk &c);
+    std::deque<Device> devices_;
+    u32 max_active_;
+    PafSummary summary_;
 
     bool stopped_;
 
     u32 active_count_;
 
-    //List of mappers - one for each channel
+    //List of mappers - one for each channel of each device
     std::vector<Mapper> mappers_;
     std::vector<MapperThread> threads_;
-    std::vector<Chunk> chunk_buffer_;
+    std::vector<bool> buffered_;
+
+    //Per channel, the last ended read number and time since the last chunk
+    std::vector<u32> ended_;
+    std::vector<Timer> chunk_timers_;
+
+    //Per channel, when the last read returned by update was decided
+    std::vector<float> decided_;
+
+    //Per channel, the number of the last read received and when its first
+    //chunk arrived, and how long the active read waited to start mapping
+    std::vector<u32> recv_read_;
+    std::vector<float> received_, start_delay_;
+    Timer clock_;
+
+    mutable std::mutex api_mtx_;
+
+    //Read by latencies from other threads, such as a MetricsServer
+    mutable std::mutex lat_mtx_;
+    LatencyHist recv_evt_lat_, evt_dec_lat_, dec_disp_lat_;
+
+    //Read start to decision latencies since the last Autotuner step, and
+    //thread busy time totals at that step
+    Autotuner tuner_;
+    Autotuner::Settings tuned_;
+    bool tune_started_;
+    Timer tune_timer_;
+    LatencyHist tune_lat_;
+    double tune_busy_;
+
+    //Measures the last interval and applies the Autotuner's settings
+    void autotune();
 
     std::vector<u16> buffer_queue_, out_chs_, active_queue_;
+
+    //Idle thread wakeups, work_gen_ changes whenever work is queued
+    std::mutex idle_mtx_;
+    std::condition_variable idle_cv_;
+    u64 work_gen_;
+    std::atomic<u32> idle_count_;
     //std::deque<u16> ;
     //std::vector<u16> active_queue_;
 
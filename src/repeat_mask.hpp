@@ -0,0 +1,315 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_REPEAT_MASK
+#define _INCL_REPEAT_MASK
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <bwa/bwt.h>
+#include "util.hpp"
+#include "mapped_file.hpp"
+
+#define REPEAT_MASK_SUFF ".urm"
+
+//One bit per suffix array row, set if the row's suffix starts with a 
+//sequence of mask_len bases found at least min_copies times in the index
+//Since it's indexed by row rather than reference coordinate, seeds can be
+//checked against it before their SA lookups. All rows of a seed's FM 
+//range share its sequence, so a seed at least mask_len bases long is 
+//masked in every row or none
+class RepeatMask {
+    public:
+
+    static const u64 MAGIC = 0x314b534d4c434e55ULL; //"UNCLMSK1"
+
+    RepeatMask() :
+        seq_len_(0), primary_(0),
+        mask_len_(0), min_copies_(0),
+        bits_(NULL), nwords_(0), masked_(0),
+        loaded_(false) {}
+
+    //Move-only, since a copy would share the mapped file
+    RepeatMask(const RepeatMask &) = delete;
+    RepeatMask &operator=(const RepeatMask &) = delete;
+
+    RepeatMask(RepeatMask &&m) : RepeatMask() {
+        *this = std::move(m);
+    }
+
+    //Leaves m empty, as after destroy()
+    RepeatMask &operator=(RepeatMask &&m) {
+        if (this == &m) return *this;
+        destroy();
+        seq_len_ = m.seq_len_;
+        primary_ = m.primary_;
+        mask_len_ = m.mask_len_;
+        min_copies_ = m.min_copies_;
+        bits_ = m.bits_;
+        nwords_ = m.nwords_;
+        masked_ = m.masked_;
+        bit_buf_ = std::move(m.bit_buf_);
+        file_ = std::move(m.file_);
+        loaded_ = m.loaded_;
+        if (loaded_ && !file_.is_open()) bits_ = bit_buf_.data();
+        m.destroy();
+        return *this;
+    }
+
+    bool is_loaded() const {
+        return loaded_;
+    }
+
+    u32 mask_len() const {
+        return mask_len_;
+    }
+
+    u32 min_copies() const {
+        return min_copies_;
+    }
+
+    //Number of rows masked
+    u64 masked_count() const {
+        return masked_;
+    }
+
+    inline bool is_masked(u64 row) const {
+        return (bits_[row >> 6] >> (row & 63)) & 1;
+    }
+
+    //Searches every sequence of mask_len bases found at least min_copies 
+    //times, pruning as soon as a prefix is rarer. Subtrees of each 
+    //ROOT_LEN base sequence are searched in parallel
+    bool build(const bwt_t *bwt, u32 mask_len, u32 min_copies, u32 threads) {
+        if (mask_len < ROOT_LEN || min_copies < 2) {
+            std::cerr << "Error: repeat mask length must be at least " 
+                      << ROOT_LEN << " and copies at least 2\n";
+            return false;
+        }
+
+        seq_len_ = bwt->seq_len;
+        primary_ = bwt->primary;
+        mask_len_ = mask_len;
+        min_copies_ = min_copies;
+        nwords_ = (seq_len_ + 64) / 64;
+        bit_buf_.assign(nwords_, 0);
+        bits_ = bit_buf_.data();
+
+        //Ranges of every ROOT_LEN base sequence, like KmerExtTable::build
+        std::vector<u64> roots(8), prev;
+        for (u8 b = 0; b < 4; b++) {
+            roots[2*b] = bwt->L2[b] + 1;
+            roots[2*b+1] = bwt->L2[b+1];
+        }
+        for (u32 l = 1; l < ROOT_LEN; l++) {
+            prev.swap(roots);
+            roots.resize(prev.size() * 4);
+            for (u64 s = 0; s < prev.size() / 2; s++) {
+                u64 os[4], oe[4];
+                bwt_2occ4(bwt, prev[2*s] - 1, prev[2*s+1], os, oe);
+                for (u8 b = 0; b < 4; b++) {
+                    u64 j = 2 * ((s << 2) | b);
+                    roots[j] = bwt->L2[b] + os[b] + 1;
+                    roots[j+1] = bwt->L2[b] + oe[b];
+                }
+            }
+        }
+
+        std::atomic<u64> next_root(0), masked(0);
+        auto search = [&]() {
+            std::vector<Node> stack;
+            u64 r, count = 0;
+            while ((r = next_root++) < roots.size() / 2) {
+                stack.push_back({roots[2*r], roots[2*r+1], ROOT_LEN});
+                count += search_from(bwt, stack);
+            }
+            masked += count;
+        };
+
+        if (threads == 0) threads = 1;
+        std::vector<std::thread> pool;
+        for (u32 i = 1; i < threads; i++) pool.emplace_back(search);
+        search();
+        for (auto &t : pool) t.join();
+
+        masked_ = masked;
+        loaded_ = true;
+        return true;
+    }
+
+    bool save(const std::string &fname) const {
+        FILE *out = fopen(fname.c_str(), "wb");
+        if (out == NULL) {
+            std::cerr << "Error: failed to open \"" << fname << "\"\n";
+            return false;
+        }
+
+        u64 header[HEADER_LEN] = {MAGIC, seq_len_, primary_, mask_len_, min_copies_, nwords_, masked_, 0};
+        bool ok = fwrite(header, sizeof(u64), HEADER_LEN, out) == HEADER_LEN &&
+                  fwrite(bits_, sizeof(u64), nwords_, out) == nwords_;
+        fclose(out);
+
+        if (!ok) std::cerr << "Error: failed to write \"" << fname << "\"\n";
+        return ok;
+    }
+
+    //Returns false without printing if the file does not exist,
+    //since the mask is optional
+    bool load(const std::string &fname, const bwt_t *bwt) {
+        FILE *in = fopen(fname.c_str(), "rb");
+        if (in == NULL) return false;
+
+        u64 header[HEADER_LEN];
+        bool ok = fread(header, sizeof(u64), HEADER_LEN, in) == HEADER_LEN &&
+                  check_header(header, bwt);
+
+        if (ok) {
+            bit_buf_.resize(nwords_);
+            ok = fread(bit_buf_.data(), sizeof(u64), nwords_, in) == nwords_;
+        }
+        fclose(in);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid repeat mask \"" << fname << "\"\n";
+            destroy();
+            return false;
+        }
+
+        bits_ = bit_buf_.data();
+        loaded_ = true;
+        return true;
+    }
+
+    //Like load(), but maps the file instead of copying it
+    bool map(const std::string &fname, const bwt_t *bwt,
+             bool populate = false, bool hugepages = false) {
+        if (!file_.open(fname, false, populate, hugepages)) return false;
+
+        const u64 *header = reinterpret_cast<const u64 *>(file_.data());
+        bool ok = file_.size() >= HEADER_LEN * sizeof(u64) &&
+                  check_header(header, bwt) &&
+                  file_.size() == (HEADER_LEN + nwords_) * sizeof(u64);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid repeat mask \"" << fname << "\"\n";
+            destroy();
+            return false;
+        }
+
+        bits_ = header + HEADER_LEN;
+        loaded_ = true;
+        return true;
+    }
+
+    void destroy() {
+        file_.close();
+        bit_buf_.clear();
+        bits_ = NULL;
+        nwords_ = 0;
+        masked_ = 0;
+        loaded_ = false;
+    }
+
+    private:
+
+    static const u32 HEADER_LEN = 8, ROOT_LEN = 4;
+
+    struct Node {
+        u64 st, en;
+        u32 depth;
+    };
+
+    //Marks the rows of every frequent full-length sequence below the 
+    //nodes on the stack, returns the number of rows marked
+    u64 search_from(const bwt_t *bwt, std::vector<Node> &stack) {
+        u64 count = 0;
+
+        while (!stack.empty()) {
+            Node n = stack.back();
+            stack.pop_back();
+
+            if (n.en < n.st || n.en - n.st + 1 < min_copies_) continue;
+
+            if (n.depth == mask_len_) {
+                mark(n.st, n.en);
+                count += n.en - n.st + 1;
+                continue;
+            }
+
+            u64 os[4], oe[4];
+            bwt_2occ4(bwt, n.st - 1, n.en, os, oe);
+            for (u8 b = 0; b < 4; b++) {
+                stack.push_back({bwt->L2[b] + os[b] + 1, bwt->L2[b] + oe[b], n.depth + 1});
+            }
+        }
+
+        return count;
+    }
+
+    //Threads mark disjoint rows, but may share the words at their ends
+    void mark(u64 st, u64 en) {
+        u64 *bits = bit_buf_.data();
+        for (u64 w = st >> 6; w <= (en >> 6); w++) {
+            u64 lo = w == (st >> 6) ? (st & 63) : 0,
+                hi = w == (en >> 6) ? (en & 63) : 63;
+            u64 m = (hi == 63 ? ~0ULL : ((1ULL << (hi + 1)) - 1)) & (~0ULL << lo);
+            __atomic_fetch_or(&bits[w], m, __ATOMIC_RELAXED);
+        }
+    }
+
+    bool check_header(const u64 *header, const bwt_t *bwt) {
+        if (header[0] != MAGIC || 
+            header[1] != bwt->seq_len || 
+            header[2] != bwt->primary ||
+            header[5] != (bwt->seq_len + 64) / 64) {
+            return false;
+        }
+        seq_len_ = header[1];
+        primary_ = header[2];
+        mask_len_ = header[3];
+        min_copies_ = header[4];
+        nwords_ = header[5];
+        masked_ = header[6];
+        return true;
+    }
+
+    u64 seq_len_, primary_;
+    u32 mask_len_, min_copies_;
+
+    const u64 *bits_;
+    u64 nwords_, masked_;
+
+    //Storage when built or loaded rather than mapped
+    std::vector<u64> bit_buf_;
+    MappedFile file_;
+
+    bool loaded_;
+};
+
+#endif
@@ -0,0 +1,143 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_SA_CACHE
+#define _INCL_SA_CACHE
+
+#include "util.hpp"
+
+//Cache of suffix array values for rows seen before, shared by every Mapper
+//Rows hash to sets of WAYS entries. Each entry is one u64 holding a valid
+//bit, a CLOCK reference bit, the rest of the row's hash, and its SA value,
+//so lookups are single atomic loads and inserts a compare-and-swap
+//Inserts give referenced entries a second chance, approximating LRU
+class SaCache {
+    public:
+
+    //Sets fill one cache line
+    static const u32 WAYS = 8;
+
+    SaCache() : nsets_(0) {}
+
+    //Allocates up to size_mb MB for an index of length seq_len, or frees
+    //the cache if size_mb is 0. Returns false if an entry can't hold
+    //both a row's tag and its value
+    bool init(u64 size_mb, u64 seq_len) {
+        table_.clear();
+        nsets_ = 0;
+        if (size_mb == 0) return true;
+
+        u64 nsets = 1;
+        while (nsets * 2 * WAYS * sizeof(u64) <= (size_mb << 20)) nsets *= 2;
+
+        set_bits_ = 0;
+        while ((u64(1) << set_bits_) < nsets) set_bits_++;
+
+        row_bits_ = val_bits_ = 1;
+        while ((seq_len + 1) >> row_bits_) row_bits_++;
+        val_bits_ = row_bits_;
+
+        u8 tag_bits = row_bits_ > set_bits_ ? row_bits_ - set_bits_ : 0;
+        if (tag_bits + val_bits_ > 62) return false;
+
+        val_mask_ = (u64(1) << val_bits_) - 1;
+        key_mask_ = ~(REF | val_mask_);
+        set_mask_ = nsets - 1;
+        table_.assign(nsets * WAYS, 0);
+        nsets_ = nsets;
+        return true;
+    }
+
+    bool is_active() const {
+        return nsets_ > 0;
+    }
+
+    u64 size_bytes() const {
+        return table_.size() * sizeof(u64);
+    }
+
+    //Stores the row's value in val and marks it referenced if cached
+    inline bool get(u64 row, u64 &val) {
+        u64 h = hash(row);
+        u64 *set = &table_[(h & set_mask_) * WAYS];
+        u64 key = key_of(h);
+
+        for (u32 w = 0; w < WAYS; w++) {
+            u64 e = __atomic_load_n(&set[w], __ATOMIC_RELAXED);
+            if ((e & key_mask_) != key) continue;
+
+            val = e & val_mask_;
+            if (!(e & REF)) __atomic_fetch_or(&set[w], REF, __ATOMIC_RELAXED);
+            return true;
+        }
+        return false;
+    }
+
+    //Replaces the first empty or unreferenced entry in the row's set,
+    //clearing the reference bits it passes. If every entry was 
+    //referenced (or changed while we looked), one is overwritten
+    inline void put(u64 row, u64 val) {
+        u64 h = hash(row);
+        u64 *set = &table_[(h & set_mask_) * WAYS];
+        u64 entry = key_of(h) | val;
+
+        for (u32 w = 0; w < WAYS; w++) {
+            u64 e = __atomic_load_n(&set[w], __ATOMIC_RELAXED);
+            if ((e & key_mask_) == (entry & key_mask_)) return;
+
+            if (!(e & REF)) {
+                if (__atomic_compare_exchange_n(&set[w], &e, entry, false, 
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    return;
+                }
+            } else {
+                __atomic_fetch_and(&set[w], ~REF, __ATOMIC_RELAXED);
+            }
+        }
+
+        __atomic_store_n(&set[val % WAYS], entry, __ATOMIC_RELAXED);
+    }
+
+    private:
+    static const u64 VALID = u64(1) << 63,
+                     REF   = u64(1) << 62;
+
+    //Multiplying by an odd constant and folding the high half into the
+    //low half are both invertible modulo 2^row_bits_, so the set index
+    //and tag together identify the row
+    inline u64 hash(u64 row) const {
+        u64 mask = (u64(1) << row_bits_) - 1;
+        u64 h = (row * 0x9E3779B97F4A7C15ULL) & mask;
+        return h ^ (h >> ((row_bits_ + 1) / 2));
+    }
+
+    inline u64 key_of(u64 h) const {
+        return VALID | ((h >> set_bits_) << val_bits_);
+    }
+
+    AlignedVec<u64> table_;
+    u64 nsets_, set_mask_, val_mask_, key_mask_;
+    u8 set_bits_, row_bits_, val_bits_;
+};
+
+#endif
@@ -0,0 +1,270 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_SAMPLED_SA
+#define _INCL_SAMPLED_SA
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdio>
+#include <iostream>
+#include <bwa/bwt.h>
+#include "util.hpp"
+#include "mapped_file.hpp"
+
+#define SAMPLED_SA_SUFF ".usa"
+
+//Sampled suffix array with bit-packed entries, replacing the BWA ".sa"
+//Entries take ceil(log2(seq_len+1)) bits instead of 64. The sampling 
+//interval must be a power of two, as bwt_sa assumes.
+class SampledSA {
+    public:
+
+    static const u64 MAGIC = 0x314153534c434e55ULL; //"UNCLSSA1"
+
+    SampledSA() :
+        seq_len_(0), primary_(0), 
+        intv_shift_(0), intv_mask_(0), 
+        bits_(0), val_mask_(0),
+        words_(NULL), nwords_(0),
+        loaded_(false) {}
+
+    //Move-only, since a copy would share the mapped file
+    SampledSA(const SampledSA &) = delete;
+    SampledSA &operator=(const SampledSA &) = delete;
+
+    SampledSA(SampledSA &&s) : SampledSA() {
+        *this = std::move(s);
+    }
+
+    //Leaves s empty, as after destroy()
+    SampledSA &operator=(SampledSA &&s) {
+        if (this == &s) return *this;
+        destroy();
+        seq_len_ = s.seq_len_;
+        primary_ = s.primary_;
+        intv_shift_ = s.intv_shift_;
+        intv_mask_ = s.intv_mask_;
+        bits_ = s.bits_;
+        val_mask_ = s.val_mask_;
+        words_ = s.words_;
+        nwords_ = s.nwords_;
+        word_buf_ = std::move(s.word_buf_);
+        file_ = std::move(s.file_);
+        loaded_ = s.loaded_;
+        if (loaded_ && !file_.is_open()) words_ = word_buf_.data();
+        s.destroy();
+        return *this;
+    }
+
+    static bool valid_intv(u64 intv) {
+        return intv > 0 && (intv & (intv - 1)) == 0;
+    }
+
+    static u8 entry_bits(u64 seq_len) {
+        u8 bits = 1;
+        while (bits < 64 && (seq_len >> bits) != 0) bits++;
+        return bits;
+    }
+
+    //Estimated size in bytes for a sequence of seq_len bases (both strands)
+    static u64 estimate_bytes(u64 seq_len, u64 intv) {
+        u64 n_sa = (seq_len + intv) / intv;
+        return HEADER_LEN * sizeof(u64) + (n_sa * entry_bits(seq_len) / 64 + 2) * sizeof(u64);
+    }
+
+    bool is_loaded() const {
+        return loaded_;
+    }
+
+    u64 intv() const {
+        return intv_mask_ + 1;
+    }
+
+    u64 size_bytes() const {
+        return nwords_ * sizeof(u64);
+    }
+
+    //Packs bwt->sa, which must already be computed (bwt_restore_sa or bwt_cal_sa)
+    bool build(const bwt_t *bwt) {
+        if (!valid_intv(bwt->sa_intv)) {
+            std::cerr << "Error: SA interval must be a power of two\n";
+            return false;
+        }
+
+        set_params(bwt->seq_len, bwt->primary, bwt->sa_intv);
+
+        u64 n_sa = bwt->n_sa;
+        word_buf_.assign(n_sa * bits_ / 64 + 2, 0);
+
+        //sa[0] is stored as 0 and decoded as -1, see get()
+        for (u64 i = 1; i < n_sa; i++) {
+            u64 bit = i * bits_, 
+                val = bwt->sa[i];
+            word_buf_[bit >> 6] |= val << (bit & 63);
+            if ((bit & 63) + bits_ > 64) {
+                word_buf_[(bit >> 6) + 1] |= val >> (64 - (bit & 63));
+            }
+        }
+
+        words_ = word_buf_.data();
+        nwords_ = word_buf_.size();
+        loaded_ = true;
+        return true;
+    }
+
+    bool save(const std::string &fname) const {
+        FILE *out = fopen(fname.c_str(), "wb");
+        if (out == NULL) {
+            std::cerr << "Error: failed to open \"" << fname << "\"\n";
+            return false;
+        }
+
+        u64 header[HEADER_LEN] = {MAGIC, seq_len_, primary_, intv(), bits_, nwords_, 0, 0};
+        bool ok = fwrite(header, sizeof(u64), HEADER_LEN, out) == HEADER_LEN &&
+                  fwrite(words_, sizeof(u64), nwords_, out) == nwords_;
+        fclose(out);
+
+        if (!ok) std::cerr << "Error: failed to write \"" << fname << "\"\n";
+        return ok;
+    }
+
+    //Returns false without printing if the file does not exist
+    bool load(const std::string &fname, const bwt_t *bwt) {
+        FILE *in = fopen(fname.c_str(), "rb");
+        if (in == NULL) return false;
+
+        u64 header[HEADER_LEN];
+        bool ok = fread(header, sizeof(u64), HEADER_LEN, in) == HEADER_LEN &&
+                  check_header(header, bwt);
+
+        if (ok) {
+            word_buf_.resize(header[5]);
+            ok = fread(word_buf_.data(), sizeof(u64), word_buf_.size(), in) == word_buf_.size();
+        }
+        fclose(in);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid sampled SA \"" << fname << "\"\n";
+            word_buf_.clear();
+            return false;
+        }
+
+        words_ = word_buf_.data();
+        nwords_ = word_buf_.size();
+        loaded_ = true;
+        return true;
+    }
+
+    bool map(const std::string &fname, const bwt_t *bwt,
+             bool populate = false, bool hugepages = false) {
+        if (!file_.open(fname, false, populate, hugepages)) return false;
+
+        const u64 *header = reinterpret_cast<const u64 *>(file_.data());
+        bool ok = file_.size() >= HEADER_LEN * sizeof(u64) &&
+                  check_header(header, bwt) &&
+                  file_.size() == (HEADER_LEN + header[5]) * sizeof(u64);
+
+        if (!ok) {
+            std::cerr << "Warning: ignoring invalid sampled SA \"" << fname << "\"\n";
+            file_.close();
+            return false;
+        }
+
+        words_ = header + HEADER_LEN;
+        nwords_ = header[5];
+        loaded_ = true;
+        return true;
+    }
+
+    void destroy() {
+        file_.close();
+        word_buf_.clear();
+        words_ = NULL;
+        nwords_ = 0;
+        loaded_ = false;
+    }
+
+    inline bool is_sampled(u64 k) const {
+        return (k & intv_mask_) == 0;
+    }
+
+    //SA value of sampled row k
+    inline u64 get(u64 k) const {
+        if (k == 0) return (u64) -1;
+        u64 bit = (k >> intv_shift_) * bits_;
+        u64 val = words_[bit >> 6] >> (bit & 63);
+        if ((bit & 63) + bits_ > 64) {
+            val |= words_[(bit >> 6) + 1] << (64 - (bit & 63));
+        }
+        return val & val_mask_;
+    }
+
+    inline void prefetch(u64 k) const {
+        __builtin_prefetch(&words_[((k >> intv_shift_) * bits_) >> 6]);
+    }
+
+    private:
+
+    static const u32 HEADER_LEN = 8;
+
+    void set_params(u64 seq_len, u64 primary, u64 intv) {
+        seq_len_ = seq_len;
+        primary_ = primary;
+        intv_mask_ = intv - 1;
+        intv_shift_ = 0;
+        while ((1ULL << intv_shift_) < intv) intv_shift_++;
+        bits_ = entry_bits(seq_len);
+        val_mask_ = bits_ == 64 ? ~0ULL : (1ULL << bits_) - 1;
+    }
+
+    bool check_header(const u64 *header, const bwt_t *bwt) {
+        if (header[0] != MAGIC || 
+            header[1] != bwt->seq_len || 
+            header[2] != bwt->primary ||
+            !valid_intv(header[3]) ||
+            header[4] != entry_bits(bwt->seq_len)) {
+            return false;
+        }
+        set_params(header[1], header[2], header[3]);
+        return true;
+    }
+
+    u64 seq_len_, primary_;
+    u8 intv_shift_;
+    u64 intv_mask_;
+    u8 bits_;
+    u64 val_mask_;
+
+    const u64 *words_;
+    u64 nwords_;
+
+    std::vector<u64> word_buf_;
+    MappedFile file_;
+
+    bool loaded_;
+};
+
+#endif
@@ -22,19 +22,20 @@
  */
 
 #include <iostream>
-#include <set>
 #include "seed_tracker.hpp"
 
 const SeedTracker::Params SeedTracker::PRMS_DEF = {
     min_map_len   : 25,
     min_mean_conf : 6.00,
-    min_top_conf  : 1.85
+    min_top_conf  : 1.85,
+    max_evt_gap   : 2000
 };
 
 SeedCluster::SeedCluster() 
     : evt_st_(1),
       evt_en_(0),
-      total_len_(0) {
+      total_len_(0),
+      id_(0) {
 }
 
 SeedCluster::SeedCluster(Range ref_st, u32 evt_st)
@@ -42,7 +43,8 @@ SeedCluster::SeedCluster(Range ref_st, u32 evt_st)
       ref_en_(ref_st),
       evt_st_(evt_st),
       evt_en_(evt_st),
-      total_len_(ref_st.length()) {
+      total_len_(ref_st.length()),
+      id_(0) {
 }
 
 //SeedCluster::SeedCluster(const SeedCluster &r)
@@ -111,27 +113,33 @@ std::ostream &operator<< (std::ostream &out, const SeedCluster &a) {
 SeedTracker::SeedTracker() : SeedTracker(PRMS_DEF) {}
 
 SeedTracker::SeedTracker(Params prms) :
-    PRMS(prms) {
+    PRMS(prms),
+    nblocks_(0) {
     reset();
 }
 
 void SeedTracker::reset() {
-    seed_clusters_.clear();
-    all_lens_.clear();
+    for (u32 b = 0; b < nblocks_; b++) {
+        blocks_[b].clear();
+    }
+    nblocks_ = 0;
+    cluster_count_ = 0;
+    len_count_ = top_len_ = second_len_ = 0;
+    next_sweep_ = PRMS.max_evt_gap;
     max_map_ = NULL_ALN;
     len_sum_ = 0;
 }
 
 bool SeedTracker::empty() {
-    return seed_clusters_.empty();
+    return cluster_count_ == 0;
 }
 
 SeedCluster SeedTracker::get_final() {
     if (max_map_.total_len_ < PRMS.min_map_len || 
-        all_lens_.size() < 2) return NULL_ALN;
+        len_count_ < 2) return NULL_ALN;
 
-    float mean_len = len_sum_ / seed_clusters_.size();
-    float second_len = *std::next(all_lens_.rbegin());
+    float mean_len = len_sum_ / cluster_count_;
+    float second_len = second_len_;
 
     if (check_map_conf(max_map_.total_len_, mean_len, second_len)) {
 
@@ -147,33 +155,146 @@ SeedCluster SeedTracker::get_best() {
 }
 
 float SeedTracker::get_top_conf() {
-    return (float) max_map_.total_len_ / (*std::next(all_lens_.rbegin()));
+    return (float) max_map_.total_len_ / second_len_;
 }
 
 float SeedTracker::get_mean_conf() {
-    return max_map_.total_len_ / (len_sum_ / seed_clusters_.size());
+    return max_map_.total_len_ / (len_sum_ / cluster_count_);
+}
+
+SeedTracker::Pos SeedTracker::lower_bound(const SeedCluster &s) const {
+    //First block whose last cluster isn't less than s
+    u32 lo = 0, hi = nblocks_;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (blocks_[mid].back() < s) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    Pos p = {lo, 0};
+    if (valid(p)) {
+        const std::vector<SeedCluster> &b = blocks_[lo];
+        p.i = std::lower_bound(b.begin(), b.end(), s) - b.begin();
+    }
+    return p;
+}
+
+//Inserts s unless an equivalent cluster exists, same as std::set::insert
+//Sets p to the position of the new or existing cluster
+bool SeedTracker::insert(const SeedCluster &s, Pos &p) {
+    p = lower_bound(s);
+
+    if (valid(p)) {
+        if (!(s < at(p))) return false;
+    } else if (nblocks_ > 0) {
+        p.blk = nblocks_ - 1;
+        p.i = blocks_[p.blk].size();
+    } else {
+        if (blocks_.empty()) blocks_.emplace_back();
+        nblocks_ = 1;
+        p.blk = p.i = 0;
+    }
+
+    blocks_[p.blk].insert(blocks_[p.blk].begin() + p.i, s);
+
+    if (blocks_[p.blk].size() > BLOCK_MAX) {
+
+        //Rotate a spare block in after the full one and move half into it
+        if (nblocks_ == blocks_.size()) blocks_.emplace_back();
+        std::rotate(blocks_.begin() + p.blk + 1, 
+                    blocks_.begin() + nblocks_, 
+                    blocks_.begin() + nblocks_ + 1);
+        nblocks_++;
+
+        std::vector<SeedCluster> &full = blocks_[p.blk],
+                                 &spare = blocks_[p.blk+1];
+        u32 half = full.size() / 2;
+        spare.assign(full.begin() + half, full.end());
+        full.erase(full.begin() + half, full.end());
+
+        if (p.i >= half) {
+            p.blk++;
+            p.i -= half;
+        }
+    }
+
+    return true;
+}
+
+void SeedTracker::erase(Pos p) {
+    std::vector<SeedCluster> &b = blocks_[p.blk];
+    b.erase(b.begin() + p.i);
+
+    if (b.empty()) {
+        std::rotate(blocks_.begin() + p.blk, 
+                    blocks_.begin() + p.blk + 1, 
+                    blocks_.begin() + nblocks_);
+        nblocks_--;
+    }
+}
+
+//Removes clusters which haven't been extended for max_evt_gap events
+//They stay counted in the confidence stats, as if they were never removed
+void SeedTracker::expire(u32 evt) {
+    u32 gap = PRMS.max_evt_gap;
+
+    for (u32 b = 0; b < nblocks_; b++) {
+        std::vector<SeedCluster> &blk = blocks_[b];
+        blk.erase(std::remove_if(blk.begin(), blk.end(),
+                      [evt, gap](const SeedCluster &c) -> bool {
+                          return c.evt_en_ + gap < evt;
+                      }), blk.end());
+    }
+
+    auto end = std::stable_partition(blocks_.begin(), blocks_.begin() + nblocks_,
+                   [](const std::vector<SeedCluster> &b) -> bool {
+                       return !b.empty();
+                   });
+    nblocks_ = end - blocks_.begin();
+}
+
+//A cluster of length prev_len grew to new_len (prev_len = 0 for new clusters)
+void SeedTracker::update_lens(u32 prev_len, u32 new_len) {
+    if (prev_len == top_len_) {
+        top_len_ = new_len;
+    } else if (new_len > top_len_) {
+        second_len_ = top_len_;
+        top_len_ = new_len;
+    } else if (new_len > second_len_) {
+        second_len_ = new_len;
+    }
 }
 
 const SeedCluster &SeedTracker::add_seed(u64 ref_en, u32 ref_len, u32 evt_st) {
     SeedCluster new_seed(Range(ref_en-ref_len+1, ref_en), evt_st);
+
+    u64 e2 = new_seed.evt_en_, //new event loc
+        r2 = new_seed.ref_en_.start_; //new ref loc
+
+    if (PRMS.max_evt_gap > 0 && e2 >= next_sweep_) {
+        expire(e2);
+        next_sweep_ = e2 + PRMS.max_evt_gap;
+    }
     
     //Locations sorted by decreasing ref_en_.start
     //Find the largest loc s.t. loc->ref_en_.start <= new_seed.ref_en_.start
     //AKA r1 <= r2
-    auto loc = seed_clusters_.lower_bound(new_seed),
-         loc_match = seed_clusters_.end();
+    Pos loc = lower_bound(new_seed), loc_match = {0, 0};
+    bool matched = false;
 
-    u64 e2 = new_seed.evt_en_, //new event loc
-        r2 = new_seed.ref_en_.start_; //new ref loc
+    while (valid(loc)) {
+        const SeedCluster &c = at(loc);
 
-    while (loc != seed_clusters_.end()) {
-        u64 e1 = loc->evt_en_, //old event loc
-            r1 = loc->ref_en_.start_; //old ref loc
+        u64 e1 = c.evt_en_, //old event loc
+            r1 = c.ref_en_.start_; //old ref loc
 
         //We know r1 <= r2 because of location sort order
 
-        bool higher_sup = loc_match == seed_clusters_.end() 
-                       || loc_match->total_len_ < loc->total_len_,
+        bool higher_sup = !matched
+                       || at(loc_match).total_len_ < c.total_len_,
              
              in_range = e1 <= e2 && //event coord must increase
                         //r1 <= r2 &&
@@ -183,61 +304,60 @@ const SeedCluster &SeedTracker::add_seed(u64 ref_en, u32 ref_len, u32 evt_st) {
              
         if (higher_sup && in_range) {
             loc_match = loc;
+            matched = true;
         } else if (r2 - r1 >= e2) {
             break;
         }
 
-        loc++;
+        advance(loc);
     }
 
-    auto ret = seed_clusters_.end();
+    Pos ret;
 
     //If we find a matching seed cluster to join
-    if (loc_match != seed_clusters_.end()) {
-        SeedCluster a = *loc_match;
+    if (matched) {
+        SeedCluster a = at(loc_match);
 
         u32 prev_len = a.total_len_;
         a.update(new_seed);
 
         if (a.total_len_ != prev_len) {
             len_sum_ += a.total_len_ - prev_len;
-            auto l = all_lens_.find(prev_len);
-            all_lens_.insert(l, a.total_len_);
-            all_lens_.erase(l);
+            update_lens(prev_len, a.total_len_);
 
             if (a.total_len_ >= PRMS.min_map_len && a.total_len_ > max_map_.total_len_) {
                 max_map_ = a;
             }
         }
 
-        auto hint = std::next(loc_match);
-        seed_clusters_.erase(loc_match);
-        ret = seed_clusters_.insert(hint, a);
+        erase(loc_match);
+        if (!insert(a, ret)) cluster_count_--;
     } else {
 
-        all_lens_.insert(new_seed.total_len_);
+        len_count_++;
+        update_lens(0, new_seed.total_len_);
         len_sum_ += new_seed.total_len_;
 
         if (new_seed.total_len_ >= PRMS.min_map_len && new_seed.total_len_ > max_map_.total_len_) {
             max_map_ = new_seed;
         }
 
-        #ifdef DEBUG_SEEDS
-        new_seed.id_ = static_cast<u32>(seed_clusters_.size());
-        #endif
-        ret = seed_clusters_.insert(new_seed).first;
+        new_seed.id_ = cluster_count_;
+        if (insert(new_seed, ret)) cluster_count_++;
     }
 
-    return *ret;
+    return at(ret);
 }
 
 void SeedTracker::print(std::ostream &out, u16 max_out = 10) {
-    if (seed_clusters_.empty()) {
-        return;
+    std::vector<SeedCluster> seeds_sort;
+    for (u32 b = 0; b < nblocks_; b++) {
+        seeds_sort.insert(seeds_sort.end(), blocks_[b].begin(), blocks_[b].end());
     }
 
-    std::vector<SeedCluster> seeds_sort(seed_clusters_.begin(),
-                                     seed_clusters_.end());
+    if (seeds_sort.empty()) {
+        return;
+    }
 
     std::sort(seeds_sort.begin(), seeds_sort.end(),
               [](const SeedCluster &a, const SeedCluster &b) -> bool {
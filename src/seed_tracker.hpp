@@ -24,7 +24,6 @@
 #ifndef _INCL_READ_SEED_TRACKER
 #define _INCL_READ_SEED_TRACKER
 
-#include <set>
 #include <vector>
 #include <iostream>
 #include <algorithm>
@@ -47,9 +46,8 @@ class SeedCluster {
         evt_en_,
         total_len_;
 
-    #ifdef DEBUG_SEEDS
+    //Order the cluster was created in, for debug output and ReadTracer
     u32 id_;
-    #endif
 
     SeedCluster(Range ref_st, u32 evt_st);
     //SeedCluster(const SeedCluster &r);
@@ -76,17 +74,62 @@ class SeedTracker {
         u32 min_map_len;
         float min_mean_conf;
         float min_top_conf;
+        u32 max_evt_gap;
     } Params;
     static const Params PRMS_DEF;
 
     Params PRMS;
 
-    std::set<SeedCluster> seed_clusters_;
-    std::multiset<u32> all_lens_;
     SeedCluster max_map_;
 
     float len_sum_;
 
+    private:
+
+    //Clusters in set order (decreasing ref_en_.start_, then evt_en_),
+    //split into sorted blocks so inserts and erases only shift one block.
+    //Blocks past nblocks_ are emptied but kept allocated for reuse
+    static const u32 BLOCK_MAX = 64;
+    std::vector< std::vector<SeedCluster> > blocks_;
+    u32 nblocks_;
+
+    struct Pos {
+        u32 blk, i;
+    };
+
+    //Number of clusters std::set would hold, including expired clusters
+    u32 cluster_count_;
+
+    //Replaces a multiset of every cluster length: lengths only grow,
+    //so the top two can be maintained as clusters are updated
+    u32 len_count_, top_len_, second_len_;
+
+    //Event index of the next expiry sweep
+    u32 next_sweep_;
+
+    Pos lower_bound(const SeedCluster &s) const;
+    bool insert(const SeedCluster &s, Pos &p);
+    void erase(Pos p);
+    void expire(u32 evt);
+    void update_lens(u32 prev_len, u32 new_len);
+
+    bool valid(Pos p) const {
+        return p.blk < nblocks_;
+    }
+
+    const SeedCluster &at(Pos p) const {
+        return blocks_[p.blk][p.i];
+    }
+
+    void advance(Pos &p) const {
+        if (++p.i == blocks_[p.blk].size()) {
+            p.blk++;
+            p.i = 0;
+        }
+    }
+
+    public:
+
     SeedTracker();
     SeedTracker(Params params);
 
@@ -98,6 +141,23 @@ class SeedTracker {
     float get_mean_conf();
     bool empty();
 
+    //Length of the longest cluster, even if below min_map_len
+    u32 get_top_len() const {
+        return top_len_;
+    }
+
+    //Length of the longest cluster for which pred returns true
+    template <typename F>
+    u32 max_len_where(F pred) const {
+        u32 ret = 0;
+        for (u32 b = 0; b < nblocks_; b++) {
+            for (const SeedCluster &c : blocks_[b]) {
+                if (c.total_len_ > ret && pred(c)) ret = c.total_len_;
+            }
+        }
+        return ret;
+    }
+
     void reset();
 
     std::vector<SeedCluster> get_alignments(u8 min_len);
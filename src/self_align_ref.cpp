@@ -25,6 +25,9 @@
 #include <string>
 #include <list>
 #include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <random>
 #include "range.hpp"
 #include "bwa_index.hpp"
 #include "self_align_ref.hpp"
@@ -36,7 +39,7 @@ std::vector< std::vector<u64> > self_align(const std::string &bwa_prefix,
 
     srand(0);
 
-    BwaIndex<KLEN> fmi(bwa_prefix);
+    BwaIndex<KLEN> fmi(bwa_prefix, false, true);
 
     //std::vector< std::vector<u8> > seqs;
     //std::ifstream fasta_in(fasta_fname);
@@ -87,6 +90,119 @@ std::vector< std::vector<u64> > self_align(const std::string &bwa_prefix,
         st += len;
     }
 
+    fmi.destroy();
+
     return ret;
 }
 
+SelfAlignStats::SelfAlignStats(u32 kmer_len_, u32 max_len_) 
+    : kmer_len(std::max(kmer_len_, 1u)),
+      max_len(max_len_),
+      len_counts(),
+      fm_counts(FM_BINS * max_len_, 0) {}
+
+void SelfAlignStats::add_path(const std::vector<u64> &fmlens) {
+    u32 trim = kmer_len - 1;
+
+    if (fmlens.size() <= trim) {
+        if (len_counts.size() < 2) len_counts.resize(2, 0);
+        len_counts[1]++;
+        if (max_len > 0) fm_counts[0]++;
+        return;
+    }
+
+    u64 len = fmlens.size() - trim;
+    if (len_counts.size() <= len) len_counts.resize(len+1, 0);
+    len_counts[len]++;
+
+    for (u32 i = 0; i < len && i < max_len; i++) {
+        u32 b = 63 - __builtin_clzll(fmlens[trim+i]);
+        fm_counts[b * max_len + i]++;
+    }
+}
+
+void SelfAlignStats::merge(const SelfAlignStats &s) {
+    if (len_counts.size() < s.len_counts.size()) {
+        len_counts.resize(s.len_counts.size(), 0);
+    }
+    for (u64 l = 0; l < s.len_counts.size(); l++) {
+        len_counts[l] += s.len_counts[l];
+    }
+    for (u64 i = 0; i < fm_counts.size() && i < s.fm_counts.size(); i++) {
+        fm_counts[i] += s.fm_counts[i];
+    }
+}
+
+SelfAlignStats self_align_stats(const std::string &bwa_prefix, 
+                                u32 sample_dist, 
+                                u32 kmer_len, u32 max_len,
+                                u16 threads, u32 seed) {
+
+    const u64 BLOCK_LEN = 1 << 20;
+
+    BwaIndex<KLEN> fmi(bwa_prefix, false, true);
+    fmi.load_pacseq();
+
+    //Start and end pacseq coordinates of each block, and of its sequence
+    struct Block {u64 st, en, seq_en;};
+    std::vector<Block> blocks;
+
+    u64 seq_st = 0;
+    for (auto s : fmi.get_seqs()) {
+        u64 seq_en = seq_st + s.second;
+        for (u64 st = seq_st; st < seq_en; st += BLOCK_LEN) {
+            blocks.push_back({st, std::min(st + BLOCK_LEN, seq_en), seq_en});
+        }
+        seq_st = seq_en;
+    }
+
+    threads = std::max<u16>(threads, 1);
+    std::vector<SelfAlignStats> stats(threads, SelfAlignStats(kmer_len, max_len));
+    std::atomic<u64> next_block(0);
+
+    auto run = [&](SelfAlignStats &out) {
+        std::vector<u64> fmlens;
+
+        //Gap between samples, so each base is sampled with p = 1/sample_dist
+        std::geometric_distribution<u64> gap(1.0 / std::max(sample_dist, 1u));
+
+        for (u64 b = next_block++; b < blocks.size(); b = next_block++) {
+            const Block &blk = blocks[b];
+            std::seed_seq ss {seed, u32(b), u32(b >> 32)};
+            std::mt19937_64 rng(ss);
+            gap.reset();
+
+            for (u64 i = blk.st + gap(rng); i < blk.en; i += gap(rng) + 1) {
+                fmlens.clear();
+
+                Range r = fmi.get_base_range(BASE_COMP_B[fmi.get_base(i)]);
+                for (u64 j = i+1; j < blk.seq_en && r.length() > 1; j++) {
+                    fmlens.push_back(r.length());
+                    r = fmi.get_neighbor(r, BASE_COMP_B[fmi.get_base(j)]);
+                }
+
+                //Happens on Ns
+                if (r.length() > 0) {
+                    fmlens.push_back(r.length());
+                }
+
+                out.add_path(fmlens);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (u16 t = 1; t < threads; t++) {
+        pool.emplace_back(run, std::ref(stats[t]));
+    }
+    run(stats[0]);
+
+    for (u16 t = 1; t < threads; t++) {
+        pool[t-1].join();
+        stats[0].merge(stats[t]);
+    }
+
+    fmi.destroy();
+
+    return stats[0];
+}
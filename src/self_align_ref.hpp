@@ -28,7 +28,55 @@
 #include <string>
 #include "util.hpp"
 
+#ifdef PYBIND
+#include "pybind11/numpy.h"
+#endif
+
 std::vector< std::vector<u64> > self_align(const std::string &bwa_prefix,
                                          u32 sample_dist);
 
+//Summary of self-alignment paths, used to compute index parameters
+//Paths are trimmed by kmer_len-1 FM ranges like k-mer paths, and paths
+//shorter than kmer_len count as one range of length 1
+struct SelfAlignStats {
+    static const u32 FM_BINS = 64;
+
+    u32 kmer_len, max_len;
+
+    //len_counts[l] is the number of paths with l FM ranges
+    std::vector<u64> len_counts;
+
+    //fm_counts[b*max_len + i] is the number of paths whose i'th FM range
+    //length has floor(log2) = b, for i < max_len
+    std::vector<u64> fm_counts;
+
+    SelfAlignStats(u32 kmer_len, u32 max_len);
+
+    void add_path(const std::vector<u64> &fmlens);
+    void merge(const SelfAlignStats &s);
+
+    #ifdef PYBIND
+
+    static void pybind_defs(pybind11::class_<SelfAlignStats> &c) {
+        c.def_readonly("kmer_len", &SelfAlignStats::kmer_len);
+        c.def_readonly("max_len", &SelfAlignStats::max_len);
+        c.def_property_readonly("len_counts", [](SelfAlignStats &s) {
+            return pybind11::array_t<u64>(s.len_counts.size(), s.len_counts.data());
+        });
+        c.def_property_readonly("fm_counts", [](SelfAlignStats &s) {
+            return pybind11::array_t<u64>({FM_BINS, s.max_len}, s.fm_counts.data());
+        });
+    }
+
+    #endif
+};
+
+//Parallel self_align which only keeps SelfAlignStats
+//The reference is split into fixed blocks sampled with their own RNG 
+//streams, so results only depend on the seed and not the thread count
+SelfAlignStats self_align_stats(const std::string &bwa_prefix, 
+                                u32 sample_dist, 
+                                u32 kmer_len, u32 max_len,
+                                u16 threads, u32 seed);
+
 #endif
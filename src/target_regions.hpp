@@ -0,0 +1,119 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INCL_TARGET_REGIONS
+#define _INCL_TARGET_REGIONS
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include "util.hpp"
+
+//Regions loaded from a BED file, stored as sorted and merged half-open 
+//intervals of concatenated reference (pac) coordinates
+class TargetRegions {
+    public:
+
+    TargetRegions() {}
+
+    bool empty() const {
+        return intvs_.empty();
+    }
+
+    u32 size() const {
+        return intvs_.size();
+    }
+
+    //offsets maps each reference name to its pac offset
+    //Names not in the index are skipped with a warning
+    bool load_bed(const std::string &fname, 
+                  const std::unordered_map<std::string, u64> &offsets) {
+        std::ifstream in(fname);
+        if (!in.is_open()) {
+            std::cerr << "Error: failed to open target BED \"" << fname << "\"\n";
+            return false;
+        }
+
+        intvs_.clear();
+
+        std::string line, name;
+        u64 st, en;
+        u32 missing = 0;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#' || 
+                line.compare(0, 5, "track") == 0 || 
+                line.compare(0, 7, "browser") == 0) continue;
+
+            std::istringstream fields(line);
+            if (!(fields >> name >> st >> en) || en <= st) {
+                std::cerr << "Warning: skipping invalid BED line \"" << line << "\"\n";
+                continue;
+            }
+
+            auto o = offsets.find(name);
+            if (o == offsets.end()) {
+                missing++;
+                continue;
+            }
+
+            intvs_.push_back({o->second + st, o->second + en});
+        }
+
+        if (missing > 0) {
+            std::cerr << "Warning: " << missing 
+                      << " target regions are on references not in the index\n";
+        }
+
+        std::sort(intvs_.begin(), intvs_.end());
+
+        //Merge overlapping and adjacent regions
+        u32 n = 0;
+        for (u32 i = 0; i < intvs_.size(); i++) {
+            if (n > 0 && intvs_[i].first <= intvs_[n-1].second) {
+                intvs_[n-1].second = std::max(intvs_[n-1].second, intvs_[i].second);
+            } else {
+                intvs_[n++] = intvs_[i];
+            }
+        }
+        intvs_.resize(n);
+
+        return true;
+    }
+
+    //True if [st, en) overlaps any region
+    bool overlaps(u64 st, u64 en) const {
+        auto i = std::upper_bound(intvs_.begin(), intvs_.end(), 
+                                  std::make_pair(st, UINT64_MAX));
+        if (i != intvs_.begin() && (i-1)->second > st) return true;
+        return i != intvs_.end() && i->first < en;
+    }
+
+    private:
+    std::vector< std::pair<u64, u64> > intvs_;
+};
+
+#endif
@@ -36,6 +36,26 @@ typedef struct {
     float duration;
 
     u32 max_active_reads;
+
+    //Unblock/stop actions are held until action_batch are queued or 
+    //action_interval ms pass since the first one
+    float action_interval;
+    u32 action_batch;
+
+    //Schedule channels by pore time left before max_chunks, abandoning 
+    //reads more than abandon_time ms late if it's above zero
+    bool deadline_sched;
+    float abandon_time;
+
+    //If tune_latency is above zero, every tune_interval ms the Autotuner
+    //adjusts max_active_reads, evt_batch_size, evt_timeout and chunk_timeout
+    //within the tune_* bounds to hold the 90th percentile time from read start to 
+    //decision near tune_latency ms. Device 0's settings apply to the pool
+    float tune_latency, tune_interval;
+    u32 tune_active_min, tune_active_max;
+    u16 tune_batch_min, tune_batch_max;
+    float tune_timeout_min, tune_timeout_max;
+    float tune_chunk_timeout_min, tune_chunk_timeout_max;
 } RealtimeParams;
 
 const RealtimeParams REALTIME_PRMS_DEF = {
@@ -44,13 +64,36 @@ const RealtimeParams REALTIME_PRMS_DEF = {
     host             : "127.0.0.1",
     port             : 8000,
     duration         : 72,
-    max_active_reads : 512
+    max_active_reads : 512,
+    action_interval  : 0,
+    action_batch     : 0,
+    deadline_sched   : false,
+    abandon_time     : 0,
+    tune_latency     : 0,
+    tune_interval    : 2000,
+    tune_active_min  : 32,
+    tune_active_max  : 4096,
+    tune_batch_min   : 1,
+    tune_batch_max   : 20,
+    tune_timeout_min : 1,
+    tune_timeout_max : 50,
+    tune_chunk_timeout_min : 1000,
+    tune_chunk_timeout_max : 8000
 };
 
 typedef struct {
     std::string ctl_seqsum, unc_seqsum, unc_paf;
     float sim_speed, scan_time, scan_intv_time, ej_time;
     u32 min_ch_reads;
+
+    //Index reads instead of preloading them, loading each read when its
+    //channel reaches it and releasing it after
+    bool stream_reads;
+
+    //Advance simulated time by clock_step seconds each time advance is 
+    //called, instead of with wall time
+    bool fast_clock;
+    float clock_step;
 } SimParams;
 
 const SimParams SIM_PRMS_DEF = {
@@ -61,7 +104,10 @@ const SimParams SIM_PRMS_DEF = {
     scan_time      : 10,
     scan_intv_time : 10.0,
     ej_time        : 5400.0,
-    min_ch_reads   : 0 //TODO is this needed?
+    min_ch_reads   : 0, //TODO is this needed?
+    stream_reads   : false,
+    fast_clock     : false,
+    clock_step     : 0.1
 };
 
 typedef struct {
@@ -72,4 +118,51 @@ const MapOrdParams MAP_ORD_PRMS_DEF = {
     min_active_reads : 0
 };
 
+typedef struct {
+    //PAF output file, stdout if empty
+    std::string paf_out;
+
+    //Write binary records instead of PAF text, see PafWriter
+    bool paf_binary;
+
+    //Bytes the PAF writer buffers before each write
+    u32 paf_buffer;
+
+    //Log of finished reads and files, see ReadCheckpoint
+    std::string checkpoint;
+
+    //Skip what the checkpoint lists and append to paf_out
+    bool resume;
+} OutputParams;
+
+const OutputParams OUTPUT_PRMS_DEF = {
+    paf_out    : "",
+    paf_binary : false,
+    paf_buffer : 1 << 20,
+    checkpoint : "",
+    resume     : false
+};
+
+typedef struct {
+    //"host:port" of a DistCoordinator to map files from, as a worker
+    std::string dist_coord;
+
+    //Port the coordinator listens on
+    u16 dist_port;
+
+    //Give idle workers a second copy of the slowest file at the end
+    bool dist_backup;
+
+    //Most files handed out past the first unwritten one, limiting how
+    //many files' results are held for ordered output. 0 for no limit
+    u32 dist_window;
+} DistParams;
+
+const DistParams DIST_PRMS_DEF = {
+    dist_coord  : "",
+    dist_port   : 7381,
+    dist_backup : true,
+    dist_window : 64
+};
+
 #endif
@@ -0,0 +1,441 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+//Microbenchmarks for the mapping hot path
+//
+//  make bench
+//  cd example && ../bin/uncalled_bench index/example_ref fast5_filename.txt
+//
+//Each benchmark is repeated (-r) and the fastest repetition is reported,
+//using fixed random seeds so runs are comparable between versions.
+//-j prints JSON instead of a table, -b NAME runs only benchmarks
+//whose name starts with NAME
+//
+//-c instead checks the SIMD k-mer scoring against scalar match_prob,
+//needing no index or reads, and exits non-zero on a mismatch
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <random>
+#include <unistd.h>
+#include "conf.hpp"
+#include "mapper.hpp"
+#include "fast5_reader.hpp"
+
+typedef struct {
+    std::string name, unit;
+    u64 ops;
+    double ns_per_op;
+} BenchResult;
+
+class Bench {
+    public:
+
+    Bench(u32 reps, const std::string &filter) 
+        : reps_(reps), filter_(filter) {}
+
+    bool enabled(const std::string &name) const {
+        return name.compare(0, filter_.size(), filter_) == 0;
+    }
+
+    //Runs fn() reps_ times, recording the fastest
+    //fn performs ops operations of the given unit
+    template <typename F>
+    void run(const std::string &name, const std::string &unit, u64 ops, F fn) {
+        if (!enabled(name) || ops == 0) return;
+
+        double best = 0;
+        Timer t;
+        for (u32 r = 0; r < reps_; r++) {
+            t.reset();
+            fn();
+            double ms = t.get();
+            if (r == 0 || ms < best) best = ms;
+        }
+
+        results_.push_back({name, unit, ops, best * 1e6 / ops});
+        std::cerr << "# " << name << " done\n";
+    }
+
+    void print_table(std::ostream &out) const {
+        out << std::left << std::setw(28) << "benchmark"
+            << std::right << std::setw(12) << "ops"
+            << std::setw(14) << "ns/op"
+            << std::setw(16) << "per sec" << "\n";
+
+        for (const BenchResult &b : results_) {
+            out << std::left << std::setw(28) << b.name
+                << std::right << std::setw(12) << b.ops
+                << std::setw(14) << std::fixed << std::setprecision(2) << b.ns_per_op
+                << std::setw(16) << std::setprecision(0) << (1e9 / b.ns_per_op)
+                << " " << b.unit << "/s\n";
+        }
+    }
+
+    void print_json(std::ostream &out) const {
+        out << "{\"reps\": " << reps_ << ", \"benchmarks\": [";
+        for (u32 i = 0; i < results_.size(); i++) {
+            const BenchResult &b = results_[i];
+            out << (i > 0 ? ", " : "") << "\n  {"
+                << "\"name\": \"" << b.name << "\", "
+                << "\"unit\": \"" << b.unit << "\", "
+                << "\"ops\": " << b.ops << ", "
+                << std::setprecision(6)
+                << "\"ns_per_op\": " << b.ns_per_op << ", "
+                << "\"per_sec\": " << (1e9 / b.ns_per_op) << "}";
+        }
+        out << "\n]}\n";
+    }
+
+    private:
+    u32 reps_;
+    std::string filter_;
+    std::vector<BenchResult> results_;
+};
+
+//Prevents the compiler from discarding benchmark results
+static volatile float sink_;
+
+//Compares match_probs at every SIMD level the CPU supports, and the 
+//sparse candidates, to match_prob over random events and thresholds.
+//Probabilities must agree within PROB_TOL relative to their magnitude,
+//and k-mers must be selected the same way unless within PROB_TOL of
+//the threshold
+static bool check_match_probs(const PoreModel<KLEN> &model) {
+    typedef PoreModel<KLEN> Model;
+    const u32 NEVTS = 20000;
+    const float PROB_TOL = 1e-4;
+    const char *LEVEL_NAMES[] = {"scalar", "avx2", "avx512"};
+
+    u32 nkmers = kmer_count<KLEN>();
+    std::mt19937 rng(0);
+    std::normal_distribution<float> evt_dist(model.get_means_mean(), 
+                                             2 * model.get_means_stdv());
+    std::uniform_real_distribution<float> thresh_dist(-12, 0);
+
+    std::vector<float> evts(NEVTS), threshes(NEVTS);
+    for (u32 i = 0; i < NEVTS; i++) {
+        evts[i] = evt_dist(rng);
+        threshes[i] = thresh_dist(rng);
+    }
+
+    auto tol = [&](float ref) {
+        return PROB_TOL * std::max(1.0f, std::fabs(ref));
+    };
+
+    std::vector<float> ref(nkmers);
+    AlignedVec<float> probs(nkmers);
+    std::vector<u64> mask((nkmers + 63) / 64);
+    std::vector<Model::kmer_t> cands;
+    std::vector<bool> is_cand(nkmers);
+
+    bool ok = true;
+    for (u32 l = Model::SCALAR; l <= Model::AVX512; l++) {
+        auto level = (typename Model::SimdLevel) l;
+        if (!Model::simd_supported(level)) continue;
+
+        u64 bad_probs = 0, bad_mask = 0;
+        float max_err = 0;
+        for (u32 i = 0; i < NEVTS; i++) {
+            for (u32 k = 0; k < nkmers; k++) ref[k] = model.match_prob(evts[i], k);
+
+            model.match_probs_at(level, evts[i], probs.data(), threshes[i], mask.data());
+            for (u32 k = 0; k < nkmers; k++) {
+                float err = std::fabs(probs[k] - ref[k]);
+                max_err = std::max(max_err, err / std::max(1.0f, std::fabs(ref[k])));
+                if (err > tol(ref[k])) bad_probs++;
+
+                bool bit = (mask[k >> 6] >> (k & 63)) & 1;
+                if (bit != (probs[k] >= threshes[i]) ||
+                    (std::fabs(ref[k] - threshes[i]) > tol(ref[k]) && 
+                     bit != (ref[k] >= threshes[i]))) {
+                    bad_mask++;
+                }
+            }
+        }
+
+        std::cout << "match_probs " << LEVEL_NAMES[l] << ": max relative error " 
+                  << max_err << ", " << bad_probs << " probs and " << bad_mask 
+                  << " mask bits out of tolerance\n";
+        ok = ok && bad_probs == 0 && bad_mask == 0;
+    }
+
+    u64 bad_cands = 0;
+    for (u32 i = 0; i < NEVTS; i++) {
+        cands.clear();
+        model.candidates(evts[i], threshes[i], cands, probs.data());
+        std::fill(is_cand.begin(), is_cand.end(), false);
+        for (auto k : cands) {
+            is_cand[k] = true;
+            if (std::fabs(probs[k] - model.match_prob(evts[i], k)) > 
+                tol(model.match_prob(evts[i], k))) bad_cands++;
+        }
+        for (u32 k = 0; k < nkmers; k++) {
+            float p = model.match_prob(evts[i], k);
+            if (std::fabs(p - threshes[i]) > tol(p) && is_cand[k] != (p >= threshes[i])) {
+                bad_cands++;
+            }
+        }
+    }
+    std::cout << "candidates: " << bad_cands << " k-mers out of tolerance\n";
+
+    return ok && bad_cands == 0;
+}
+
+int main(int argc, char** argv) {
+    u32 reps = 5;
+    bool json = false, check = false;
+    std::string filter;
+
+    int opt;
+    while((opt = getopt(argc, argv, "r:b:jc")) != -1) {
+        switch(opt) {  
+            case 'r':
+                reps = atoi(optarg);
+                break;
+            case 'b':
+                filter = optarg;
+                break;
+            case 'j':
+                json = true;
+                break;
+            case 'c':
+                check = true;
+                break;
+            default:
+                std::cerr << "Error: unknown flag\n";
+                return 1;
+        }
+    }
+
+    if (check) {
+        if (!Mapper::model.is_loaded()) {
+            std::cerr << "Error: no built-in " << (u32) KLEN << "-mer pore model\n";
+            return 1;
+        }
+        return check_match_probs(Mapper::model) ? 0 : 1;
+    }
+
+    if (argc - optind < 2) {
+        std::cerr << "Usage: uncalled_bench [-j] [-r reps] [-b name] "
+                  << "bwa_prefix fast5_list\n"
+                  << "       uncalled_bench -c\n";
+        return 1;
+    }
+
+    Conf conf;
+    conf.set_bwa_prefix(argv[optind]);
+    conf.set_fast5_list(argv[optind+1]);
+
+    Fast5Reader fast5s(conf.fast5_prms);
+    std::vector<ReadBuffer> reads;
+    while (!fast5s.empty()) {
+        reads.push_back(fast5s.pop_read());
+    }
+
+    if (reads.empty()) {
+        std::cerr << "Error: no reads loaded\n";
+        return 1;
+    }
+
+    std::cerr << "Loading index\n";
+    Mapper mapper;
+
+    Bench bench(reps, filter);
+    std::mt19937 rng(0);
+
+    //Signal and events shared by several benchmarks
+    std::vector<float> signal;
+    for (const ReadBuffer &r : reads) {
+        signal.insert(signal.end(), r.get_raw().begin(), r.get_raw().end());
+    }
+
+    EventDetector evdt(Mapper::PRMS.event_prms);
+    std::vector<Event> events = evdt.get_events(signal);
+
+    Normalizer norm(Mapper::PRMS.norm_prms);
+    norm.set_signal(evdt.get_means(signal));
+    std::vector<float> norm_means;
+    while (!norm.empty()) norm_means.push_back(norm.pop());
+
+    bench.run("event_detector.add_sample", "samples", signal.size(), [&] {
+        evdt.reset();
+        u32 n = 0;
+        for (float s : signal) n += evdt.add_sample(s);
+        sink_ = n;
+    });
+
+    bench.run("event_detector.add_samples", "samples", signal.size(), [&] {
+        std::vector<Event> out;
+        evdt.reset();
+        evdt.add_samples(signal.data(), signal.size(), out);
+        sink_ = out.size();
+    });
+
+    bench.run("normalizer.push_pop", "events", events.size(), [&] {
+        Normalizer n(Mapper::PRMS.norm_prms);
+        float sum = 0;
+        for (const Event &e : events) {
+            if (!n.push(e.mean)) n.skip_unread();
+            sum += n.pop();
+        }
+        sink_ = sum;
+    });
+
+    u32 nkmers = kmer_count<KLEN>();
+    u64 nprobs = (u64) norm_means.size() * nkmers;
+
+    bench.run("pore_model.match_prob", "probs", nprobs, [&] {
+        float sum = 0;
+        for (float e : norm_means) {
+            for (u32 k = 0; k < nkmers; k++) sum += Mapper::model.match_prob(e, k);
+        }
+        sink_ = sum;
+    });
+
+    bench.run("pore_model.match_probs", "probs", nprobs, [&] {
+        AlignedVec<float> probs(nkmers);
+        float sum = 0;
+        for (float e : norm_means) {
+            Mapper::model.match_probs(e, probs.data());
+            sum += probs[e > 0 ? nkmers-1 : 0];
+        }
+        sink_ = sum;
+    });
+
+    //Random walk extending ranges, restarting when a range empties
+    const u32 NBASES = 1000000;
+    std::vector<u8> bases(NBASES);
+    for (u8 &b : bases) b = rng() % BASE_COUNT;
+
+    bench.run("bwa_index.get_neighbor", "calls", NBASES, [&] {
+        Range r = Mapper::fmi.get_base_range(bases[0]);
+        u64 sum = 0;
+        for (u32 i = 1; i < NBASES; i++) {
+            r = Mapper::fmi.get_neighbor(r, bases[i]);
+            if (!r.is_valid()) r = Mapper::fmi.get_base_range(bases[i]);
+            sum += r.start_;
+        }
+        sink_ = sum;
+    });
+
+    //Random k-mers extended to the k-mer extension table length, like new
+    //paths in their first events. Skipped if the index has no table
+    u8 ext_len = Mapper::fmi.kmer_ext_len();
+    const u32 NEXTS = 100000;
+    std::vector<u32> ext_seqs(NEXTS);
+    for (u32 &s : ext_seqs) s = rng() & ((1ULL << (2 * ext_len)) - 1);
+    u64 ext_steps = (u64) NEXTS * (ext_len - KLEN);
+
+    bench.run("bwa_index.extend.neighbors", "steps", ext_steps, [&] {
+        Range next[BASE_COUNT];
+        u64 sum = 0;
+        for (u32 s : ext_seqs) {
+            Range r = Mapper::fmi.get_kmer_range(s >> (2 * (ext_len - KLEN)));
+            for (u8 l = KLEN; l < ext_len && r.is_valid(); l++) {
+                Mapper::fmi.get_neighbors(r, next);
+                r = next[(s >> (2 * (ext_len - l - 1))) & 3];
+            }
+            sum += r.start_;
+        }
+        sink_ = sum;
+    });
+
+    bench.run("bwa_index.extend.table", "steps", ext_steps, [&] {
+        Range next[BASE_COUNT];
+        u64 sum = 0;
+        for (u32 s : ext_seqs) {
+            u32 seq = s >> (2 * (ext_len - KLEN));
+            Range r = Mapper::fmi.get_kmer_range(seq);
+            for (u8 l = KLEN; l < ext_len && r.is_valid(); l++) {
+                u8 b = (s >> (2 * (ext_len - l - 1))) & 3;
+                Mapper::fmi.get_extensions(seq, l, next);
+                r = next[b];
+                seq = (seq << 2) | b;
+            }
+            sum += r.start_;
+        }
+        sink_ = sum;
+    });
+
+    const u32 NROWS = 100000;
+    std::vector<u64> rows(NROWS);
+    for (u64 &i : rows) i = rng() % Mapper::fmi.size();
+
+    bench.run("bwa_index.sa", "rows", NROWS, [&] {
+        u64 sum = 0;
+        for (u64 i : rows) sum += Mapper::fmi.sa(i);
+        sink_ = sum;
+    });
+
+    //Seeds from a few consistent clusters plus noise, as on a mappable read
+    const u32 NSEEDS = 200000, SEEDS_PER_READ = 2000;
+    std::vector<u64> seed_refs(NSEEDS);
+    for (u32 i = 0; i < NSEEDS; i++) {
+        u32 evt = i % SEEDS_PER_READ;
+        seed_refs[i] = (rng() % 4 == 0) ? 
+                       rng() % Mapper::fmi.size() : 
+                       (rng() % 4) * 100000 + evt / 2;
+    }
+
+    bench.run("seed_tracker.add_seed", "seeds", NSEEDS, [&] {
+        SeedTracker tracker(Mapper::PRMS.seed_prms);
+        u32 sum = 0;
+        for (u32 i = 0; i < NSEEDS; i++) {
+            if (i % SEEDS_PER_READ == 0) tracker.reset();
+            u32 evt = i % SEEDS_PER_READ;
+            sum += tracker.add_seed(seed_refs[i], Mapper::PRMS.seed_len, evt).total_len_;
+        }
+        sink_ = sum;
+    });
+
+    //Whole reads, timed both per read and per event
+    u64 nevents = 0;
+    if (bench.enabled("mapper.map_read")) {
+        for (ReadBuffer r : reads) {
+            mapper.new_read(r);
+            mapper.map_read();
+            nevents += mapper.events_mapped();
+        }
+    }
+
+    auto map_reads = [&] {
+        for (ReadBuffer r : reads) {
+            mapper.new_read(r);
+            mapper.map_read();
+        }
+    };
+
+    bench.run("mapper.map_read", "reads", reads.size(), map_reads);
+    bench.run("mapper.map_read.events", "events", nevents, map_reads);
+
+    if (json) {
+        bench.print_json(std::cout);
+    } else {
+        bench.print_table(std::cout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include <memory>
+#include "conf.hpp"
+#include "paf_writer.hpp"
+#include "dist_coordinator.hpp"
+
+bool load_conf(int argc, char** argv, Conf &conf);
+
+int main(int argc, char** argv) {
+    Conf conf;
+
+    if (!load_conf(argc, argv, conf)) {
+        return 1;
+    }
+
+    std::unique_ptr<ReadCheckpoint> checkpoint;
+    if (!conf.output_prms.checkpoint.empty()) {
+        checkpoint.reset(new ReadCheckpoint(conf.output_prms.checkpoint, 
+                                            conf.output_prms.resume));
+    } else if (conf.output_prms.resume) {
+        std::cerr << "Error: must specify a checkpoint (-k) to resume\n";
+        return 1;
+    }
+
+    PafWriter out(conf.output_prms, checkpoint.get());
+    DistCoordinator coord(conf.dist_prms, out, checkpoint.get());
+
+    if (!coord.load_fast5_list(conf.fast5_prms.fast5_list) || !coord.start()) {
+        return 1;
+    }
+
+    std::cerr << "Serving " << coord.file_count() << " files on port " 
+              << conf.dist_prms.dist_port << "\n";
+
+    double STATUS_INTERVAL = 10000;
+
+    Timer t;
+    double last_status = 0;
+
+    while (coord.running()) {
+        coord.update(100);
+
+        if (t.get() - last_status >= STATUS_INTERVAL) {
+            std::cerr << coord.written_count() << "/" << coord.file_count() 
+                      << " files written, " << coord.worker_count() 
+                      << " workers\n";
+            last_status = t.get();
+        }
+    }
+
+    std::cerr << "Finishing\n";
+
+    coord.stop();
+    out.close();
+}
+
+#define FLAG_TO_CONF(C, T, F) { \
+    case C: \
+        conf.set_##F(T(optarg)); \
+        break; \
+}
+
+#define POSITIONAL_TO_CONF(T, F) {\
+    if (i < argc) { \
+        conf.set_##F(T(argv[i])); \
+        i++; \
+    } else { \
+        std::cerr << "Error: must specify " << #F << "\n"; \
+        return false; \
+    } \
+}
+
+bool load_conf(int argc, char** argv, Conf &conf) {
+    int opt;
+    std::string flagstr = ":p:o:k:w:BRX";
+
+    while((opt = getopt(argc, argv, flagstr.c_str())) != -1) {
+
+        switch(opt) {  
+
+            FLAG_TO_CONF('p', atoi, dist_port)
+            FLAG_TO_CONF('o', std::string, paf_out)
+            FLAG_TO_CONF('k', std::string, checkpoint)
+            FLAG_TO_CONF('w', atoi, dist_window)
+
+            case 'B':
+                conf.set_paf_binary(true);
+                break;
+
+            case 'R':
+                conf.set_resume(true);
+                break;
+
+            case 'X':
+                conf.set_dist_backup(false);
+                break;
+
+            case ':':  
+            std::cerr << "Error: failed to load flag value\n";  
+            return false;
+
+            case '?':  
+            std::cerr << "Error: unknown flag\n";  
+            return false;
+        }
+    }
+
+    //parse positionals
+    int i = optind;
+
+    POSITIONAL_TO_CONF(std::string, fast5_list)
+
+    return true;
+}
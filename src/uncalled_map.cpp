@@ -1,9 +1,13 @@
 #include <iostream>
 #include <cstdlib>
 #include <unistd.h>
+#include <memory>
 #include "map_pool.hpp"
+#include "paf_writer.hpp"
+#include "dist_worker.hpp"
 
 bool load_conf(int argc, char** argv, Conf &conf);
+int run_worker(Conf &conf, MapPool &pool);
 
 int main(int argc, char** argv) {
     std::cerr << "Loading conf\n";
@@ -16,6 +20,22 @@ int main(int argc, char** argv) {
 
     MapPool pool(conf);
 
+    if (!conf.dist_prms.dist_coord.empty()) {
+        return run_worker(conf, pool);
+    }
+
+    std::unique_ptr<ReadCheckpoint> checkpoint;
+    if (!conf.output_prms.checkpoint.empty()) {
+        checkpoint.reset(new ReadCheckpoint(conf.output_prms.checkpoint, 
+                                            conf.output_prms.resume));
+        pool.set_checkpoint(checkpoint.get());
+    } else if (conf.output_prms.resume) {
+        std::cerr << "Error: must specify a checkpoint (-k) to resume\n";
+        return 1;
+    }
+
+    PafWriter out(conf.output_prms, checkpoint.get());
+
     u64 MAX_SLEEP = 100;
 
     std::cerr << "Mapping\n";
@@ -25,7 +45,7 @@ int main(int argc, char** argv) {
     while (pool.running()) {
         u64 t0 = t.get();
         for (Paf p : pool.update()) {
-            p.print_paf();
+            out.submit(std::move(p));
         }
         u64 dt = t.get() - t0;
         if (dt < MAX_SLEEP) usleep(1000*(MAX_SLEEP - dt));
@@ -34,9 +54,63 @@ int main(int argc, char** argv) {
     std::cerr << "Finishing\n";
 
     pool.stop();
+    out.close();
 
 }
 
+//Maps files from a coordinator, sending results back instead of writing
+int run_worker(Conf &conf, MapPool &pool) {
+    if (!conf.output_prms.checkpoint.empty() || conf.fast5_prms.max_reads > 0) {
+        std::cerr << "Error: checkpoints and max reads are not supported "
+                  << "by workers, resume the coordinator instead\n";
+        return 1;
+    }
+
+    DistWorker worker(conf.dist_prms.dist_coord);
+    if (!worker.is_connected()) return 1;
+
+    pool.set_checkpoint(worker.tracker());
+    pool.set_file_source([&worker](std::string &fname) {
+        return worker.next_file(fname);
+    });
+
+    u64 MAX_SLEEP = 100;
+
+    std::cerr << "Mapping files from " << conf.dist_prms.dist_coord << "\n";
+
+    Timer t;
+
+    while (pool.running()) {
+        u64 t0 = t.get();
+        for (Paf p : pool.update()) {
+            worker.submit(p);
+        }
+
+        if (!worker.flush()) {
+            std::cerr << "Error: lost connection to coordinator\n";
+            worker.close();
+            pool.stop();
+            return 1;
+        }
+
+        u64 dt = t.get() - t0;
+        if (dt < MAX_SLEEP) usleep(1000*(MAX_SLEEP - dt));
+    }
+
+    std::cerr << "Finishing\n";
+
+    pool.stop();
+    bool sent = worker.flush();
+    worker.close();
+
+    if (!sent || !worker.finished()) {
+        std::cerr << "Error: lost connection to coordinator\n";
+        return 1;
+    }
+
+    return 0;
+}
+
 #define FLAG_TO_CONF(C, T, F) { \
     case C: \
         conf.set_##F(T(optarg)); \
@@ -55,7 +129,7 @@ int main(int argc, char** argv) {
 
 bool load_conf(int argc, char** argv, Conf &conf) {
     int opt;
-    std::string flagstr = ":t:n:l:";
+    std::string flagstr = ":t:n:l:b:L:o:k:N:T:S:W:A:MBRP";
 
     #ifdef DEBUG_OUT
     flagstr += "D:";
@@ -68,6 +142,32 @@ bool load_conf(int argc, char** argv, Conf &conf) {
             FLAG_TO_CONF('t', atoi, threads)
             FLAG_TO_CONF('n', atoi, max_reads)
             FLAG_TO_CONF('l', std::string, read_list)
+            FLAG_TO_CONF('b', atoi, batch_size)
+            FLAG_TO_CONF('L', atoi, load_chunks)
+            FLAG_TO_CONF('o', std::string, paf_out)
+            FLAG_TO_CONF('k', std::string, checkpoint)
+            FLAG_TO_CONF('T', std::string, trace_out)
+            FLAG_TO_CONF('S', atof, trace_sample)
+            FLAG_TO_CONF('W', std::string, dist_coord)
+
+            case 'B':
+                conf.set_paf_binary(true);
+                break;
+
+            case 'R':
+                conf.set_resume(true);
+                break;
+
+            FLAG_TO_CONF('N', std::string, numa_index)
+            FLAG_TO_CONF('A', atoi, sa_cache_mb)
+
+            case 'P':
+                conf.set_numa_pin(true);
+                break;
+
+            case 'M':
+                conf.set_idx_mmap(true);
+                break;
 
             #ifdef DEBUG_OUT
             FLAG_TO_CONF('D', std::string, dbg_prefix);
@@ -88,7 +188,11 @@ bool load_conf(int argc, char** argv, Conf &conf) {
     int i = optind;
 
     POSITIONAL_TO_CONF(std::string, bwa_prefix)
-    POSITIONAL_TO_CONF(std::string, fast5_list)
+
+    //Workers get their files from the coordinator
+    if (conf.dist_prms.dist_coord.empty()) {
+        POSITIONAL_TO_CONF(std::string, fast5_list)
+    }
 
     return true;
 }
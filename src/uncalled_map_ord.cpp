@@ -2,6 +2,7 @@
 #include <cstdlib>
 #include <unistd.h>
 #include "map_pool_ord.hpp"
+#include "paf_writer.hpp"
 
 void load_conf(int argc, char** argv, Conf &conf);
 
@@ -13,6 +14,7 @@ int main(int argc, char** argv) {
     load_conf(argc, argv, conf);
 
     MapPoolOrd pool(conf);
+    PafWriter out(conf.output_prms);
 
     Timer t;
 
@@ -28,7 +30,7 @@ int main(int argc, char** argv) {
     while (pool.running()) {
         u64 t0 = t.get();
         for (Paf p : pool.update()) {
-            p.print_paf();
+            out.submit(std::move(p));
         }
         u64 dt = t.get() - t0;
         if (dt < MAX_SLEEP) usleep(1000*(MAX_SLEEP - dt));
@@ -39,6 +41,7 @@ int main(int argc, char** argv) {
     std::cerr << "Finishing\n";
 
     pool.stop();
+    out.close();
 
 }
 
@@ -60,7 +63,7 @@ int main(int argc, char** argv) {
 
 void load_conf(int argc, char** argv, Conf &conf) {
     int opt;
-    std::string flagstr = "C:t:n:r:R:c:l:s:w:p:";
+    std::string flagstr = "C:t:n:r:R:c:l:s:w:p:o:N:T:S:A:U:MBP";
 
     #ifdef DEBUG_OUT
     flagstr += "D:";
@@ -76,6 +79,23 @@ void load_conf(int argc, char** argv, Conf &conf) {
             FLAG_TO_CONF('R', atoi, max_active_reads)
             FLAG_TO_CONF('c', atoi, max_chunks)
             FLAG_TO_CONF('l', std::string, read_list)
+
+            FLAG_TO_CONF('o', std::string, paf_out)
+            FLAG_TO_CONF('N', std::string, numa_index)
+            FLAG_TO_CONF('A', atoi, sa_cache_mb)
+            FLAG_TO_CONF('U', atof, tune_latency)
+            FLAG_TO_CONF('T', std::string, trace_out)
+            FLAG_TO_CONF('S', atof, trace_sample)
+
+            case 'P':
+                conf.set_numa_pin(true);
+                break;
+            case 'M':
+                conf.set_idx_mmap(true);
+                break;
+            case 'B':
+                conf.set_paf_binary(true);
+                break;
             FLAG_TO_CONF('s', atof, win_stdv_min)
             FLAG_TO_CONF('w', atof, win_len)
             FLAG_TO_CONF('p', std::string, idx_preset)
@@ -4,6 +4,7 @@
 #include "client_sim.hpp"
 #include "realtime_pool.hpp"
 #include "read_buffer.hpp"
+#include "paf_writer.hpp"
 
 const std::string CONF_DIR(std::getenv("UNCALLED_CONF")),
                   DEF_MODEL = CONF_DIR + "/r94_5mers.txt",
@@ -24,6 +25,7 @@ int main(int argc, char** argv) {
 
     std::cerr << "Loading mappers\n";
     RealtimePool pool(conf);
+    PafWriter out(conf.output_prms);
 
     const u64 MAX_SLEEP = 100;
 
@@ -52,7 +54,7 @@ int main(int argc, char** argv) {
                 paf.set_float(Paf::Tag::ENDED, map_time);
                 sim.stop_receiving_read(channel, number);
 
-            } else if ((paf.is_mapped() && deplete) || (!paf.is_mapped() && !deplete)) {
+            } else if ((paf.is_on_target() && deplete) || (!paf.is_on_target() && !deplete)) {
 
                 u32 delay = sim.unblock_read(channel, number);
                 paf.set_float(Paf::Tag::EJECT, map_time); 
@@ -64,8 +66,7 @@ int main(int argc, char** argv) {
                 sim.stop_receiving_read(channel, number);
                 paf.set_float(Paf::Tag::KEEP, map_time);
             }
-            paf.print_paf();
-            std::cout.flush();
+            out.submit(std::move(paf));
         }
 
         for (auto &r : sim.get_read_chunks()) {
@@ -82,12 +83,20 @@ int main(int argc, char** argv) {
             }
         }
 
+        //Simulated time only moves once mapping has caught up
+        if (conf.get_fast_clock()) {
+            if (pool.is_idle()) sim.advance();
+            else usleep(1000);
+            continue;
+        }
+
         u64 dt = t.get() - t0;
         if (dt < MAX_SLEEP) usleep(1000*(MAX_SLEEP - dt));
     }
     std::cerr << "Reads aligned (" << (t.get() / 1000) << " sec)\n";
 
     pool.stop_all();
+    out.close();
     std::cerr << "Done " << (t.get() / 1000) << "\n";
 }
 
@@ -109,7 +118,7 @@ int main(int argc, char** argv) {
 
 bool load_conf(int argc, char** argv, Conf &conf) {
     int opt;
-    std::string flagstr = ":t:c:p:de";
+    std::string flagstr = ":t:c:p:o:deB";
 
     #ifdef DEBUG_OUT
     flagstr += "D:";
@@ -122,6 +131,7 @@ bool load_conf(int argc, char** argv, Conf &conf) {
             FLAG_TO_CONF('p', std::string, idx_preset)
             FLAG_TO_CONF('t', atoi, threads)
             FLAG_TO_CONF('c', atoi, max_chunks)
+            FLAG_TO_CONF('o', std::string, paf_out)
 
             #ifdef DEBUG_OUT
             FLAG_TO_CONF('D', std::string, dbg_prefix);
@@ -135,6 +145,10 @@ bool load_conf(int argc, char** argv, Conf &conf) {
                 conf.set_realtime_mode(RealtimeParams::Mode::ENRICH);
                 break;
 
+            case 'B':
+                conf.set_paf_binary(true);
+                break;
+
             case ':':  
             std::cerr << "Error: failed to load flag value\n";  
             return false;
@@ -25,10 +25,13 @@
 #define _INCL_UTIL
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <cstdint>
 #include <chrono>
 #include <cassert>
+#include <cstdlib>
+#include <new>
 
 #ifdef PYBIND
 #include "pybind11/pybind11.h"
@@ -76,4 +79,41 @@ class Timer {
         }
 };
 
+//Allocates std::vector storage on SIMD/cache-line boundaries
+template <typename T, size_t ALIGN = 64>
+class AlignedAllocator {
+    public:
+    typedef T value_type;
+
+    template <typename U> struct rebind { 
+        typedef AlignedAllocator<U, ALIGN> other; 
+    };
+
+    AlignedAllocator() {}
+
+    template <typename U> 
+    AlignedAllocator(const AlignedAllocator<U, ALIGN> &) {}
+
+    T *allocate(size_t n) {
+        void *p = NULL;
+        if (posix_memalign(&p, ALIGN, n * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t) {
+        free(p);
+    }
+};
+
+template <typename T, typename U, size_t ALIGN>
+bool operator==(const AlignedAllocator<T, ALIGN> &, const AlignedAllocator<U, ALIGN> &) {return true;}
+
+template <typename T, typename U, size_t ALIGN>
+bool operator!=(const AlignedAllocator<T, ALIGN> &, const AlignedAllocator<U, ALIGN> &) {return false;}
+
+template <typename T>
+using AlignedVec = std::vector< T, AlignedAllocator<T> >;
+
 #endif
@@ -0,0 +1,312 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include "vbz.hpp"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef VBZ_X86_SIMD
+#include <immintrin.h>
+#endif
+
+//Byte lengths of the 2-bit streamvbyte codes
+//Version 0 uses standard streamvbyte, version 1 allows zero-byte values
+static const u8 SVB_LENS[2][4] = {{1, 2, 3, 4}, {0, 1, 2, 4}};
+
+static inline float calibrate(i16 raw, const VbzDecoder::Calibration &cal) {
+    return (cal.range * (u16) raw / cal.digit) + cal.offset;
+}
+
+//Decodes samples [i, count) one value at a time, advancing data
+//Returns the number of samples decoded, less than count if data runs out
+static u32 decode_svb_scalar(const u8 *keys, const u8 *&data, const u8 *end,
+                             u32 i, u32 count, i16 prev,
+                             const VbzDecoder::Options &opts, 
+                             const VbzDecoder::Calibration &cal,
+                             float *out) {
+    const u8 *lens = SVB_LENS[opts.version > 0];
+
+    for (; i < count; i++) {
+        u8 len = lens[(keys[i >> 2] >> ((i & 3) * 2)) & 3];
+        if (data + len > end) break;
+
+        u32 v = 0;
+        for (u8 b = 0; b < len; b++) {
+            v |= (u32) data[b] << (8 * b);
+        }
+        data += len;
+
+        if (opts.zig_zag) {
+            prev = (i16) (prev + ((i32) (v >> 1) ^ -(i32) (v & 1)));
+        } else {
+            prev = (i16) v;
+        }
+
+        out[i] = calibrate(prev, cal);
+    }
+
+    return i;
+}
+
+#ifdef VBZ_X86_SIMD
+
+//Shuffle masks which expand four packed values (one key byte) into u32 lanes
+struct SvbTable {
+    u8 shuf[256][16];
+    u8 len[256];
+};
+
+static SvbTable make_svb_table(const u8 *lens) {
+    SvbTable t;
+    for (u32 key = 0; key < 256; key++) {
+        u8 offs = 0;
+        for (u8 j = 0; j < 4; j++) {
+            u8 len = lens[(key >> (2 * j)) & 3];
+            for (u8 b = 0; b < 4; b++) {
+                t.shuf[key][4*j + b] = b < len ? offs + b : 0xFF;
+            }
+            offs += len;
+        }
+        t.len[key] = offs;
+    }
+    return t;
+}
+
+static bool has_ssse3() {
+    static const bool ret = __builtin_cpu_supports("ssse3");
+    return ret;
+}
+
+//Decodes four samples per key byte, computing the zig-zag delta
+//prefix sum in-register. Falls back to scalar near the end of the data
+__attribute__((target("ssse3")))
+static u32 decode_svb_ssse3(const u8 *keys, const u8 *&data, const u8 *end,
+                            u32 count, 
+                            const VbzDecoder::Options &opts, 
+                            const VbzDecoder::Calibration &cal,
+                            float *out) {
+
+    static const SvbTable TABLES[2] = {make_svb_table(SVB_LENS[0]),
+                                       make_svb_table(SVB_LENS[1])};
+    const SvbTable &tbl = TABLES[opts.version > 0];
+
+    const __m128i zero = _mm_setzero_si128(),
+                  one = _mm_set1_epi32(1),
+                  low16 = _mm_set1_epi32(0xFFFF);
+    const __m128 range = _mm_set1_ps(cal.range),
+                 digit = _mm_set1_ps(cal.digit),
+                 offset = _mm_set1_ps(cal.offset);
+
+    __m128i prev = zero;
+    u32 i = 0;
+
+    for (; i + 4 <= count && data + 16 <= end; i += 4) {
+        u8 key = keys[i >> 2];
+        __m128i v = _mm_shuffle_epi8(
+                        _mm_loadu_si128((const __m128i *) data),
+                        _mm_loadu_si128((const __m128i *) tbl.shuf[key]));
+        data += tbl.len[key];
+
+        if (opts.zig_zag) {
+            v = _mm_xor_si128(_mm_srli_epi32(v, 1), 
+                              _mm_sub_epi32(zero, _mm_and_si128(v, one)));
+
+            //Only the low 16 bits are kept, so i32 overflow doesn't matter
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi32(v, prev);
+            prev = _mm_shuffle_epi32(v, 0xFF);
+        }
+
+        __m128 f = _mm_cvtepi32_ps(_mm_and_si128(v, low16));
+        _mm_storeu_ps(out + i, 
+            _mm_add_ps(_mm_div_ps(_mm_mul_ps(range, f), digit), offset));
+    }
+
+    i16 last = (i16) _mm_cvtsi128_si32(prev);
+    return decode_svb_scalar(keys, data, end, i, count, last, opts, cal, out);
+}
+
+#endif
+
+VbzDecoder::VbzDecoder() {}
+
+bool VbzDecoder::get_options(hid_t dcpl, Options &opts) {
+    //Only handle VBZ as the sole filter, otherwise leave it to HDF5
+    if (H5Pget_nfilters(dcpl) != 1) return false;
+
+    unsigned int flags, cd[8];
+    size_t ncd = 8;
+    H5Z_filter_t id = H5Pget_filter2(dcpl, 0, &flags, &ncd, cd, 0, NULL, NULL);
+    if (id != FILTER_ID || ncd < 4) return false;
+
+    opts.version = cd[0];
+    opts.int_size = cd[1];
+    opts.zig_zag = cd[2] != 0;
+    opts.zstd_level = cd[3];
+
+    if (opts.version > 1 || opts.int_size != sizeof(i16)) return false;
+
+    #ifndef HAVE_ZSTD
+    if (opts.zstd_level != 0) return false;
+    #endif
+
+    return true;
+}
+
+bool VbzDecoder::decode_chunk(const u8 *src, size_t len, const Options &opts,
+                              const Calibration &cal, u64 max_len,
+                              std::vector<float> &out) {
+    //Chunks start with the uncompressed size in bytes
+    u32 orig_size;
+    if (len < sizeof(orig_size)) return false;
+    memcpy(&orig_size, src, sizeof(orig_size));
+    src += sizeof(orig_size);
+    len -= sizeof(orig_size);
+
+    if (opts.zstd_level != 0) {
+        #ifdef HAVE_ZSTD
+        unsigned long long n = ZSTD_getFrameContentSize(src, len);
+        if (n == ZSTD_CONTENTSIZE_ERROR || n == ZSTD_CONTENTSIZE_UNKNOWN) {
+            return false;
+        }
+
+        zstd_buf_.resize(n);
+        size_t dlen = ZSTD_decompress(zstd_buf_.data(), n, src, len);
+        if (ZSTD_isError(dlen)) return false;
+
+        src = zstd_buf_.data();
+        len = dlen;
+        #else
+        return false;
+        #endif
+    }
+
+    u32 total = orig_size / opts.int_size,
+        count = std::min<u64>(total, max_len),
+        keys_len = (total + 3) / 4;
+    if (len < keys_len) return false;
+
+    const u8 *keys = src, 
+             *data = src + keys_len,
+             *end = src + len;
+
+    size_t st = out.size();
+    out.resize(st + count);
+    float *dst = out.data() + st;
+
+    u32 n;
+    #ifdef VBZ_X86_SIMD
+    if (has_ssse3()) {
+        n = decode_svb_ssse3(keys, data, end, count, opts, cal, dst);
+    } else 
+    #endif
+    {
+        n = decode_svb_scalar(keys, data, end, 0, count, 0, opts, cal, dst);
+    }
+
+    if (n < count) {
+        out.resize(st + n);
+        return false;
+    }
+
+    return true;
+}
+
+bool VbzDecoder::read_signal(hid_t file, const std::string &path, 
+                             const Calibration &cal, u64 max_len,
+                             std::vector<float> &out, u64 start) {
+    #if H5_VERSION_GE(1,10,2)
+
+    hid_t dset = H5Dopen2(file, path.c_str(), H5P_DEFAULT);
+    if (dset < 0) return false;
+
+    hid_t dcpl = H5Dget_create_plist(dset),
+          space = H5Dget_space(dset);
+
+    Options opts;
+    hsize_t dim = 0, chunk_dim = 0;
+
+    bool ok = dcpl >= 0 && space >= 0 &&
+              H5Pget_layout(dcpl) == H5D_CHUNKED &&
+              H5Sget_simple_extent_ndims(space) == 1 &&
+              H5Pget_chunk(dcpl, 1, &chunk_dim) == 1 &&
+              chunk_dim > 0 &&
+              get_options(dcpl, opts) &&
+              H5Sget_simple_extent_dims(space, &dim, NULL) == 1;
+
+    u64 en = std::min<u64>(dim, start + max_len);
+    size_t st = out.size();
+    if (start < en) out.reserve(st + en - start);
+
+    hsize_t offs0 = ok ? start - start % chunk_dim : 0;
+    for (hsize_t offs = offs0; ok && offs < en; offs += chunk_dim) {
+        hsize_t nbytes = 0;
+        u32 filter_mask = 0;
+
+        ok = H5Dget_chunk_storage_size(dset, &offs, &nbytes) >= 0 && nbytes > 0;
+        if (!ok) break;
+
+        chunk_buf_.resize(nbytes);
+        ok = H5Dread_chunk(dset, H5P_DEFAULT, &offs, &filter_mask, chunk_buf_.data()) >= 0;
+        if (!ok) break;
+
+        u64 n = std::min<u64>(chunk_dim, en - offs);
+        size_t chunk_st = out.size();
+
+        //Filter was skipped for this chunk, samples are stored as-is
+        if (filter_mask & 1) {
+            ok = nbytes >= n * sizeof(i16);
+            const i16 *raw = reinterpret_cast<const i16 *>(chunk_buf_.data());
+            for (u64 i = 0; ok && i < n; i++) {
+                out.push_back(calibrate(raw[i], cal));
+            }
+        } else {
+            ok = decode_chunk(chunk_buf_.data(), nbytes, opts, cal, n, out) &&
+                 out.size() - chunk_st == n;
+        }
+
+        //The first chunk can begin before start
+        if (ok && offs < start) {
+            out.erase(out.begin() + chunk_st, out.begin() + chunk_st + (start - offs));
+        }
+    }
+
+    if (!ok) out.resize(st);
+
+    if (space >= 0) H5Sclose(space);
+    if (dcpl >= 0) H5Pclose(dcpl);
+    H5Dclose(dset);
+
+    return ok;
+
+    #else
+    return false;
+    #endif
+}
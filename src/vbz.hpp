@@ -0,0 +1,79 @@
+/* MIT License
+ *
+ * Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef _INCL_VBZ
+#define _INCL_VBZ
+
+#include <vector>
+#include <string>
+#include <hdf5.h>
+#include "util.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VBZ_X86_SIMD
+#endif
+
+//Built-in decoder for VBZ-compressed raw signal (HDF5 filter 32020)
+//Compressed chunks are read directly with H5Dread_chunk, bypassing the
+//HDF5 plugin, then zstd (if built with HAVE_ZSTD) and streamvbyte/zig-zag
+//delta decoded straight into calibrated floats
+class VbzDecoder {
+    public:
+
+    static const H5Z_filter_t FILTER_ID = 32020;
+
+    typedef struct {
+        u32 version, int_size;
+        bool zig_zag;
+        u32 zstd_level;
+    } Options;
+
+    //Samples are calibrated as (range * raw / digit) + offset
+    typedef struct {
+        float range, digit, offset;
+    } Calibration;
+
+    VbzDecoder();
+
+    //Appends up to max_len calibrated samples from the dataset at path,
+    //starting from sample start. Only chunks overlapping them are decoded
+    //Returns false if the dataset isn't VBZ compressed or can't be decoded
+    //here, in which case out is unchanged and the normal HDF5 read can be used
+    bool read_signal(hid_t file, const std::string &path, 
+                     const Calibration &cal, u64 max_len,
+                     std::vector<float> &out, u64 start = 0);
+
+    //Decodes one compressed chunk, including its original size header
+    //Appends at most max_len samples
+    bool decode_chunk(const u8 *src, size_t len, const Options &opts,
+                      const Calibration &cal, u64 max_len,
+                      std::vector<float> &out);
+
+    private:
+    std::vector<u8> chunk_buf_, zstd_buf_;
+
+    static bool get_options(hid_t dcpl, Options &opts);
+};
+
+#endif
@@ -1,2 +1,2 @@
 from _uncalled import *
-from uncalled import index, pafstats, sim_utils, args, debug, minknow_client
+from uncalled import index, pafstats, sim_utils, args, debug, minknow_client, metrics
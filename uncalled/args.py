@@ -110,11 +110,56 @@ def add_index_opts(p, conf):
             type=int, default=1000000, 
             help="Maximum number of alignments to produce (approximate, due to deterministically random start locations)"
     )
+    p.add_argument(
+            "--sa-intv", 
+            type=int, default=32, 
+            help="Suffix array sampling interval (power of two). Larger values use less memory but make reference coordinate lookups slower. Memory is roughly 2*ref_len*log2(2*ref_len)/(8*sa_intv) bytes"
+    )
+    p.add_argument(
+            "--panel-bed", 
+            type=str, default=None, 
+            help="Only index these BED regions plus a decoy summary of the rest of the genome, for enrichment panels. The prefix defaults to the FASTA filename with \".panel\" appended"
+    )
+    p.add_argument(
+            "--panel-pad", 
+            type=int, default=1000, 
+            help="Bases to add on each side of --panel-bed regions"
+    )
+    p.add_argument(
+            "--decoy-frac", 
+            type=float, default=1.0, 
+            help="Total length of decoy sequences sampled from outside the panel, relative to the panel length"
+    )
+    p.add_argument(
+            "--decoy-len", 
+            type=int, default=2000, 
+            help="Length of each decoy sequence"
+    )
+    p.add_argument(
+            "--kmer-ext-len", 
+            type=int, default=0, 
+            help="Precompute FM index ranges of all sequences up to this length (8-12), so the mapper can skip the first BWT steps of new paths. Memory is roughly 21*4^len bytes. 0 disables the table"
+    )
+    p.add_argument(
+            "--mask-len", 
+            type=int, default=0, 
+            help="Build a repeat mask of sequences this long found at least --mask-copies times, so the mapper can drop seeds in them before their suffix array lookups. Memory is 2*ref_len/8 bytes. 0 disables the mask"
+    )
+    p.add_argument(
+            "--mask-copies", 
+            type=int, default=10, 
+            help="Minimum copies of a --mask-len sequence for it to be masked"
+    )
     p.add_argument(
             "-k", "--kmer-len", 
             type=int, default=5,
             help="Model k-mer length"
     )
+    p.add_argument(
+            "-t", "--threads", 
+            type=int, default=conf.threads, 
+            help="Number of threads to use for reference self-alignment and the repeat mask"
+    )
     p.add_argument(
             "-1", "--matchpr1", 
             default=0.6334, type=float, 
@@ -157,9 +202,43 @@ def add_bwa_opt(p, conf):
             type=str, default=conf.idx_preset, 
             help="Mapping mode"
     )
+    p.add_argument(
+            "--idx-mmap", 
+            action="store_true", 
+            help="Memory-map the index instead of loading it, so multiple UNCALLED processes share one copy"
+    )
+    p.add_argument(
+            "--idx-populate", 
+            action="store_true", 
+            help="Pre-fault the memory-mapped index (only has effect with --idx-mmap)"
+    )
+    p.add_argument(
+            "--idx-hugepages", 
+            action="store_true", 
+            help="Request transparent hugepages for the memory-mapped index (only has effect with --idx-mmap)"
+    )
+    p.add_argument(
+            "--numa-pin", 
+            action="store_true", 
+            help="Pin mapping threads to cores, alternating between NUMA nodes"
+    )
+    p.add_argument(
+            "--numa-index", 
+            type=str, default=conf.numa_index, choices=["none", "interleave", "replicate"],
+            help="Interleave the index across NUMA nodes, or load a copy on each node for its threads (replicate needs the index memory once per node)"
+    )
+    p.add_argument(
+            "--no-repeat-mask", 
+            action="store_false", dest="repeat_mask",
+            help="Keep seeds in repeats even if the index has a repeat mask"
+    )
+    p.add_argument(
+            "--sa-cache", 
+            type=int, default=conf.sa_cache_mb, dest="sa_cache_mb", metavar="MB",
+            help="Size in MB of a cache of reference locations shared by all threads, which speeds up runs where many reads cover the same sequence (0 to disable)"
+    )
 
 def add_ru_opts(p, conf):
-    #TODO: selectively enrich or deplete refs in index
     p.add_argument(
             "-c", "--max-chunks", 
             type=int, default=conf.max_chunks, required=True, 
@@ -182,6 +261,16 @@ def add_ru_opts(p, conf):
             const=unc.RealtimePool.ENRICH, dest='realtime_mode', 
             help="Will eject reads that don't align to index"
     )
+    p.add_argument(
+            "--target-bed", 
+            type=str, default=None, 
+            help="BED file of target regions. Only reads aligning within them are ejected with --deplete or kept with --enrich"
+    )
+    p.add_argument(
+            "--early-conf", 
+            type=float, default=None, 
+            help="Decide reads early once they can't reach the minimum mapping length in their remaining chunks, or once an off-target cluster is this many times longer than any on-target cluster. 0 disables early decisions"
+    )
 
     active = p.add_mutually_exclusive_group()
     active.add_argument(
@@ -227,6 +316,18 @@ def add_sim_opts(p, conf):
             "--sim-speed", 
             type=float, default=conf.sim_speed, 
             help="")
+    p.add_argument(
+            "--stream-reads", 
+            action="store_true", 
+            help="Index reads instead of preloading them, loading each read when its channel reaches it. Bounds memory to about one read per channel")
+    p.add_argument(
+            "--fast-clock", 
+            action="store_true", 
+            help="Advance simulated time only once the mappers have caught up, instead of with wall time, so simulations run as fast as mapping allows")
+    p.add_argument(
+            "--clock-step", 
+            type=float, default=conf.clock_step, 
+            help="Simulated seconds to advance each step with --fast-clock")
 
 def add_realtime_opts(p, conf):
     p.add_argument(
@@ -244,6 +345,51 @@ def add_realtime_opts(p, conf):
             type=float, default=conf.duration, 
             help=unc.Conf.duration.__doc__
     )
+    p.add_argument(
+            "--action-interval", 
+            type=float, default=conf.action_interval, 
+            help="Milliseconds to hold unblock/stop-receiving actions so they are sent together. 0 sends them every update"
+    )
+    p.add_argument(
+            "--action-batch", 
+            type=int, default=conf.action_batch, 
+            help="Send held actions once this many are queued, regardless of --action-interval. 0 disables"
+    )
+    p.add_argument(
+            "--deadline-sched", 
+            action="store_true", default=conf.deadline_sched, 
+            help="Map the channel with the least pore time left before --max-chunks first. Reads that can't be decided in time are mapped last"
+    )
+    p.add_argument(
+            "--abandon-time", 
+            type=float, default=conf.abandon_time, 
+            help="With --deadline-sched, stop mapping reads this many milliseconds past their deadline. 0 never abandons reads"
+    )
+    p.add_argument(
+            "--tune-latency", 
+            type=float, default=conf.tune_latency, metavar="MS",
+            help="Adjust the active read limit and event batching while running to keep 90%% of reads decided within this many milliseconds of their start. 0 keeps them fixed"
+    )
+    p.add_argument(
+            "--tune-interval", 
+            type=float, default=conf.tune_interval, metavar="MS",
+            help="Milliseconds between --tune-latency adjustments"
+    )
+    p.add_argument(
+            "--tune-active-max", 
+            type=int, default=conf.tune_active_max, 
+            help="Most active reads --tune-latency can allow"
+    )
+    p.add_argument(
+            "--path-pool-size", 
+            type=int, default=conf.path_pool_size, 
+            help="Total paths allowed across all channels before each channel's path budget is halved (down to --min-path-budget), growing back when below 3/4 of it. 0 gives every channel max_paths"
+    )
+    p.add_argument(
+            "--min-path-budget", 
+            type=int, default=conf.min_path_budget, 
+            help="Smallest path budget a channel can be shrunk to"
+    )
 
 #def add_list_ports_opts(p, conf):
 #    p.add_argument(
@@ -271,6 +417,16 @@ def add_fast5_opts(p, conf):
             type=int, default=None, 
             help=unc.Conf.max_reads.__doc__
     )
+    p.add_argument(
+            "--io-threads", 
+            type=int, default=None, 
+            help=unc.Conf.io_threads.__doc__
+    )
+    p.add_argument(
+            "--load-chunks", 
+            type=int, default=None, 
+            help="Number of signal chunks loaded with each fast5 read, the rest is only read from the file if mapping needs it. 0 loads whole reads"
+    )
 
 #TODO get defautls from conf
 def add_map_opts(p, conf):
@@ -279,6 +435,11 @@ def add_map_opts(p, conf):
             type=int, default=conf.threads, 
             help="Number of threads to use for mapping"
     )
+    p.add_argument(
+            "--batch-size", 
+            type=int, default=conf.batch_size, 
+            help="Number of reads each thread maps at once, interleaving FM index queries between them. 1 disables batching"
+    )
     p.add_argument(
             "--num-channels", 
             type=int, default=conf.num_channels, 
@@ -289,6 +450,51 @@ def add_map_opts(p, conf):
             type=int, default=conf.max_events, 
             help="Will give up on a read after this many events have been processed"
     )
+    p.add_argument(
+            "--counter-tags", 
+            action="store_true", 
+            help="Output per-read counts of events, paths, FM index neighbor queries, SA lookups, seeds, sources, and normalizer skips as PAF tags"
+    )
+    p.add_argument(
+            "-o", "--paf-out", 
+            type=str, default=None, 
+            help="Write mappings to this file instead of stdout"
+    )
+    p.add_argument(
+            "--paf-binary", 
+            action="store_true", 
+            help="Write mappings as binary records instead of PAF text. They can be read with \"uncalled pafstats\" or uncalled.PafBinReader"
+    )
+    p.add_argument(
+            "-k", "--checkpoint", 
+            type=str, default=None, 
+            help="Log mapped reads and finished read files to this file, so an interrupted run can be resumed with --resume"
+    )
+    p.add_argument(
+            "--resume", 
+            action="store_true", 
+            help="Skip reads and files listed in the checkpoint, and append to the PAF output"
+    )
+    p.add_argument(
+            "--trace-out", 
+            type=str, default=None, 
+            help="Write binary traces of how sampled reads are mapped to this file, which can be read with uncalled.debug.TraceFile"
+    )
+    p.add_argument(
+            "--trace-sample", 
+            type=float, default=conf.trace_sample, 
+            help="Fraction of reads to trace with --trace-out, chosen by read ID"
+    )
+    p.add_argument(
+            "--trace-list", 
+            type=str, default=None, 
+            help="File listing read IDs to trace with --trace-out, in addition to --trace-sample"
+    )
+    p.add_argument(
+            "--metrics-port", 
+            type=int, default=None, 
+            help="Serve running totals of the --counter-tags counts at http://localhost:PORT/metrics"
+    )
 
 def load_conf(argv):
     conf = unc.Conf()
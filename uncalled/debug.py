@@ -4,6 +4,8 @@ import sys, os
 import numpy as np
 import argparse
 import bisect
+import struct
+import io
 from collections import defaultdict
 import re
 
@@ -26,6 +28,136 @@ CIG_INCR_ALL = {'M','=', 'X'}
 CIG_INCR_RD = CIG_INCR_ALL | {'I','S'}
 CIG_INCR_RF = CIG_INCR_ALL | {'D','N'}
 
+#ReadTracer binary format, see src/read_tracer.hpp
+TRACE_MAGIC = b"UNCT"
+TRACE_VERSION = 1
+TRACE_HEAD = struct.Struct("<4sI")
+TRACE_REC_HEAD = struct.Struct("<BxHI")
+TRACE_RECS = {
+    ord('R') : struct.Struct("<IHH"),          #number, channel, name length
+    ord('E') : struct.Struct("<IIffffI"),      #start, length, mean, stdv, win mean, win stdv, mask
+    ord('P') : struct.Struct("<IIfffI"),       #event, paths, value, norm scale, norm shift, top cluster length
+    ord('S') : struct.Struct("<IIIIQBxHxxxx"), #event, path, cluster, ref length, ref start, fwd, name length
+    ord('D') : struct.Struct("<IBBxxfxxxx"),   #events, state, mapped, decision time
+}
+
+class TraceRead:
+    """Records of one read from a ReadTracer file"""
+
+    def __init__(self, number, channel, rid):
+        self.rid = rid
+        self.number = number
+        self.channel = channel
+
+        self.events = list()
+        self.steps = list()
+        self.seeds = list()
+        self.end = None
+
+    @property
+    def path_counts(self):
+        return [s[1] for s in self.steps]
+
+    #Detected event index of each mapped event
+    def _mask_map(self):
+        return [i for i,e in enumerate(self.events) if e[6] == 1]
+
+    def events_tsv(self):
+        """Events in the DEBUG_EVENTS "_events.tsv" format"""
+        out = io.StringIO()
+        out.write("start\tlength\tmean\tstdv\tnorm_scale\tnorm_shift\twin_mean\twin_stdv\twin_mask\n")
+
+        norms = {s[0] : (s[3], s[4]) for s in self.steps}
+        mask_map = self._mask_map()
+        norm = (1, 0)
+        mapped = 0
+
+        for st,ln,mn,sd,win_mn,win_sd,mask in self.events:
+            if mask == 1:
+                norm = norms.get(mapped, norm)
+                mapped += 1
+            out.write("%d\t%d\t%f\t%f\t%f\t%f\t%f\t%f\t%d\n" % (
+                st, ln, mn, sd, norm[0], norm[1], win_mn, win_sd, mask))
+
+        out.seek(0)
+        return out
+
+    def seeds_bed(self):
+        """Seeds in the DEBUG_SEEDS "_seeds.bed" format"""
+        out = io.StringIO()
+        mask_map = self._mask_map()
+
+        for evt, path, clust, ln, st, fwd, rf in self.seeds:
+            if evt < len(mask_map): 
+                evt = mask_map[evt]
+            out.write("%s\t%d\t%d\t%d:%d:%d\t%s\n" % (
+                rf, st, st+ln, evt, path, clust, "+" if fwd else "-"))
+
+        out.seek(0)
+        return out
+
+class TraceFile:
+    """Reads a ReadTracer file, written by "uncalled map --trace-out" """
+
+    def __init__(self, fname):
+        self.reads = dict()
+        self.by_id = dict()
+
+        with open(fname, "rb") as f:
+            data = f.read()
+
+        if len(data) < TRACE_HEAD.size:
+            raise ValueError("\"%s\" is not a trace file" % fname)
+
+        magic, version = TRACE_HEAD.unpack_from(data, 0)
+        if magic != TRACE_MAGIC or version != TRACE_VERSION:
+            raise ValueError("\"%s\" is not a version %d trace file" % (fname, TRACE_VERSION))
+
+        i = TRACE_HEAD.size
+        while i + TRACE_REC_HEAD.size <= len(data):
+            kind, size, read = TRACE_REC_HEAD.unpack_from(data, i)
+            rec = TRACE_RECS.get(kind, None)
+            if rec is None or size < TRACE_REC_HEAD.size + rec.size or i + size > len(data): 
+                sys.stderr.write("Warning: ignoring trace records after byte %d\n" % i)
+                break
+
+            vals = rec.unpack_from(data, i + TRACE_REC_HEAD.size)
+            name = data[i + TRACE_REC_HEAD.size + rec.size : i + size].decode()
+            i += size
+
+            if kind == ord('R'):
+                r = TraceRead(vals[0], vals[1], name)
+                self.reads[read] = r
+                self.by_id[name] = r
+                continue
+
+            r = self.reads.get(read, None)
+            if r is None: continue
+
+            if kind == ord('E'):
+                r.events.append(vals)
+            elif kind == ord('P'):
+                r.steps.append(vals)
+            elif kind == ord('S'):
+                r.seeds.append(vals[:6] + (name,))
+            elif kind == ord('D'):
+                r.end = vals
+
+        #Threads are drained in turn, so a read's records may be out of order
+        for r in self.reads.values():
+            r.events.sort(key=lambda e: e[0])
+            r.steps.sort(key=lambda s: s[0])
+            r.seeds.sort(key=lambda s: s[0])
+
+    def __len__(self):
+        return len(self.by_id)
+
+    def __contains__(self, rid):
+        return rid in self.by_id
+
+    def __getitem__(self, rid):
+        return self.by_id[rid]
+
 class DebugParser:
     CONF_PAD_COEF = 2
 
@@ -44,10 +176,19 @@ class DebugParser:
                  load_seeds=True,
                  load_events=True,
                  load_paths=True,
-                 load_conf=True):
+                 load_conf=True,
+                 trace=None):
 
         self.rid = unc_paf.qr_name
 
+        #Events and seeds can come from a TraceFile instead of DEBUG_* output
+        #Traces only include path counts, and no confidence
+        self.trace = None
+        if trace is not None:
+            self.trace = trace[self.rid]
+            self.path_counts = self.trace.path_counts
+            load_paths = load_conf = False
+
         #Cofident seed cluster ID, confident event, and reference length
         #(conf_evt is where mapping would normally end)
         self.conf_cid = unc_paf.tags.get('sc', (None,)*2)[0]
@@ -125,12 +266,18 @@ class DebugParser:
 
         self.evts_loaded = False
         if load_events:
-            self.evts_in = open(debug_prefix + self.rid + "_events.tsv")
+            if self.trace is not None:
+                self.evts_in = self.trace.events_tsv()
+            else:
+                self.evts_in = open(debug_prefix + self.rid + "_events.tsv")
             self.parse_events()
 
         self.seeds_loaded = False
         if load_seeds:
-            self.seeds_in  = open(debug_prefix + self.rid + "_seeds.bed")
+            if self.trace is not None:
+                self.seeds_in = self.trace.seeds_bed()
+            else:
+                self.seeds_in  = open(debug_prefix + self.rid + "_seeds.bed")
             self.parse_seeds()
 
         self.bc_loaded = False
@@ -32,6 +32,12 @@ import uncalled as unc
 from bisect import bisect_left, bisect_right
 
 UNCL_SUFF = ".uncl"
+OCC_SUFF = ".uocc"
+SSA_SUFF = ".usa"
+KMER_EXT_SUFF = ".ukx"
+REPEAT_MASK_SUFF = ".urm"
+PANEL_SUFF = ".upnl"
+PANEL_FASTA_SUFF = ".panel.fa"
 AMB_SUFF = ".amb"
 ANN_SUFF = ".ann"
 BWT_SUFF = ".bwt"
@@ -44,6 +50,161 @@ ROOT_DIR = os.path.dirname(os.path.realpath(__file__))
 MODEL_FNAME = os.path.join(ROOT_DIR, "conf/r94_5mers.txt")
 CONF_DEFAULTS = os.path.join(ROOT_DIR, "conf/defaults.toml")
 
+def get_ref_len(bwa_prefix):
+    with open(bwa_prefix + ANN_SUFF) as ann_in:
+        return int(ann_in.readline().split()[0])
+
+def sa_size_mb(ref_len, sa_intv, packed=True):
+    """Approximate suffix array size in megabytes
+
+    The index stores both strands, and BWA uses 64 bits per entry while
+    the UNCALLED sampled SA uses ceil(log2(2*ref_len+1)) bits"""
+    seq_len = 2 * ref_len
+    bits = int(np.ceil(np.log2(seq_len + 1))) if packed else 64
+    return (seq_len / sa_intv) * bits / 8 / 1e6
+
+def sampled_sa_intv(bwa_prefix):
+    """Returns the sampling interval of an existing sampled SA, or None"""
+    fname = bwa_prefix + SSA_SUFF
+    if not os.path.exists(fname):
+        return None
+    header = np.fromfile(fname, dtype=np.uint64, count=8)
+    if len(header) < 8:
+        return None
+    return int(header[3])
+
+def kmer_ext_len(bwa_prefix):
+    """Returns the maximum sequence length of an existing k-mer extension 
+    table, or None"""
+    fname = bwa_prefix + KMER_EXT_SUFF
+    if not os.path.exists(fname):
+        return None
+    header = np.fromfile(fname, dtype=np.uint64, count=8)
+    if len(header) < 8:
+        return None
+    return int(header[4])
+
+def repeat_mask_params(bwa_prefix):
+    """Returns the (length, copies) an existing repeat mask was built with, 
+    or None"""
+    fname = bwa_prefix + REPEAT_MASK_SUFF
+    if not os.path.exists(fname):
+        return None
+    header = np.fromfile(fname, dtype=np.uint64, count=8)
+    if len(header) < 8:
+        return None
+    return (int(header[3]), int(header[4]))
+
+def kmer_ext_size_mb(kmer_len, max_len):
+    """Approximate k-mer extension table size in megabytes"""
+    return sum(4**l for l in range(kmer_len+1, max_len+1)) * 16 / 1e6
+
+def read_fasta(fname):
+    """Yields (name, sequence) for each record of a FASTA file"""
+    name, seq = None, []
+    with open(fname) as fasta_in:
+        for line in fasta_in:
+            if line.startswith(">"):
+                if name != None:
+                    yield name, "".join(seq)
+                name, seq = line[1:].split()[0], []
+            else:
+                seq.append(line.strip())
+    if name != None:
+        yield name, "".join(seq)
+
+def read_bed(fname, pad=0):
+    """Returns merged, padded BED intervals as {name : [(start, end), ...]}"""
+    regions = dict()
+    with open(fname) as bed_in:
+        for line in bed_in:
+            if line.startswith(("#", "track", "browser")) or not line.strip():
+                continue
+            fields = line.split()
+            st, en = int(fields[1]), int(fields[2])
+            regions.setdefault(fields[0], list()).append((max(0, st-pad), en+pad))
+
+    for name, intvs in regions.items():
+        intvs.sort()
+        merged = [intvs[0]]
+        for st, en in intvs[1:]:
+            if st <= merged[-1][1]:
+                merged[-1] = (merged[-1][0], max(merged[-1][1], en))
+            else:
+                merged.append((st, en))
+        regions[name] = merged
+
+    return regions
+
+def build_panel(fasta_fname, bed_fname, prefix, pad=1000, decoy_frac=1.0, decoy_len=2000, seed=0):
+    """Writes a FASTA of the BED target regions plus a decoy summary, and 
+    the manifest BwaIndex uses to translate panel coordinates
+
+    The decoys are windows sampled evenly from the rest of the genome, 
+    totalling decoy_frac times the target length. Reads from outside the
+    targets tend to align to them rather than to a target by chance, and
+    alignments to decoys are reported as off-target. Returns the FASTA name"""
+
+    regions = read_bed(bed_fname, pad)
+
+    #First pass finds the off-target length to space the decoys
+    ref_lens = dict()
+    for name, seq in read_fasta(fasta_fname):
+        ref_lens[name] = len(seq)
+
+    for name in regions:
+        if name not in ref_lens:
+            sys.stderr.write("Warning: target reference \"%s\" not in FASTA\n" % name)
+        else:
+            regions[name] = [(st, min(en, ref_lens[name])) for st, en in regions[name] if st < ref_lens[name]]
+
+    tgt_len = sum(en-st for intvs in regions.values() for st, en in intvs)
+    off_len = sum(ref_lens.values()) - tgt_len
+    ndecoys = min(int(np.ceil(decoy_frac * tgt_len / decoy_len)), off_len // decoy_len)
+    decoy_step = off_len / ndecoys if ndecoys > 0 else 0
+
+    rng = np.random.RandomState(seed)
+
+    fasta_out = open(prefix + PANEL_FASTA_SUFF, "w")
+    panel_out = open(prefix + PANEL_SUFF, "w")
+
+    def write_contig(name, seq, src, st, decoy):
+        fasta_out.write(">%s\n" % name)
+        for i in range(0, len(seq), 80):
+            fasta_out.write(seq[i:i+80] + "\n")
+        panel_out.write("%s\t%s\t%d\t%d\t%d\n" % (name, src, ref_lens[src], st, decoy))
+
+    #Off-target coordinate of the next decoy, jittered within its step
+    off_pos = 0
+    next_decoy = rng.uniform(0, max(0, decoy_step - decoy_len))
+
+    for name, seq in read_fasta(fasta_fname):
+        intvs = regions.get(name, [])
+
+        for st, en in intvs:
+            write_contig("%s:%d-%d" % (name, st, en), seq[st:en], name, st, 0)
+
+        #Off-target stretches between the targets
+        gaps, prev = list(), 0
+        for st, en in intvs + [(len(seq), len(seq))]:
+            if st > prev: 
+                gaps.append((prev, st))
+            prev = en
+
+        for st, en in gaps:
+            while ndecoys > 0 and next_decoy < off_pos + (en - st):
+                dst = st + int(next_decoy - off_pos)
+                den = min(en, dst + decoy_len)
+                if den - dst >= decoy_len // 2:
+                    write_contig("decoy|%s:%d-%d" % (name, dst, den), seq[dst:den], name, dst, 1)
+                next_decoy += decoy_step
+            off_pos += en - st
+
+    fasta_out.close()
+    panel_out.close()
+
+    return prefix + PANEL_FASTA_SUFF
+
 def power_fn(xmax, ymin, ymax, exp, N=100):
     dt = 1.0/N
     t = np.arange(0, 1+dt, dt)
@@ -66,10 +227,7 @@ class IndexParameterizer:
 
     def calc_map_stats(self, args):
 
-        ann_in = open(args.bwa_prefix + ANN_SUFF)
-        header = ann_in.readline()
-        ref_len = int(header.split()[0])
-        ann_in.close()
+        ref_len = get_ref_len(args.bwa_prefix)
 
         approx_samps = ref_len / args.max_sample_dist
         if approx_samps < args.min_samples:
@@ -79,25 +237,21 @@ class IndexParameterizer:
         else:
             sample_dist = args.max_sample_dist
 
-        fmlens = unc.self_align(args.bwa_prefix, sample_dist)
-        path_kfmlens = [p[args.kmer_len-1:] if len(p) >= args.kmer_len else [1] for p in fmlens]
-
-        max_pathlen = 0
-        all_pathlens = [len(p) for p in path_kfmlens if len(p) <= args.max_replen]
-        gt1_counts = np.zeros(max(all_pathlens))
-        for l in all_pathlens:
-            for i in range(l):
-                gt1_counts[i] += 1
-
-        max_pathlen = np.flatnonzero(gt1_counts / len(all_pathlens) <= args.pathlen_percentile)[0]
-        max_fmexp = int(np.log2(max([p[0] for p in path_kfmlens])))+1
-        fm_path_mat = np.zeros((max_fmexp, max_pathlen))
-
-        for p in path_kfmlens:
-            for i in range(min(max_pathlen, len(p))):
-                fm_path_mat[int(np.log2(p[i])), i] += 1
-            for i in range(len(p), max_pathlen):
-                fm_path_mat[0, i] += 1
+        stats = unc.self_align_stats(args.bwa_prefix, sample_dist, 
+                                     args.kmer_len, args.max_replen, 
+                                     args.threads)
+
+        #Number of paths longer than each length, up to max_replen
+        len_counts = stats.len_counts
+        rep_counts = len_counts[:args.max_replen+1]
+        gt1_counts = (rep_counts.sum() - np.cumsum(rep_counts))[:np.flatnonzero(rep_counts)[-1]]
+
+        max_pathlen = np.flatnonzero(gt1_counts / rep_counts.sum() <= args.pathlen_percentile)[0]
+        max_fmexp = np.flatnonzero(stats.fm_counts[:,0])[-1]+1
+        fm_path_mat = stats.fm_counts[:max_fmexp, :max_pathlen].astype(float)
+
+        #Paths which ended count as FM range 1 for the remaining locations
+        fm_path_mat[0] += np.cumsum(len_counts)[:max_pathlen]
 
         mean_fm_locs = list()
         for f in range(max_fmexp):
@@ -0,0 +1,90 @@
+#!/usr/bin/env python
+
+# MIT License
+#
+# Copyright (c) 2018 Sam Kovaka <skovaka@gmail.com>
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+import sys
+import threading
+
+if sys.version_info[0] >= 3:
+    from http.server import HTTPServer, BaseHTTPRequestHandler
+else:
+    from BaseHTTPServer import HTTPServer, BaseHTTPRequestHandler
+
+class MetricsServer:
+    """Serves a MapPool or RealtimePool's counters in the Prometheus text 
+    format at /metrics, from a daemon thread so mapping is not held up"""
+
+    def __init__(self, pool, port, host=""):
+        self.pool = pool
+
+        server = self
+
+        class Handler(BaseHTTPRequestHandler):
+            def do_GET(self):
+                if self.path.split("?")[0] != "/metrics":
+                    self.send_error(404)
+                    return
+
+                body = server.metrics().encode()
+                self.send_response(200)
+                self.send_header("Content-Type", "text/plain; version=0.0.4")
+                self.send_header("Content-Length", str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+
+            def log_message(self, *args):
+                pass
+
+        self.httpd = HTTPServer((host, port), Handler)
+        self.thread = threading.Thread(target=self.httpd.serve_forever)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def metrics(self):
+        lines = list()
+
+        for name, count in sorted(self.pool.counters().items()):
+            lines.append("# TYPE uncalled_%s_total counter" % name)
+            lines.append("uncalled_%s_total %d" % (name, count))
+
+        if hasattr(self.pool, "thread_stats"):
+            stats = self.pool.thread_stats()
+            for field in ["load", "reads_mapped", "steals", "busy_time", "idle_time"]:
+                kind = "gauge" if field == "load" else "counter"
+                lines.append("# TYPE uncalled_thread_%s %s" % (field, kind))
+                for i, s in enumerate(stats):
+                    lines.append("uncalled_thread_%s{thread=\"%d\"} %s" % (field, i, getattr(s, field)))
+
+        if hasattr(self.pool, "latencies"):
+            lines.append("# TYPE uncalled_latency_ms summary")
+            for stage, hist in sorted(self.pool.latencies().items()):
+                for q in [50, 90, 99]:
+                    lines.append("uncalled_latency_ms{stage=\"%s\",quantile=\"%.2f\"} %f" % (stage, q / 100.0, hist.percentile(q)))
+                lines.append("uncalled_latency_ms_sum{stage=\"%s\"} %f" % (stage, hist.mean() * hist.count()))
+                lines.append("uncalled_latency_ms_count{stage=\"%s\"} %d" % (stage, hist.count()))
+
+        return "\n".join(lines) + "\n"
+
+    def stop(self):
+        self.httpd.shutdown()
+        self.httpd.server_close()
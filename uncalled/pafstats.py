@@ -4,6 +4,12 @@ import sys
 import numpy as np
 import re
 import argparse
+import uncalled as unc
+
+#Binary PAF files written by PafWriter, see Paf::BinFlag
+BIN_MAGIC = b"UNCP"
+BIN_MAPPED = 1
+BIN_FWD = 2
 
 class PafEntry:
     def __init__(self, line, tags=None):
@@ -106,7 +112,57 @@ class PafEntry:
         return s
 
 
+def is_bin_paf(fname):
+    if not isinstance(fname, str):
+        return False
+    with open(fname, "rb") as f:
+        return f.read(len(BIN_MAGIC)) == BIN_MAGIC
+
+def parse_bin_paf(fname, max_load=None):
+    pafs = unc.PafBinReader(fname)
+    n = len(pafs) if max_load == None else min(max_load, len(pafs))
+
+    tags = [dict() for i in range(n)]
+    str_val = pafs.str_val
+    for recs, ids, vals, t, cast in [(pafs.int_rec, pafs.int_tag, pafs.int_val, 'i', int),
+                                     (pafs.float_rec, pafs.float_tag, pafs.float_val, 'f', float),
+                                     (pafs.str_rec, pafs.str_tag, str_val, 'Z', str)]:
+        for r, k, v in zip(recs, ids, vals):
+            if r < n:
+                tags[r][unc.Paf.tag_str(unc.Paf.Tag(k))] = (cast(v), t)
+
+    #Columns are fetched once, each access builds a new view or list
+    rd_names, rf_names, rf_lens = pafs.rd_names, pafs.rf_names, pafs.rf_lens
+    flags, rd_len, rd_st, rd_en = pafs.flags, pafs.rd_len, pafs.rd_st, pafs.rd_en
+    rf_id, rf_st, rf_en, matches = pafs.rf_id, pafs.rf_st, pafs.rf_en, pafs.matches
+
+    for i in range(n):
+        if flags[i] & BIN_MAPPED:
+            tabs = [rd_names[i], rd_len[i], rd_st[i], rd_en[i],
+                    bool(flags[i] & BIN_FWD), rf_names[rf_id[i]], rf_lens[rf_id[i]], 
+                    rf_st[i], rf_en[i], matches[i], rf_en[i] - rf_st[i] + 1, 255]
+        else:
+            tabs = [rd_names[i], rd_len[i]] + [None]*10
+        yield PafEntry(tabs, tags[i])
+
+def bin_map_speed(fname, max_load=None):
+    """Returns the map time and read end of each mapped read in a binary PAF,
+    read straight from the numpy columns"""
+    pafs = unc.PafBinReader(fname)
+    n = len(pafs) if max_load == None else min(max_load, len(pafs))
+    mapped = (pafs.flags[:n] & BIN_MAPPED) != 0
+
+    mt = (pafs.float_tag == int(unc.Paf.MAP_TIME)) & (pafs.float_rec < n)
+    recs = pafs.float_rec[mt]
+    keep = mapped[recs]
+    return pafs.float_val[mt][keep], pafs.rd_en[recs[keep]]
+
 def parse_paf(infile, max_load=None):
+    if is_bin_paf(infile):
+        for p in parse_bin_paf(infile, max_load):
+            yield p
+        return
+
     if isinstance(infile, str):
         infile = open(infile)
     c = 0
@@ -195,9 +251,15 @@ def run(args):
                     p.set_tag("rf", lab, "Z")
                     sys.stdout.write("%s\n" % p)
 
-    if locs[0].get_tag('mt') != None:
+    if is_bin_paf(args.infile):
+        map_ms, map_bp = bin_map_speed(args.infile, args.max_reads)
+    elif locs[0].get_tag('mt') != None:
         map_ms = np.array([p.get_tag('mt') for p in locs if p.is_mapped])
         map_bp = np.array([p.qr_en for p in locs if p.is_mapped])
+    else:
+        map_ms = []
+
+    if len(map_ms) > 0:
         map_bpps = 1000*map_bp/map_ms
 
         statsout.write("Speed            Mean    Median\n")